@@ -0,0 +1,375 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+
+/**
+* Unit tests for the region parsing of sam-dump
+*/
+#include <ktst/unit_test.hpp>
+#include <klib/rc.h>
+#include <klib/container.h>
+#include <klib/vector.h>
+
+#include "../../tools/sra-pileup/sam-dump-regions.h"
+#include "../../tools/sra-pileup/bam_index.h"
+
+#include <kfs/directory.h>
+#include <kfs/file.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+
+using namespace std;
+
+TEST_SUITE(SamDumpRegionsTestSuite);
+
+class RegionFixture
+{
+public:
+    RegionFixture()
+    {
+        BSTreeInit( &regions );
+    }
+    ~RegionFixture()
+    {
+        free_ref_regions( &regions );
+    }
+    void Add( const char * s )
+    {
+        if ( parse_and_add_region( &regions, s ) != 0 )
+            throw logic_error( "parse_and_add_region() failed" );
+    }
+    reference_region * Find( const char * name )
+    {
+        reference_region * res = find_reference_region_len( &regions, name, strlen( name ) );
+        if ( res == NULL )
+            throw logic_error( "find_reference_region_len() failed" );
+        return res;
+    }
+    const range * Range( const char * name, uint32_t idx )
+    {
+        const range * res = ( const range * )VectorGet( &Find( name )->ranges, idx );
+        if ( res == NULL )
+            throw logic_error( "no such range" );
+        return res;
+    }
+
+    BSTree regions;
+};
+
+FIXTURE_TEST_CASE(ClosedRange, RegionFixture)
+{
+    Add( "chr1:100-200" );
+    check_ref_regions( &regions );
+    resolve_ref_region_ends( Find( "chr1" ), 1000 );
+    REQUIRE_EQ( VectorLength( &Find( "chr1" )->ranges ), 1u );
+    REQUIRE_EQ( Range( "chr1", 0 )->start, ( uint64_t )99 );
+    REQUIRE_EQ( Range( "chr1", 0 )->end, ( uint64_t )199 );
+}
+
+FIXTURE_TEST_CASE(OpenRange, RegionFixture)
+{
+    Add( "chr1:100" );
+    check_ref_regions( &regions );
+    REQUIRE_EQ( Range( "chr1", 0 )->start, ( uint64_t )99 );
+    REQUIRE_EQ( Range( "chr1", 0 )->end, ( uint64_t )0 );
+    resolve_ref_region_ends( Find( "chr1" ), 1000 );
+    REQUIRE_EQ( Range( "chr1", 0 )->start, ( uint64_t )99 );
+    REQUIRE_EQ( Range( "chr1", 0 )->end, ( uint64_t )999 );
+}
+
+FIXTURE_TEST_CASE(OpenRange_Dash, RegionFixture)
+{
+    Add( "chr1:100-" );
+    check_ref_regions( &regions );
+    resolve_ref_region_ends( Find( "chr1" ), 1000 );
+    REQUIRE_EQ( Range( "chr1", 0 )->start, ( uint64_t )99 );
+    REQUIRE_EQ( Range( "chr1", 0 )->end, ( uint64_t )999 );
+}
+
+FIXTURE_TEST_CASE(WholeReference, RegionFixture)
+{
+    Add( "chr1" );
+    check_ref_regions( &regions );
+    resolve_ref_region_ends( Find( "chr1" ), 1000 );
+    REQUIRE_EQ( Range( "chr1", 0 )->start, ( uint64_t )0 );
+    REQUIRE_EQ( Range( "chr1", 0 )->end, ( uint64_t )999 );
+}
+
+FIXTURE_TEST_CASE(OpenRange_SwallowsLaterRanges, RegionFixture)
+{
+    Add( "chr1:100" );
+    Add( "chr1:500-600" );
+    check_ref_regions( &regions );
+    REQUIRE_EQ( VectorLength( &Find( "chr1" )->ranges ), 1u );
+    resolve_ref_region_ends( Find( "chr1" ), 1000 );
+    REQUIRE_EQ( Range( "chr1", 0 )->start, ( uint64_t )99 );
+    REQUIRE_EQ( Range( "chr1", 0 )->end, ( uint64_t )999 );
+}
+
+FIXTURE_TEST_CASE(OpenRange_ExtendsOverlappingRange, RegionFixture)
+{
+    Add( "chr1:50-60" );
+    Add( "chr1:55" );
+    check_ref_regions( &regions );
+    REQUIRE_EQ( VectorLength( &Find( "chr1" )->ranges ), 1u );
+    REQUIRE_EQ( Range( "chr1", 0 )->start, ( uint64_t )49 );
+    REQUIRE_EQ( Range( "chr1", 0 )->end, ( uint64_t )0 );
+    resolve_ref_region_ends( Find( "chr1" ), 1000 );
+    REQUIRE_EQ( Range( "chr1", 0 )->end, ( uint64_t )999 );
+}
+
+FIXTURE_TEST_CASE(OpenRange_AfterClosedRange, RegionFixture)
+{
+    Add( "chr1:10-20" );
+    Add( "chr1:100" );
+    check_ref_regions( &regions );
+    resolve_ref_region_ends( Find( "chr1" ), 1000 );
+    REQUIRE_EQ( VectorLength( &Find( "chr1" )->ranges ), 2u );
+    REQUIRE_EQ( Range( "chr1", 0 )->start, ( uint64_t )9 );
+    REQUIRE_EQ( Range( "chr1", 0 )->end, ( uint64_t )19 );
+    REQUIRE_EQ( Range( "chr1", 1 )->start, ( uint64_t )99 );
+    REQUIRE_EQ( Range( "chr1", 1 )->end, ( uint64_t )999 );
+}
+
+FIXTURE_TEST_CASE(OpenRange_BeyondReference, RegionFixture)
+{
+    Add( "chr1:2000" );
+    check_ref_regions( &regions );
+    resolve_ref_region_ends( Find( "chr1" ), 1000 );
+    REQUIRE_EQ( Range( "chr1", 0 )->start, ( uint64_t )1999 );
+    REQUIRE_EQ( Range( "chr1", 0 )->end, ( uint64_t )1999 );
+}
+
+// a BAM-stream built in memory, fed to the index in small pieces
+class BamIndexFixture
+{
+public:
+    BamIndexFixture()
+    : idx( NULL ), fname( "wb-test-sam-dump.bai" )
+    {
+        if ( make_bam_index( &idx ) != 0 )
+            throw logic_error( "make_bam_index() failed" );
+        bam.append( "BAM\1", 4 );
+        U32( 0 );               /* no header-text */
+        U32( 2 );
+        for ( int i = 0; i < 2; ++i )
+        {
+            U32( 5 );
+            bam.append( i == 0 ? "chr1" : "chr2", 5 );
+            U32( 1000000 );
+        }
+    }
+    ~BamIndexFixture()
+    {
+        release_bam_index( idx );
+        remove( fname.c_str() );
+    }
+    void U32( uint32_t v )
+    {
+        for ( int i = 0; i < 4; ++i )
+            bam += ( char )( ( v >> ( 8 * i ) ) & 0xFF );
+    }
+    void U16( uint32_t v )
+    {
+        bam += ( char )( v & 0xFF );
+        bam += ( char )( ( v >> 8 ) & 0xFF );
+    }
+    /* a record with one M-operation of len bases, returns where it starts in the stream */
+    uint64_t Record( int32_t ref_id, int32_t pos, uint32_t len )
+    {
+        uint64_t start = bam.size();
+        U32( 32 + 2 + ( ref_id < 0 ? 0 : 4 ) );   /* block-size: fixed part, name "r\0", cigar */
+        U32( ref_id );
+        U32( pos );
+        bam += ( char )2;       /* l_read_name */
+        bam += ( char )0;       /* mapq */
+        U16( 0 );               /* bin, recalculated by the index */
+        U16( ref_id < 0 ? 0 : 1 );
+        U16( ref_id < 0 ? 4 : 0 );
+        U32( 0 );               /* l_seq */
+        U32( ( uint32_t )-1 );
+        U32( ( uint32_t )-1 );
+        U32( 0 );
+        bam.append( "r", 2 );
+        if ( ref_id >= 0 )
+            U32( len << 4 );
+        return start;
+    }
+    rc_t Write()
+    {
+        for ( size_t i = 0; i < bam.size(); i += 7 )
+            bam_index_feed( idx, bam.data() + i, bam.size() - i < 7 ? bam.size() - i : 7 );
+
+        KDirectory * dir;
+        KFile * f;
+        rc_t rc = KDirectoryNativeDir( &dir );
+        if ( rc == 0 )
+        {
+            rc = KDirectoryCreateFile( dir, &f, false, 0664, kcmInit, "%s", fname.c_str() );
+            if ( rc == 0 )
+            {
+                rc = bam_index_write( idx, f, Identity, NULL );
+                KFileRelease( f );
+            }
+            KDirectoryRelease( dir );
+        }
+        if ( rc == 0 )
+        {
+            char buf[ 4096 ];
+            size_t n;
+            FILE * in = fopen( fname.c_str(), "rb" );
+            if ( in == NULL )
+                throw logic_error( "cannot open " + fname );
+            while ( ( n = fread( buf, 1, sizeof buf, in ) ) > 0 )
+                bai.append( buf, n );
+            fclose( in );
+        }
+        return rc;
+    }
+    static uint64_t CC Identity( void * data, uint64_t upos )
+    {
+        return upos;
+    }
+    uint64_t Get( size_t & ofs, size_t bytes )
+    {
+        uint64_t v = 0;
+        if ( ofs + bytes > bai.size() )
+            throw logic_error( "index too short" );
+        for ( size_t i = 0; i < bytes; ++i )
+            v |= ( uint64_t )( uint8_t )bai[ ofs + i ] << ( 8 * i );
+        ofs += bytes;
+        return v;
+    }
+
+    struct bam_index * idx;
+    string fname;
+    string bam;
+    string bai;
+};
+
+FIXTURE_TEST_CASE(BamIndex_Sorted, BamIndexFixture)
+{
+    uint64_t r1 = Record( 0, 100, 50 );
+    Record( 0, 20000, 50 );
+    uint64_t r3 = Record( 1, 5, 10 );
+    Record( -1, -1, 0 );
+    uint64_t end = bam.size();
+    REQUIRE_RC( Write() );
+
+    size_t ofs = 0;
+    REQUIRE_EQ( bai.substr( 0, 4 ), string( "BAI\1", 4 ) );
+    ofs = 4;
+    REQUIRE_EQ( Get( ofs, 4 ), ( uint64_t )2 );
+
+    /* chr1: bin 4681 ( window 0 ), bin 4682 ( window 1 ), the pseudo-bin */
+    REQUIRE_EQ( Get( ofs, 4 ), ( uint64_t )3 );
+    REQUIRE_EQ( Get( ofs, 4 ), ( uint64_t )4681 );
+    REQUIRE_EQ( Get( ofs, 4 ), ( uint64_t )1 );
+    REQUIRE_EQ( Get( ofs, 8 ), r1 );
+    uint64_t r2 = Get( ofs, 8 );
+    REQUIRE_EQ( Get( ofs, 4 ), ( uint64_t )4682 );
+    REQUIRE_EQ( Get( ofs, 4 ), ( uint64_t )1 );
+    REQUIRE_EQ( Get( ofs, 8 ), r2 );
+    REQUIRE_EQ( Get( ofs, 8 ), r3 );
+    REQUIRE_EQ( Get( ofs, 4 ), ( uint64_t )37450 );
+    REQUIRE_EQ( Get( ofs, 4 ), ( uint64_t )2 );
+    REQUIRE_EQ( Get( ofs, 8 ), r1 );
+    REQUIRE_EQ( Get( ofs, 8 ), r3 );
+    REQUIRE_EQ( Get( ofs, 8 ), ( uint64_t )2 );   /* mapped */
+    REQUIRE_EQ( Get( ofs, 8 ), ( uint64_t )0 );   /* unmapped */
+    REQUIRE_EQ( Get( ofs, 4 ), ( uint64_t )2 );   /* linear index */
+    REQUIRE_EQ( Get( ofs, 8 ), r1 );
+    REQUIRE_EQ( Get( ofs, 8 ), r2 );
+
+    /* chr2: one bin, the pseudo-bin, one window */
+    REQUIRE_EQ( Get( ofs, 4 ), ( uint64_t )2 );
+    REQUIRE_EQ( Get( ofs, 4 ), ( uint64_t )4681 );
+    REQUIRE_EQ( Get( ofs, 4 ), ( uint64_t )1 );
+    REQUIRE_EQ( Get( ofs, 8 ), r3 );
+    uint64_t r4 = Get( ofs, 8 );
+    REQUIRE_EQ( Get( ofs, 4 ), ( uint64_t )37450 );
+    REQUIRE_EQ( Get( ofs, 4 ), ( uint64_t )2 );
+    REQUIRE_EQ( Get( ofs, 8 ), r3 );
+    REQUIRE_EQ( Get( ofs, 8 ), r4 );
+    REQUIRE_EQ( Get( ofs, 8 ), ( uint64_t )1 );
+    REQUIRE_EQ( Get( ofs, 8 ), ( uint64_t )0 );
+    REQUIRE_EQ( Get( ofs, 4 ), ( uint64_t )1 );
+    REQUIRE_EQ( Get( ofs, 8 ), r3 );
+
+    /* one unplaced record behind them */
+    REQUIRE_EQ( Get( ofs, 8 ), ( uint64_t )1 );
+    REQUIRE_EQ( ofs, bai.size() );
+    REQUIRE_LT( r4, end );
+}
+
+FIXTURE_TEST_CASE(BamIndex_Unsorted, BamIndexFixture)
+{
+    Record( 0, 500, 50 );
+    Record( 0, 100, 50 );
+    rc_t rc = Write();
+    REQUIRE_EQ( ( int )GetRCState( rc ), ( int )rcOutoforder );
+}
+
+FIXTURE_TEST_CASE(BamIndex_Truncated, BamIndexFixture)
+{
+    Record( 0, 100, 50 );
+    bam.resize( bam.size() - 3 );
+    rc_t rc = Write();
+    REQUIRE_EQ( ( int )GetRCState( rc ), ( int )rcCorrupt );
+}
+
+//////////////////////////////////////////// Main
+extern "C"
+{
+
+#include <kapp/args.h>
+#include <kfg/config.h>
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+rc_t CC UsageSummary (const char * progname)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args )
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "wb-test-sam-dump";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    KConfigDisableUserSettings();
+    rc_t rc=SamDumpRegionsTestSuite(argc, argv);
+    return rc;
+}
+
+}
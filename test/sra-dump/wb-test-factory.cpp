@@ -0,0 +1,289 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+
+/**
+* Unit tests for the output files of the dumpers
+*/
+#include <ktst/unit_test.hpp>
+#include <klib/rc.h>
+
+extern "C" {
+#include "../../tools/sra-dump/factory.h"
+}
+
+#include <zlib.h>
+#include <bzlib.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+
+using namespace std;
+
+TEST_SUITE(SraDumpFactoryWbTestSuite);
+
+// more than one output arena, so that the block compression of files would make several members
+#define SPOTS 2000
+
+static
+rc_t DumpSpot(const SRASplitter* self, spotid_t spot, const readmask_t* readmask)
+{
+    char buf[ 256 ];
+    int n = sprintf(buf, "@spot.%u\n%0200u\n", ( unsigned )spot, ( unsigned )spot);
+    rc_t rc = SRASplitter_FileActivate(self, ".fastq");
+    if( rc == 0 ) {
+        rc = SRASplitter_FileWrite(self, spot, buf, n);
+    }
+    return rc;
+}
+
+static
+rc_t NewDumper(const SRASplitterFactory* self, const SRASplitter** splitter)
+{
+    return SRASplitter_Make(splitter, 0, NULL, NULL, DumpSpot, NULL);
+}
+
+// dumps SPOTS spots with the filer in stdout mode, fd 1 redirected into a file
+class StdoutFixture
+{
+public:
+    StdoutFixture()
+    : fname("wb-test-factory.out"), saved(-1)
+    {
+        fflush(stdout);
+        int fd = open(fname.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0600);
+        if( fd < 0 ) {
+            throw logic_error("cannot create " + fname);
+        }
+        saved = dup(1);
+        dup2(fd, 1);
+        close(fd);
+    }
+    ~StdoutFixture()
+    {
+        Restore();
+        remove(fname.c_str());
+    }
+    void Restore()
+    {
+        if( saved >= 0 ) {
+            dup2(saved, 1);
+            close(saved);
+            saved = -1;
+        }
+    }
+    void Dump(bool gzip, bool bzip2, bool to_stdout = true)
+    {
+        const SRASplitterFactory* fact = NULL;
+        const SRASplitter* sp = NULL;
+        make_readmask(readmask);
+        rc_t rc = SRASplitterFactory_FilerInit(to_stdout, gzip, bzip2, false, false, to_stdout ? NULL : ".");
+        if( rc == 0 ) {
+            rc = SRASplitterFactory_FilerPrefix("SRR000001");
+        }
+        if( rc == 0 ) {
+            rc = SRASplitterFactory_Make(&fact, eSplitterFormat, 0, NULL, NewDumper, NULL);
+        }
+        if( rc == 0 ) {
+            rc = SRASplitterFactory_Init(fact);
+        }
+        if( rc == 0 ) {
+            rc = SRASplitterFactory_NewObj(fact, &sp);
+        }
+        for( spotid_t spot = 1; rc == 0 && spot <= SPOTS; ++spot ) {
+            reset_readmask(readmask);
+            rc = SRASplitter_AddSpot(sp, spot, readmask);
+        }
+        SRASplitter_Release(sp);
+        SRASplitterFactory_Release(fact);
+        /* writes out and closes stdout, finishes the compressed stream */
+        SRASplitterFiler_Release();
+        Restore();
+        if( rc != 0 ) {
+            throw logic_error("dump failed");
+        }
+    }
+    static string Output(const string& fname)
+    {
+        string res;
+        FILE* f = fopen(fname.c_str(), "rb");
+        if( f == NULL ) {
+            throw logic_error("cannot open " + fname);
+        }
+        char buf[ 4096 ];
+        size_t n;
+        while( (n = fread(buf, 1, sizeof buf, f)) > 0 ) {
+            res.append(buf, n);
+        }
+        fclose(f);
+        return res;
+    }
+    string Output()
+    {
+        return Output(fname);
+    }
+    static string Expected()
+    {
+        string res;
+        char buf[ 256 ];
+        for( spotid_t spot = 1; spot <= SPOTS; ++spot ) {
+            res += string(buf, sprintf(buf, "@spot.%u\n%0200u\n", ( unsigned )spot, ( unsigned )spot));
+        }
+        return res;
+    }
+
+    string fname;
+    int saved;
+};
+
+// inflates exactly one gzip member, false if anything follows it
+static
+bool Gunzip1(const string& in, string& out)
+{
+    z_stream s;
+    char buf[ 4096 ];
+    int zr;
+    memset(&s, 0, sizeof s);
+    if( inflateInit2(&s, 15 + 16) != Z_OK ) {
+        return false;
+    }
+    s.next_in = (Bytef*)in.data();
+    s.avail_in = in.size();
+    do {
+        s.next_out = (Bytef*)buf;
+        s.avail_out = sizeof buf;
+        zr = inflate(&s, Z_NO_FLUSH);
+        out.append(buf, sizeof buf - s.avail_out);
+    } while( zr == Z_OK );
+    inflateEnd(&s);
+    return zr == Z_STREAM_END && s.avail_in == 0;
+}
+
+// decompresses exactly one bzip2 stream, false if anything follows it
+static
+bool Bunzip1(const string& in, string& out)
+{
+    bz_stream s;
+    char buf[ 4096 ];
+    int br;
+    memset(&s, 0, sizeof s);
+    if( BZ2_bzDecompressInit(&s, 0, 0) != BZ_OK ) {
+        return false;
+    }
+    s.next_in = (char*)in.data();
+    s.avail_in = in.size();
+    do {
+        s.next_out = buf;
+        s.avail_out = sizeof buf;
+        br = BZ2_bzDecompress(&s);
+        out.append(buf, sizeof buf - s.avail_out);
+    } while( br == BZ_OK );
+    BZ2_bzDecompressEnd(&s);
+    return br == BZ_STREAM_END && s.avail_in == 0;
+}
+
+FIXTURE_TEST_CASE(Stdout_Plain, StdoutFixture)
+{
+    Dump(false, false);
+    REQUIRE(Output() == Expected());
+}
+
+FIXTURE_TEST_CASE(Stdout_Gzip_OneStream, StdoutFixture)
+{
+    Dump(true, false);
+    string out;
+    REQUIRE(Gunzip1(Output(), out));
+    REQUIRE(out == Expected());
+}
+
+FIXTURE_TEST_CASE(Stdout_Bzip2_OneStream, StdoutFixture)
+{
+    Dump(false, true);
+    string out;
+    REQUIRE(Bunzip1(Output(), out));
+    REQUIRE(out == Expected());
+}
+
+// files get one bzip2 stream per 900K arena: the whole output fits into the first one
+FIXTURE_TEST_CASE(File_Bzip2_FullBlock, StdoutFixture)
+{
+    Dump(false, true, false);
+    string out;
+    string file = Output("SRR000001.fastq.bz2");
+    remove("SRR000001.fastq.bz2");
+    REQUIRE(Bunzip1(file, out));
+    REQUIRE(out == Expected());
+}
+
+TEST_CASE(FilerLimits_Validation)
+{
+    REQUIRE_RC(SRASplitterFactory_FilerInit(true, false, false, false, false, NULL));
+    REQUIRE_RC(SRASplitterFactory_FilerLimits(0, DUMPER_PENDING_SIZE));
+    REQUIRE_RC(SRASplitterFactory_FilerLimits(16, 0));
+    REQUIRE_RC(SRASplitterFactory_FilerLimits(0, 128 * 1024));
+    REQUIRE_RC_FAIL(SRASplitterFactory_FilerLimits(0, 128 * 1024 + 1));
+    SRASplitterFiler_Release();
+    /* a bzip2 file buffers 900000 bytes while open */
+    REQUIRE_RC(SRASplitterFactory_FilerInit(false, false, true, false, false, "."));
+    REQUIRE_RC(SRASplitterFactory_FilerLimits(0, 900 * 1000));
+    REQUIRE_RC_FAIL(SRASplitterFactory_FilerLimits(0, 900 * 1000 + 1));
+    SRASplitterFiler_Release();
+}
+
+//////////////////////////////////////////// Main
+extern "C"
+{
+
+#include <kapp/args.h>
+#include <kfg/config.h>
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+rc_t CC UsageSummary (const char * progname)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args )
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "wb-test-factory";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    KConfigDisableUserSettings();
+    nreads_max = NREADS_MAX;
+    rc_t rc=SraDumpFactoryWbTestSuite(argc, argv);
+    return rc;
+}
+
+}
@@ -49,6 +49,10 @@ struct s_alignment {
     TableWriterAlgn const *tbl[tblN];
     int64_t rowId;
     int st;
+    /* rows of the last batch from AlignmentGetSpotKeys */
+    int batchSt;
+    int64_t batchRowId;
+    rc_t pendingRc;
 };
 
 Alignment *AlignmentMake(VDatabase *db) {
@@ -153,6 +157,49 @@ rc_t AlignmentGetSpotKey(Alignment *const self, uint64_t * keyId)
     return rc;
 }
 
+rc_t AlignmentGetSpotKeys(Alignment *const self, uint64_t keyId[], unsigned const max, unsigned *const count)
+{
+    rc_t rc = self->pendingRc;
+    unsigned n = 0;
+
+    self->pendingRc = 0;
+    while (rc == 0 && n < max) {
+        rc = AlignmentGetSpotKey(self, &keyId[n]);
+        if (rc)
+            break;
+        if (n == 0) {
+            self->batchSt = self->st;
+            self->batchRowId = self->rowId;
+        }
+        else if (self->st != self->batchSt) {
+            /* first row of the secondary table, leave it for the next batch */
+            --self->rowId;
+            break;
+        }
+        ++n;
+    }
+    *count = n;
+    if (n > 0) {
+        /* report the end ( or error ) with the next call */
+        self->pendingRc = rc;
+        rc = 0;
+    }
+    return rc;
+}
+
+rc_t AlignmentWriteSpotIds(Alignment *const self, int64_t const spotId[], unsigned const count)
+{
+    TableWriterAlgn const *const tbl = self->tbl[self->batchSt == 1 ? tblPrimary : tblSecondary];
+    rc_t rc = 0;
+    unsigned i;
+
+    if (self->batchSt != 1 && self->batchSt != 3)
+        return RC(rcAlign, rcTable, rcUpdating, rcSelf, rcInconsistent);
+    for (i = 0; i < count && rc == 0; ++i)
+        rc = TableWriterAlgn_Write_SpotId(tbl, self->batchRowId + i, spotId[i]);
+    return rc;
+}
+
 rc_t AlignmentWriteSpotId(Alignment * const self, int64_t const spotId)
 {
     switch (self->st) {
@@ -92,6 +92,12 @@ rc_t AlignmentGetSpotKey(Alignment *self, uint64_t *keyId);
 
 rc_t AlignmentWriteSpotId(Alignment *self, int64_t spotId);
 
+/* batched form of AlignmentGetSpotKey: up to max keys of consecutive rows of one table */
+rc_t AlignmentGetSpotKeys(Alignment *self, uint64_t keyId[], unsigned max, unsigned *count);
+
+/* writes the spot ids for the rows of the last AlignmentGetSpotKeys */
+rc_t AlignmentWriteSpotIds(Alignment *self, int64_t const spotId[], unsigned count);
+
 rc_t AlignmentWhack(Alignment *self, bool commit);
 
 rc_t AlignmentRecordInit(AlignmentRecord *self, unsigned readlen);
@@ -0,0 +1,211 @@
+/* ===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+
+#include "bam-read-ahead.h"
+
+#include <klib/rc.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+#include <kproc/thread.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define DEFAULT_QUEUE_SIZE (4096)
+
+typedef struct {
+    const BAMAlignment *rec;
+    float pos;
+    rc_t rc;
+} BAMReaderEntry;
+
+struct BAMReader
+{
+    const BAMFile *file;
+
+    KLock *lock;
+    KCondition *have_data;
+    KCondition *need_data;
+    KThread *th;
+
+    /* ring buffer, filled by the thread */
+    BAMReaderEntry *que;
+    unsigned qsize;
+    unsigned head;          /* next to read */
+    unsigned count;         /* in que */
+
+    float pos;
+    rc_t final_rc;          /* of the last entry, returned again on every read after it */
+    bool done;              /* thread has queued its last entry */
+    bool quit;              /* consumer is gone */
+};
+
+static bool IsFinal(rc_t const rc)
+{
+    /* the loaders skip empty records with a warning and go on */
+    if (rc == 0)
+        return false;
+    if (GetRCModule(rc) == rcAlign && GetRCObject(rc) == rcRow && GetRCState(rc) == rcEmpty)
+        return false;
+    return true;
+}
+
+static rc_t CC BAMReaderThreadMain(const KThread *th, void *vp)
+{
+    BAMReader *const self = (BAMReader *)vp;
+    bool done = false;
+
+    while (!done) {
+        BAMReaderEntry entry;
+
+        entry.rec = NULL;
+        /* BAMFileRead2 would hand out the file's one record buffer, which the
+         * next read overwrites; the queued records need copies of their own */
+        entry.rc = BAMFileRead(self->file, &entry.rec);
+        entry.pos = BAMFileGetProportionalPosition(self->file);
+        done = IsFinal(entry.rc);
+
+        KLockAcquire(self->lock);
+        while (self->count == self->qsize && !self->quit)
+            KConditionWait(self->need_data, self->lock);
+        if (self->quit) {
+            KLockUnlock(self->lock);
+            BAMAlignmentRelease(entry.rec);
+            break;
+        }
+        self->que[(self->head + self->count) % self->qsize] = entry;
+        ++self->count;
+        self->done = done;
+        if (done)
+            self->final_rc = entry.rc;
+        KConditionSignal(self->have_data);
+        KLockUnlock(self->lock);
+    }
+    return 0;
+}
+
+rc_t BAMReaderMake( BAMReader **result, const BAMFile *file, unsigned queueSize )
+{
+    BAMReader *const self = calloc(1, sizeof(*self));
+    rc_t rc;
+
+    *result = NULL;
+    if (self == NULL)
+        return RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+
+    self->qsize = queueSize ? queueSize : DEFAULT_QUEUE_SIZE;
+    self->que = malloc(self->qsize * sizeof(self->que[0]));
+    if (self->que == NULL) {
+        free(self);
+        return RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+    }
+    rc = BAMFileAddRef(file);
+    if (rc == 0) {
+        self->file = file;
+        rc = KLockMake(&self->lock);
+        if (rc == 0) {
+            rc = KConditionMake(&self->have_data);
+            if (rc == 0) {
+                rc = KConditionMake(&self->need_data);
+                if (rc == 0) {
+                    rc = KThreadMake(&self->th, BAMReaderThreadMain, self);
+                    if (rc == 0) {
+                        *result = self;
+                        return 0;
+                    }
+                    KConditionRelease(self->need_data);
+                }
+                KConditionRelease(self->have_data);
+            }
+            KLockRelease(self->lock);
+        }
+        BAMFileRelease(file);
+    }
+    free(self->que);
+    free(self);
+    return rc;
+}
+
+void BAMReaderRelease( BAMReader *self )
+{
+    if (self != NULL) {
+        KLockAcquire(self->lock);
+        self->quit = true;
+        KConditionSignal(self->need_data);
+        KLockUnlock(self->lock);
+
+        KThreadWait(self->th, NULL);
+        KThreadRelease(self->th);
+
+        while (self->count > 0) {
+            BAMAlignmentRelease(self->que[self->head].rec);
+            self->head = (self->head + 1) % self->qsize;
+            --self->count;
+        }
+        KConditionRelease(self->need_data);
+        KConditionRelease(self->have_data);
+        KLockRelease(self->lock);
+        BAMFileRelease(self->file);
+        free(self->que);
+        free(self);
+    }
+}
+
+rc_t BAMReaderRead( BAMReader *self, const BAMAlignment **result )
+{
+    BAMReaderEntry entry;
+
+    *result = NULL;
+    if (self == NULL)
+        return RC(rcAlign, rcFile, rcReading, rcSelf, rcNull);
+
+    KLockAcquire(self->lock);
+    while (self->count == 0) {
+        if (self->done) {
+            /* the final entry was already handed out, the file keeps returning its rc */
+            rc_t const rc = self->final_rc;
+            KLockUnlock(self->lock);
+            return rc;
+        }
+        KConditionWait(self->have_data, self->lock);
+    }
+    entry = self->que[self->head];
+    self->head = (self->head + 1) % self->qsize;
+    --self->count;
+    KConditionSignal(self->need_data);
+    KLockUnlock(self->lock);
+
+    self->pos = entry.pos;
+    *result = entry.rec;
+    return entry.rc;
+}
+
+float BAMReaderGetProportionalPosition( const BAMReader *self )
+{
+    return self->pos;
+}
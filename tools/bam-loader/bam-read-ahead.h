@@ -0,0 +1,79 @@
+/* ===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+
+#ifndef _h_bam_read_ahead_
+#define _h_bam_read_ahead_
+
+#include <klib/rc.h>
+#include <align/bam.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*--------------------------------------------------------------------------
+ * BAMReader, a parsing thread adapter for BAMFile.
+ * A thread reads and parses records of an open BAMFile ahead of the consumer
+ * ( BGZF inflate happens on the BAMFile's own thread ), the consumer gets
+ * them one at a time in file order.
+ * While the reader runs, only the header accessors of the BAMFile may be used.
+ */
+typedef struct BAMReader BAMReader;
+
+/* Make
+ *  starts the thread, takes a reference to "file"
+ *
+ *  "queueSize" [ IN ] - number of records to read ahead, 0 for default
+ */
+rc_t BAMReaderMake( BAMReader **result, const BAMFile *file, unsigned queueSize );
+
+/* Release
+ *  stops the thread, drops the records not yet read
+ */
+void BAMReaderRelease( BAMReader *self );
+
+/* Read
+ *  read an aligment
+ *
+ *  "result" [ OUT ] - return param for BAMAlignment object
+ *   must be released with BAMAlignmentRelease
+ *
+ *  returns the same codes as BAMFileRead,
+ *  RC(..., ..., ..., rcRow, rcNotFound) at end
+ */
+rc_t BAMReaderRead( BAMReader *self, const BAMAlignment **result );
+
+/* GetProportionalPosition
+ *  position of the last record returned by Read, see BAMFileGetProportionalPosition
+ */
+float BAMReaderGetProportionalPosition( const BAMReader *self );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_bam_read_ahead_ */
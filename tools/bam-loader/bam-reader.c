@@ -39,6 +39,7 @@ typedef struct BamReferenceInfo BamReferenceInfo;
 #define REFERENCEINFO_IMPL  BamReferenceInfo
 
 #include "bam-reader.h"
+#include "bam-read-ahead.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -702,6 +703,7 @@ struct BamReaderFile
     ReferenceInfo refInfo;
     
     const BAMFile* reader;
+    BAMReader* ahead; /* reads and parses on a thread of its own */
 };
 
 const BAMFile* ToBam(const ReaderFile* reader)
@@ -713,7 +715,7 @@ const BAMFile* ToBam(const ReaderFile* reader)
 float BamReaderFileGetProportionalPosition ( const BamReaderFile *f )
 {
     BamReaderFile* self = (BamReaderFile*) f;
-    return BAMFileGetProportionalPosition(self->reader);
+    return BAMReaderGetProportionalPosition(self->ahead);
 } 
 
 rc_t BamReaderFileGetReferenceInfo ( const BamReaderFile *self, const ReferenceInfo** result )
@@ -726,6 +728,7 @@ rc_t BamReaderFileWhack( BamReaderFile* f )
 {
     BamReaderFile* self = (BamReaderFile*) f;
     
+    BAMReaderRelease(self->ahead);
     BAMFileRelease(self->reader);
     
     free ( (void*)self->dad.pathname );
@@ -752,7 +755,7 @@ rc_t BamReaderFileGetRecord ( const BamReaderFile *f, const Record** result )
         return rc;
     }
     
-    rc = BAMFileRead2(self->reader, &record->seq.bam);
+    rc = BAMReaderRead(self->ahead, &record->seq.bam);
     if (rc)
     {
         if (GetRCModule(rc) == rcAlign && GetRCObject(rc) == rcRow && GetRCState(rc) == rcNotFound)
@@ -792,7 +795,11 @@ rc_t CC BamReaderFileMake( const ReaderFile **reader, char const headerText[], c
             rc = RC ( RC_MODULE, rcFileFormat, rcAllocating, rcMemory, rcExhausted );
         }
         
+        self->reader = NULL;
+        self->ahead = NULL;
         rc = BAMFileMakeWithHeader ( &self->reader, headerText, "%s", self->dad.pathname );
+        if (rc == 0)
+            rc = BAMReaderMake ( &self->ahead, self->reader, 0 );
         
         if (rc != 0)
         {
@@ -882,223 +889,3 @@ rc_t BamReferenceInfoGetReadGroupByName ( const BamReferenceInfo *self, const ch
     
     return 0;
 }
-
-
-
-
-
- 
-#ifdef TENTATIVE 
-/**************************** future parsing-on-a-thread code *****************************************/
-
-#include "bam-reader.h"
-
-#include <atomic32.h>
-#include <stdlib.h>
-#include <string.h>
-
-#include <klib/rc.h>
-#include <kproc/lock.h>
-#include <kproc/cond.h>
-#include <kproc/thread.h>
-
-#define BUFFER_COUNT (3)
-
-struct BAMReader
-{
-    atomic32_t refcount;
-    const BAMFile* file;
-    
-    KLock *lock;
-    KCondition *have_data;
-    KCondition *need_data;
-    KThread *th;
-
-    const BAMAlignment* que[BUFFER_COUNT];
-    unsigned volatile nque;
-    rc_t volatile rc;
-    
-    bool eof;
-};
-
-static rc_t BAMReaderThreadMain(KThread const *const th, void *const vp);
-
-#define END_OF_DATA RC(rcAlign, rcFile, rcReading, rcRow, rcNotFound)
-
-rc_t BAMReaderMake( const BAMReader **result,
-                    char const headerText[],
-                    char const path[] )
-{
-    rc_t rc;
-    BAMReader *self = malloc(sizeof(BAMReader));
-    if ( self == NULL )
-    {
-        *result = NULL;
-        return RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
-    }
-    else
-    {
-        atomic32_set( & self->refcount, 1 );
-        rc = BAMFileMakeWithHeader( & self->file, headerText, "%s", path);
-        if ( rc != 0 )
-        {
-            free(self);
-            *result = 0;
-        }
-        else
-            *result = self;
-    }
-    
-    self->nque = 0;
-    self->rc = 0;
-    self->eof = false;
-    
-    rc = KLockMake(&self->lock);
-    if (rc == 0) 
-    {
-        rc = KConditionMake(&self->have_data);
-        if (rc == 0) 
-        {
-            rc = KConditionMake(&self->need_data);
-            if (rc == 0) 
-            {
-                rc = KThreadMake(&self->th, BAMReaderThreadMain, self);
-                if (rc == 0) 
-                    return 0;
-                KConditionRelease(self->need_data);
-            }
-            KConditionRelease(self->have_data);
-        }
-        KLockRelease(self->lock);
-    }
-    
-    return rc;
-}           
-
-static void BAMReaderWhack(BAMReader *const self)
-{
-    KThreadCancel(self->th);
-    KThreadWait(self->th, NULL);
-    BAMFileRelease(self->file);
-    KConditionRelease(self->need_data);
-    KConditionRelease(self->have_data);
-    KLockRelease(self->lock);
-    KThreadRelease(self->th);
-}
-        
-
-/* AddRef
- * Release
- */
-rc_t BAMReaderAddRef ( const BAMReader *self )
-{
-    if (self != NULL)
-        atomic32_inc(&((BAMReader *)self)->refcount);
-    return 0;
-}
-
-rc_t BAMReaderRelease ( const BAMReader *cself )
-{
-    BAMReader *self = (BAMReader *)cself;
-    
-    if (cself != NULL) 
-    {
-        if (atomic32_dec_and_test(&self->refcount)) 
-        {
-            BAMReaderWhack(self);
-            free(self);
-        }
-    }
-    return 0;
-}
-
-/* GetBAMFile
- */
-const BAMFile* BAMReaderGetBAMFile ( const BAMReader *self )
-{
-    if (self == NULL)
-        return NULL;
-    return self->file;
-}
-
-static rc_t BAMReaderThreadMain(KThread const *const th, void *const vp)
-{
-    BAMReader *const self = (BAMReader *)vp;
-    rc_t rc = 0;
-    const BAMAlignment* rec;
-    
-    KLockAcquire(self->lock);
-    do 
-    {
-        while (self->nque == BUFFER_COUNT)
-            KConditionWait(self->need_data, self->lock);
-
-        {
-            rc = BAMFileRead( self->file, &rec);
-            if (rc == END_OF_DATA)
-            {
-                rec = NULL;
-                rc = 0;
-            }
-            else if (rc)
-                break;
-
-            self->que[self->nque] = rec;
-            ++self->nque;
-            KConditionSignal(self->have_data);
-        }
-    }
-    while (rec);
-    self->rc = rc;
-    KLockUnlock(self->lock);
-    return 0;
-}
-
-/* Read
- *  read an aligment
- *
- *  "result" [ OUT ] - return param for BAMAlignment object
- *   must be released with BAMAlignmentRelease
- *
- *  returns RC(..., ..., ..., rcRow, rcNotFound) at end
- */
-rc_t BAMReaderRead ( const BAMReader *cself, const BAMAlignment **result )
-{
-    rc_t rc;
-    BAMReader *self = (BAMReader *)cself;
-    
-    if (self == NULL)
-        return RC(rcAlign, rcFile, rcReading, rcParam, rcNull);
-    if (self->eof)
-        return RC(rcAlign, rcFile, rcReading, rcData, rcInsufficient);
-        
-    KLockAcquire(self->lock);
-    if ((rc = self->rc) == 0) 
-    {
-        while (self->nque == 0 && (rc = self->rc) == 0)
-            KConditionWait(self->have_data, self->lock);
-        if (rc == 0) 
-        {
-            *result = self->que[0];
-            
-            if (*result) 
-            {
-                --self->nque;
-                memmove(&self->que[0], &self->que[1], self->nque * sizeof(self->que[0]));
-                KConditionSignal(self->need_data);
-            }
-            else 
-            {
-                self->eof = true;
-                rc = END_OF_DATA;
-            }
-        }
-    }
-    KLockUnlock(self->lock);
-
-    return rc;
-}
-
-#endif
-
-
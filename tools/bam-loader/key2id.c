@@ -0,0 +1,395 @@
+/* ===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+
+#include <klib/rc.h>
+#include <klib/log.h>
+#include <klib/sort.h>
+#include <klib/printf.h>
+#include <kfs/directory.h>
+#include <kfs/file.h>
+#include <kdb/btree.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "key2id.h"
+
+#define NUM_KEY_SPACES (256u)
+
+#define KEY2ID_MIN_SLOTS (1u << 16)     /* must be a power of 2 */
+#define KEY2ID_CHUNK_BITS (26u)
+#define KEY2ID_CHUNK_SIZE (1u << KEY2ID_CHUNK_BITS)
+#define KEY2ID_MIN_CHUNK_SIZE (1u << 20)
+#define KEY2ID_MIN_SPILL (KEY2ID_MIN_SLOTS / 2) /* names in the table before it may spill */
+
+/* an entry in the name arena; the name follows, padded to 4 bytes */
+typedef struct {
+    uint32_t len;
+    uint32_t space;
+} KeyToIDName;
+
+/* ref == 0: free slot; else ( chunk << KEY2ID_CHUNK_BITS | offset ) + 1 */
+typedef struct {
+    uint64_t ref;
+    uint32_t hash;
+    uint32_t id;
+} KeyToIDSlot;
+
+struct KeyToID {
+    KeyToIDSlot *slot;
+    size_t mask;            /* number of slots - 1 */
+    size_t count;
+
+    /* names are appended to chunks, which are never moved */
+    uint8_t **chunk;
+    unsigned chunks;        /* in use */
+    unsigned chunk_alloc;
+    size_t chunk_used;      /* in the last chunk */
+    size_t chunk_size;      /* at most KEY2ID_CHUNK_SIZE, smaller for a small memLimit */
+
+    size_t memLimit;
+    size_t treeCacheSize;
+
+    KDirectory *dir;
+    int pid;
+    KBTree *tree[NUM_KEY_SPACES]; /* NULL until the first spill of the space */
+};
+
+static uint64_t HashName(unsigned const space, void const *const key, size_t const keylen)
+{
+    /* FNV-1a */
+    uint64_t h = 0xcbf29ce484222325;
+    size_t i;
+
+    h = (h ^ (uint8_t)space) * 0x100000001b3ull;
+    for (i = 0; i < keylen; ++i) {
+        uint8_t const octet = ((uint8_t const *)key)[i];
+        h = (h ^ octet) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+static KeyToIDName const *GetName(KeyToID const *const self, uint64_t const ref)
+{
+    uint64_t const r = ref - 1;
+    return (KeyToIDName const *)&self->chunk[r >> KEY2ID_CHUNK_BITS][r & (KEY2ID_CHUNK_SIZE - 1)];
+}
+
+static size_t NameSize(size_t const keylen)
+{
+    return (sizeof(KeyToIDName) + keylen + 3) & ~((size_t)3);
+}
+
+static size_t MemUsed(KeyToID const *const self)
+{
+    return (self->mask + 1) * sizeof(self->slot[0]) + (size_t)self->chunks * self->chunk_size;
+}
+
+static rc_t MakeSlots(KeyToID *const self, size_t const count)
+{
+    self->slot = calloc(count, sizeof(self->slot[0]));
+    if (self->slot == NULL)
+        return RC(rcExe, rcIndex, rcAllocating, rcMemory, rcExhausted);
+    self->mask = count - 1;
+    return 0;
+}
+
+rc_t KeyToIDMake(KeyToID **const rslt, KDirectory *const dir, int const pid, size_t const memLimit)
+{
+    KeyToID *const self = calloc(1, sizeof(*self));
+    rc_t rc;
+
+    if (self == NULL)
+        return RC(rcExe, rcIndex, rcConstructing, rcMemory, rcExhausted);
+
+    rc = MakeSlots(self, KEY2ID_MIN_SLOTS);
+    if (rc) {
+        free(self);
+        return rc;
+    }
+    self->memLimit = memLimit;
+    /* a chunk takes at most a quarter of the budget, or the table would spill after every name */
+    self->chunk_size = KEY2ID_CHUNK_SIZE;
+    while (self->chunk_size > KEY2ID_MIN_CHUNK_SIZE && self->chunk_size > memLimit / 4)
+        self->chunk_size >>= 1;
+    /* the trees only come into play under memory pressure, keep their caches modest */
+    self->treeCacheSize = ((memLimit / 8) + 0xFFFFF) & ~((size_t)0xFFFFF);
+    self->pid = pid;
+    self->dir = dir;
+    KDirectoryAddRef(dir);
+
+    *rslt = self;
+    return 0;
+}
+
+void KeyToIDRelease(KeyToID *const self)
+{
+    if (self) {
+        unsigned i;
+
+        for (i = 0; i != NUM_KEY_SPACES; ++i) {
+            if (self->tree[i]) {
+                KBTreeDropBacking(self->tree[i]);
+                KBTreeRelease(self->tree[i]);
+            }
+        }
+        for (i = 0; i != self->chunks; ++i)
+            free(self->chunk[i]);
+        free(self->chunk);
+        free(self->slot);
+        KDirectoryRelease(self->dir);
+        free(self);
+    }
+}
+
+static rc_t OpenTree(KeyToID *const self, unsigned const space)
+{
+    KFile *file = NULL;
+    char fname[4096];
+    rc_t rc = string_printf(fname, sizeof(fname), NULL, "key2id.%u.%u", self->pid, space);
+
+    if (rc)
+        return rc;
+
+    rc = KDirectoryCreateFile(self->dir, &file, true, 0600, kcmInit, "%s", fname);
+    KDirectoryRemove(self->dir, 0, "%s", fname);
+    if (rc == 0) {
+        rc = KBTreeMakeUpdate(&self->tree[space], file, self->treeCacheSize,
+                              false, kbtOpaqueKey,
+                              1, 255, sizeof ( uint32_t ),
+                              NULL
+                              );
+        KFileRelease(file);
+    }
+    return rc;
+}
+
+static int CC CompareSlots(void const *const A, void const *const B, void *const data)
+{
+    KeyToID const *const self = data;
+    KeyToIDName const *const a = GetName(self, ((KeyToIDSlot const *)A)->ref);
+    KeyToIDName const *const b = GetName(self, ((KeyToIDSlot const *)B)->ref);
+    size_t const len = a->len < b->len ? a->len : b->len;
+    int diff;
+
+    if (a->space != b->space)
+        return a->space < b->space ? -1 : 1;
+    diff = memcmp(a + 1, b + 1, len);
+    if (diff != 0)
+        return diff;
+    return a->len < b->len ? -1 : a->len > b->len;
+}
+
+static void ClearTable(KeyToID *const self)
+{
+    unsigned i;
+
+    /* keep the first chunk and the slots for the next round */
+    for (i = 1; i < self->chunks; ++i)
+        free(self->chunk[i]);
+    if (self->chunks > 1)
+        self->chunks = 1;
+    self->chunk_used = 0;
+    memset(self->slot, 0, (self->mask + 1) * sizeof(self->slot[0]));
+    self->count = 0;
+}
+
+/* moves all names into the trees, in key order to keep the trees' pages hot */
+static rc_t Spill(KeyToID *const self)
+{
+    size_t const nslots = self->mask + 1;
+    size_t i;
+    size_t n;
+    rc_t rc = 0;
+
+    for (i = n = 0; i < nslots; ++i) {
+        if (self->slot[i].ref != 0)
+            self->slot[n++] = self->slot[i];
+    }
+    assert(n == self->count);
+    ksort(self->slot, n, sizeof(self->slot[0]), CompareSlots, self);
+
+    (void)PLOGMSG(klogInfo, (klogInfo, "key2id: moving $(count) names to disk", "count=%lu", (unsigned long)n));
+
+    for (i = 0; i < n && rc == 0; ++i) {
+        KeyToIDName const *const name = GetName(self, self->slot[i].ref);
+        uint64_t id = self->slot[i].id;
+        bool wasInserted = false;
+
+        if (self->tree[name->space] == NULL) {
+            rc = OpenTree(self, name->space);
+            if (rc) break;
+        }
+        rc = KBTreeEntry(self->tree[name->space], &id, &wasInserted, name + 1, name->len);
+        /* a name is only ever in the table or in the tree */
+        assert(rc != 0 || (wasInserted && id == self->slot[i].id));
+    }
+    ClearTable(self);
+    return rc;
+}
+
+static rc_t Grow(KeyToID *const self)
+{
+    KeyToIDSlot *const old = self->slot;
+    size_t const nslots = self->mask + 1;
+    size_t i;
+    rc_t rc = MakeSlots(self, nslots * 2);
+
+    if (rc) {
+        self->slot = old;
+        return rc;
+    }
+    for (i = 0; i < nslots; ++i) {
+        if (old[i].ref != 0) {
+            size_t j = old[i].hash & self->mask;
+
+            while (self->slot[j].ref != 0)
+                j = (j + 1) & self->mask;
+            self->slot[j] = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+static rc_t AddChunk(KeyToID *const self)
+{
+    if (self->chunks == self->chunk_alloc) {
+        unsigned const alloc = self->chunk_alloc ? self->chunk_alloc * 2 : 16;
+        void *const tmp = realloc(self->chunk, alloc * sizeof(self->chunk[0]));
+
+        if (tmp == NULL)
+            return RC(rcExe, rcIndex, rcAllocating, rcMemory, rcExhausted);
+        self->chunk = tmp;
+        self->chunk_alloc = alloc;
+    }
+    self->chunk[self->chunks] = malloc(self->chunk_size);
+    if (self->chunk[self->chunks] == NULL)
+        return RC(rcExe, rcIndex, rcAllocating, rcMemory, rcExhausted);
+    ++self->chunks;
+    self->chunk_used = 0;
+    return 0;
+}
+
+/* makes room for one more name; may spill the table
+ * the budget is checked only for what has to be added, a chunk or a larger slot array,
+ * and the table spills only once it holds enough names to make the trip to the trees worthwhile
+ */
+static rc_t Reserve(KeyToID *const self, size_t const namesize)
+{
+    bool const needChunk = self->chunks == 0 || self->chunk_used + namesize > self->chunk_size;
+    bool const needGrow = (self->count + 1) * 4 > (self->mask + 1) * 3;
+    size_t need = MemUsed(self);
+
+    if (!needChunk && !needGrow)
+        return 0;
+    if (needChunk)
+        need += self->chunk_size;
+    if (needGrow)
+        need += (self->mask + 1) * sizeof(self->slot[0]);
+
+    if (need > self->memLimit && self->count >= KEY2ID_MIN_SPILL) {
+        rc_t const rc = Spill(self);
+        if (rc) return rc;
+        return Reserve(self, namesize);
+    }
+    if (needGrow) {
+        rc_t const rc = Grow(self);
+        if (rc) return rc;
+    }
+    if (needChunk) {
+        rc_t const rc = AddChunk(self);
+        if (rc) return rc;
+    }
+    return 0;
+}
+
+rc_t KeyToIDEntry(KeyToID *const self, unsigned const space, uint64_t *const id, bool *const wasInserted, void const *const key, size_t const keylen)
+{
+    uint64_t const h = HashName(space, key, keylen);
+    uint32_t const hash = (uint32_t)(h ^ (h >> 32));
+    size_t const namesize = NameSize(keylen);
+    size_t j = hash & self->mask;
+    rc_t rc;
+
+    assert(space < NUM_KEY_SPACES);
+    if (namesize > self->chunk_size)
+        return RC(rcExe, rcIndex, rcInserting, rcName, rcTooLong);
+
+    *wasInserted = false;
+    for ( ; ; ) {
+        KeyToIDSlot const *const slot = &self->slot[j];
+
+        if (slot->ref == 0)
+            break;
+        if (slot->hash == hash) {
+            KeyToIDName const *const name = GetName(self, slot->ref);
+
+            if (name->space == space && name->len == keylen && memcmp(name + 1, key, keylen) == 0) {
+                *id = slot->id;
+                return 0;
+            }
+        }
+        j = (j + 1) & self->mask;
+    }
+
+    if (self->tree[space]) {
+        uint64_t found;
+
+        rc = KBTreeFind(self->tree[space], &found, key, keylen);
+        if (rc == 0) {
+            *id = found;
+            return 0;
+        }
+        if (GetRCState(rc) != rcNotFound)
+            return rc;
+    }
+
+    /* a new name */
+    rc = Reserve(self, namesize);
+    if (rc) return rc;
+
+    /* the table may have changed */
+    for (j = hash & self->mask; self->slot[j].ref != 0; j = (j + 1) & self->mask)
+        ;
+    {
+        KeyToIDName *const name = (KeyToIDName *)&self->chunk[self->chunks - 1][self->chunk_used];
+
+        name->len = (uint32_t)keylen;
+        name->space = space;
+        memcpy(name + 1, key, keylen);
+
+        self->slot[j].ref = ((((uint64_t)(self->chunks - 1)) << KEY2ID_CHUNK_BITS) | self->chunk_used) + 1;
+        self->slot[j].hash = hash;
+        self->slot[j].id = (uint32_t)*id;
+        self->chunk_used += namesize;
+        ++self->count;
+    }
+    *wasInserted = true;
+    return 0;
+}
@@ -0,0 +1,39 @@
+/* ===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+
+/* maps ( key space, name ) to the id of the spot within the key space;
+ * the names live in an in-memory hash table; only when it would grow past
+ * its memory limit are its entries moved, sorted, into on-disk KBTrees */
+typedef struct KeyToID KeyToID;
+
+rc_t KeyToIDMake(KeyToID **rslt, struct KDirectory *dir, int pid, size_t memLimit);
+
+void KeyToIDRelease(KeyToID *self);
+
+/* same contract as KBTreeEntry: *id is the id to use if the name is new;
+ * on return it is the id of the name */
+rc_t KeyToIDEntry(KeyToID *self, unsigned space, uint64_t *id, bool *wasInserted, void const *key, size_t keylen);
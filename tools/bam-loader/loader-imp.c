@@ -38,7 +38,6 @@
 
 #include <kfs/directory.h>
 #include <kfs/file.h>
-#include <kdb/btree.h>
 #include <kdb/manager.h>
 #include <kdb/database.h>
 #include <kdb/table.h>
@@ -84,6 +83,8 @@
 #include "reference-writer.h"
 #include "alignment-writer.h"
 #include "mem-bank.h"
+#include "key2id.h"
+#include "bam-read-ahead.h"
 
 #define NUM_ID_SPACES (256u)
 
@@ -92,6 +93,15 @@
 #define MMA_SUBCHUNK_SIZE (1u << MMA_NUM_CHUNKS_BITS)
 #define MMA_SUBCHUNK_COUNT (1u << MMA_NUM_SUBCHUNKS_BITS)
 
+/* number of lookups issued ( and prefetched ) ahead of use in the random passes */
+#define MMA_BATCH_SIZE (64u)
+
+#ifdef MADV_HUGEPAGE
+#define MMA_USE_HUGEPAGES 1
+#else
+#define MMA_USE_HUGEPAGES 0
+#endif
+
 typedef struct {
     int fd;
     size_t elemSize;
@@ -138,9 +148,10 @@ typedef struct FragmentInfo {
 
 typedef struct context_t {
     const KLoadProgressbar *progress[4];
-    KBTree *key2id[NUM_ID_SPACES];
+    KeyToID *key2id;
     char *key2id_names;
     MMArray *id2value;
+    MMArray *id2spot; /* just the spot ids, for the last pass */
     MemBank *frags;
     int64_t spotId;
     int64_t primaryId;
@@ -215,6 +226,10 @@ static rc_t MMArrayGet(MMArray *const self, void **const value, uint64_t const e
                 return RC(rcExe, rcMemMap, rcConstructing, rcMemory, rcExhausted);
             }
             else {
+#if MMA_USE_HUGEPAGES
+                /* MAP_HUGETLB does not apply to a tmpfs file; this is only a hint */
+                madvise(base, chunk, MADV_HUGEPAGE);
+#endif
 #if PERF
                 static unsigned mapcount = 0;
 
@@ -267,6 +282,37 @@ static rc_t MMArrayGetRead(MMArray *const self, void const **const value, uint64
     return 0;
 }
 
+static void MMArrayPrefetch(MMArray const *const self, uint64_t const element)
+{
+#if __GNUC__
+    unsigned const bin_no = element >> 32;
+    unsigned const subbin = ((uint32_t)element) >> MMA_NUM_CHUNKS_BITS;
+    unsigned const in_bin = (uint32_t)element & (MMA_SUBCHUNK_SIZE - 1);
+
+    if (bin_no < sizeof(self->map)/sizeof(self->map[0])) {
+        uint8_t const *const base = self->map[bin_no].submap[subbin].base;
+
+        if (base)
+            __builtin_prefetch(&base[(size_t)in_bin * self->elemSize], 0, 0);
+    }
+#endif
+}
+
+static void MMArrayAdvise(MMArray *const self, int const advice)
+{
+    size_t const chunk = MMA_SUBCHUNK_SIZE * self->elemSize;
+    unsigned i;
+
+    for (i = 0; i != sizeof(self->map)/sizeof(self->map[0]); ++i) {
+        unsigned j;
+
+        for (j = 0; j != sizeof(self->map[0].submap)/sizeof(self->map[0].submap[0]); ++j) {
+            if (self->map[i].submap[j].base)
+                madvise(self->map[i].submap[j].base, chunk, advice);
+        }
+    }
+}
+
 static void MMArrayLock(MMArray *const self)
 {
 #if PROT
@@ -281,9 +327,13 @@ static void MMArrayLock(MMArray *const self)
 
 static void MMArrayWhack(MMArray *self)
 {
-    size_t const chunk = MMA_SUBCHUNK_SIZE * self->elemSize;
+    size_t chunk;
     unsigned i;
 
+    if (self == NULL)
+        return;
+    chunk = MMA_SUBCHUNK_SIZE * self->elemSize;
+
     for (i = 0; i != sizeof(self->map)/sizeof(self->map[0]); ++i) {
         unsigned j;
 
@@ -296,56 +346,18 @@ static void MMArrayWhack(MMArray *self)
     free(self);
 }
 
-static rc_t OpenKBTree(KBTree **const rslt, unsigned n, unsigned max)
-{
-    size_t const cacheSize = (((G.cache_size - (G.cache_size / 2) - (G.cache_size / 8)) / max)
-                            + 0xFFFFF) & ~((size_t)0xFFFFF);
-    KFile *file = NULL;
-    KDirectory *dir;
-    char fname[4096];
-    rc_t rc;
-
-    rc = KDirectoryNativeDir(&dir);
-    if (rc)
-        return rc;
-
-    rc = string_printf(fname, sizeof(fname), NULL, "%s/key2id.%u.%u", G.tmpfs, G.pid, n); if (rc) return rc;
-    rc = KDirectoryCreateFile(dir, &file, true, 0600, kcmInit, "%s", fname);
-    KDirectoryRemove(dir, 0, "%s", fname);
-    KDirectoryRelease(dir);
-    if (rc == 0) {
-        rc = KBTreeMakeUpdate(rslt, file, cacheSize,
-                              false, kbtOpaqueKey,
-                              1, 255, sizeof ( uint32_t ),
-                              NULL
-                              );
-        KFileRelease(file);
-#if PERF
-        if (rc == 0) {
-            static unsigned treecount = 0;
-
-            (void)PLOGMSG(klogInfo, (klogInfo, "Number of trees: $(cnt)", "cnt=%u", ++treecount));
-        }
-#endif
-    }
-    return rc;
-}
-
 static rc_t GetKeyIDOld(context_t *const ctx, uint64_t *const rslt, bool *const wasInserted, char const key[], char const name[], unsigned const namelen)
 {
     unsigned const keylen = strlen(key);
     rc_t rc;
     uint64_t tmpKey;
 
-    if (ctx->key2id_count == 0) {
-        rc = OpenKBTree(&ctx->key2id[0], 1, 1);
-        if (rc) return rc;
+    if (ctx->key2id_count == 0)
         ctx->key2id_count = 1;
-    }
     if (memcmp(key, name, keylen) == 0) {
         /* qname starts with read group; no append */
         tmpKey = ctx->idCount[0];
-        rc = KBTreeEntry(ctx->key2id[0], &tmpKey, wasInserted, name, namelen);
+        rc = KeyToIDEntry(ctx->key2id, 0, &tmpKey, wasInserted, name, namelen);
     }
     else {
         char sbuf[4096];
@@ -363,7 +375,7 @@ static rc_t GetKeyIDOld(context_t *const ctx, uint64_t *const rslt, bool *const
         rc = string_printf(buf, bsize, &actsize, "%s\t%.*s", key, (int)namelen, name);
 
         tmpKey = ctx->idCount[0];
-        rc = KBTreeEntry(ctx->key2id[0], &tmpKey, wasInserted, buf, actsize);
+        rc = KeyToIDEntry(ctx->key2id, 0, &tmpKey, wasInserted, buf, actsize);
         if (hbuf)
             free(hbuf);
     }
@@ -529,10 +541,7 @@ rc_t GetKeyID(context_t *const ctx,
         }
         if (ctx->key2id_count < ctx->key2id_max) {
             unsigned const name_max = ctx->key2id_name_max + keylen + 1;
-            KBTree *tree;
-            rc_t rc = OpenKBTree(&tree, ctx->key2id_count + 1, 1); /* ctx->key2id_max); */
-
-            if (rc) return rc;
+            rc_t rc;
 
             if (ctx->key2id_name_alloc < name_max) {
                 unsigned alloc = ctx->key2id_name_alloc;
@@ -558,7 +567,6 @@ rc_t GetKeyID(context_t *const ctx,
             ctx->key2id_name_max = name_max;
 
             memcpy(&ctx->key2id_names[ctx->key2id_name[f]], key, keylen + 1);
-            ctx->key2id[f] = tree;
             ctx->idCount[f] = 0;
             if ((uint8_t)ctx->key2id_hash[h] < 3) {
                 unsigned const n = (uint8_t)ctx->key2id_hash[h] + 1;
@@ -573,7 +581,7 @@ rc_t GetKeyID(context_t *const ctx,
             }
         GET_ID:
             tmpKey = ctx->idCount[f];
-            rc = KBTreeEntry(ctx->key2id[f], &tmpKey, wasInserted, name, namelen);
+            rc = KeyToIDEntry(ctx->key2id, f, &tmpKey, wasInserted, name, namelen);
             if (rc == 0) {
                 *rslt = (((uint64_t)f) << 32) | tmpKey;
                 if (*wasInserted)
@@ -586,11 +594,11 @@ rc_t GetKeyID(context_t *const ctx,
     }
 }
 
-static rc_t OpenMMapFile(context_t *const ctx, KDirectory *const dir)
+static rc_t OpenMMArray(MMArray **const rslt, char const name[], uint32_t const elemSize)
 {
     int fd;
     char fname[4096];
-    rc_t rc = string_printf(fname, sizeof(fname), NULL, "%s/id2value.%u", G.tmpfs, G.pid);
+    rc_t rc = string_printf(fname, sizeof(fname), NULL, "%s/%s.%u", G.tmpfs, name, G.pid);
 
     if (rc)
         return rc;
@@ -599,7 +607,10 @@ static rc_t OpenMMapFile(context_t *const ctx, KDirectory *const dir)
     if (fd < 0)
         return RC(rcExe, rcFile, rcCreating, rcFile, rcNotFound);
     unlink(fname);
-    return MMArrayMake(&ctx->id2value, fd, sizeof(ctx_value_t));
+    rc = MMArrayMake(rslt, fd, elemSize);
+    if (rc)
+        close(fd);
+    return rc;
 }
 
 static rc_t TmpfsDirectory(KDirectory **const rslt)
@@ -635,9 +646,15 @@ static rc_t SetupContext(context_t *ctx, unsigned numfiles)
 
         rc = TmpfsDirectory(&dir);
         if (rc == 0)
-            rc = OpenMMapFile(ctx, dir);
+            rc = OpenMMArray(&ctx->id2value, "id2value", sizeof(ctx_value_t));
         if (rc == 0)
             rc = MemBankMake(&ctx->frags, dir, G.pid, fragSize);
+        if (rc == 0) {
+            /* the share of the cache the per-space KBTrees used to get */
+            size_t const key2idSize = G.cache_size - (G.cache_size / 2) - (G.cache_size / 8);
+
+            rc = KeyToIDMake(&ctx->key2id, dir, G.pid, key2idSize);
+        }
         KDirectoryRelease(dir);
     }
     return rc;
@@ -656,6 +673,7 @@ static void ContextRelease(context_t *ctx)
     KLoadProgressbar_Release(ctx->progress[2], true);
     KLoadProgressbar_Release(ctx->progress[3], true);
     MMArrayWhack(ctx->id2value);
+    MMArrayWhack(ctx->id2spot);
 }
 
 static
@@ -1159,6 +1177,7 @@ static rc_t ProcessBAM(char const bamFile[], context_t *ctx, VDatabase *db,
                        bool *had_alignments, bool *had_sequences)
 {
     const BAMFile *bam;
+    BAMReader *reader = NULL;
     const BAMAlignment *rec;
     KDataBuffer buf;
     KDataBuffer fragBuf;
@@ -1204,10 +1223,10 @@ static rc_t ProcessBAM(char const bamFile[], context_t *ctx, VDatabase *db,
         unsigned rgi;
 
         BAMFileGetReadGroupCount(bam, &rgcount);
-        if (rgcount > (sizeof(ctx->key2id)/sizeof(ctx->key2id[0]) - 1))
+        if (rgcount > (NUM_ID_SPACES - 1))
             ctx->key2id_max = 1;
         else
-            ctx->key2id_max = sizeof(ctx->key2id)/sizeof(ctx->key2id[0]);
+            ctx->key2id_max = NUM_ID_SPACES;
 
         for (rgi = 0; rgi != rgcount; ++rgi) {
             BAMReadGroup const *rg;
@@ -1235,6 +1254,8 @@ static rc_t ProcessBAM(char const bamFile[], context_t *ctx, VDatabase *db,
 
     if (rc == 0) {
         (void)PLOGMSG(klogInfo, (klogInfo, "Loading '$(file)'", "file=%s", bamFile));
+        /* records are read and parsed ahead on a thread of their own */
+        rc = BAMReaderMake(&reader, bam, 0);
     }
     while (rc == 0 && (rc = Quitting()) == 0) {
         bool aligned;
@@ -1257,7 +1278,7 @@ static rc_t ProcessBAM(char const bamFile[], context_t *ctx, VDatabase *db,
         uint64_t ti = 0;
         uint32_t csSeqLen = 0;
 
-        rc = BAMFileRead2(bam, &rec);
+        rc = BAMReaderRead(reader, &rec);
         if (rc) {
             if (GetRCModule(rc) == rcAlign && GetRCObject(rc) == rcRow && GetRCState(rc) == rcNotFound)
                 rc = 0;
@@ -1270,8 +1291,8 @@ static rc_t ProcessBAM(char const bamFile[], context_t *ctx, VDatabase *db,
             break;
         }
         ++recordsRead;
-        if ((unsigned)(BAMFileGetProportionalPosition(bam) * 100.0) > progress) {
-            unsigned new_value = BAMFileGetProportionalPosition(bam) * 100.0;
+        if ((unsigned)(BAMReaderGetProportionalPosition(reader) * 100.0) > progress) {
+            unsigned new_value = BAMReaderGetProportionalPosition(reader) * 100.0;
             KLoadProgressbar_Process(ctx->progress[0], new_value - progress, false);
             progress = new_value;
         }
@@ -1508,7 +1529,7 @@ MIXED_BASE_AND_COLOR:
         }
         rc = GetKeyID(ctx, &keyId, &wasInserted, spotGroup, name, namelen);
         if (rc) {
-            (void)PLOGERR(klogErr, (klogErr, rc, "KBTreeEntry: failed on key '$(key)'", "key=%.*s", namelen, name));
+            (void)PLOGERR(klogErr, (klogErr, rc, "KeyToIDEntry: failed on key '$(key)'", "key=%.*s", namelen, name));
             goto LOOP_END;
         }
         rc = MMArrayGet(ctx->id2value, (void **)&value, keyId);
@@ -2026,6 +2047,7 @@ MIXED_BASE_AND_COLOR:
                      "The file contained no records that were processed.");
         rc = RC(rcAlign, rcFile, rcReading, rcData, rcEmpty);
     }
+    BAMReaderRelease(reader);
     BAMFileRelease(bam);
     MMArrayLock(ctx->id2value);
     KDataBufferWhack(&buf);
@@ -2141,82 +2163,140 @@ static rc_t SequenceUpdateAlignInfo(context_t *ctx, Sequence *seq)
 {
     rc_t rc = 0;
     uint64_t row;
-    ctx_value_t const *value;
-    uint64_t keyId;
+    uint64_t keyId[MMA_BATCH_SIZE];
 
     ++ctx->pass;
     KLoadProgressbar_Append(ctx->progress[ctx->pass - 1], ctx->spotId + 1);
 
-    for (row = 1; row <= ctx->spotId; ++row) {
-        rc = SequenceReadKey(seq, row, &keyId);
-        if (rc) {
-            (void)PLOGERR(klogErr, (klogErr, rc, "Failed to get key for row $(row)", "row=%u", (unsigned)row));
-            break;
-        }
-        rc = MMArrayGetRead(ctx->id2value, (void const **)&value, keyId);
-        if (rc) {
-            (void)PLOGERR(klogErr, (klogErr, rc, "Failed to read info for row $(row), index $(idx)", "row=%u,idx=%u", (unsigned)row, (unsigned)keyId));
-            break;
-        }
-        if (row != CTX_VALUE_GET_S_ID(*value)) {
-            rc = RC(rcApp, rcTable, rcWriting, rcData, rcUnexpected);
-            (void)PLOGMSG(klogErr, (klogErr, "Unexpected spot id $(spotId) for row $(row), index $(idx)", "spotId=%u,row=%u,idx=%u", (unsigned)CTX_VALUE_GET_S_ID(*value), (unsigned)row, (unsigned)keyId));
-            break;
+#ifdef MADV_RANDOM
+    MMArrayAdvise(ctx->id2value, MADV_RANDOM);
+#endif
+    for (row = 1; row <= ctx->spotId && rc == 0; ) {
+        unsigned const n = (ctx->spotId - row + 1) < MMA_BATCH_SIZE ? (unsigned)(ctx->spotId - row + 1) : MMA_BATCH_SIZE;
+        unsigned i;
+
+        /* get the keys for the batch first so the lookups can be prefetched */
+        for (i = 0; i < n; ++i) {
+            rc = SequenceReadKey(seq, row + i, &keyId[i]);
+            if (rc) {
+                (void)PLOGERR(klogErr, (klogErr, rc, "Failed to get key for row $(row)", "row=%u", (unsigned)(row + i)));
+                break;
+            }
+            MMArrayPrefetch(ctx->id2value, keyId[i]);
         }
-        {{
-            int64_t primaryId[2];
+        for (i = 0; i < n && rc == 0; ++i, ++row) {
+            ctx_value_t const *value;
 
-            primaryId[0] = CTX_VALUE_GET_P_ID(*value, 0);
-            primaryId[1] = CTX_VALUE_GET_P_ID(*value, 1);
+            rc = MMArrayGetRead(ctx->id2value, (void const **)&value, keyId[i]);
+            if (rc) {
+                (void)PLOGERR(klogErr, (klogErr, rc, "Failed to read info for row $(row), index $(idx)", "row=%u,idx=%u", (unsigned)row, (unsigned)keyId[i]));
+                break;
+            }
+            if (row != CTX_VALUE_GET_S_ID(*value)) {
+                rc = RC(rcApp, rcTable, rcWriting, rcData, rcUnexpected);
+                (void)PLOGMSG(klogErr, (klogErr, "Unexpected spot id $(spotId) for row $(row), index $(idx)", "spotId=%u,row=%u,idx=%u", (unsigned)CTX_VALUE_GET_S_ID(*value), (unsigned)row, (unsigned)keyId[i]));
+                break;
+            }
+            {{
+                int64_t primaryId[2];
 
-            rc = SequenceUpdateAlignData(seq, row, value->unmated ? 1 : 2,
-                                         primaryId,
-                                         value->alignmentCount);
-        }}
-        if (rc) {
-            (void)LOGERR(klogErr, rc, "Failed updating Alignment data in sequence table");
-            break;
+                primaryId[0] = CTX_VALUE_GET_P_ID(*value, 0);
+                primaryId[1] = CTX_VALUE_GET_P_ID(*value, 1);
+
+                rc = SequenceUpdateAlignData(seq, row, value->unmated ? 1 : 2,
+                                             primaryId,
+                                             value->alignmentCount);
+            }}
+            if (rc) {
+                (void)LOGERR(klogErr, rc, "Failed updating Alignment data in sequence table");
+                break;
+            }
+            KLoadProgressbar_Process(ctx->progress[ctx->pass - 1], 1, false);
         }
-        KLoadProgressbar_Process(ctx->progress[ctx->pass - 1], 1, false);
     }
     MMArrayLock(ctx->id2value);
     return rc;
 }
 
+/* The last pass needs only the spot id of each key; copy them out in one
+ * sequential sweep so the random lookups run over 8 bytes per id instead of
+ * the whole ctx_value_t, then drop id2value. */
+static rc_t MakeSpotIdArray(context_t *ctx)
+{
+    rc_t rc = OpenMMArray(&ctx->id2spot, "id2spot", sizeof(int64_t));
+    unsigned j;
+
+    for (j = 0; j < ctx->key2id_count && rc == 0; ++j) {
+        uint32_t i;
+
+        for (i = 0; i != ctx->idCount[j]; ++i) {
+            uint64_t const keyId = ((uint64_t)j << 32) | i;
+            ctx_value_t const *value;
+            int64_t *spotId;
+
+            rc = MMArrayGetRead(ctx->id2value, (void const **)&value, keyId);
+            if (rc == 0)
+                rc = MMArrayGet(ctx->id2spot, (void **)&spotId, keyId);
+            if (rc) {
+                (void)PLOGERR(klogErr, (klogErr, rc, "Failed to copy spot id for index $(idx)", "idx=%lx", keyId));
+                break;
+            }
+            *spotId = CTX_VALUE_GET_S_ID(*value);
+        }
+    }
+    MMArrayLock(ctx->id2spot);
+    MMArrayWhack(ctx->id2value);
+    ctx->id2value = NULL;
+    return rc;
+}
+
 static rc_t AlignmentUpdateSpotInfo(context_t *ctx, Alignment *align)
 {
     rc_t rc;
-    uint64_t keyId;
+    uint64_t keyId[MMA_BATCH_SIZE];
+    int64_t spotId[MMA_BATCH_SIZE];
 
     ++ctx->pass;
 
     KLoadProgressbar_Append(ctx->progress[ctx->pass - 1], ctx->alignCount);
 
+    rc = MakeSpotIdArray(ctx);
+    if (rc)
+        return rc;
+#ifdef MADV_RANDOM
+    MMArrayAdvise(ctx->id2spot, MADV_RANDOM);
+#endif
     rc = AlignmentStartUpdatingSpotIds(align);
     while (rc == 0 && (rc = Quitting()) == 0) {
-        ctx_value_t const *value;
+        unsigned n;
+        unsigned i;
 
-        rc = AlignmentGetSpotKey(align, &keyId);
+        rc = AlignmentGetSpotKeys(align, keyId, MMA_BATCH_SIZE, &n);
         if (rc) {
             if (GetRCObject(rc) == rcRow && GetRCState(rc) == rcNotFound)
                 rc = 0;
             break;
         }
-        assert(keyId >> 32 < ctx->key2id_count);
-        assert((uint32_t)keyId < ctx->idCount[keyId >> 32]);
-        rc = MMArrayGetRead(ctx->id2value, (void const **)&value, keyId);
-        if (rc == 0) {
-            int64_t const spotId = CTX_VALUE_GET_S_ID(*value);
-
-            if (spotId == 0) {
-                (void)PLOGMSG(klogWarn, (klogWarn, "Spot '$(id)' was never assigned a spot id, probably has no primary alignments", "id=%lx", keyId));
-                /* (void)PLOGMSG(klogWarn, (klogWarn, "Spot #$(i): { $(s) }", "i=%lu,s=%s", keyId, Print_ctx_value_t(value))); */
+        for (i = 0; i < n; ++i)
+            MMArrayPrefetch(ctx->id2spot, keyId[i]);
+        for (i = 0; i < n; ++i) {
+            int64_t const *value;
+
+            assert(keyId[i] >> 32 < ctx->key2id_count);
+            assert((uint32_t)keyId[i] < ctx->idCount[keyId[i] >> 32]);
+            rc = MMArrayGetRead(ctx->id2spot, (void const **)&value, keyId[i]);
+            if (rc)
+                break;
+            spotId[i] = *value;
+            if (spotId[i] == 0) {
+                (void)PLOGMSG(klogWarn, (klogWarn, "Spot '$(id)' was never assigned a spot id, probably has no primary alignments", "id=%lx", keyId[i]));
             }
-            rc = AlignmentWriteSpotId(align, spotId);
         }
-        KLoadProgressbar_Process(ctx->progress[ctx->pass - 1], 1, false);
+        if (rc == 0)
+            rc = AlignmentWriteSpotIds(align, spotId, n);
+        KLoadProgressbar_Process(ctx->progress[ctx->pass - 1], n, false);
     }
-    MMArrayLock(ctx->id2value);
+    MMArrayLock(ctx->id2spot);
     return rc;
 }
 
@@ -2271,11 +2351,8 @@ static rc_t ArchiveBAM(VDBManager *mgr, VDatabase *db,
         has_sequences |= this_has_sequences;
     }
 /*** No longer need memory for key2id ***/
-    for (i = 0; i != ctx.key2id_count; ++i) {
-        KBTreeDropBacking(ctx.key2id[i]);
-        KBTreeRelease(ctx.key2id[i]);
-        ctx.key2id[i] = NULL;
-    }
+    KeyToIDRelease(ctx.key2id);
+    ctx.key2id = NULL;
     free(ctx.key2id_names);
     ctx.key2id_names = NULL;
 /*******************/
@@ -163,141 +163,656 @@ rc_t MemBank_Free(MemBank *const self, uint32_t const id)
 
 #else
 
+#include <kfs/file.h>
+#include <kfs/directory.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+#include <kproc/thread.h>
+#include <klib/log.h>
+
 #include <map>
-#include <set>
+#include <deque>
 #include <vector>
 #include <iostream>
 #include <stdexcept>
 #include <algorithm>
 
-class pmem
+#include <stdlib.h>
+#include <string.h>
+
+/* Fragments are kept in pages of ARENA_PAGE_SIZE, each page holding slots
+ * of one size class; short- and long-lived fragments get separate pages so
+ * the long-lived ones collect in pages that go cold together.
+ * When the pages in memory go over the limit, the coldest ones ( by a clock
+ * sweep ) are queued to a writer thread which spills them to a temp file,
+ * a page at a time, and frees their memory. The loader only waits when the
+ * writer falls behind. A spilled page is read back whole the next time one
+ * of its fragments is used, so its neighbors come back with it; it keeps its
+ * place in the file, and if it is not changed it is simply dropped again
+ * when it goes cold.
+ * Mates are resolved about in the order the fragments were allocated, so when
+ * a page has to be read back the writer thread, when it has nothing to write,
+ * reads ahead the next spilled pages; those buffers are the first to go when
+ * memory is short.
+ */
+#define ARENA_PAGE_SIZE (1u << 20)
+#define ARENA_MAX_SLOT (16u * 1024u)    /* bigger ones are malloc'ed */
+#define ARENA_NUM_CLASSES (62u * 2u)
+#define ARENA_MAX_QUEUED (32u)          /* pages handed to the writer at once */
+#define ARENA_READ_AHEAD (4u)           /* spilled pages read ahead after a page is read back */
+#define ARENA_MIN_PAGES (64u)
+#define ARENA_NO_PAGE (~(uint32_t)0)
+
+class arena
 {
-    struct allocation {
-        void *memory;
-        size_t size;
-        
-        allocation(int = 0) : memory(0), size(0) {}
+    struct page {
+        uint8_t *memory;    /* NULL when spilled */
+        uint64_t fpos;      /* where it is in the file, if has_fpos */
+        uint32_t sclass;
+        uint32_t top;       /* bump pointer */
+        uint32_t used;      /* live slots */
+        uint32_t gen;       /* invalidates free slots when the page is recycled */
+        bool referenced;    /* for the clock */
+        bool has_fpos;
+        bool dirty;         /* differs from the copy in the file */
+        bool queued;        /* handed to the writer; only changed by the loader */
+        bool spilled;       /* memory was written and freed; changed by the writer under lock */
+        bool want_ahead;    /* in the read-ahead queue or being read; under lock */
+        uint8_t *ahead;     /* read ahead by the writer while spilled; under lock */
     };
-    typedef std::map<uint32_t, struct allocation> my_map_t;
-    typedef std::set<uint32_t> my_set_t;
-    my_map_t in_use;
-    my_set_t no_use;
-    my_map_t::size_type max_in_use;
-    my_set_t::size_type max_no_use;
-    my_map_t::size_type total_allocs;
-    my_map_t::size_type total_frees;
-    
-    void *get(uint32_t const id) const
+    struct slot {
+        uint32_t page;
+        uint32_t offset;
+        uint32_t size;      /* 0 for an unused id */
+    };
+    struct free_slot {
+        uint32_t page;
+        uint32_t offset;
+        uint32_t gen;
+    };
+    /* deque: the writer holds pointers to pages while new ones are added */
+    std::deque<page> pages;
+    std::vector<uint32_t> free_pages;
+    std::vector<slot> slots;
+    std::vector<uint32_t> free_ids;
+    std::vector<free_slot> free_slots[ARENA_NUM_CLASSES];
+    uint32_t current[ARENA_NUM_CLASSES];
+    std::map<uint32_t, void *> large;
+    std::vector<uint64_t> free_fpos;
+    uint64_t fend;
+    unsigned limit;
+    unsigned hand;
+
+    KFile *file;
+    KThread *th;
+    KLock *lock;
+    KCondition *have_work;
+    KCondition *work_done;
+
+    /* shared with the writer, guarded by lock */
+    std::deque<page *> queue;
+    std::deque<page *> ahead_queue;
+    std::deque<page *> aheads;  /* pages with a read-ahead buffer, oldest first */
+    page const *writing;
+    page const *reading;
+    unsigned resident;
+    unsigned inQueue;
+    bool quit;
+
+    static unsigned size_class(size_t const size)
     {
-        my_map_t::const_iterator const i = in_use.find(id);
-        
-        if (i == in_use.end())
-            throw std::runtime_error("attempt to access invalid id");
-        
-        return i->second.memory;
+        if (size <= 1024)
+            return size == 0 ? 0 : (unsigned)((size - 1) / 32);
+        return 32 + (unsigned)((size - 1025) / 512);
     }
-public:
-    pmem(int = 0)
-    : max_in_use(0)
-    , max_no_use(0)
-    , total_allocs(0)
-    , total_frees(0)
-    {}
-    ~pmem() {
-        my_map_t::iterator i;
-        
-        for (i = in_use.begin(); i != in_use.end(); ++i) {
-            free(i->second.memory);
-            ++total_frees;
+    static uint32_t class_size(unsigned const c)
+    {
+        return c < 32 ? (c + 1) * 32 : 1024 + (c - 31) * 512;
+    }
+
+    static rc_t CC writer(KThread const *, void *const vp)
+    {
+        arena *const self = reinterpret_cast<arena *>(vp);
+
+        KLockAcquire(self->lock);
+        for ( ; ; ) {
+            while (self->queue.empty() && self->ahead_queue.empty() && !self->quit)
+                KConditionWait(self->have_work, self->lock);
+            if (self->quit)
+                break;
+            if (self->queue.empty()) {
+                self->read_ahead();
+                continue;
+            }
+
+            page *const p = self->queue.front();
+            size_t nwrit = 0;
+
+            self->queue.pop_front();
+            self->writing = p;
+            KLockUnlock(self->lock);
+
+            rc_t const rc = KFileWriteAll(self->file, p->fpos, p->memory, ARENA_PAGE_SIZE, &nwrit);
+
+            KLockAcquire(self->lock);
+            self->writing = NULL;
+            if (rc == 0 && nwrit == ARENA_PAGE_SIZE) {
+                free(p->memory);
+                p->memory = NULL;
+                p->spilled = true;
+                --self->resident;
+            }
+            else
+                (void)LOGERR(klogWarn, rc, "failed to spill fragment data; keeping it in memory");
+            --self->inQueue;
+            KConditionBroadcast(self->work_done);
         }
-#if 0
-        std::cerr << "max. used: " << max_in_use << std::endl;
-        std::cerr << "max. free: " << max_no_use << std::endl;
-        std::cerr << "num alloc: " << total_allocs << std::endl;
-        std::cerr << "num frees: " << total_frees << std::endl;
-#endif
+        KLockUnlock(self->lock);
+        return 0;
     }
-    
-    void Write(uint32_t id, size_t const offset, size_t const size, void const *const data) const
+    /* on the writer thread, with lock held; writes go first */
+    void read_ahead()
+    {
+        page *const p = ahead_queue.front();
+        uint8_t *memory = NULL;
+        size_t nread = 0;
+
+        ahead_queue.pop_front();
+        reading = p;
+        KLockUnlock(lock);
+
+        memory = reinterpret_cast<uint8_t *>(malloc(ARENA_PAGE_SIZE));
+        if (memory != NULL) {
+            rc_t const rc = KFileReadAll(file, p->fpos, memory, ARENA_PAGE_SIZE, &nread);
+            if (rc != 0 || nread != ARENA_PAGE_SIZE) {
+                /* the loader will read it itself, and report the failure */
+                free(memory);
+                memory = NULL;
+            }
+        }
+
+        KLockAcquire(lock);
+        reading = NULL;
+        p->want_ahead = false;
+        if (memory != NULL) {
+            p->ahead = memory;
+            aheads.push_back(p);
+            ++resident;
+        }
+        KConditionBroadcast(work_done);
+    }
+    /* with lock held: cancels the read-ahead of a page and returns its buffer, if any */
+    uint8_t *take_ahead(page &p)
+    {
+        if (p.want_ahead) {
+            std::deque<page *>::iterator const i = std::find(ahead_queue.begin(), ahead_queue.end(), &p);
+            if (i != ahead_queue.end()) {
+                ahead_queue.erase(i);
+                p.want_ahead = false;
+            }
+            while (reading == &p)
+                KConditionWait(work_done, lock);
+        }
+        uint8_t *const memory = p.ahead;
+        if (memory != NULL) {
+            p.ahead = NULL;
+            aheads.erase(std::find(aheads.begin(), aheads.end(), &p));
+        }
+        return memory;
+    }
+    /* queues the spilled pages after idx for reading ahead, if memory allows;
+     * the buffers count as resident, so colder pages are spilled for them */
+    void queue_ahead(uint32_t const idx)
+    {
+        uint32_t i;
+
+        KLockAcquire(lock);
+        for (i = idx + 1; i < pages.size() && i <= idx + ARENA_READ_AHEAD; ++i) {
+            page &p = pages[i];
+
+            if (!p.queued || !p.spilled || p.want_ahead || p.ahead != NULL)
+                continue;
+            if (resident + ahead_queue.size() + (reading ? 1 : 0) + 1 > limit)
+                break;
+            if (aheads.size() + ahead_queue.size() >= 2 * ARENA_READ_AHEAD)
+                break;
+            p.want_ahead = true;
+            ahead_queue.push_back(&p);
+            KConditionSignal(have_work);
+        }
+        KLockUnlock(lock);
+    }
+
+    page *cold_page()
+    {
+        size_t const n = pages.size();
+        size_t i;
+
+        for (i = 0; i < 2 * n; ++i) {
+            uint32_t const idx = hand;
+            page &p = pages[idx];
+
+            hand = (hand + 1) % n;
+            if (p.queued || p.memory == NULL || p.used == 0 || current[p.sclass] == idx)
+                continue;
+            if (p.referenced) {
+                p.referenced = false;
+                continue;
+            }
+            return &p;
+        }
+        return NULL;
+    }
+    uint64_t alloc_fpos()
+    {
+        if (free_fpos.empty()) {
+            uint64_t const fpos = fend;
+
+            fend += ARENA_PAGE_SIZE;
+            return fpos;
+        }
+        uint64_t const fpos = free_fpos.back();
+
+        free_fpos.pop_back();
+        return fpos;
+    }
+    /* called before another page is brought into memory */
+    void make_room()
     {
-        if (offset + size <= this->Size(id)) {
-            char *dst = reinterpret_cast<char *>(get(id)) + offset;
-            char const *src = reinterpret_cast<char const *>(data);
-            
-            std::copy(src, src + size, dst);
+        if (file == NULL)
             return;
+
+        unsigned const reserve = std::min(ARENA_MAX_QUEUED, limit / 4);
+
+        KLockAcquire(lock);
+        /* pages read ahead but not used yet are given up before going over */
+        while (!aheads.empty() && resident + 1 > limit) {
+            page *const p = aheads.front();
+
+            aheads.pop_front();
+            free(p->ahead);
+            p->ahead = NULL;
+            --resident;
+        }
+        while (inQueue < ARENA_MAX_QUEUED && resident - inQueue + 1 > limit - reserve) {
+            page *const p = cold_page();
+
+            if (p == NULL)
+                break;
+            if (!p->has_fpos) {
+                p->fpos = alloc_fpos();
+                p->has_fpos = true;
+            }
+            p->queued = true;
+            if (!p->dirty) {
+                /* the file already has it */
+                free(p->memory);
+                p->memory = NULL;
+                p->spilled = true;
+                --resident;
+                continue;
+            }
+            p->dirty = false;
+            queue.push_back(p);
+            ++inQueue;
+            KConditionSignal(have_work);
         }
-        throw std::runtime_error("attempt to write more than was allocated");
+        while (resident + 1 > limit && inQueue > 0)
+            KConditionWait(work_done, lock);
+        KLockUnlock(lock);
     }
-    uint32_t Alloc(size_t const size, bool const clear = true)
+    /* takes a queued page back from the writer; on return it is either
+     * spilled or in memory and no longer queued */
+    void settle(page &p)
     {
-        my_map_t::key_type new_key;
-        
-        if (no_use.begin() == no_use.end()) {
-            my_map_t::size_type const new_id = in_use.size() + 1;
-
-            if (max_in_use < new_id)
-                max_in_use = new_id;
-            
-            new_key = (my_map_t::key_type)new_id;
-            if (new_key < new_id)
-                throw std::runtime_error("pmem overflow");
+        KLockAcquire(lock);
+        std::deque<page *>::iterator const i = std::find(queue.begin(), queue.end(), &p);
+        if (i != queue.end()) {
+            queue.erase(i);
+            --inQueue;
+        }
+        while (writing == &p)
+            KConditionWait(work_done, lock);
+        KLockUnlock(lock);
+        if (!p.spilled) {
+            /* never written */
+            p.queued = false;
+            p.dirty = true;
+        }
+    }
+    void load(uint32_t const idx)
+    {
+        page &p = pages[idx];
+
+        KLockAcquire(lock);
+        uint8_t *memory = take_ahead(p);
+        KLockUnlock(lock);
+
+        if (memory == NULL) {
+            /* not read ahead, it is already counted as resident otherwise */
+            make_room();
+
+            size_t nread = 0;
+
+            memory = reinterpret_cast<uint8_t *>(malloc(ARENA_PAGE_SIZE));
+            if (memory == NULL)
+                throw std::bad_alloc();
+            rc_t const rc = KFileReadAll(file, p.fpos, memory, ARENA_PAGE_SIZE, &nread);
+            if (rc != 0 || nread != ARENA_PAGE_SIZE) {
+                free(memory);
+                throw std::runtime_error("failed to read back spilled fragment data");
+            }
+            KLockAcquire(lock);
+            ++resident;
+            KLockUnlock(lock);
+        }
+        p.memory = memory;
+        p.spilled = false;
+        p.queued = false;
+        queue_ahead(idx);
+    }
+    uint8_t *page_memory(uint32_t const idx, bool const modify)
+    {
+        page &p = pages[idx];
+
+        if (p.queued) {
+            settle(p);
+            if (p.spilled)
+                load(idx);
+        }
+        p.referenced = true;
+        p.dirty |= modify;
+        return p.memory;
+    }
+    uint32_t new_page(unsigned const sclass)
+    {
+        make_room();
+
+        uint8_t *const memory = reinterpret_cast<uint8_t *>(malloc(ARENA_PAGE_SIZE));
+        uint32_t idx;
+
+        if (memory == NULL)
+            throw std::bad_alloc();
+        if (free_pages.empty()) {
+            idx = (uint32_t)pages.size();
+            pages.push_back(page());
         }
         else {
-            my_set_t::const_iterator const j = no_use.begin();
-            
-            new_key = *j;
-            no_use.erase(j);
+            idx = free_pages.back();
+            free_pages.pop_back();
         }
-        my_map_t::iterator const i = in_use.insert(my_map_t::value_type(new_key, 0)).first;
-        
-        void *const alloc = calloc(1, size);
-        if (alloc) {
-            i->second.memory = alloc;
-            i->second.size = size;
-            
-            ++total_allocs;
-            return i->first;
+        page &p = pages[idx];
+
+        p.memory = memory;
+        p.sclass = sclass;
+        p.top = 0;
+        p.used = 0;
+        p.referenced = true;
+        p.has_fpos = false;
+        p.dirty = true;
+        p.queued = false;
+        p.spilled = false;
+        p.want_ahead = false;
+        p.ahead = NULL;
+
+        KLockAcquire(lock);
+        ++resident;
+        KLockUnlock(lock);
+        return idx;
+    }
+    void recycle(uint32_t const idx)
+    {
+        page &p = pages[idx];
+
+        ++p.gen;
+        if (current[p.sclass] == idx && !p.queued) {
+            /* keep it for the next allocations */
+            p.top = 0;
+            return;
         }
-        throw std::bad_alloc();
+        if (current[p.sclass] == idx)
+            current[p.sclass] = ARENA_NO_PAGE;
+        if (p.queued) {
+            settle(p);
+
+            KLockAcquire(lock);
+            uint8_t *const ahead = take_ahead(p);
+            if (ahead != NULL) {
+                free(ahead);
+                --resident;
+            }
+            KLockUnlock(lock);
+        }
+        if (p.has_fpos)
+            free_fpos.push_back(p.fpos);
+        if (p.memory) {
+            free(p.memory);
+            p.memory = NULL;
+            KLockAcquire(lock);
+            --resident;
+            KLockUnlock(lock);
+        }
+        p.has_fpos = false;
+        p.queued = false;
+        p.spilled = false;
+        free_pages.push_back(idx);
+    }
+    slot &get(uint32_t const id)
+    {
+        if (id == 0 || id >= slots.size() || slots[id].size == 0)
+            throw std::runtime_error("attempt to access invalid or freed id");
+        return slots[id];
+    }
+    uint8_t *data(uint32_t const id, slot const &s, bool const modify)
+    {
+        if (s.page == ARENA_NO_PAGE)
+            return reinterpret_cast<uint8_t *>(large[id]);
+        return page_memory(s.page, modify) + s.offset;
+    }
+    uint32_t new_id()
+    {
+        if (free_ids.empty()) {
+            size_t const id = slots.size();
+
+            if ((uint32_t)id != id)
+                throw std::runtime_error("pmem overflow");
+            slots.push_back(slot());
+            return (uint32_t)id;
+        }
+        uint32_t const id = free_ids.back();
+
+        free_ids.pop_back();
+        return id;
+    }
+public:
+    arena(size_t const memLimit)
+    : fend(0)
+    , limit(std::max((unsigned)(memLimit / ARENA_PAGE_SIZE), ARENA_MIN_PAGES))
+    , hand(0)
+    , file(0)
+    , th(0)
+    , lock(0)
+    , have_work(0)
+    , work_done(0)
+    , writing(0)
+    , reading(0)
+    , resident(0)
+    , inQueue(0)
+    , quit(false)
+    {
+        std::fill(current, current + ARENA_NUM_CLASSES, ARENA_NO_PAGE);
+        slots.push_back(slot()); /* id 0 is never used */
+        slots[0].size = 0;
+    }
+    rc_t Open(KDirectory *const dir, int const pid)
+    {
+        rc_t rc = KLockMake(&lock);
+        if (rc == 0)
+            rc = KConditionMake(&have_work);
+        if (rc == 0)
+            rc = KConditionMake(&work_done);
+        if (rc || dir == NULL)
+            return rc;
+
+        rc = KDirectoryCreateFile(dir, &file, true, 0600, kcmInit, "frag_data.%u", pid);
+        KDirectoryRemove(dir, 0, "frag_data.%u", pid);
+        if (rc == 0)
+            rc = KThreadMake(&th, writer, this);
+        if (rc) {
+            KFileRelease(file);
+            file = NULL;
+        }
+        return rc;
+    }
+    ~arena()
+    {
+        if (th) {
+            KLockAcquire(lock);
+            quit = true;
+            queue.clear();
+            ahead_queue.clear();
+            KConditionSignal(have_work);
+            KLockUnlock(lock);
+            KThreadWait(th, NULL);
+            KThreadRelease(th);
+        }
+        for (size_t i = 0; i < pages.size(); ++i) {
+            free(pages[i].memory);
+            free(pages[i].ahead);
+        }
+        for (std::map<uint32_t, void *>::iterator i = large.begin(); i != large.end(); ++i)
+            free(i->second);
+        KFileRelease(file);
+        KConditionRelease(work_done);
+        KConditionRelease(have_work);
+        KLockRelease(lock);
+    }
+
+    uint32_t Alloc(size_t const size, bool const clear, bool const longlived)
+    {
+        uint32_t const id = new_id();
+        slot &s = slots[id];
+
+        if (size > ARENA_MAX_SLOT) {
+            void *const alloc = clear ? calloc(1, size) : malloc(size);
+
+            if (alloc == NULL) {
+                free_ids.push_back(id);
+                throw std::bad_alloc();
+            }
+            large[id] = alloc;
+            s.page = ARENA_NO_PAGE;
+            s.offset = 0;
+            s.size = (uint32_t)size;
+            return id;
+        }
+        unsigned const c = size_class(size) * 2 + (longlived ? 1 : 0);
+        uint32_t const csize = class_size(c / 2);
+        std::vector<free_slot> &fs = free_slots[c];
+
+        s.page = ARENA_NO_PAGE;
+        while (!fs.empty()) {
+            free_slot const f = fs.back();
+            page const &p = pages[f.page];
+
+            fs.pop_back();
+            if (p.gen == f.gen && p.sclass == c && !p.queued && p.memory != NULL) {
+                s.page = f.page;
+                s.offset = f.offset;
+                break;
+            }
+        }
+        if (s.page == ARENA_NO_PAGE) {
+            uint32_t cur = current[c];
+
+            if (cur == ARENA_NO_PAGE || pages[cur].top + csize > ARENA_PAGE_SIZE) {
+                try {
+                    cur = current[c] = new_page(c);
+                }
+                catch (...) {
+                    free_ids.push_back(id);
+                    throw;
+                }
+            }
+            s.page = cur;
+            s.offset = pages[cur].top;
+            pages[cur].top += csize;
+        }
+        s.size = size == 0 ? 1 : (uint32_t)size;
+        ++pages[s.page].used;
+
+        uint8_t *const dst = page_memory(s.page, true) + s.offset;
+        if (clear)
+            memset(dst, 0, s.size);
+        return id;
     }
     void Free(uint32_t const id)
     {
-        my_map_t::iterator const i = in_use.find(id);
-        
-        if (i == in_use.end())
-            throw std::runtime_error("attempt to free invalid id");
-        
-        void *const alloc = i->second.memory;
+        slot &s = get(id);
 
-        no_use.insert(id);
-        if (max_no_use < no_use.size())
-            max_no_use = no_use.size();
+        if (s.page == ARENA_NO_PAGE) {
+            std::map<uint32_t, void *>::iterator const i = large.find(id);
 
-        in_use.erase(i);
-        free(alloc);
-        ++total_frees;
+            free(i->second);
+            large.erase(i);
+        }
+        else {
+            page &p = pages[s.page];
+
+            if (--p.used == 0)
+                recycle(s.page);
+            else if (!p.queued && p.memory != NULL) {
+                free_slot const f = { s.page, s.offset, p.gen };
+
+                free_slots[p.sclass].push_back(f);
+            }
+        }
+        s.size = 0;
+        free_ids.push_back(id);
     }
-    size_t Size(uint32_t const id) const
+    size_t Size(uint32_t const id)
     {
-        my_map_t::const_iterator const i = in_use.find(id);
-        
-        if (i == in_use.end())
-            throw std::runtime_error("attempt to access invalid or freed id");
-        
-        return i->second.size;
+        return get(id).size;
+    }
+    size_t Write(uint32_t const id, uint64_t const pos, void const *const buffer, size_t const bsize)
+    {
+        slot const s = get(id);
+
+        if (pos >= s.size)
+            return 0;
+
+        size_t const actsize = (bsize + pos > s.size) ? (size_t)(s.size - pos) : bsize;
+        uint8_t *const dst = data(id, s, true) + pos;
+
+        memmove(dst, buffer, actsize);
+        return actsize;
     }
-    void const *Read(uint32_t const id) const
+    size_t Read(uint32_t const id, uint64_t const pos, void *const buffer, size_t const bsize)
     {
-        return get(id);
+        slot const s = get(id);
+
+        if (pos >= s.size)
+            return 0;
+
+        size_t const actsize = (bsize + pos > s.size) ? (size_t)(s.size - pos) : bsize;
+        uint8_t const *const src = data(id, s, false) + pos;
+
+        memmove(buffer, src, actsize);
+        return actsize;
     }
 };
 
-rc_t MemBank_Make(MemBank **bank, struct KDirectory * = 0, int = 0, size_t const * = 0)
+rc_t MemBank_Make(MemBank **bank, struct KDirectory *dir = 0, int pid = 0, size_t const climits[2] = 0)
 {
     try {
-        pmem *const rslt = new pmem;
-        
+        size_t const memLimit = climits ? (climits[0] + climits[1]) : 0;
+        arena *const rslt = new arena(memLimit);
+        rc_t const rc = rslt->Open(dir, pid);
+
+        if (rc) {
+            delete rslt;
+            return rc;
+        }
         *bank = reinterpret_cast<MemBank *>(rslt);
         return 0;
     }
@@ -316,15 +831,15 @@ rc_t MemBank_Make(MemBank **bank, struct KDirectory * = 0, int = 0, size_t const
 
 void MemBank_Release(MemBank *const self)
 {
-    delete reinterpret_cast<pmem *>(self);
+    delete reinterpret_cast<arena *>(self);
 }
 
 rc_t MemBank_Alloc(MemBank *const Self, uint32_t *const id, size_t const bytes, bool const clear, bool const longlived)
 {
     try {
-        pmem *const self = reinterpret_cast<pmem *>(Self);
+        arena *const self = reinterpret_cast<arena *>(Self);
         
-        *id = self->Alloc(bytes, clear);
+        *id = self->Alloc(bytes, clear, longlived);
         return 0;
     }
     catch (std::bad_alloc const &e) {
@@ -343,22 +858,15 @@ rc_t MemBank_Alloc(MemBank *const Self, uint32_t *const id, size_t const bytes,
 rc_t MemBank_Write(MemBank *const Self, uint32_t const id, uint64_t const pos, void const *const buffer, size_t const bsize, size_t *const num_writ)
 {
     try {
-        pmem *const self = reinterpret_cast<pmem *>(Self);
+        arena *const self = reinterpret_cast<arena *>(Self);
         
         *num_writ = 0;
-
-        size_t const size = self->Size((uint32_t)id);
-        
-        if (pos >= size)
-            return 0;
-        
-        size_t const actsize = (bsize + pos > size) ? (size - pos) : size;
-        
-        *num_writ = actsize;
-        self->Write(id, pos, actsize, buffer);
-        
+        *num_writ = self->Write(id, pos, buffer, bsize);
         return 0;
     }
+    catch (std::bad_alloc const &e) {
+        return RC(rcApp, rcFile, rcWriting, rcMemory, rcExhausted);
+    }
     catch (std::exception const &e) {
         std::cerr << e.what() << std::endl;
         abort();
@@ -372,7 +880,7 @@ rc_t MemBank_Write(MemBank *const Self, uint32_t const id, uint64_t const pos, v
 rc_t MemBank_Size(MemBank const *const Self, uint32_t const id, size_t *const size)
 {
     try {
-        pmem const *const self = reinterpret_cast<pmem const *>(Self);
+        arena *const self = reinterpret_cast<arena *>(const_cast<MemBank *>(Self));
         
         *size = self->Size(id);
         return 0;
@@ -390,25 +898,16 @@ rc_t MemBank_Size(MemBank const *const Self, uint32_t const id, size_t *const si
 rc_t MemBank_Read(MemBank const *const Self, uint32_t const id, uint64_t const pos, void *const buffer, size_t const bsize, size_t *const num_read)
 {
     try {
-        pmem const *const self = reinterpret_cast<pmem const *>(Self);
+        /* reading may bring a spilled page back into memory */
+        arena *const self = reinterpret_cast<arena *>(const_cast<MemBank *>(Self));
         
         *num_read = 0;
-        
-        size_t const size = self->Size(id);
-        char const *data = reinterpret_cast<char const *>(self->Read(id)) + pos;
-        
-        if (pos >= size)
-            return 0;
-        
-        size_t const actsize = (bsize + pos > size) ? (size - pos) : size;
-        
-        *num_read = actsize;
-        
-        char *dst = reinterpret_cast<char *>(buffer);
-        std::copy(data, data + actsize, dst);
-        
+        *num_read = self->Read(id, pos, buffer, bsize);
         return 0;
     }
+    catch (std::bad_alloc const &e) {
+        return RC(rcApp, rcFile, rcReading, rcMemory, rcExhausted);
+    }
     catch (std::exception const &e) {
         std::cerr << e.what() << std::endl;
         abort();
@@ -422,7 +921,7 @@ rc_t MemBank_Read(MemBank const *const Self, uint32_t const id, uint64_t const p
 rc_t MemBank_Free(MemBank *const Self, uint32_t const id)
 {
     try {
-        pmem *const self = reinterpret_cast<pmem *>(Self);
+        arena *const self = reinterpret_cast<arena *>(Self);
         
         self->Free(id);
         return 0;
@@ -12,10 +12,16 @@
 
 #include <string.h>         /* strcmp () */
 
+#include <iostream>
+#include <vector>
+
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+#include <kproc/thread.h>
+
 #include "args.hpp"
 #include "filters.hpp"
-
-#include "koutstream"
+#include "writer.hpp"
 
 namespace ngs {
 
@@ -32,9 +38,11 @@ public :
     static const char * _sM_categoryName;
     static const char * _sM_fastaName;
     static const char * _sM_legacyReportName;
+    static const char * _sM_threadsName;
 
     static const int64_t _sM_minSpotIdDefValue = 1;
     static const int64_t _sM_maxSpotIdDefValue = 0;
+    static const uint32_t _sM_threadsDefValue = 4;
 
 public :
     typedef AArgs PAPAHEN;
@@ -67,6 +75,9 @@ public :
     inline bool legacyReport () const
                 { return _M_legacyReport; };
 
+    inline uint32_t threads () const
+                { return _M_threads; };
+
 protected :
     void __customInit ();
     void __customParse ();
@@ -83,6 +94,7 @@ private :
     ReadCategory _M_category;   /* -Y | --category */
     uint64_t _M_fasta;          /* -A | --fasta */
     bool _M_legacyReport;       /* -L | --legacy-report */
+    uint32_t _M_threads;        /* -t | --threads */
 };
 
 /*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
@@ -96,6 +108,7 @@ const char * DumpArgs :: _sM_minReadLengthName = "minReadLength";
 const char * DumpArgs :: _sM_categoryName = "category";
 const char * DumpArgs :: _sM_fastaName = "fasta";
 const char * DumpArgs :: _sM_legacyReportName = "legacy-report";
+const char * DumpArgs :: _sM_threadsName = "threads";
 
 DumpArgs :: DumpArgs ()
 :   AArgs ()
@@ -106,6 +119,7 @@ DumpArgs :: DumpArgs ()
 ,   _M_category ( Read :: all )
 ,   _M_fasta ( 0 )
 ,   _M_legacyReport ( false )
+,   _M_threads ( _sM_threadsDefValue )
 {
 }   /* DumpArgs :: DumpArgs () */
 
@@ -214,6 +228,20 @@ DumpArgs :: __customInit ()
 
         addOpt ( TheOpt );
     }
+
+    {
+        AOptDef TheOpt;
+
+        TheOpt . setName ( _sM_threadsName );
+        TheOpt . setAliases ( "t" );
+        TheOpt . setParam ( "count" );
+        TheOpt . setNeedValue ( true );
+        TheOpt . setRequired ( false );
+        TheOpt . setHlp ( "Number of threads reading the run, default 4. Output is the same for any value" );
+        TheOpt . setMaxCount ( 1 );
+
+        addOpt ( TheOpt );
+    }
 }   /* DumpArgs :: __customInit () */
 
 void
@@ -226,6 +254,7 @@ DumpArgs :: __customDispose ()
     _M_category = Read :: all;
     _M_fasta = 0;
     _M_legacyReport = false;
+    _M_threads = _sM_threadsDefValue;
 }   /* DumpArgs :: __customDispose () */
 
 void
@@ -349,6 +378,17 @@ DumpArgs :: __customParse ()
 
     _M_legacyReport = optVal ( _sM_legacyReportName ) . exist ();
 
+    _M_threads = _sM_threadsDefValue;
+    optV = optVal ( _sM_threadsName );
+    if ( optV . exist () ) {
+        if ( optV . valCount () != 1 ) {
+            throw ErrorMsg ( String ( "__custromParse: ERROR: Too many \"" ) + _sM_threadsName + "\" values");
+        }
+
+        uint64_t __t = optV . uint64Val ();
+        _M_threads = __t == 0 ? 1 : ( __t < 64 ? ( uint32_t ) __t : 64 );
+    }
+
 }   /* DumpArgs :: __customParse () */
 
 }; /* namespace ngs */
@@ -477,105 +517,372 @@ static
 void
 dumpFastQ (
         int64_t SpotId,
-        const ngs :: String & CollectionName,
+        AWriter & Writer,
         const ReadIterator & Iterator
 )
 {
         /*)  We do not check values for arguments validity!
          (*/
-    StringRef ReadName = Iterator . getReadName ();
-    StringRef Bases = Iterator . getReadBases ();
-    StringRef Qualities = Iterator . getReadQualities ();
-
-        /*)  First, we are doint base header
-         (*/
-    kout << "@"
-        << CollectionName
-        << '.'
-        << SpotId
-        << ' '
-        << ReadName
-        << " length="
-        << Bases . size ()
-        << '\n'
-        ;
-
-        /*)  Second is going base itsefl
-         (*/
-    kout << Bases
-        << '\n'
-        ;
-
-        /*)  Third, header for qualities
-         (*/
-    kout << '+'
-        << CollectionName
-        << '.'
-        << SpotId
-        << ' '
-        << ReadName
-        << " length="
-        << Qualities . size ()
-        << '\n'
-        ;
-
-        /*)  Finally there are qualities
-         (*/
-    kout << Qualities
-        << '\n'
-        ;
+    Writer . writeFastQ (
+                        SpotId,
+                        Iterator . getReadName (),
+                        Iterator . getReadBases (),
+                        Iterator . getReadQualities ()
+                        );
 }   /* dumpFastQ () */
 
 static
 void
 dumpFastA (
         int64_t SpotId,
-        const ngs :: String & CollectionName,
+        AWriter & Writer,
         const ReadIterator & Iterator,
         uint64_t Width
 )
 {
         /*)  We do not check values for arguments validity!
          (*/
-    StringRef ReadName = Iterator . getReadName ();
-    StringRef Bases = Iterator . getReadBases ();
+    Writer . writeFastA (
+                        SpotId,
+                        Iterator . getReadName (),
+                        Iterator . getReadBases (),
+                        Width
+                        );
+}   /* dumpFastA () */
+
+/*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
+/*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
+
+/*))
+ //  Parallel dump : read range is cut into slices, each slice is
+ //  read by it's own ReadIterator on a worker thread and formatted
+ //  into a private buffer, and buffers are written in slice order.
+ //  Workers filter whole batches of reads by their lengths.
+((*/
+class __Dumper {
+public :
+    __Dumper (
+            const DumpArgs & TheArgs,
+            const ngs :: String & Accession,
+            const ngs :: String & CollectionName,
+            int64_t MinSpot,
+            int64_t MaxSpot
+            );
+    ~__Dumper ();
+
+    void run ( AWriter & Writer, AFilters & Filters );
+
+    static const uint64_t _sM_sliceSize = 16384;
+    static const size_t _sM_batchSize = 256;
+
+private :
+    struct __Slice {
+        AWriter * Out;
+        bool Ready;
+    };
+
+    static rc_t CC __worker ( const KThread * Self, void * Data );
+
+    void __work ();
+    void __dumpSlice (
+                    ReadCollection & RCol,
+                    uint64_t Slice,
+                    AFilters & Filters,
+                    AWriter & Out
+                    );
+    void __fail ( const String & Message );
+
+private :
+    const DumpArgs & _M_args;
+    ngs :: String _M_accession;
+    ngs :: String _M_collectionName;
+
+    int64_t _M_minSpot;
+    int64_t _M_maxSpot;
+    uint64_t _M_sliceCount;
+
+    std :: vector < __Slice > _M_slices;   /* window of slices in work */
+    std :: vector < KThread * > _M_threads;
+
+    KLock * _M_lock;
+    KCondition * _M_cond;
+
+        /*) guarded by _M_lock
+         (*/
+    uint64_t _M_next;       /* next slice to read */
+    uint64_t _M_written;    /* slices written */
+    bool _M_failed;
+    String _M_message;
+    AFilters * _M_filters;
+};
+
+const uint64_t __Dumper :: _sM_sliceSize;
+const size_t __Dumper :: _sM_batchSize;
+
+__Dumper :: __Dumper (
+                    const DumpArgs & TheArgs,
+                    const ngs :: String & Accession,
+                    const ngs :: String & CollectionName,
+                    int64_t MinSpot,
+                    int64_t MaxSpot
+)
+:   _M_args ( TheArgs )
+,   _M_accession ( Accession )
+,   _M_collectionName ( CollectionName )
+,   _M_minSpot ( MinSpot )
+,   _M_maxSpot ( MaxSpot )
+,   _M_sliceCount ( 0 )
+,   _M_lock ( NULL )
+,   _M_cond ( NULL )
+,   _M_next ( 0 )
+,   _M_written ( 0 )
+,   _M_failed ( false )
+,   _M_filters ( NULL )
+{
+    uint64_t Count = ( uint64_t ) ( MaxSpot - MinSpot + 1 );
+
+    _M_sliceCount = ( Count + _sM_sliceSize - 1 ) / _sM_sliceSize;
+
+    if ( KLockMake ( & _M_lock ) != 0 || KConditionMake ( & _M_cond ) != 0 ) {
+        KLockRelease ( _M_lock );
+        throw ErrorMsg ( "__Dumper: can not make lock" );
+    }
+
+    _M_slices . resize ( TheArgs . threads () * 2 );
+    for ( size_t llp = 0; llp < _M_slices . size (); llp ++ ) {
+        _M_slices [ llp ] . Out = NULL;
+        _M_slices [ llp ] . Ready = false;
+    }
+}   /* __Dumper :: __Dumper () */
+
+__Dumper :: ~__Dumper ()
+{
+    for ( size_t llp = 0; llp < _M_slices . size (); llp ++ ) {
+        delete _M_slices [ llp ] . Out;
+        _M_slices [ llp ] . Out = NULL;
+    }
+
+    KConditionRelease ( _M_cond );
+    KLockRelease ( _M_lock );
+}   /* __Dumper :: ~__Dumper () */
+
+void
+__Dumper :: __fail ( const String & Message )
+{
+    KLockAcquire ( _M_lock );
+    if ( ! _M_failed ) {
+        _M_failed = true;
+        _M_message = Message;
+    }
+    KConditionBroadcast ( _M_cond );
+    KLockUnlock ( _M_lock );
+}   /* __Dumper :: __fail () */
+
+rc_t CC
+__Dumper :: __worker ( const KThread *, void * Data )
+{
+    __Dumper * Dumper = ( __Dumper * ) Data;
+
+    try {
+        Dumper -> __work ();
+    }
+    catch ( std :: exception & E ) {
+        Dumper -> __fail ( E . what () );
+    }
+    catch ( ... ) {
+        Dumper -> __fail ( "UNKNOWN exception in worker thread" );
+    }
 
-    uint64_t __l = Bases . size ();
+    return 0;
+}   /* __Dumper :: __worker () */
 
-        /*)  First, we are doing base header
+void
+__Dumper :: __work ()
+{
+        /*) Every thread gets it's own collection and filters
          (*/
-    kout << '>'
-        << CollectionName
-        << '.'
-        << SpotId
-        << ' '
-        << ReadName
-        << " length="
-        << __l
-        << '\n'
-        ;
-
-        /*)  Second is going base itself by width
+    ReadCollection RCol = ncbi :: NGS :: openReadCollection ( _M_accession );
+
+    AFilters Filters ( _M_args . accession () );
+    setupFilters ( Filters, _M_args );
+
+    uint64_t Window = _M_slices . size ();
+
+    while ( true ) {
+        uint64_t Slice;
+
+        KLockAcquire ( _M_lock );
+        while ( ! _M_failed
+                && _M_next < _M_sliceCount
+                && _M_written + Window <= _M_next
+        ) {
+            KConditionWait ( _M_cond, _M_lock );
+        }
+        if ( _M_failed || _M_sliceCount <= _M_next ) {
+            KLockUnlock ( _M_lock );
+            break;
+        }
+        Slice = _M_next ++;
+        KLockUnlock ( _M_lock );
+
+        __dumpSlice ( RCol, Slice, Filters, * _M_slices [ Slice % Window ] . Out );
+
+        KLockAcquire ( _M_lock );
+        _M_slices [ Slice % Window ] . Ready = true;
+        KConditionBroadcast ( _M_cond );
+        KLockUnlock ( _M_lock );
+    }
+
+    KLockAcquire ( _M_lock );
+    _M_filters -> merge ( Filters );
+    KLockUnlock ( _M_lock );
+}   /* __Dumper :: __work () */
+
+void
+__Dumper :: __dumpSlice (
+                    ReadCollection & RCol,
+                    uint64_t Slice,
+                    AFilters & Filters,
+                    AWriter & Out
+)
+{
+    uint64_t Skip = Slice * _sM_sliceSize;
+    int64_t First = _M_minSpot + ( int64_t ) Skip;
+    uint64_t Count = std :: min (
+                            _sM_sliceSize,
+                            ( uint64_t ) ( _M_maxSpot - First + 1 )
+                            );
+
+        /*) Spots are numbered the way single iterator does
          (*/
+    int64_t SpotId = _M_args . minSpotId () + ( int64_t ) Skip;
 
-    uint64_t __p = 0;
-    const char * __s = Bases . data ();
+    ReadIterator Iterator = RCol . getReadRange ( First, Count, Read :: all );
 
+    uint64_t Lengths [ _sM_batchSize ];
+    bool Pass [ _sM_batchSize ];
+    size_t Offsets [ _sM_batchSize + 1 ];
+    bool More = true;
 
-    if ( 0 < Width ) {
-        while ( __p < __l ) {
-            uint64_t __t = std :: min ( Width, __l - __p );
+    while ( More ) {
+        size_t Qty = 0;
 
-            kout << std :: string ( __s, ( std :: string :: size_type ) __p, ( std :: string :: size_type ) __t ) << "\n" ;
+        while ( Qty < _sM_batchSize && ( More = Iterator . nextRead () ) ) {
+            StringRef Bases = Iterator . getReadBases ();
+
+            Offsets [ Qty ] = Out . size ();
+            Lengths [ Qty ] = Bases . size ();
+
+            if ( _M_args . fastaDump () ) {
+                Out . writeFastA (
+                                SpotId,
+                                Iterator . getReadName (),
+                                Bases,
+                                _M_args . fastaDumpWidth ()
+                                );
+            }
+            else {
+                Out . writeFastQ (
+                                SpotId,
+                                Iterator . getReadName (),
+                                Bases,
+                                Iterator . getReadQualities ()
+                                );
+            }
 
-            __p += __t;
+            SpotId ++;
+            Qty ++;
         }
+
+        if ( Qty == 0 ) {
+            break;
+        }
+
+        Offsets [ Qty ] = Out . size ();
+
+            /*) Dropping records of rejected reads
+             (*/
+        Filters . checkLengths ( Lengths, Pass, Qty );
+
+        char * Data = Out . data ();
+        size_t To = Offsets [ 0 ];
+
+        for ( size_t llp = 0; llp < Qty; llp ++ ) {
+            size_t Size = Offsets [ llp + 1 ] - Offsets [ llp ];
+
+            if ( Pass [ llp ] ) {
+                if ( To != Offsets [ llp ] ) {
+                    memmove ( Data + To, Data + Offsets [ llp ], Size );
+                }
+                To += Size;
+            }
+        }
+
+        Out . resize ( To );
     }
-    else {
-        kout << __s << "\n" ;
+}   /* __Dumper :: __dumpSlice () */
+
+void
+__Dumper :: run ( AWriter & Writer, AFilters & Filters )
+{
+    _M_filters = & Filters;
+
+    for ( size_t llp = 0; llp < _M_slices . size (); llp ++ ) {
+        _M_slices [ llp ] . Out = new AWriter ( _M_collectionName, false );
     }
 
-}   /* dumpFastA () */
+    uint64_t Qty = std :: min ( ( uint64_t ) _M_args . threads (), _M_sliceCount );
+    for ( uint64_t llp = 0; llp < Qty; llp ++ ) {
+        KThread * Thread = NULL;
+
+        if ( KThreadMake ( & Thread, __worker, this ) != 0 ) {
+            __fail ( "run: can not start worker thread" );
+            break;
+        }
+        _M_threads . push_back ( Thread );
+    }
+
+    uint64_t Window = _M_slices . size ();
+
+    try {
+        for ( uint64_t Slice = 0; Slice < _M_sliceCount; Slice ++ ) {
+            __Slice & S = _M_slices [ Slice % Window ];
+
+            KLockAcquire ( _M_lock );
+            while ( ! _M_failed && ! S . Ready ) {
+                KConditionWait ( _M_cond, _M_lock );
+            }
+            bool Failed = _M_failed;
+            KLockUnlock ( _M_lock );
+
+            if ( Failed ) {
+                break;
+            }
+
+            Writer . write ( S . Out -> data (), S . Out -> size () );
+            S . Out -> resize ( 0 );
+
+            KLockAcquire ( _M_lock );
+            S . Ready = false;
+            _M_written ++;
+            KConditionBroadcast ( _M_cond );
+            KLockUnlock ( _M_lock );
+        }
+    }
+    catch ( std :: exception & E ) {
+        __fail ( E . what () );
+    }
+
+    for ( size_t llp = 0; llp < _M_threads . size (); llp ++ ) {
+        KThreadWait ( _M_threads [ llp ], NULL );
+        KThreadRelease ( _M_threads [ llp ] );
+    }
+    _M_threads . clear ();
+
+    if ( _M_failed ) {
+        throw ErrorMsg ( _M_message );
+    }
+}   /* __Dumper :: run () */
 
 /*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
 /*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
@@ -608,30 +915,53 @@ run ( const DumpArgs & TheArgs )
         maxSpot = Id;
     }
 
-    ReadIterator Iterator = RCol.getReadRange (
-                                            minSpot,
-                                            maxSpot - minSpot + 1,
-                                            TheArgs . category ()
-                                            );
-
     ngs :: String ReadCollectionName = RCol.getName ();
 
     AFilters Filters ( TheArgs . accession () );
     setupFilters ( Filters, TheArgs );
 
-    for ( int64_t llp = TheArgs . minSpotId () ; Iterator.nextRead (); llp ++ ) {
+    AWriter Writer ( ReadCollectionName );
+
+        /*) Slices can be numbered up front only if every read
+         (  in the range comes out of the iterator
+         */
+    bool Parallel = 1 < TheArgs . threads ()
+                    && TheArgs . category () == Read :: all
+                    && __Dumper :: _sM_sliceSize < ( uint64_t ) ( maxSpot - minSpot + 1 )
+                    ;
+
+    if ( Parallel ) {
+        __Dumper Dumper (
+                        TheArgs,
+                        Acc,
+                        ReadCollectionName,
+                        minSpot,
+                        maxSpot
+                        );
 
-        if ( Filters . checkIt ( Iterator ) ) {
-            if ( TheArgs . fastaDump () ) {
-                dumpFastA ( llp, ReadCollectionName, Iterator, TheArgs . fastaDumpWidth () );
-            }
-            else { 
-                dumpFastQ ( llp, ReadCollectionName, Iterator );
+        Dumper . run ( Writer, Filters );
+    }
+    else {
+        ReadIterator Iterator = RCol.getReadRange (
+                                                minSpot,
+                                                maxSpot - minSpot + 1,
+                                                TheArgs . category ()
+                                                );
+
+        for ( int64_t llp = TheArgs . minSpotId () ; Iterator.nextRead (); llp ++ ) {
+
+            if ( Filters . checkIt ( Iterator ) ) {
+                if ( TheArgs . fastaDump () ) {
+                    dumpFastA ( llp, Writer, Iterator, TheArgs . fastaDumpWidth () );
+                }
+                else { 
+                    dumpFastQ ( llp, Writer, Iterator );
+                }
             }
         }
     }
 
-    kout.flush ();
+    Writer . flush ();
 
     std :: cerr << Filters . report ( TheArgs . legacyReport () );
 
@@ -61,6 +61,12 @@ AFilter :: checkIt ( const ReadIterator & pos ) const
     throw ErrorMsg ( ":: checkIt() - is not implemented for class" );
 }   /* AFilter :: checkIt () */
 
+void
+AFilter :: checkLengths ( const uint64_t *, bool *, size_t ) const
+{
+    throw ErrorMsg ( ":: checkLengths() - is not implemented for class" );
+}   /* AFilter :: checkLengths () */
+
 String
 AFilter :: report () const
 {
@@ -100,6 +106,11 @@ public :
     __NReadFilter ( const String & source );
 
     bool checkIt ( const ReadIterator & Rit ) const;
+    void checkLengths (
+                    const uint64_t * Lengths,
+                    bool * Pass,
+                    size_t Count
+                    ) const;
 
     String report () const;
 
@@ -120,6 +131,14 @@ __NReadFilter :: checkIt ( const ReadIterator & ) const
     return true;
 }   /* __NReadFilter :: checkIt () */ 
 
+void
+__NReadFilter :: checkLengths ( const uint64_t *, bool *, size_t Count ) const
+{
+    for ( size_t llp = 0; llp < Count; llp ++ ) {
+        reject ();
+    }
+}   /* __NReadFilter :: checkLengths () */
+
 String
 __NReadFilter :: report () const
 {
@@ -145,6 +164,11 @@ public :
     __SpotLengthFilter ( uint64_t MinLength );
 
     bool checkIt ( const ReadIterator & Rit ) const;
+    void checkLengths (
+                    const uint64_t * Lengths,
+                    bool * Pass,
+                    size_t Count
+                    ) const;
 
 protected :
     String reason () const;
@@ -171,6 +195,22 @@ __SpotLengthFilter :: checkIt ( const ReadIterator & Rit ) const
     return true;
 }   /* __SpotLengthFilter :: checkIt () */ 
 
+void
+__SpotLengthFilter :: checkLengths (
+                                const uint64_t * Lengths,
+                                bool * Pass,
+                                size_t Count
+) const
+{
+    for ( size_t llp = 0; llp < Count; llp ++ ) {
+        if ( Pass [ llp ] && Lengths [ llp ] < _M_minLength ) {
+            Pass [ llp ] = false;
+
+            reject ();
+        }
+    }
+}   /* __SpotLengthFilter :: checkLengths () */
+
 String
 __SpotLengthFilter :: reason () const
 {
@@ -259,6 +299,48 @@ AFilters :: __checkIt ( const ReadIterator & Rit ) const
     return true;
 }   /* AFilters :: __checkIt () */
 
+void
+AFilters :: checkLengths (
+                        const uint64_t * Lengths,
+                        bool * Pass,
+                        size_t Count
+) const
+{
+    for ( size_t llp = 0; llp < Count; llp ++ ) {
+        Pass [ llp ] = true;
+    }
+
+    for ( TVecCI __b = _M_filters . begin (); __b != _M_filters . end (); __b ++ ) {
+        AFilter * __f = * __b;
+
+        if ( __f != NULL ) {
+            __f -> checkLengths ( Lengths, Pass, Count );
+        }
+    }
+
+    for ( size_t llp = 0; llp < Count; llp ++ ) {
+        if ( Pass [ llp ] ) {
+            _M_confirmed ++;
+        }
+    }
+}   /* AFilters :: checkLengths () */
+
+void
+AFilters :: merge ( const AFilters & Other )
+{
+    if ( _M_filters . size () != Other . _M_filters . size () ) {
+        throw ErrorMsg ( "merge: Filters are set up differently" );
+    }
+
+    for ( size_t llp = 0; llp < _M_filters . size (); llp ++ ) {
+        if ( _M_filters [ llp ] != NULL && Other . _M_filters [ llp ] != NULL ) {
+            _M_filters [ llp ] -> merge ( * Other . _M_filters [ llp ] );
+        }
+    }
+
+    _M_confirmed += Other . _M_confirmed;
+}   /* AFilters :: merge () */
+
 void
 AFilters :: addFilter ( AFilter * Flt )
 {
@@ -52,8 +52,22 @@ public :
 
     virtual bool checkIt ( const ReadIterator & pos ) const = 0;
 
+        /* Batch version of 'checkIt()' : works on read lengths only,
+         * and checks only entries which are still 'true' in Pass
+         */
+    virtual void checkLengths (
+                            const uint64_t * Lengths,
+                            bool * Pass,
+                            size_t Count
+                            ) const;
+
     virtual String report () const;
 
+        /* Adds statistics from same kind filter
+         */
+    inline void merge ( const AFilter & Other )
+                { _M_rejected += Other . _M_rejected; };
+
 protected :
         /* That method should be called from 'checkIt()' for stat
          */
@@ -79,6 +93,19 @@ public :
 
     bool checkIt ( const ReadIterator & pos ) const;
 
+        /* Sets Pass for a batch of reads by their lengths
+         */
+    void checkLengths (
+                    const uint64_t * Lengths,
+                    bool * Pass,
+                    size_t Count
+                    ) const;
+
+        /* Adds statistics from filters set up the same way,
+         * f.e. ones used on other threads
+         */
+    void merge ( const AFilters & Other );
+
         /* Adds new user_defined filter ...
          */
     void addFilter ( AFilter * pFilter );
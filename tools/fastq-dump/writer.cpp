@@ -0,0 +1,371 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include <sysalloc.h>
+
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
+#include <klib/rc.h>
+#include <kfs/file.h>
+#include <klib/printf.h>
+
+#include <string.h>
+
+#include "writer.hpp"
+
+using namespace ngs;
+
+/*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
+/*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
+
+static const size_t _sM_bufferSize = 1024 * 1024 * 4;
+
+static
+void
+__throwRc ( const char * What, rc_t Rc )
+{
+    char Msg [ 4096 ];
+    size_t Len = 0;
+
+    if ( string_printf ( Msg, sizeof ( Msg ), & Len, "%s: %R", What, Rc ) != 0 ) {
+        throw ErrorMsg ( What );
+    }
+
+    throw ErrorMsg ( Msg );
+}   /* __throwRc () */
+
+static
+size_t
+__digits ( uint64_t Value )
+{
+    size_t Ret = 1;
+
+    while ( 10 <= Value ) {
+        Value /= 10;
+        Ret ++;
+    }
+
+    return Ret;
+}   /* __digits () */
+
+static
+size_t
+__int64Size ( int64_t Value )
+{
+    return Value < 0
+            ? 1 + __digits ( - ( uint64_t ) Value )
+            : __digits ( ( uint64_t ) Value )
+            ;
+}   /* __int64Size () */
+
+    /*) Writes digits from the end, Pos should point right after
+     (  the last one, returns the start
+     */
+static
+char *
+__putUint64 ( char * Pos, uint64_t Value )
+{
+    do {
+        * -- Pos = ( char ) ( '0' + Value % 10 );
+        Value /= 10;
+    } while ( Value != 0 );
+
+    return Pos;
+}   /* __putUint64 () */
+
+static
+char *
+__putInt64 ( char * Pos, int64_t Value )
+{
+    size_t Size = __int64Size ( Value );
+    char * End = Pos + Size;
+
+    if ( Value < 0 ) {
+        * Pos = '-';
+        __putUint64 ( End, - ( uint64_t ) Value );
+    }
+    else {
+        __putUint64 ( End, ( uint64_t ) Value );
+    }
+
+    return End;
+}   /* __putInt64 () */
+
+static
+char *
+__put ( char * Pos, const char * Data, size_t Size )
+{
+    memcpy ( Pos, Data, Size );
+
+    return Pos + Size;
+}   /* __put () */
+
+static const char _sM_length [] = " length=";
+
+/*))
+ //     AWriter
+((*/
+AWriter :: AWriter ( const String & CollectionName, bool ToStdout )
+:   _M_collectionName ( CollectionName )
+,   _M_file ( NULL )
+,   _M_filePos ( 0 )
+,   _M_buffer ( NULL )
+,   _M_bufferSize ( _sM_bufferSize )
+,   _M_bufferUsed ( 0 )
+{
+    if ( ToStdout ) {
+        rc_t RCt = KFileMakeStdOut ( & _M_file );
+        if ( RCt != 0 ) {
+            __throwRc ( "AWriter: can not open stdout", RCt );
+        }
+    }
+
+    _M_buffer = new char [ _M_bufferSize ];
+}   /* AWriter :: AWriter () */
+
+AWriter :: ~AWriter ()
+{
+    try {
+        flush ();
+    }
+    catch ( ... ) {
+        /* nothing to do here */
+    }
+
+    delete [] _M_buffer;
+    _M_buffer = NULL;
+
+    KFileRelease ( _M_file );
+    _M_file = NULL;
+}   /* AWriter :: ~AWriter () */
+
+void
+AWriter :: flush ()
+{
+    if ( _M_file != NULL && _M_bufferUsed != 0 ) {
+        size_t Writ = 0;
+
+        rc_t RCt = KFileWriteAll (
+                                _M_file,
+                                _M_filePos,
+                                _M_buffer,
+                                _M_bufferUsed,
+                                & Writ
+                                );
+        if ( RCt == 0 && Writ != _M_bufferUsed ) {
+            RCt = RC ( rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete );
+        }
+
+        _M_filePos += Writ;
+        _M_bufferUsed = 0;
+
+        if ( RCt != 0 ) {
+            __throwRc ( "AWriter: can not write output", RCt );
+        }
+    }
+}   /* AWriter :: flush () */
+
+void
+AWriter :: __grow ( size_t Size )
+{
+    size_t NewSize = _M_bufferSize;
+
+    while ( NewSize < Size ) {
+        NewSize *= 2;
+    }
+
+    char * NewBuffer = new char [ NewSize ];
+
+    memcpy ( NewBuffer, _M_buffer, _M_bufferUsed );
+    delete [] _M_buffer;
+
+    _M_buffer = NewBuffer;
+    _M_bufferSize = NewSize;
+}   /* AWriter :: __grow () */
+
+char *
+AWriter :: __reserve ( size_t Size )
+{
+    if ( _M_bufferSize - _M_bufferUsed < Size ) {
+        flush ();
+
+            /*) Record does not fit in an empty buffer, or there
+             (  is no file to flush to
+             */
+        if ( _M_bufferSize - _M_bufferUsed < Size ) {
+            __grow ( _M_bufferUsed + Size );
+        }
+    }
+
+    return _M_buffer + _M_bufferUsed;
+}   /* AWriter :: __reserve () */
+
+void
+AWriter :: write ( const char * Data, size_t Size )
+{
+    if ( _M_file != NULL && _M_bufferSize <= Size ) {
+            /*) Too big to copy, going straight to the file
+             (*/
+        flush ();
+
+        size_t Writ = 0;
+
+        rc_t RCt = KFileWriteAll ( _M_file, _M_filePos, Data, Size, & Writ );
+        if ( RCt == 0 && Writ != Size ) {
+            RCt = RC ( rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete );
+        }
+
+        _M_filePos += Writ;
+
+        if ( RCt != 0 ) {
+            __throwRc ( "AWriter: can not write output", RCt );
+        }
+
+        return;
+    }
+
+    memcpy ( __reserve ( Size ), Data, Size );
+    _M_bufferUsed += Size;
+}   /* AWriter :: write () */
+
+size_t
+AWriter :: __deflineSize (
+                    int64_t SpotId,
+                    const StringRef & ReadName,
+                    size_t Length
+) const
+{
+        /*)  Tag, '.', ' ' and final '\n'
+         (*/
+    return 4
+            + _M_collectionName . size ()
+            + __int64Size ( SpotId )
+            + ReadName . size ()
+            + sizeof ( _sM_length ) - 1
+            + __digits ( Length )
+            ;
+}   /* AWriter :: __deflineSize () */
+
+char *
+AWriter :: __defline (
+                    char * Pos,
+                    char Tag,
+                    int64_t SpotId,
+                    const StringRef & ReadName,
+                    size_t Length
+) const
+{
+    * Pos ++ = Tag;
+    Pos = __put ( Pos, _M_collectionName . data (), _M_collectionName . size () );
+    * Pos ++ = '.';
+    Pos = __putInt64 ( Pos, SpotId );
+    * Pos ++ = ' ';
+    Pos = __put ( Pos, ReadName . data (), ReadName . size () );
+    Pos = __put ( Pos, _sM_length, sizeof ( _sM_length ) - 1 );
+    Pos += __digits ( Length );
+    __putUint64 ( Pos, Length );
+    * Pos ++ = '\n';
+
+    return Pos;
+}   /* AWriter :: __defline () */
+
+void
+AWriter :: writeFastQ (
+                    int64_t SpotId,
+                    const StringRef & ReadName,
+                    const StringRef & Bases,
+                    const StringRef & Qualities
+)
+{
+    size_t Size = __deflineSize ( SpotId, ReadName, Bases . size () )
+                + Bases . size () + 1
+                + __deflineSize ( SpotId, ReadName, Qualities . size () )
+                + Qualities . size () + 1
+                ;
+
+    char * Start = __reserve ( Size );
+    char * Pos = Start;
+
+    Pos = __defline ( Pos, '@', SpotId, ReadName, Bases . size () );
+    Pos = __put ( Pos, Bases . data (), Bases . size () );
+    * Pos ++ = '\n';
+
+    Pos = __defline ( Pos, '+', SpotId, ReadName, Qualities . size () );
+    Pos = __put ( Pos, Qualities . data (), Qualities . size () );
+    * Pos ++ = '\n';
+
+    _M_bufferUsed += Pos - Start;
+}   /* AWriter :: writeFastQ () */
+
+void
+AWriter :: writeFastA (
+                    int64_t SpotId,
+                    const StringRef & ReadName,
+                    const StringRef & Bases,
+                    uint64_t Width
+)
+{
+    size_t Length = Bases . size ();
+    size_t Lines = 1;
+
+    if ( 0 < Width ) {
+        Lines = ( size_t ) ( ( Length + Width - 1 ) / Width );
+    }
+
+    size_t Size = __deflineSize ( SpotId, ReadName, Length )
+                + Length + Lines
+                ;
+
+    char * Start = __reserve ( Size );
+    char * Pos = Start;
+
+    Pos = __defline ( Pos, '>', SpotId, ReadName, Length );
+
+    if ( 0 < Width ) {
+            /*)  Wrapping in place, line by line
+             (*/
+        const char * Src = Bases . data ();
+        size_t Left = Length;
+
+        while ( 0 < Left ) {
+            size_t Line = ( size_t ) ( Width < Left ? Width : Left );
+
+            Pos = __put ( Pos, Src, Line );
+            * Pos ++ = '\n';
+
+            Src += Line;
+            Left -= Line;
+        }
+    }
+    else {
+        Pos = __put ( Pos, Bases . data (), Length );
+        * Pos ++ = '\n';
+    }
+
+    _M_bufferUsed += Pos - Start;
+}   /* AWriter :: writeFastA () */
@@ -0,0 +1,117 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_outpost_writer_
+#define _h_outpost_writer_
+
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
+#include <ngs/ErrorMsg.hpp>
+#include <ngs/StringRef.hpp>
+
+struct KFile;
+
+/*)))   Namespace
+ (((*/
+namespace ngs {
+
+/*))
+ //  Formats FASTQ/FASTA records straight into one output buffer
+ //  and hands full buffers to the stdout KFile. Each record is
+ //  sized first, so it never gets split between two writes.
+ //  Without stdout the buffer just grows, and the owner takes
+ //  the formatted records with data () and size ().
+((*/
+class AWriter {
+public :
+    AWriter ( const String & CollectionName, bool ToStdout = true );
+    ~AWriter ();
+
+    void writeFastQ (
+                    int64_t SpotId,
+                    const StringRef & ReadName,
+                    const StringRef & Bases,
+                    const StringRef & Qualities
+                    );
+
+        /* Width == 0 means no line wrap
+         */
+    void writeFastA (
+                    int64_t SpotId,
+                    const StringRef & ReadName,
+                    const StringRef & Bases,
+                    uint64_t Width
+                    );
+
+        /* Appends already formatted data
+         */
+    void write ( const char * Data, size_t Size );
+
+    void flush ();
+
+    inline char * data () { return _M_buffer; };
+    inline size_t size () const { return _M_bufferUsed; };
+    inline void resize ( size_t Size )
+                { if ( Size < _M_bufferUsed ) _M_bufferUsed = Size; };
+
+private :
+    AWriter ( const AWriter & );
+    AWriter & operator = ( const AWriter & );
+
+    char * __reserve ( size_t Size );
+    void __grow ( size_t Size );
+
+    char * __defline (
+                    char * Pos,
+                    char Tag,
+                    int64_t SpotId,
+                    const StringRef & ReadName,
+                    size_t Length
+                    ) const;
+    size_t __deflineSize (
+                    int64_t SpotId,
+                    const StringRef & ReadName,
+                    size_t Length
+                    ) const;
+
+private :
+    String _M_collectionName;
+
+    KFile * _M_file;
+    uint64_t _M_filePos;
+
+    char * _M_buffer;
+    size_t _M_bufferSize;
+    size_t _M_bufferUsed;
+};  /* class AWriter */
+
+/*)))   Namespace
+ (((*/
+}; /* namespace ngs */
+
+#endif /* _h_outpost_writer_ */
@@ -556,6 +556,23 @@ typedef struct AbsolidFormatterSplitter_struct {
     KDataBuffer* b;
 } AbsolidFormatterSplitter;
 
+/* header and data line assembled in place and written at once */
+static
+rc_t AbsolidFormatterSplitter_WriteRecord(const SRASplitter* cself, const AbsolidFormatterSplitter* self,
+                                          spotid_t spot, size_t head_sz, size_t data_sz)
+{
+    char* d = NULL;
+    rc_t rc = SRASplitter_FileReserve(cself, head_sz + data_sz + 1, &d);
+
+    if( rc == 0 ) {
+        memcpy(d, self->hb->base, head_sz);
+        memcpy(&d[head_sz], self->b->base, data_sz);
+        d[head_sz + data_sz] = '\n';
+        rc = SRASplitter_FileCommit(cself, spot, head_sz + data_sz + 1);
+    }
+    return rc;
+}
+
 static
 rc_t AbsolidFormatterSplitter_Dump(const SRASplitter* cself, spotid_t spot, const readmask_t* readmask)
 {
@@ -600,49 +617,43 @@ rc_t AbsolidFormatterSplitter_Dump(const SRASplitter* cself, spotid_t spot, cons
                 }
                 if( rc == 0 && (rc = SRASplitter_FileActivate(cself, ".csfasta")) == 0 ) {
                     IF_BUF((AbsolidReaderBase(self->reader, readId, self->b->base, KDataBufferBytes(self->b) - 1, &writ)), self->b, writ) {
-                        if( writ > 0 && (rc = SRASplitter_FileWrite(cself, 0, self->hb->base, head_sz)) == 0 ) {
-                            ((char*)(self->b->base))[writ] = '\n';
-                            rc = SRASplitter_FileWrite(cself, spot, self->b->base, writ + 1);
+                        if( writ > 0 ) {
+                            rc = AbsolidFormatterSplitter_WriteRecord(cself, self, spot, head_sz, writ);
                         }
                     }
                 }
                 if( rc == 0 && (rc = SRASplitter_FileActivate(cself, "_QV.qual")) == 0 ) {
                     IF_BUF((AbsolidReaderQuality(self->reader, readId, self->b->base, KDataBufferBytes(self->b) - 1, &writ)), self->b, writ) {
-                        if( writ > 0 && (rc = SRASplitter_FileWrite(cself, 0, self->hb->base, head_sz)) == 0 ) {
-                            ((char*)(self->b->base))[writ] = '\n';
-                            rc = SRASplitter_FileWrite(cself, spot, self->b->base, writ + 1);
+                        if( writ > 0 ) {
+                            rc = AbsolidFormatterSplitter_WriteRecord(cself, self, spot, head_sz, writ);
                         }
                     }
                 }
                 if( rc == 0 && (rc = SRASplitter_FileActivate(cself, "_intensity.ScaledFTC.fasta")) == 0 ) {
                     IF_BUF((AbsolidReaderSignalFTC(self->reader, readId, self->b->base, KDataBufferBytes(self->b) - 1, &writ)), self->b, writ) {
-                        if( writ > 0 && (rc = SRASplitter_FileWrite(cself, 0, self->hb->base, head_sz)) == 0 ) {
-                            ((char*)(self->b->base))[writ] = '\n';
-                            rc = SRASplitter_FileWrite(cself, spot, self->b->base, writ + 1);
+                        if( writ > 0 ) {
+                            rc = AbsolidFormatterSplitter_WriteRecord(cself, self, spot, head_sz, writ);
                         }
                     }
                 }
                 if( rc == 0 && (rc = SRASplitter_FileActivate(cself, "_intensity.ScaledCY3.fasta")) == 0 ) {
                     IF_BUF((AbsolidReaderSignalCY3(self->reader, readId, self->b->base, KDataBufferBytes(self->b) - 1, &writ)), self->b, writ) {
-                        if( writ > 0 && (rc = SRASplitter_FileWrite(cself, 0, self->hb->base, head_sz)) == 0 ) {
-                            ((char*)(self->b->base))[writ] = '\n';
-                            rc = SRASplitter_FileWrite(cself, spot, self->b->base, writ + 1);
+                        if( writ > 0 ) {
+                            rc = AbsolidFormatterSplitter_WriteRecord(cself, self, spot, head_sz, writ);
                         }
                     }
                 }
                 if( rc == 0 && (rc = SRASplitter_FileActivate(cself, "_intensity.ScaledTXR.fasta")) == 0 ) {
                     IF_BUF((AbsolidReaderSignalTXR(self->reader, readId, self->b->base, KDataBufferBytes(self->b) - 1, &writ)), self->b, writ) {
-                        if( writ > 0 && (rc = SRASplitter_FileWrite(cself, 0, self->hb->base, head_sz)) == 0 ) {
-                            ((char*)(self->b->base))[writ] = '\n';
-                            rc = SRASplitter_FileWrite(cself, spot, self->b->base, writ + 1);
+                        if( writ > 0 ) {
+                            rc = AbsolidFormatterSplitter_WriteRecord(cself, self, spot, head_sz, writ);
                         }
                     }
                 }
                 if( rc == 0 && (rc = SRASplitter_FileActivate(cself, "_intensity.ScaledCY5.fasta")) == 0 ) {
                     IF_BUF((AbsolidReaderSignalCY5(self->reader, readId, self->b->base, KDataBufferBytes(self->b) - 1, &writ)), self->b, writ) {
-                        if( writ > 0 && (rc = SRASplitter_FileWrite(cself, 0, self->hb->base, head_sz)) == 0 ) {
-                            ((char*)(self->b->base))[writ] = '\n';
-                            rc = SRASplitter_FileWrite(cself, spot, self->b->base, writ + 1);
+                        if( writ > 0 ) {
+                            rc = AbsolidFormatterSplitter_WriteRecord(cself, self, spot, head_sz, writ);
                         }
                     }
                 }
@@ -907,6 +918,8 @@ rc_t SRADumper_Init(SRADumperFmt* fmt)
     fmt->arg_desc = arg;
     fmt->add_arg = AbsolidDumper_AddArg;
     fmt->get_factory = AbsolidDumper_Factories;
+    /* title header is written only when spot name prefix changes */
+    fmt->single_threaded = true;
     fmt->gzip = true;
     fmt->bzip2 = true;
 
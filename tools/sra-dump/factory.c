@@ -25,28 +25,47 @@
 */
 #include <klib/log.h>
 #include <klib/out.h>
+#include <klib/printf.h>
 #include <klib/container.h>
 #include <kfs/directory.h>
-#include <kfs/buffile.h>
 #include <kfs/gzip.h>
 #include <kfs/bzip.h>
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <ctype.h>
-#include <time.h>
 #include <os-native.h>
 #include <sysalloc.h>
+#if ! WINDOWS
+#include <sys/resource.h>
+#endif
+
+#include <zlib.h>
+#include <bzlib.h>
 
 #include "factory.h"
 #include "debug.h"
 
 #define DUMPER_MAX_KEY_LENGTH 63
 #define DUMPER_MAX_TREE_DEPTH 100
-#define DUMPER_MAX_OPEN_FILES 100
+/* file descriptors left for tables, libraries and stdio when pool size is derived from RLIMIT_NOFILE */
+#define DUMPER_RESERVED_FDS 256
+#define DUMPER_MIN_OPEN_FILES 16
+#define DUMPER_DEF_OPEN_FILES 100
+/* every open file holds OUTPUT_BUFFER_SIZE arena */
+#define DUMPER_MAX_OPEN_FILES 1024
+#define DUMPER_INIT_BUCKETS 256
 
 #define OUTPUT_BUFFER_SIZE ( 128 * 1024 )
+/* bzip2 files: one member per arena, filling the 900k block of level 9 */
+#define BZIP2_BUFFER_SIZE ( 900 * 1000 )
+#define COMPRESS_MAX_THREADS 32
 
 uint32_t nreads_max = 0;
 uint32_t quality_N_limit = 0;
@@ -54,17 +73,40 @@ bool g_legacy_report = false;
 
 typedef struct SRASplitterFile_struct {
     SLNode dad;
+    /* position in list of open files, least recently used first */
+    DLNode lru;
+    /* chain in registry bucket */
+    struct SRASplitterFile_struct* next;
+    uint32_t hash;
     char* key;
     KDirectory* dir;
     char* name;
     KFile* file;
-    time_t opened;
+    /* logical end of file, includes bytes still sitting in arena */
     uint64_t pos;
+    /* physical end of compressed file */
+    uint64_t zpos;
+    /* records are assembled here and written out in OUTPUT_BUFFER_SIZE blocks,
+       holds data from pos - used to pos; while file is closed it is a smaller
+       pending buffer, file is reopened only when it fills up */
+    char* arena;
+    size_t arena_sz;
+    size_t used;
     /* keep track of number of spots written to file */
     spotid_t curr_spot;
     uint64_t spot_qty;
 } SRASplitterFile;
 
+/* list of keys to construct a path */
+typedef struct SRASplitterPath_struct {
+    int tail; /* count of elements in path array */
+    int len; /* cumulative length of path in array */
+    const char* path[DUMPER_MAX_TREE_DEPTH];
+    char key_buf[DUMPER_MAX_TREE_DEPTH * (DUMPER_MAX_KEY_LENGTH + 3) + 10];
+} SRASplitterPath;
+
+typedef struct SRASplitterZip_struct SRASplitterZip;
+
 typedef struct SRASplitterFiler_struct {
     /* TBD - reorder structure to avoid premature ageing of compiler and CPU */
     char* prefix;
@@ -74,18 +116,25 @@ typedef struct SRASplitterFiler_struct {
     bool do_gzip;
     bool do_bzip2;
     const char* arc_extension;
+    /* compresses output if do_gzip or do_bzip2 */
+    SRASplitterZip* zip;
     KDirectory* dir;
 
-    /* TBD - this should be a BSTree */
+    /* all files in order of creation */
     SLList files;
-
-    /* list of keys to construct a path */
-    int path_tail; /* count of elements in path array */
-    int path_len; /* cumulative length of path in array */
-    const char* path[DUMPER_MAX_TREE_DEPTH];
-    char key_buf[DUMPER_MAX_TREE_DEPTH * (DUMPER_MAX_KEY_LENGTH + 3) + 10];
-    /* holds opened files */
-    SRASplitterFile* open[DUMPER_MAX_OPEN_FILES];
+    /* same files hashed by key */
+    SRASplitterFile** bucket;
+    uint32_t buckets;
+    uint32_t qty;
+
+    SRASplitterPath path;
+    /* opened files, least recently used first */
+    DLList lru;
+    uint32_t open_qty;
+    uint32_t max_open;
+    size_t pending_sz;
+    /* size of arena of an open file */
+    size_t arena_sz;
     /* keep track of number of spots written to file */
     spotid_t curr_spot;
     uint64_t spot_qty;
@@ -93,18 +142,444 @@ typedef struct SRASplitterFiler_struct {
 
 SRASplitterFiler* g_filer = NULL;
 
+/* ### Block compression ##################################################### */
+
+/* compressed output is a series of independent gzip members (or bzip2 streams), one per arena
+   (128K for gzip, 900K for bzip2 so that level 9 gets its full block),
+   so arenas can be compressed in parallel and a file evicted from the open set
+   can be reopened later and appended to, standard tools decompress such files as a whole
+ */
+
+typedef struct SRASplitterZipJob_struct {
+    SRASplitterFile* file;
+    char* src;
+    size_t src_sz;
+    size_t src_cap;
+    char* dst;
+    size_t dst_sz;
+    size_t dst_cap;
+    bool done;
+    rc_t rc;
+} SRASplitterZipJob;
+
+struct SRASplitterZip_struct {
+    bool bzip2;
+    uint32_t threads;
+    KThread* thread[COMPRESS_MAX_THREADS];
+    KLock* lock;
+    KCondition* cond;
+    bool quit;
+    /* jobs are used as a ring in order of submission:
+       [head, comp) being compressed or done, [comp, tail) waiting for a thread */
+    uint64_t head;
+    uint64_t comp;
+    uint64_t tail;
+    uint32_t qty;
+    SRASplitterZipJob job[1];
+};
+
+static
+rc_t SRASplitterZip_Compress(bool bzip2, SRASplitterZipJob* j)
+{
+    rc_t rc = 0;
+    /* covers worst case of both deflate and bzip2 */
+    size_t need = j->src_sz + j->src_sz / 100 + 1024;
+
+    if( j->dst_cap < need ) {
+        char* d = realloc(j->dst, need);
+        if( d == NULL ) {
+            return RC(rcExe, rcFile, rcWriting, rcMemory, rcExhausted);
+        }
+        j->dst = d;
+        j->dst_cap = need;
+    }
+    if( bzip2 ) {
+        unsigned int dsz = j->dst_cap;
+        int bz_err = BZ2_bzBuffToBuffCompress(j->dst, &dsz, j->src, j->src_sz, 9, 0, 0);
+        if( bz_err != BZ_OK ) {
+            rc = RC(rcExe, rcFile, rcWriting, rcInterface, rcUnexpected);
+            SRA_DUMP_DBG(3, ("BZ2_bzBuffToBuffCompress: %R %d\n", rc, bz_err));
+        }
+        j->dst_sz = dsz;
+    } else {
+        z_stream z_strm;
+        int z_err;
+
+        memset(&z_strm, 0, sizeof(z_strm));
+        /* 15 + 16: default window, gzip header */
+        if( (z_err = deflateInit2(&z_strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY)) != Z_OK ) {
+            rc = RC(rcExe, rcFile, rcWriting, rcInterface, rcUnexpected);
+            SRA_DUMP_DBG(3, ("deflateInit2: %R %d\n", rc, z_err));
+        } else {
+            z_strm.next_in = (Bytef*)j->src;
+            z_strm.avail_in = j->src_sz;
+            z_strm.next_out = (Bytef*)j->dst;
+            z_strm.avail_out = j->dst_cap;
+            if( (z_err = deflate(&z_strm, Z_FINISH)) != Z_STREAM_END ) {
+                rc = RC(rcExe, rcFile, rcWriting, rcInterface, rcUnexpected);
+                SRA_DUMP_DBG(3, ("deflate(Z_FINISH): %R %d\n", rc, z_err));
+            }
+            j->dst_sz = j->dst_cap - z_strm.avail_out;
+            deflateEnd(&z_strm);
+        }
+    }
+    return rc;
+}
+
+static
+rc_t CC SRASplitterZip_Thread(const KThread* t, void* data)
+{
+    SRASplitterZip* self = data;
+    rc_t rc = KLockAcquire(self->lock);
+
+    while( rc == 0 ) {
+        SRASplitterZipJob* j;
+        while( self->comp == self->tail && !self->quit ) {
+            KConditionWait(self->cond, self->lock);
+        }
+        if( self->comp == self->tail ) {
+            break;
+        }
+        j = &self->job[self->comp++ % self->qty];
+        KLockUnlock(self->lock);
+
+        j->rc = SRASplitterZip_Compress(self->bzip2, j);
+
+        rc = KLockAcquire(self->lock);
+        j->done = true;
+        KConditionBroadcast(self->cond);
+    }
+    if( rc == 0 ) {
+        KLockUnlock(self->lock);
+    }
+    return rc;
+}
+
+/* write out compressed block at the end of its file */
+static
+rc_t SRASplitterZip_WriteOut(SRASplitterZipJob* j)
+{
+    size_t writ = 0;
+    rc_t rc = KFileWriteAll(j->file->file, j->file->zpos, j->dst, j->dst_sz, &writ);
+
+    j->file->zpos += writ;
+    if( rc == 0 && writ != j->dst_sz ) {
+        rc = RC(rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete);
+    }
+    return rc;
+}
+
+/* wait for oldest job and write it out */
+static
+rc_t SRASplitterZip_Retire(SRASplitterZip* self)
+{
+    SRASplitterZipJob* j = &self->job[self->head % self->qty];
+    rc_t rc = KLockAcquire(self->lock);
+
+    if( rc == 0 ) {
+        while( !j->done ) {
+            KConditionWait(self->cond, self->lock);
+        }
+        KLockUnlock(self->lock);
+        if( (rc = j->rc) == 0 ) {
+            rc = SRASplitterZip_WriteOut(j);
+        }
+    }
+    j->done = false;
+    self->head++;
+    return rc;
+}
+
+/* write out all submitted blocks */
+static
+rc_t SRASplitterZip_Drain(SRASplitterZip* self)
+{
+    rc_t rc = 0;
+
+    while( self->head != self->tail ) {
+        rc_t rc2 = SRASplitterZip_Retire(self);
+        rc = rc ? rc : rc2;
+    }
+    return rc;
+}
+
+/* hand file arena over for compression, file gets a spare buffer in exchange */
+static
+rc_t SRASplitterZip_Submit(SRASplitterZip* self, SRASplitterFile* file)
+{
+    rc_t rc = 0;
+    SRASplitterZipJob* j;
+
+    if( self->threads == 0 ) {
+        /* compress in place on caller's thread */
+        j = &self->job[0];
+        j->file = file;
+        j->src = file->arena;
+        j->src_sz = file->used;
+        if( (rc = SRASplitterZip_Compress(self->bzip2, j)) == 0 ) {
+            rc = SRASplitterZip_WriteOut(j);
+        }
+        j->src = NULL;
+        return rc;
+    }
+    if( self->tail - self->head == self->qty ) {
+        rc = SRASplitterZip_Retire(self);
+    }
+    if( rc == 0 ) {
+        char* a;
+        size_t cap;
+
+        j = &self->job[self->tail % self->qty];
+        a = j->src;
+        cap = j->src_cap;
+        j->file = file;
+        j->src = file->arena;
+        j->src_cap = file->arena_sz;
+        j->src_sz = file->used;
+        file->arena = a;
+        file->arena_sz = cap;
+        if( (rc = KLockAcquire(self->lock)) == 0 ) {
+            self->tail++;
+            KConditionBroadcast(self->cond);
+            KLockUnlock(self->lock);
+        }
+    }
+    return rc;
+}
+
+static
+void SRASplitterZip_Release(SRASplitterZip* self)
+{
+    if( self != NULL ) {
+        uint32_t i;
+
+        SRASplitterZip_Drain(self);
+        if( self->threads > 0 && KLockAcquire(self->lock) == 0 ) {
+            self->quit = true;
+            KConditionBroadcast(self->cond);
+            KLockUnlock(self->lock);
+        }
+        for(i = 0; i < self->threads; i++) {
+            KThreadWait(self->thread[i], NULL);
+            KThreadRelease(self->thread[i]);
+        }
+        KConditionRelease(self->cond);
+        KLockRelease(self->lock);
+        for(i = 0; i < self->qty; i++) {
+            free(self->job[i].src);
+            free(self->job[i].dst);
+        }
+        free(self);
+    }
+}
+
+static
+rc_t SRASplitterZip_Make(SRASplitterZip** self, bool bzip2, uint32_t threads)
+{
+    rc_t rc = 0;
+    uint32_t i, qty = threads > 0 ? threads * 2 : 1;
+    SRASplitterZip* obj = calloc(1, sizeof(*obj) + (qty - 1) * sizeof(obj->job[0]));
+
+    if( obj == NULL ) {
+        return RC(rcExe, rcFile, rcConstructing, rcMemory, rcExhausted);
+    }
+    obj->bzip2 = bzip2;
+    obj->qty = qty;
+    if( threads > 0 ) {
+        /* spare buffers to be exchanged with file arenas */
+        for(i = 0; rc == 0 && i < qty; i++) {
+            obj->job[i].src_cap = bzip2 ? BZIP2_BUFFER_SIZE : OUTPUT_BUFFER_SIZE;
+            if( (obj->job[i].src = malloc(obj->job[i].src_cap)) == NULL ) {
+                rc = RC(rcExe, rcFile, rcConstructing, rcMemory, rcExhausted);
+            }
+        }
+        if( rc == 0 && (rc = KLockMake(&obj->lock)) == 0 ) {
+            rc = KConditionMake(&obj->cond);
+        }
+        for(i = 0; rc == 0 && i < threads; i++) {
+            if( (rc = KThreadMake(&obj->thread[obj->threads], SRASplitterZip_Thread, obj)) == 0 ) {
+                obj->threads++;
+            }
+        }
+    }
+    if( rc == 0 ) {
+        *self = obj;
+    } else {
+        SRASplitterZip_Release(obj);
+    }
+    return rc;
+}
+
+/* ### Output files ##################################################### */
+
+static
+rc_t SRASplitterFiler_OpenFile(SRASplitterFile* file, bool initial);
+
+/* write out arena content */
+static
+rc_t SRASplitterFile_Flush(SRASplitterFile* file)
+{
+    rc_t rc = 0;
+
+    if( file->used > 0 && file->file == NULL ) {
+        /* pending output of closed file */
+        rc = SRASplitterFiler_OpenFile(file, false);
+    }
+    if( rc != 0 ) {
+        SRA_DUMP_DBG(5, ("failed to reopen file '%s'\n", file->key));
+    } else if( file->used > 0 && g_filer->zip != NULL ) {
+        rc = SRASplitterZip_Submit(g_filer->zip, file);
+        file->used = 0;
+    } else if( file->used > 0 ) {
+        size_t writ = 0;
+        rc = KFileWriteAll(file->file, file->pos - file->used, file->arena, file->used, &writ);
+        if( rc == 0 && writ != file->used ) {
+            rc = RC(rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete);
+        }
+        file->used = 0;
+    }
+    return rc;
+}
+
+static
+void SRASplitterFile_CountSpot(SRASplitterFile* file, spotid_t spot)
+{
+    if( file->curr_spot != spot && spot != 0 ) {
+        file->curr_spot = spot;
+        file->spot_qty++;
+    }
+    if( g_filer->curr_spot != spot && spot != 0 ) {
+        g_filer->curr_spot = spot;
+        g_filer->spot_qty++;
+    }
+}
+
+/* arena is full: closed file is reopened with full size arena, open one is written out */
+static
+rc_t SRASplitterFile_Spill(SRASplitterFile* file)
+{
+    if( file->file == NULL ) {
+        return SRASplitterFiler_OpenFile(file, false);
+    }
+    return SRASplitterFile_Flush(file);
+}
+
+/* get at least size contiguous bytes at the end of arena */
+static
+rc_t SRASplitterFile_Reserve(SRASplitterFile* file, size_t size, char** buf)
+{
+    rc_t rc = 0;
+
+    if( file->used + size > file->arena_sz && file->file == NULL ) {
+        rc = SRASplitterFiler_OpenFile(file, false);
+    }
+    if( rc == 0 && file->used + size > file->arena_sz ) {
+        if( (rc = SRASplitterFile_Flush(file)) == 0 && size > file->arena_sz ) {
+            /* record does not fit at all, grow arena to fit it */
+            char* a = realloc(file->arena, size);
+            if( a == NULL ) {
+                rc = RC(rcExe, rcFile, rcWriting, rcMemory, rcExhausted);
+            } else {
+                SRA_DUMP_DBG(10, ("\n%s grow arena '%s' from %lu to %lu\n", __func__, file->key, file->arena_sz, size));
+                file->arena = a;
+                file->arena_sz = size;
+            }
+        }
+    }
+    if( rc == 0 ) {
+        *buf = &file->arena[file->used];
+    }
+    return rc;
+}
+
+static
+void SRASplitterFile_Commit(SRASplitterFile* file, spotid_t spot, size_t size)
+{
+    file->used += size;
+    file->pos += size;
+    SRASplitterFile_CountSpot(file, spot);
+}
+
+/* copy data into arena, writing out arena only when it is full */
+static
+rc_t SRASplitterFile_Append(SRASplitterFile* file, spotid_t spot, const void* buf, size_t size)
+{
+    rc_t rc = 0;
+    const char* b = buf;
+    size_t left = size;
+
+    while( rc == 0 && left > 0 ) {
+        size_t q = file->arena_sz - file->used;
+        if( q == 0 ) {
+            rc = SRASplitterFile_Spill(file);
+        } else {
+            if( q > left ) {
+                q = left;
+            }
+            memcpy(&file->arena[file->used], b, q);
+            file->used += q;
+            file->pos += q;
+            b += q;
+            left -= q;
+        }
+    }
+    if( rc == 0 ) {
+        SRASplitterFile_CountSpot(file, spot);
+    }
+    return rc;
+}
+
+/* flush and close open file, arena goes away with it */
+static
+rc_t SRASplitterFile_Close(SRASplitterFile* file)
+{
+    rc_t rc = SRASplitterFile_Flush(file);
+
+    DLListUnlink(&g_filer->lru, &file->lru);
+    g_filer->open_qty--;
+
+    if( g_filer->zip != NULL ) {
+        /* pending blocks refer to the file */
+        rc_t rc2 = SRASplitterZip_Drain(g_filer->zip);
+        rc = rc ? rc : rc2;
+    }
+
+    KFileRelease(file->file);
+    file->file = NULL;
+    free(file->arena);
+    file->arena = NULL;
+    file->arena_sz = 0;
+    return rc;
+}
+
 static
 void CC SRASplitterFiler_WhackFile( SLNode *node, void *data )
 {
     SRASplitterFile* file = (SRASplitterFile*)node;
     bool* d = (bool*)data;
+    rc_t rc;
 
     SRA_DUMP_DBG(5, ("Close file: '%s%s'\n", file->key, g_filer->arc_extension));
+    if( file->file != NULL || file->used > 0 ) {
+        /* may reopen file to write out pending data */
+        if( (rc = SRASplitterFile_Flush(file)) == 0 && g_filer->zip != NULL ) {
+            rc = SRASplitterZip_Drain(g_filer->zip);
+        }
+        if( rc != 0 ) {
+            PLOGERR(klogErr, (klogErr, rc, "writing file '$(s)$(e)'",
+                PLOG_2(PLOG_S(s),PLOG_S(e)), file->key, g_filer->arc_extension));
+        }
+    }
+    if( file->file != NULL ) {
+        DLListUnlink(&g_filer->lru, &file->lru);
+        g_filer->open_qty--;
+    }
     if( file->spot_qty == 0 ) {
         /* truncate file which didn't get actual spots written */
         KFileSetSize(file->file, 0);
     }
     KFileRelease(file->file);
+    free(file->arena);
     if( !*d ) {
         uint64_t sz = ~0;
         if( KDirectoryFileSize(file->dir, &sz, "%s%s", file->name, g_filer->arc_extension) == 0 ) {
@@ -137,6 +612,8 @@ void SRASplitterFiler_Release(void)
 {
     if( g_filer != NULL ) {
         SLListWhack(&g_filer->files, SRASplitterFiler_WhackFile, &g_filer->keep_empty);
+        free(g_filer->bucket);
+        SRASplitterZip_Release(g_filer->zip);
         KFileRelease(g_filer->kf_stdout);
         KDirectoryRelease(g_filer->dir);
         free(g_filer->prefix);
@@ -158,12 +635,12 @@ void SRASplitterFactory_FilerReport(uint64_t* total, uint64_t* biggest_file)
 }
 
 static
-rc_t SRASplitterFiler_PushKey(const char* key)
+rc_t SRASplitterFiler_PushKey(SRASplitterPath* path, const char* key)
 {
-    if( g_filer == NULL || key == NULL ) {
+    if( g_filer == NULL || path == NULL || key == NULL ) {
         return RC(rcExe, rcFile, rcAttaching, rcParam, rcNull);
     }
-    if( g_filer->path_tail == sizeof(g_filer->path) - 1 ) {
+    if( path->tail == sizeof(path->path) / sizeof(path->path[0]) - 1 ) {
         return RC(rcExe, rcFile, rcAttaching, rcDirEntry, rcTooLong);
     }
     if( g_filer->key_as_dir ) {
@@ -172,21 +649,54 @@ rc_t SRASplitterFiler_PushKey(const char* key)
             ++key;
         }
     }
-    g_filer->path[g_filer->path_tail++] = key;
-    g_filer->path_len += strlen(key) + 1;
+    path->path[path->tail++] = key;
+    path->len += strlen(key) + 1;
     return 0;
 }
 
 static
-rc_t SRASplitterFiler_PopKey(void)
+rc_t SRASplitterFiler_PopKey(SRASplitterPath* path)
 {
-    if( g_filer->path_tail == 0 ) {
+    if( path->tail == 0 ) {
         return RC(rcExe, rcFile, rcDetaching, rcDirEntry, rcTooShort);
     }
-    g_filer->path_len -= strlen(g_filer->path[--g_filer->path_tail]) + 1;
+    path->len -= strlen(path->path[--path->tail]) + 1;
     return 0;
 }
 
+static
+void SRASplitterFiler_MakeKey(SRASplitterPath* path)
+{
+    int i;
+    char* key = path->key_buf; /* shortcut */
+
+    if( g_filer->kf_stdout ) {
+        strcpy(key, "stdout");
+    } else {
+        /* prepare the key
+           if key_as_dir true, key will be prefix/path[i]/(path[i+1]..)/suffix
+           otherwise key will be prefix_path[i](_path[i+1]..)_?suffix
+         */
+        key[0] = '\0';
+        for(i = 0; i < path->tail; i++ ) {
+            if( path->path[i][0] == '\0' ) {
+                continue;
+            }
+            if( g_filer->key_as_dir ) {
+                if( i != 0 ) {
+                    strcat(key, "/");
+                }
+                strcat(key, path->path[i]);
+            } else {
+                if( i != 0 && isalnum(path->path[i][0]) ) {
+                    strcat(key, "_");
+                }
+                strcat(key, path->path[i]);
+            }
+        }
+    }
+}
+
 static
 rc_t SRASplitterFiler_OpenFile(SRASplitterFile* file, bool initial)
 {
@@ -195,114 +705,127 @@ rc_t SRASplitterFiler_OpenFile(SRASplitterFile* file, bool initial)
     if( file == NULL || (initial && file->file != NULL) ) {
         rc = RC(rcExe, rcFile, rcOpening, rcParam, rcInvalid);
     } else if( initial || file->file == NULL ) {
-        int i, vacancy = -1;
-        time_t oldest = 0;
-
-        for(i = 0; i < DUMPER_MAX_OPEN_FILES; i++) {
-            if(g_filer->open[i] == NULL ) {
-                vacancy = i;
-                break;
-            }
-            if(g_filer->open[i]->opened < oldest || oldest == 0 ) {
-                oldest = g_filer->open[i]->opened;
-                vacancy = i;
-            }
-        }
-        if( g_filer->open[vacancy] != NULL ) {
-            SRA_DUMP_DBG(5, ("Close file[%i]: %lu '%s%s'\n", vacancy,
-                g_filer->open[vacancy]->opened, g_filer->open[vacancy]->key, g_filer->arc_extension));
-            KFileRelease(g_filer->open[vacancy]->file);
-            g_filer->open[vacancy]->file = NULL;
-            g_filer->open[vacancy] = NULL;
+        while( rc == 0 && g_filer->open_qty >= g_filer->max_open ) {
+            SRASplitterFile* lru = (SRASplitterFile*)((char*)DLListHead(&g_filer->lru) - offsetof(SRASplitterFile, lru));
+            SRA_DUMP_DBG(5, ("Close file: '%s%s'\n", lru->key, g_filer->arc_extension));
+            rc = SRASplitterFile_Close(lru);
         }
-        if( g_filer->kf_stdout ) {
+        if( rc != 0 ) {
+            SRA_DUMP_DBG(5, ("failed to flush least recently used file\n"));
+        } else if( g_filer->kf_stdout ) {
             SRA_DUMP_DBG(5, ("attach to pre-opened stdout: '%s'\n", file->key));
             rc = KFileAddRef(g_filer->kf_stdout);
             file->file = g_filer->kf_stdout;
         } else if( initial ) {
             SRA_DUMP_DBG(5, ("Create file: '%s%s'\n", file->key, g_filer->arc_extension));
-            if( (rc = KDirectoryCreateFile(file->dir, &file->file, false, 0664, kcmInit,
-                                           "%s%s", file->name, g_filer->arc_extension)) == 0 ) {
-                if( g_filer->do_gzip ) {
-                    KFile* gz;
-                    if( (rc = KFileMakeGzipForWrite(&gz, file->file)) == 0 ) {
-                        KFileRelease(file->file);
-                        file->file = gz;
-                    }
-                } else if( g_filer->do_bzip2 ) {
-                    KFile* bz;
-                    if( (rc = KFileMakeBzip2ForWrite(&bz, file->file)) == 0 ) {
-                        KFileRelease(file->file);
-                        file->file = bz;
-                    }
-                }
-            }
+            /* compression is done by g_filer->zip in blocks */
+            rc = KDirectoryCreateFile(file->dir, &file->file, false, 0664, kcmInit,
+                                      "%s%s", file->name, g_filer->arc_extension);
         } else if( file->file == NULL ) {
             SRA_DUMP_DBG(5, ("Reopen file: '%s%s'\n", file->key, g_filer->arc_extension));
-            /* position is rememebered since last time */
-            if( (rc = KDirectoryOpenFileWrite(file->dir, &file->file, false,
-                                              "%s%s", file->name, g_filer->arc_extension)) == 0 ) {
-#if ! SUPPORT_MULTI_SESSION_GZIP_FILES
-                if( g_filer->do_gzip || g_filer->do_bzip2 ) {
-                    /* compressed files cannot (currently) be re-opened until we support multi-session compression */
-                    rc = RC(rcExe, rcFile, rcOpening, rcConstraint, rcViolated);
-                }
-#else
-                if( g_filer->do_gzip ) {
-                    KFile* gz;
-                    if( (rc = KFileMakeGzipForAppend(&gz, file->file)) == 0 ) {
-                        KFileRelease(file->file);
-                        file->file = gz;
-                    }
-                } else if( g_filer->do_bzip2 ) {
-                    KFile* bz;
-                    if( (rc = KFileMakeBzip2ForWrite(&bz, file->file)) == 0 ) {
-                        KFileRelease(file->file);
-                        file->file = bz;
-                    }
-                }
-#endif
-            }
+            /* position is rememebered since last time,
+               compressed file simply gets more blocks appended */
+            rc = KDirectoryOpenFileWrite(file->dir, &file->file, false,
+                                         "%s%s", file->name, g_filer->arc_extension);
         }
-#if OUTPUT_BUFFER_SIZE
-        if( rc == 0 && !g_filer->kf_stdout ) {
-            /* attach buffer */
-            KFile *buf = NULL;
-            if( (rc = KBufFileMakeWrite(&buf, file->file, false, OUTPUT_BUFFER_SIZE)) == 0 ) {
+        if( rc == 0 && file->arena_sz < g_filer->arena_sz ) {
+            /* output is buffered in arena instead of KBufFile, pending data is kept */
+            char* a = realloc(file->arena, g_filer->arena_sz);
+            if( a == NULL ) {
+                rc = RC(rcExe, rcFile, rcOpening, rcMemory, rcExhausted);
                 KFileRelease(file->file);
-                file->file = buf;
+                file->file = NULL;
             } else {
-#if _DEBUGGING
-                /* we only want to see this in debug */
-                PLOGERR(klogErr, (klogErr, rc, "creating buffer for file '$(s)$(e)'",
-                    PLOG_2(PLOG_S(s),PLOG_S(e)), file->key, g_filer->arc_extension));
-#else
-                rc = 0;
-#endif
+                file->arena = a;
+                file->arena_sz = g_filer->arena_sz;
             }
         }
-#endif
         if( rc == 0 ) {
-            g_filer->open[vacancy] = file;
-            file->opened = time(NULL);
-            SRA_DUMP_DBG(5, ("Opened file[%i]: %lu '%s%s'\n",
-                vacancy, file->opened, file->key, g_filer->arc_extension));
+            DLListPushTail(&g_filer->lru, &file->lru);
+            g_filer->open_qty++;
+            SRA_DUMP_DBG(5, ("Opened file %u of %u: '%s%s'\n",
+                g_filer->open_qty, g_filer->max_open, file->key, g_filer->arc_extension));
         }
     }
     return rc;
 }
 
+/* make file current: open file becomes most recently used,
+   closed one just gets pending buffer to collect output unless pending is off */
 static
-bool CC SRASplitterFiler_GetCurrFile_FindByKey( SLNode *node, void *data )
+rc_t SRASplitterFiler_ActivateFile(SRASplitterFile* file)
 {
-    SRASplitterFile** d = (SRASplitterFile**)data;
-    SRASplitterFile* file = (SRASplitterFile*)node;
+    rc_t rc = 0;
 
-    if( strcmp(file->key, g_filer->key_buf) == 0 ) {
-        *d = file;
-        return true;
+    if( file->file != NULL ) {
+        DLListUnlink(&g_filer->lru, &file->lru);
+        DLListPushTail(&g_filer->lru, &file->lru);
+    } else if( g_filer->pending_sz == 0 ) {
+        rc = SRASplitterFiler_OpenFile(file, false);
+    } else if( file->arena == NULL ) {
+        if( (file->arena = malloc(g_filer->pending_sz)) == NULL ) {
+            rc = RC(rcExe, rcFile, rcOpening, rcMemory, rcExhausted);
+        } else {
+            file->arena_sz = g_filer->pending_sz;
+        }
     }
-    return false;
+    return rc;
+}
+
+static
+uint32_t SRASplitterFiler_Hash(const char* key)
+{
+    /* FNV-1a */
+    uint32_t h = 2166136261U;
+
+    while( *key != '\0' ) {
+        h ^= (unsigned char)*key++;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static
+SRASplitterFile* SRASplitterFiler_FindFile(const char* key)
+{
+    uint32_t h = SRASplitterFiler_Hash(key);
+    SRASplitterFile* f = g_filer->buckets ? g_filer->bucket[h & (g_filer->buckets - 1)] : NULL;
+
+    while( f != NULL && (f->hash != h || strcmp(f->key, key) != 0) ) {
+        f = f->next;
+    }
+    return f;
+}
+
+static
+rc_t SRASplitterFiler_AddFile(SRASplitterFile* file)
+{
+    if( g_filer->qty >= g_filer->buckets ) {
+        /* keep chains short: double the table */
+        uint32_t i, n = g_filer->buckets ? g_filer->buckets * 2 : DUMPER_INIT_BUCKETS;
+        SRASplitterFile** b = calloc(n, sizeof(*b));
+
+        if( b == NULL ) {
+            return RC(rcExe, rcFile, rcInserting, rcMemory, rcExhausted);
+        }
+        for(i = 0; i < g_filer->buckets; i++) {
+            while( g_filer->bucket[i] != NULL ) {
+                SRASplitterFile* f = g_filer->bucket[i];
+                g_filer->bucket[i] = f->next;
+                f->next = b[f->hash & (n - 1)];
+                b[f->hash & (n - 1)] = f;
+            }
+        }
+        free(g_filer->bucket);
+        g_filer->bucket = b;
+        g_filer->buckets = n;
+    }
+    file->hash = SRASplitterFiler_Hash(file->key);
+    file->next = g_filer->bucket[file->hash & (g_filer->buckets - 1)];
+    g_filer->bucket[file->hash & (g_filer->buckets - 1)] = file;
+    g_filer->qty++;
+    SLListPushTail(&g_filer->files, &file->dad);
+    return 0;
 }
 
 static
@@ -329,38 +852,15 @@ static
 rc_t SRASplitterFiler_GetCurrFile(const SRASplitterFile** out_file)
 {
     rc_t rc = 0;
-    int i;
-    char* key = g_filer->key_buf; /* shortcut */
-    SRASplitterFile* file = NULL;
-
-    if( out_file == NULL ) {
-        return RC(rcExe, rcFile, rcOpening, rcParam, rcInvalid);
-    } else if( g_filer->kf_stdout ) {
-        strcpy(key, "stdout");
-    } else {
-        /* prepare the key
-           if key_as_dir true, key will be prefix/path[i]/(path[i+1]..)/suffix
-           otherwise key will be prefix_path[i](_path[i+1]..)_?suffix
-         */
-        key[0] = '\0';
-        for(i = 0; i < g_filer->path_tail; i++ ) {
-            if( g_filer->path[i][0] == '\0' ) {
-                continue;
-            }
-            if( g_filer->key_as_dir ) {
-                if( i != 0 ) {
-                    strcat(key, "/");
-                }
-                strcat(key, g_filer->path[i]);
-            } else {
-                if( i != 0 && isalnum(g_filer->path[i][0]) ) {
-                    strcat(key, "_");
-                }
-                strcat(key, g_filer->path[i]);
-            }
-        }
+    int i;
+    char* key = g_filer->path.key_buf; /* shortcut */
+    SRASplitterFile* file = NULL;
+
+    if( out_file == NULL ) {
+        return RC(rcExe, rcFile, rcOpening, rcParam, rcInvalid);
     }
-    if( !SLListDoUntil( &g_filer->files, SRASplitterFiler_GetCurrFile_FindByKey, &file ) ) {
+    SRASplitterFiler_MakeKey(&g_filer->path);
+    if( (file = SRASplitterFiler_FindFile(key)) == NULL ) {
         SRA_DUMP_DBG(5, ("New file: '%s'\n", key));
         file = calloc(1, sizeof(*file));
         key = strdup(key);
@@ -372,10 +872,10 @@ rc_t SRASplitterFiler_GetCurrFile(const SRASplitterFile** out_file)
             file->key = key;
             if( g_filer->key_as_dir ) {
                 KDirectory* sub = g_filer->dir;
-                for(i = 0; rc == 0 && i < (g_filer->path_tail - 1); i++ ) {
-                    if( g_filer->path[i][0] != '\0' ) {
+                for(i = 0; rc == 0 && i < (g_filer->path.tail - 1); i++ ) {
+                    if( g_filer->path.path[i][0] != '\0' ) {
                         char* ndir = NULL;
-                        if( (rc = SRASplitterFiler_FixFSName(g_filer->path[i], &ndir)) == 0 ) {
+                        if( (rc = SRASplitterFiler_FixFSName(g_filer->path.path[i], &ndir)) == 0 ) {
                             if( (rc = KDirectoryCreateDir(sub, 0775, kcmCreate, "%s", ndir)) == 0 ||
                                 (GetRCObject(rc) == ( enum RCObject )rcDirectory && GetRCState(rc) == rcExists) ) {
                                 if( (rc = KDirectoryOpenDirUpdate(sub, &file->dir, true, "%s", ndir)) == 0 ) {
@@ -387,20 +887,22 @@ rc_t SRASplitterFiler_GetCurrFile(const SRASplitterFile** out_file)
                         }
                     }
                 }
-                rc = SRASplitterFiler_FixFSName(&file->key[strlen(file->key) - strlen(g_filer->path[g_filer->path_tail - 1])], &file->name);
+                rc = SRASplitterFiler_FixFSName(&file->key[strlen(file->key) - strlen(g_filer->path.path[g_filer->path.tail - 1])], &file->name);
             } else {
                 file->dir = g_filer->dir;
                 rc = SRASplitterFiler_FixFSName(file->key, &file->name);
             }
             if( rc == 0 && (rc = SRASplitterFiler_OpenFile(file, true)) == 0 ) {
-                SLListPushTail(&g_filer->files, &file->dad);
+                if( (rc = SRASplitterFiler_AddFile(file)) != 0 ) {
+                    SRASplitterFiler_WhackFile(&file->dad, &g_filer->keep_empty);
+                }
             } else {
                 SRASplitterFiler_WhackFile(&file->dad, &g_filer->keep_empty);
             }
         }
     } else {
         SRA_DUMP_DBG(5, ("Curr file key '%s': '%s'\n", key, file->name));
-        rc = SRASplitterFiler_OpenFile(file, false);
+        rc = SRASplitterFiler_ActivateFile(file);
     }
     *out_file = rc ? NULL : file;
     return rc;
@@ -413,19 +915,47 @@ rc_t SRASplitterFactory_FilerPrefix(const char* prefix)
     if( g_filer == NULL ) {
         rc = RC(rcExe, rcFile, rcUpdating, rcSelf, rcNotOpen);
     } else if( prefix == NULL || strcmp(prefix, g_filer->prefix) != 0 ) {
-        if( (rc = SRASplitterFiler_PopKey()) == 0 ) {
+        if( (rc = SRASplitterFiler_PopKey(&g_filer->path)) == 0 ) {
             free(g_filer->prefix);
             g_filer->prefix = strdup(prefix ? prefix : "");
             if( g_filer->prefix == NULL ) {
                 rc = RC(rcExe, rcFile, rcConstructing, rcMemory, rcExhausted);
             } else {
-                rc = SRASplitterFiler_PushKey(g_filer->prefix);
+                rc = SRASplitterFiler_PushKey(&g_filer->path, g_filer->prefix);
             }
         }
     }
     return rc;
 }
 
+/* leave room for everything else in process' descriptor limit */
+static
+uint32_t SRASplitterFiler_DefaultMaxOpen(size_t arena_sz)
+{
+    uint32_t n = DUMPER_DEF_OPEN_FILES;
+#if ! WINDOWS
+    struct rlimit rl;
+
+    if( getrlimit(RLIMIT_NOFILE, &rl) == 0 ) {
+        if( rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur >= DUMPER_RESERVED_FDS + DUMPER_MAX_OPEN_FILES ) {
+            n = DUMPER_MAX_OPEN_FILES;
+        } else if( rl.rlim_cur > DUMPER_RESERVED_FDS + DUMPER_MIN_OPEN_FILES ) {
+            n = rl.rlim_cur - DUMPER_RESERVED_FDS;
+        } else {
+            n = DUMPER_MIN_OPEN_FILES;
+        }
+    }
+#endif
+    /* bigger arenas (bzip2) take no more memory all together than the default ones */
+    if( (uint64_t)n * arena_sz > (uint64_t)DUMPER_MAX_OPEN_FILES * OUTPUT_BUFFER_SIZE ) {
+        n = (uint32_t)((uint64_t)DUMPER_MAX_OPEN_FILES * OUTPUT_BUFFER_SIZE / arena_sz);
+        if( n < DUMPER_MIN_OPEN_FILES ) {
+            n = DUMPER_MIN_OPEN_FILES;
+        }
+    }
+    return n;
+}
+
 rc_t SRASplitterFactory_FilerInit(bool to_stdout, bool gzip, bool bzip2, bool key_as_dir, bool keep_empty, const char* path, ...)
 {
     rc_t rc = 0;
@@ -443,41 +973,29 @@ rc_t SRASplitterFactory_FilerInit(bool to_stdout, bool gzip, bool bzip2, bool ke
         g_filer->do_bzip2 = bzip2;
         g_filer->arc_extension = gzip ? ".gz" : (bzip2 ? ".bz2" : "");
         SLListInit(&g_filer->files);
+        DLListInit(&g_filer->lru);
+        /* stdout is compressed as a stream, its arena is only a buffer */
+        g_filer->arena_sz = bzip2 && !to_stdout ? BZIP2_BUFFER_SIZE : OUTPUT_BUFFER_SIZE;
+        g_filer->max_open = SRASplitterFiler_DefaultMaxOpen(g_filer->arena_sz);
+        g_filer->pending_sz = DUMPER_PENDING_SIZE;
         /* push empty prefix */
         g_filer->prefix = strdup("");
-        if( (rc = SRASplitterFiler_PushKey(g_filer->prefix)) == 0 &&
+        if( (rc = SRASplitterFiler_PushKey(&g_filer->path, g_filer->prefix)) == 0 &&
             (rc = KDirectoryNativeDir(&g_filer->dir)) == 0 ) {
             if( to_stdout ) {
-                if( (rc = KFileMakeStdOut(&g_filer->kf_stdout)) == 0 ) {
-                    KFile *buf = NULL;
+                if( (rc = KFileMakeStdOut(&g_filer->kf_stdout)) == 0 && (gzip || bzip2) ) {
+                    /* stdout is compressed as one stream on caller's thread, as before the block
+                       compression: it is read by pipes which may not expect a multi-member archive */
+                    KFile* z = NULL;
                     if( gzip ) {
-                        KFile* gz;
-                        if( (rc = KFileMakeGzipForWrite(&gz, g_filer->kf_stdout)) == 0 ) {
-                            KFileRelease(g_filer->kf_stdout);
-                            g_filer->kf_stdout = gz;
-                        }
-                    } else if( bzip2 ) {
-                        KFile* bz;
-                        if( (rc = KFileMakeBzip2ForWrite(&bz, g_filer->kf_stdout)) == 0 ) {
-                            KFileRelease(g_filer->kf_stdout);
-                            g_filer->kf_stdout = bz;
-                        }
+                        rc = KFileMakeGzipForWrite(&z, g_filer->kf_stdout);
+                    } else {
+                        rc = KFileMakeBzip2ForWrite(&z, g_filer->kf_stdout);
                     }
-#if OUTPUT_BUFFER_SIZE
-                    if ( rc == 0 ) {
-                        if( (rc = KBufFileMakeWrite(&buf, g_filer->kf_stdout, false, OUTPUT_BUFFER_SIZE)) == 0 ) {
-                            KFileRelease(g_filer->kf_stdout);
-                            g_filer->kf_stdout = buf;
-                        } else {
-#if _DEBUGGING
-                            /* we only want to see this in debug */
-                            LOGERR(klogErr, rc, "creating buffer for stdout");
-#else
-                            rc = 0;
-#endif
-                        }
+                    if( rc == 0 ) {
+                        KFileRelease(g_filer->kf_stdout);
+                        g_filer->kf_stdout = z;
                     }
-#endif
                 }
             } else if( path != NULL ) {
                 va_list args;
@@ -494,15 +1012,309 @@ rc_t SRASplitterFactory_FilerInit(bool to_stdout, bool gzip, bool bzip2, bool ke
                 }
                 va_end(args);
             }
+            if( rc == 0 && (gzip || bzip2) && !to_stdout ) {
+                /* files are multi-member, compressed on caller's thread until told otherwise */
+                rc = SRASplitterZip_Make(&g_filer->zip, bzip2, 0);
+            }
         }
     }
     if( rc != 0 ) {
-        SRASplitterFiler_PopKey();
+        if( g_filer != NULL ) {
+            SRASplitterFiler_PopKey(&g_filer->path);
+        }
         SRASplitterFiler_Release();
     }
     return rc;
 }
 
+rc_t SRASplitterFactory_FilerLimits(uint32_t max_open, size_t pending)
+{
+#if ! WINDOWS
+    struct rlimit rl;
+#endif
+
+    if( g_filer == NULL ) {
+        return RC(rcExe, rcFile, rcUpdating, rcSelf, rcNotOpen);
+    }
+    /* pending output beyond a full arena would only delay the reopen */
+    if( pending > g_filer->arena_sz ) {
+        return RC(rcExe, rcFile, rcUpdating, rcParam, rcExcessive);
+    }
+#if ! WINDOWS
+    if( max_open > 0 && getrlimit(RLIMIT_NOFILE, &rl) == 0 &&
+        rl.rlim_cur != RLIM_INFINITY && max_open >= rl.rlim_cur ) {
+        return RC(rcExe, rcFile, rcUpdating, rcParam, rcExcessive);
+    }
+#endif
+    g_filer->max_open = max_open > 0 ? max_open : SRASplitterFiler_DefaultMaxOpen(g_filer->arena_sz);
+    g_filer->pending_sz = pending;
+    /* files over new limit are closed as others get opened */
+    return 0;
+}
+
+rc_t SRASplitterFactory_FilerThreads(uint32_t threads)
+{
+    rc_t rc = 0;
+
+    if( g_filer == NULL ) {
+        rc = RC(rcExe, rcFile, rcUpdating, rcSelf, rcNotOpen);
+    } else if( g_filer->zip != NULL && g_filer->zip->threads != threads ) {
+        SRASplitterZip* zip = NULL;
+        if( threads > COMPRESS_MAX_THREADS ) {
+            threads = COMPRESS_MAX_THREADS;
+        }
+        if( (rc = SRASplitterZip_Make(&zip, g_filer->do_bzip2, threads)) == 0 ) {
+            /* old one writes out whatever is pending in it, arenas go to the new one */
+            SRASplitterZip_Release(g_filer->zip);
+            g_filer->zip = zip;
+        }
+    }
+    return rc;
+}
+
+/* ### Output journal ##################################################### */
+
+#define JOURNAL_INIT_SIZE ( 64 * 1024 )
+
+/* in-memory image of a file's output for the current range of spots */
+typedef struct SRASplitterJournalEntry_struct {
+    SLNode dad;
+    char* key;
+    /* path elements below prefix leading to the file */
+    int path_tail;
+    char** path;
+    /* file was activated since last flush */
+    bool active;
+    KDataBuffer buf;
+    size_t size;
+    /* keep track of number of spots written to file */
+    spotid_t curr_spot;
+    uint64_t spot_qty;
+} SRASplitterJournalEntry;
+
+struct SRASplitterJournal {
+    SRASplitterPath path;
+    SLList entries;
+    /* keep track of number of spots written to journal */
+    spotid_t curr_spot;
+    uint64_t spot_qty;
+    /* messages logged by the splitter tree: level byte followed by 0-terminated text */
+    KDataBuffer log;
+    size_t log_size;
+};
+
+typedef struct SRASplitterJournal_FindData_struct {
+    const char* key;
+    SRASplitterJournalEntry* entry;
+} SRASplitterJournal_FindData;
+
+static
+void CC SRASplitterJournal_WhackEntry( SLNode *node, void *data )
+{
+    SRASplitterJournalEntry* e = (SRASplitterJournalEntry*)node;
+
+    KDataBufferWhack(&e->buf);
+    free(e->key);
+    free(e->path);
+    free(e);
+}
+
+static
+bool CC SRASplitterJournal_FindByKey( SLNode *node, void *data )
+{
+    SRASplitterJournal_FindData* d = (SRASplitterJournal_FindData*)data;
+    SRASplitterJournalEntry* e = (SRASplitterJournalEntry*)node;
+
+    if( strcmp(e->key, d->key) == 0 ) {
+        d->entry = e;
+        return true;
+    }
+    return false;
+}
+
+rc_t SRASplitterJournal_Make(SRASplitterJournal** self)
+{
+    if( self == NULL ) {
+        return RC(rcExe, rcFile, rcConstructing, rcParam, rcNull);
+    }
+    if( (*self = calloc(1, sizeof(**self))) == NULL ) {
+        return RC(rcExe, rcFile, rcConstructing, rcMemory, rcExhausted);
+    }
+    SLListInit(&(*self)->entries);
+    return KDataBufferMakeBytes(&(*self)->log, 0);
+}
+
+void SRASplitterJournal_Release(SRASplitterJournal* self)
+{
+    if( self != NULL ) {
+        SLListWhack(&self->entries, SRASplitterJournal_WhackEntry, NULL);
+        KDataBufferWhack(&self->log);
+        free(self);
+    }
+}
+
+/* lookup or create entry for current path in journal */
+static
+rc_t SRASplitterJournal_GetCurrEntry(SRASplitterJournal* self, SRASplitterJournalEntry** out_entry)
+{
+    rc_t rc = 0;
+    SRASplitterJournal_FindData d;
+
+    SRASplitterFiler_MakeKey(&self->path);
+    d.key = self->path.key_buf;
+    d.entry = NULL;
+    if( !SLListDoUntil(&self->entries, SRASplitterJournal_FindByKey, &d) ) {
+        /* remember path elements as single block: pointers followed by strings */
+        int i;
+        size_t sz = 0;
+        SRASplitterJournalEntry* e = calloc(1, sizeof(*e));
+
+        for(i = 1; i < self->path.tail; i++) {
+            sz += sizeof(char*) + strlen(self->path.path[i]) + 1;
+        }
+        if( e == NULL || (e->key = strdup(d.key)) == NULL || (sz > 0 && (e->path = malloc(sz)) == NULL) ) {
+            rc = RC(rcExe, rcFile, rcResolving, rcMemory, rcExhausted);
+        } else if( (rc = KDataBufferMakeBytes(&e->buf, JOURNAL_INIT_SIZE)) == 0 ) {
+            char* p = (char*)&e->path[self->path.tail - 1];
+            e->path_tail = self->path.tail - 1;
+            for(i = 1; i < self->path.tail; i++) {
+                e->path[i - 1] = p;
+                strcpy(p, self->path.path[i]);
+                p += strlen(p) + 1;
+            }
+            SLListPushTail(&self->entries, &e->dad);
+            d.entry = e;
+        }
+        if( rc != 0 && e != NULL ) {
+            free(e->key);
+            free(e->path);
+            free(e);
+        }
+    }
+    *out_entry = rc ? NULL : d.entry;
+    return rc;
+}
+
+/* get at least size contiguous bytes at the end of entry */
+static
+rc_t SRASplitterJournal_Reserve(SRASplitterJournalEntry* e, size_t size, char** buf)
+{
+    rc_t rc = 0;
+
+    if( e->size + size > KDataBufferBytes(&e->buf) ) {
+        uint64_t sz = KDataBufferBytes(&e->buf) * 2;
+        if( sz < e->size + size ) {
+            sz = e->size + size;
+        }
+        SRA_DUMP_DBG(10, ("\n%s grow journal '%s' from %lu to %lu\n", __func__, e->key, KDataBufferBytes(&e->buf), sz));
+        rc = KDataBufferResize(&e->buf, sz);
+    }
+    if( rc == 0 ) {
+        *buf = &((char*)e->buf.base)[e->size];
+    }
+    return rc;
+}
+
+static
+void SRASplitterJournal_Commit(SRASplitterJournal* self, SRASplitterJournalEntry* e, spotid_t spot, size_t size)
+{
+    e->size += size;
+    if( e->curr_spot != spot && spot != 0 ) {
+        e->curr_spot = spot;
+        e->spot_qty++;
+    }
+    if( self->curr_spot != spot && spot != 0 ) {
+        self->curr_spot = spot;
+        self->spot_qty++;
+    }
+}
+
+static
+rc_t SRASplitterJournal_Log(SRASplitterJournal* self, KLogLevel lvl, const char* msg, size_t len)
+{
+    rc_t rc = 0;
+
+    if( self->log_size + len + 2 > KDataBufferBytes(&self->log) ) {
+        rc = KDataBufferResize(&self->log, (self->log_size + len + 2) * 2);
+    }
+    if( rc == 0 ) {
+        char* b = &((char*)self->log.base)[self->log_size];
+        b[0] = (char)lvl;
+        memcpy(&b[1], msg, len);
+        b[len + 1] = '\0';
+        self->log_size += len + 2;
+    }
+    return rc;
+}
+
+static
+rc_t SRASplitterJournal_Write(SRASplitterJournal* self, SRASplitterJournalEntry* e, spotid_t spot, const void* buf, size_t size)
+{
+    char* b = NULL;
+    rc_t rc = SRASplitterJournal_Reserve(e, size, &b);
+
+    if( rc == 0 ) {
+        memcpy(b, buf, size);
+        SRASplitterJournal_Commit(self, e, spot, size);
+    }
+    return rc;
+}
+
+rc_t SRASplitterJournal_Flush(SRASplitterJournal* self)
+{
+    rc_t rc = 0;
+    SRASplitterJournalEntry* e;
+
+    if( self == NULL || g_filer == NULL ) {
+        return RC(rcExe, rcFile, rcWriting, rcSelf, rcNull);
+    }
+    for(e = (SRASplitterJournalEntry*)SLListHead(&self->entries); e != NULL; e = (SRASplitterJournalEntry*)SLNodeNext(&e->dad)) {
+        if( rc == 0 && e->active ) {
+            int i;
+            const SRASplitterFile* cfile = NULL;
+
+            /* rebuild path to the file as if the spots were dumped here */
+            for(i = 0; i < e->path_tail; i++) {
+                if( (rc = SRASplitterFiler_PushKey(&g_filer->path, e->path[i])) != 0 ) {
+                    break;
+                }
+            }
+            if( rc == 0 && (rc = SRASplitterFiler_GetCurrFile(&cfile)) == 0 ) {
+                SRASplitterFile* f = (SRASplitterFile*)cfile;
+                /* spots are accounted for below, all at once */
+                rc = SRASplitterFile_Append(f, 0, e->buf.base, e->size);
+                if( e->spot_qty > 0 ) {
+                    f->curr_spot = e->curr_spot;
+                    f->spot_qty += e->spot_qty;
+                }
+            }
+            while( i-- > 0 ) {
+                SRASplitterFiler_PopKey(&g_filer->path);
+            }
+        }
+        e->active = false;
+        e->size = 0;
+        e->spot_qty = 0;
+    }
+    if( self->spot_qty > 0 ) {
+        g_filer->curr_spot = self->curr_spot;
+        g_filer->spot_qty += self->spot_qty;
+        self->spot_qty = 0;
+    }
+    if( self->log_size > 0 ) {
+        /* messages of the range come out on this thread, in spot order */
+        const char* b = self->log.base;
+        size_t off = 0;
+        while( off < self->log_size ) {
+            KLogLevel lvl = (KLogLevel)b[off];
+            LOGMSG(lvl, &b[off + 1]);
+            off += strlen(&b[off + 1]) + 2;
+        }
+        self->log_size = 0;
+    }
+    return rc;
+}
+
 /* ### Base splitter code ##################################################### */
 
 /* used to detect correct object pointers */
@@ -532,6 +1344,8 @@ struct SRASplitter {
     SRASplitter_Release_Func* Release;
     BSTree children;
     SRASplitter_Child* last_found;
+    /* if set all file output goes to journal instead of filer */
+    SRASplitterJournal* journal;
 };
 
 struct SRASplitter_Child {
@@ -543,6 +1357,8 @@ struct SRASplitter_Child {
         const SRASplitter* splitter;
         /* file object for self type of eSplitterFormat */
         const SRASplitterFile* file;
+        /* journal entry for self type of eSplitterFormat writing to journal */
+        SRASplitterJournalEntry* entry;
     } child;
 };
 
@@ -591,6 +1407,20 @@ rc_t SRASplitter_Child_MakeFile(SRASplitter_Child** child, const char* key, cons
     return rc;
 }
 
+static
+rc_t SRASplitter_Child_MakeEntry(SRASplitter_Child** child, const char* key, SRASplitterJournalEntry* entry)
+{
+    rc_t rc = 0;
+
+    if( entry == NULL ) {
+        rc = RC(rcExe, rcNode, rcAllocating, rcParam, rcNull);
+    } else if( (rc = SRASplitter_Child_Make(child, key)) == 0 ) {
+        (*child)->is_splitter = false;
+        (*child)->child.entry = entry;
+    }
+    return rc;
+}
+
 static
 void CC SRASplitter_Child_Whack(BSTNode* node, void* data)
 {
@@ -620,6 +1450,9 @@ int CC SRASplitter_Child_Find(const void* item, const BSTNode* node)
     return strcmp(key, n->key);
 }
 
+static
+rc_t SRASplitter_ResolveSelf(const SRASplitter* self, enum RCContext ctx, SRASplitter** resolved);
+
 static /* not virtual, self is direct pointer to base type here !!! */
 rc_t SRASplitter_FindNextSplitter(SRASplitter* self, const char* key)
 {
@@ -630,8 +1463,12 @@ rc_t SRASplitter_FindNextSplitter(SRASplitter* self, const char* key)
         if( self->last_found == NULL ) {
             /* create new child using next factory in chain */
             const SRASplitter* splitter = NULL;
+            SRASplitter* sp = NULL;
             SRA_DUMP_DBG(5, ("New splitter on key '%s'\n", key));
-            if( (rc = SRASplitterFactory_NewObj(self->next_fact, &splitter)) == 0 ) {
+            if( (rc = SRASplitterFactory_NewObj(self->next_fact, &splitter)) == 0 &&
+                (rc = SRASplitter_ResolveSelf(splitter, rcConstructing, &sp)) == 0 ) {
+                /* child writes to the same place as parent */
+                sp->journal = self->journal;
                 if( (rc = SRASplitter_Child_MakeSplitter(&self->last_found, key, splitter)) == 0 ) {
                     if( (rc = BSTreeInsertUnique(&self->children, &self->last_found->node, NULL, SRASplitter_Child_Cmp)) != 0 ) {
                         SRASplitter_Child_Whack(&self->last_found->node, NULL);
@@ -653,7 +1490,19 @@ rc_t SRASplitter_FindNextFile(SRASplitter* self, const char* key)
 
     if( self->last_found == NULL || strcmp(self->last_found->key, key) != 0 ) {
         self->last_found = (SRASplitter_Child*)BSTreeFind(&self->children, key, SRASplitter_Child_Find);
-        if( self->last_found == NULL ) {
+        if( self->last_found == NULL && self->journal != NULL ) {
+            /* create new child using own journal */
+            SRASplitterJournalEntry* entry = NULL;
+            SRA_DUMP_DBG(5, ("New journal entry on key '%s'\n", key));
+            if( (rc = SRASplitterJournal_GetCurrEntry(self->journal, &entry)) == 0 ) {
+                if( (rc = SRASplitter_Child_MakeEntry(&self->last_found, key, entry)) == 0 ) {
+                    if( (rc = BSTreeInsertUnique(&self->children, &self->last_found->node, NULL, SRASplitter_Child_Cmp)) != 0 ) {
+                        SRASplitter_Child_Whack(&self->last_found->node, NULL);
+                        self->last_found = NULL;
+                    }
+                }
+            }
+        } else if( self->last_found == NULL ) {
             /* create new child using global filer */
             const SRASplitterFile* file = NULL;
             SRA_DUMP_DBG(5, ("New file on key '%s'\n", key));
@@ -668,8 +1517,12 @@ rc_t SRASplitter_FindNextFile(SRASplitter* self, const char* key)
         }
     }
     if( rc == 0 ) {
-        /* make sure file is opened */
-        rc = SRASplitterFiler_OpenFile((SRASplitterFile*)(self->last_found->child.file), false);
+        if( self->journal != NULL ) {
+            self->last_found->child.entry->active = true;
+        } else {
+            /* make sure file is opened or at least can collect output */
+            rc = SRASplitterFiler_ActivateFile((SRASplitterFile*)(self->last_found->child.file));
+        }
     }
     return rc;
 }
@@ -717,6 +1570,35 @@ rc_t SRASplitter_ResolveSelf(const SRASplitter* self, enum RCContext ctx, SRASpl
     return 0;
 }
 
+/* path of keys used by this splitter tree */
+static
+SRASplitterPath* SRASplitter_Path(const SRASplitter* self)
+{
+    return self->journal != NULL ? &self->journal->path : &g_filer->path;
+}
+
+rc_t SRASplitter_SetJournal(const SRASplitter* cself, SRASplitterJournal* journal)
+{
+    rc_t rc = 0;
+    SRASplitter* self = NULL;
+
+    if( (rc = SRASplitter_ResolveSelf(cself, rcAttaching, &self)) == 0 ) {
+        if( g_filer == NULL ) {
+            rc = RC(rcExe, rcFile, rcAttaching, rcSelf, rcNotOpen);
+        } else if( BSTreeFirst(&self->children) != NULL ) {
+            /* children already route output elsewhere */
+            rc = RC(rcExe, rcFile, rcAttaching, rcConstraint, rcViolated);
+        } else {
+            self->journal = journal;
+            if( journal != NULL && journal->path.tail == 0 ) {
+                /* journal path starts with filer prefix like filer's own */
+                rc = SRASplitterFiler_PushKey(&journal->path, g_filer->prefix);
+            }
+        }
+    }
+    return rc;
+}
+
 rc_t SRASplitter_AddSpot( const SRASplitter * cself, spotid_t spot, readmask_t * readmask )
 {
     SRASplitter * self = NULL;
@@ -768,13 +1650,13 @@ rc_t SRASplitter_AddSpot( const SRASplitter * cself, spotid_t spot, readmask_t *
                         if ( rc == 0 )
                         {
                             /* push spot to next splitter in chain */
-                            rc = SRASplitterFiler_PushKey( self->last_found->key );
+                            rc = SRASplitterFiler_PushKey( SRASplitter_Path( self ), self->last_found->key );
                             if ( rc == 0 )
                             {
                                 /* here comes RECURSION!!! */
                                 rc_t rc2;
                                 rc = SRASplitter_AddSpot( self->last_found->child.splitter, spot, local_readmask );
-                                rc2 = SRASplitterFiler_PopKey();
+                                rc2 = SRASplitterFiler_PopKey( SRASplitter_Path( self ) );
                                 rc = rc ? rc : rc2;
                             }
                         }
@@ -808,13 +1690,13 @@ rc_t SRASplitter_AddSpot( const SRASplitter * cself, spotid_t spot, readmask_t *
                     if ( rc == 0 )
                     {
                         /* push spot to next splitter in chain */
-                        rc = SRASplitterFiler_PushKey( self->last_found->key );
+                        rc = SRASplitterFiler_PushKey( SRASplitter_Path( self ), self->last_found->key );
                         if ( rc == 0 )
                         {
                             /* here comes RECURSION!!! */
                             rc_t rc2;
                             rc = SRASplitter_AddSpot( self->last_found->child.splitter, spot, readmask );
-                            rc2 = SRASplitterFiler_PopKey();
+                            rc2 = SRASplitterFiler_PopKey( SRASplitter_Path( self ) );
                             rc = rc ? rc : rc2;
                         }
                     }
@@ -857,10 +1739,10 @@ rc_t SRASplitter_FileActivate(const SRASplitter* cself, const char* key)
     SRASplitter* self = NULL;
 
     if( (rc = SRASplitter_ResolveSelf(cself, rcExecuting, &self)) == 0 ) {
-        if( (rc = SRASplitterFiler_PushKey(key)) == 0 ) {
+        if( (rc = SRASplitterFiler_PushKey(SRASplitter_Path(self), key)) == 0 ) {
             /* sets self->last_found */
             rc = SRASplitter_FindNextFile(self, key);
-            rc2 = SRASplitterFiler_PopKey();
+            rc2 = SRASplitterFiler_PopKey(SRASplitter_Path(self));
             rc = rc ? rc : rc2;
         }
     }
@@ -878,30 +1760,97 @@ rc_t SRASplitter_FileWrite( const SRASplitter* cself, spotid_t spot, const void*
         {
             rc = RC( rcExe, rcFile, rcWriting, rcDirEntry, rcUnknown );
         }
+        else if ( buf != NULL && size > 0 && self->journal != NULL )
+        {
+            rc = SRASplitterJournal_Write( self->journal, self->last_found->child.entry, spot, buf, size );
+        }
         else if ( buf != NULL && size > 0 )
         {
-            size_t writ = 0;
-            SRASplitterFile* f = ( SRASplitterFile* )( self->last_found->child.file );
-            rc = KFileWrite( f->file, f->pos, buf, size, &writ );
-            if ( rc == 0 )
+            rc = SRASplitterFile_Append( ( SRASplitterFile* )( self->last_found->child.file ), spot, buf, size );
+        }
+    }
+    return rc;
+}
+
+rc_t SRASplitter_LogMsg( const SRASplitter* cself, KLogLevel lvl, const char* fmt, ... )
+{
+    SRASplitter* self = NULL;
+
+    rc_t rc = SRASplitter_ResolveSelf( cself, rcWriting, &self );
+    if ( rc == 0 && lvl <= KLogLevelGet() )
+    {
+        char msg[ 1024 ];
+        size_t len = 0;
+        va_list args;
+
+        va_start( args, fmt );
+        rc = string_vprintf( msg, sizeof msg, &len, fmt, args );
+        va_end( args );
+        if ( rc == 0 )
+        {
+            if ( self->journal != NULL )
             {
-                f->pos += writ;
-                if ( f->curr_spot != spot && spot != 0 )
-                {
-                     f->curr_spot = spot;
-                     f->spot_qty = f->spot_qty + 1;
-                }
-                if ( g_filer->curr_spot != spot && spot != 0 )
-                {
-                    g_filer->curr_spot = spot;
-                    g_filer->spot_qty = g_filer->spot_qty + 1;
-                }
+                rc = SRASplitterJournal_Log( self->journal, lvl, msg, len );
+            }
+            else
+            {
+                LOGMSG( lvl, msg );
             }
         }
     }
     return rc;
 }
 
+rc_t SRASplitter_FileReserve( const SRASplitter* cself, size_t size, char** buf )
+{
+    SRASplitter* self = NULL;
+
+    rc_t rc = SRASplitter_ResolveSelf( cself, rcWriting, &self );
+    if ( rc == 0 )
+    {
+        if ( buf == NULL )
+        {
+            rc = RC( rcExe, rcFile, rcWriting, rcParam, rcNull );
+        }
+        else if ( self->last_found == NULL )
+        {
+            rc = RC( rcExe, rcFile, rcWriting, rcDirEntry, rcUnknown );
+        }
+        else if ( self->journal != NULL )
+        {
+            rc = SRASplitterJournal_Reserve( self->last_found->child.entry, size, buf );
+        }
+        else
+        {
+            rc = SRASplitterFile_Reserve( ( SRASplitterFile* )( self->last_found->child.file ), size, buf );
+        }
+    }
+    return rc;
+}
+
+rc_t SRASplitter_FileCommit( const SRASplitter* cself, spotid_t spot, size_t size )
+{
+    SRASplitter* self = NULL;
+
+    rc_t rc = SRASplitter_ResolveSelf( cself, rcWriting, &self );
+    if ( rc == 0 )
+    {
+        if ( self->last_found == NULL )
+        {
+            rc = RC( rcExe, rcFile, rcWriting, rcDirEntry, rcUnknown );
+        }
+        else if ( size > 0 && self->journal != NULL )
+        {
+            SRASplitterJournal_Commit( self->journal, self->last_found->child.entry, spot, size );
+        }
+        else if ( size > 0 )
+        {
+            SRASplitterFile_Commit( ( SRASplitterFile* )( self->last_found->child.file ), spot, size );
+        }
+    }
+    return rc;
+}
+
 rc_t SRASplitter_FileWritePos( const SRASplitter* cself, spotid_t spot, 
                                uint64_t pos, const void* buf, size_t size )
 {
@@ -914,18 +1863,37 @@ rc_t SRASplitter_FileWritePos( const SRASplitter* cself, spotid_t spot,
         {
             rc = RC( rcExe, rcFile, rcWriting, rcDirEntry, rcUnknown );
         }
+        else if ( self->journal != NULL || g_filer->zip != NULL )
+        {
+            /* journal and compressed files only append,
+               file positions are not known until flush */
+            rc = RC( rcExe, rcFile, rcWriting, rcFunction, rcUnsupported );
+        }
         else if ( buf != NULL && size > 0 )
         {
-            const SRASplitterFile* f = self->last_found->child.file;
-            /* remember last position */
-            uint64_t old_pos = f->pos;
-            ( ( SRASplitterFile* ) f )->pos = pos;
-            /* write to requested position */
-            rc = SRASplitter_FileWrite( cself, spot, buf, size );
-            if ( f->pos < old_pos )
+            SRASplitterFile* f = ( SRASplitterFile* )( self->last_found->child.file );
+            /* arena only appends, so empty it and write to requested position directly */
+            if ( f->file == NULL )
+            {
+                rc = SRASplitterFiler_OpenFile( f, false );
+            }
+            if ( rc == 0 )
+            {
+                rc = SRASplitterFile_Flush( f );
+            }
+            if ( rc == 0 )
             {
-                /* revert to last position if wrote less than it was */
-                ( ( SRASplitterFile* ) f )->pos = old_pos;
+                size_t writ = 0;
+                rc = KFileWriteAll( f->file, pos, buf, size, &writ );
+                if ( rc == 0 )
+                {
+                    if ( pos + writ > f->pos )
+                    {
+                        /* wrote past last position */
+                        f->pos = pos + writ;
+                    }
+                    SRASplitterFile_CountSpot( f, spot );
+                }
             }
         }
     }
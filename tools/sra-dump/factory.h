@@ -27,6 +27,7 @@
 #define _h_tools_dump_factory
 
 #include <klib/rc.h>
+#include <klib/log.h>
 #include <kfs/file.h>
 #include <klib/data-buffer.h>
 #include <sra/sradb.h>
@@ -131,6 +132,38 @@ rc_t SRASplitter_FileActivate(const SRASplitter* self, const char* key);
  */
 rc_t SRASplitter_FileWrite( const SRASplitter* cself, spotid_t spot, const void* buf, size_t size );
 rc_t SRASplitter_FileWritePos( const SRASplitter* cself, spotid_t spot, uint64_t pos, const void* buf, size_t size );
+/* zero-copy version of SRASplitter_FileWrite: assemble whole record directly in file output buffer
+   FileReserve returns pointer to at least size bytes, valid until next call to any SRASplitter_FileXXX
+   FileCommit appends first size bytes of reserved space to file
+ */
+rc_t SRASplitter_FileReserve( const SRASplitter* cself, size_t size, char** buf );
+rc_t SRASplitter_FileCommit( const SRASplitter* cself, spotid_t spot, size_t size );
+
+/**
+  * Output journal: keeps everything a splitter tree writes in memory
+  * so that a range of spots can be dumped on a worker thread
+  * and merged into the real files later in spot order
+  */
+typedef struct SRASplitterJournal SRASplitterJournal;
+
+rc_t SRASplitterJournal_Make(SRASplitterJournal** self);
+/* release only after splitter tree using it is released */
+void SRASplitterJournal_Release(SRASplitterJournal* self);
+/* writes collected data to files and resets journal for reuse,
+   must be called from the thread which owns the filer */
+rc_t SRASplitterJournal_Flush(SRASplitterJournal* self);
+
+/* logs a message about a spot, printf-like format:
+   splitter tree writing to journal keeps it there until journal is flushed,
+   so that messages come out in spot order whichever thread dumped the spot
+ */
+rc_t SRASplitter_LogMsg( const SRASplitter* self, KLogLevel lvl, const char* fmt, ... );
+
+/* route file output of the whole splitter tree into journal,
+   must be called on root splitter before 1st call to SRASplitter_AddSpot
+   SRASplitter_FileWritePos is not supported while writing to journal
+ */
+rc_t SRASplitter_SetJournal(const SRASplitter* self, SRASplitterJournal* journal);
 
 typedef struct SRASplitterFactory SRASplitterFactory;
 
@@ -149,6 +182,18 @@ typedef void (SRASplitterFactory_Release_Func)(const SRASplitterFactory* self);
   * path, ... [IN]  - path to directory where file will reside
   */
 rc_t SRASplitterFactory_FilerInit(bool to_stdout, bool gzip, bool bzip2, bool key_as_dir, bool keep_empty, const char* path, ...);
+
+/* default size of buffer collecting output of closed file until it is worth reopening */
+#define DUMPER_PENDING_SIZE ( 16 * 1024 )
+/* max_open [IN] - size of open files pool, 0 - derive from process descriptor limit (default)
+   pending [IN]  - size of buffer collecting output of a file closed to free up the pool,
+                   file is reopened when buffer is full, 0 - reopen file on 1st write,
+                   at most the size of an open file's buffer ( 128K, 900000 for bzip2 files )
+   returns rcExcessive if max_open does not fit into the descriptor limit or pending is too big */
+rc_t SRASplitterFactory_FilerLimits(uint32_t max_open, size_t pending);
+/* compress gzip/bzip2 output blocks on a pool of threads, 0 - compress on calling thread (default)
+   output goes out as independent compressed blocks in any case */
+rc_t SRASplitterFactory_FilerThreads(uint32_t threads);
 /* this only works correctly on top of the splitter tree !! */
 rc_t SRASplitterFactory_FilerPrefix(const char* prefix);
 void SRASplitterFactory_FilerReport(uint64_t* total, uint64_t* biggest_file);
@@ -432,11 +432,30 @@ typedef struct fasta_ctx
 } fasta_ctx;
 
 
+/* number of output lines read from reference and written out at once,
+   fewer for wide lines to keep a block below MAX_BLOCK_BASES, but at least one */
+#define LINES_PER_BLOCK 1024
+#define MAX_BLOCK_BASES ( 4 * 1024 * 1024 )
+
 static rc_t dump_reference_loop( fasta_options *opts, const ReferenceObj* refobj )
 {
     rc_t rc = 0;
-    uint8_t * buffer = malloc( opts->width + 2 );
-    if ( buffer == NULL )
+    size_t lines_per_block, block;
+    uint8_t * buffer;
+    char * lines;
+
+    /* no bases per line: nothing to print */
+    if ( opts->width == 0 )
+        return 0;
+    lines_per_block = MAX_BLOCK_BASES / opts->width;
+    if ( lines_per_block > LINES_PER_BLOCK )
+        lines_per_block = LINES_PER_BLOCK;
+    else if ( lines_per_block == 0 )
+        lines_per_block = 1;
+    block = ( size_t )opts->width * lines_per_block;
+    buffer = malloc( block );
+    lines = malloc( block + lines_per_block );
+    if ( buffer == NULL || lines == NULL )
     {
         rc = RC( rcExe, rcNoTarg, rcListing, rcMemory, rcExhausted );
         LOGERR( klogInt, rc, "allocating reference-buffer failed!" );
@@ -449,19 +468,32 @@ static rc_t dump_reference_loop( fasta_options *opts, const ReferenceObj* refobj
         while ( w > 0 && rc == 0 )
         {
             INSDC_coord_len written;
-            INSDC_coord_len to_read = ( w > opts->width ? opts->width : w );
+            INSDC_coord_len to_read = ( w > block ? block : w );
             rc = ReferenceObj_Read( refobj, pos, to_read, buffer, &written );
             if ( rc != 0 )
                 LOGERR( klogInt, rc, "ReferenceObj_Read() failed" );
+            else if ( written == 0 )
+                break;
             else
             {
-                OUTMSG(( "%.*s\n", written, buffer ));
+                /* wrap the whole block into lines and hand it to output in one piece */
+                INSDC_coord_len i;
+                char * dst = lines;
+                for ( i = 0; i < written; i += opts->width )
+                {
+                    INSDC_coord_len n = ( written - i > opts->width ? opts->width : written - i );
+                    memcpy( dst, &buffer[ i ], n );
+                    dst += n;
+                    *dst++ = '\n';
+                }
+                OUTMSG(( "%.*s", ( uint32_t )( dst - lines ), lines ));
                 w -= written;
                 pos += written;
             }
         }
-        free( buffer );
     }
+    free( lines );
+    free( buffer );
     return rc;
 }
 
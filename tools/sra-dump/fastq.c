@@ -84,9 +84,9 @@ struct FastqArgs_struct
     bool qual_filter;
     bool qual_filter1;
     const char* b_deffmt;
-    SLList* b_defline;
+    struct Defline_struct* b_defline;
     const char* q_deffmt;
-    SLList* q_defline;
+    struct Defline_struct* q_defline;
     const char *desiredCsKey;
     bool split_files;
     bool split_3;
@@ -132,10 +132,39 @@ typedef struct DefNode_struct
 } DefNode;
 
 
+/* defline template compiled into flat program, literal spans are kept in the same block */
+typedef struct DeflineOp_struct
+{
+    DefNodeType type;
+    /* for DefNode_Text literal length, for DefNode_Optional number of ops in group after this one */
+    uint32_t len;
+    const char* text;
+} DeflineOp;
+
+
+typedef struct Defline_struct
+{
+    uint32_t count;
+    /* leading ops which depend on spot values only, their output is cached per spot */
+    uint32_t spot_ops;
+    DeflineOp ops[ 1 ];
+} Defline;
+
+
+/* rendered spot part of up to 2 deflines ( sequence and quality ) */
+#define DEFLINE_CACHE_SLOTS 2
+#define DEFLINE_CACHE_SIZE 256
+
+typedef struct DeflineCache_struct
+{
+    const Defline* def;
+    size_t sz;
+    char text[ DEFLINE_CACHE_SIZE ];
+} DeflineCache;
+
+
 typedef struct DeflineData_struct
 {
-    rc_t rc;
-    bool optional;
     union
     {
         spotid_t* id;
@@ -146,166 +175,246 @@ typedef struct DeflineData_struct
         } str;
         uint32_t* u32;
     } values[ DefNode_Last ];
-    char* buf;
-    size_t buf_sz;
-    size_t* writ;
+    /* valid until next Defline_Bind */
+    DeflineCache cache[ DEFLINE_CACHE_SLOTS ];
 } DeflineData;
 
 
-static bool CC Defline_Builder( SLNode *node, void *data )
+/* binds values to defline variables, numeric ones are bound by pointer
+   so they can change between calls to Defline_Build */
+static rc_t Defline_Bind( DeflineData* data, const char* accession, size_t accession_sz,
+            spotid_t* spotId, const char* spot_name, size_t spotname_sz,
+            const char* spot_group, size_t sgrp_sz, uint32_t* spot_len,
+            uint32_t* readId, const char* read_name, INSDC_coord_len rlabel_sz,
+            INSDC_coord_len* read_len )
 {
-    DefNode* n = ( DefNode* )node;
-    DeflineData* d = ( DeflineData* )data;
-    char s[ 256 ];
-    size_t w;
-    int x = 0;
+    uint32_t i;
 
-    s[ 0 ] = '\0';
-    switch ( n->type )
+    if ( data == NULL )
     {
-        case DefNode_Optional :
-            d->optional = true;
-            w = *d->writ;
-            *d->writ = 0;
-            SLListDoUntil( n->data.optional, Defline_Builder, data );
-            x = ( *d->writ == 0 ) ? 0 : 1;
-            d->optional = false;
-            *d->writ = w;
-            if ( x > 0 )
-            {
-                SLListDoUntil( n->data.optional, Defline_Builder, data );
-            }
-            break;
+        return RC( rcExe, rcNamelist, rcExecuting, rcMemory, rcInsufficient );
+    }
+    data->values[ DefNode_Accession ].str.s = accession;
+    data->values[ DefNode_Accession ].str.sz = accession_sz;
+    data->values[ DefNode_SpotId ].id = spotId;
+    data->values[ DefNode_SpotName ].str.s = spot_name;
+    data->values[ DefNode_SpotName ].str.sz = spotname_sz;
+    data->values[ DefNode_SpotGroup ].str.s = spot_group;
+    data->values[ DefNode_SpotGroup ].str.sz = sgrp_sz;
+    data->values[ DefNode_SpotLen ].u32 = spot_len;
+    data->values[ DefNode_ReadId ].u32 = readId;
+    data->values[ DefNode_ReadName ].str.s = read_name;
+    data->values[ DefNode_ReadName ].str.sz = rlabel_sz;
+    data->values[ DefNode_ReadLen ].u32 = read_len;
+    for ( i = 0; i < DEFLINE_CACHE_SLOTS; i++ )
+    {
+        data->cache[ i ].def = NULL;
+    }
+    return 0;
+}
 
-        case DefNode_Text :
-            if ( d->optional )
-            {
-                break;
-            }
-            d->values[n->type].str.s = n->data.text;
-            d->values[n->type].str.sz = strlen( n->data.text );
 
-        case DefNode_Accession :
-        case DefNode_SpotName :
-        case DefNode_SpotGroup :
-        case DefNode_ReadName :
-            if ( d->values[n->type].str.s != NULL )
-            {
-                x = d->values[ n->type ].str.sz;
-                if ( x < sizeof( s ) )
-                {
-                    strncpy( s, d->values[ n->type ].str.s, x );
-                    s[ x ] = '\0';
-                    *d->writ = *d->writ + x;
-                }
-                else
-                {
-                    d->rc = RC( rcExe, rcNamelist, rcExecuting, rcBuffer, rcInsufficient );
-                }
-            }
-            break;
+/* only read name changes between reads of the same spot, cached spot part stays valid */
+static void Defline_BindRead( DeflineData* data, const char* read_name, INSDC_coord_len rlabel_sz )
+{
+    data->values[ DefNode_ReadName ].str.s = read_name;
+    data->values[ DefNode_ReadName ].str.sz = rlabel_sz;
+}
 
-        case DefNode_SpotId :
-            if ( d->values[ n->type ].id != NULL &&
-                ( !d->optional || *d->values[ n->type ].id > 0 ) )
-            {
-                x = snprintf( s, sizeof( s ), "%ld", *d->values[ n->type ].id );
-                if ( x < 0 || x >= sizeof( s ) )
-                {
-                    d->rc = RC( rcExe, rcNamelist, rcExecuting, rcBuffer, rcInsufficient );
-                }
-                else
+
+/* optional group is printed only if at least one of its variables is not empty */
+static bool Defline_HasValue( const DeflineOp* op, uint32_t count, const DeflineData* data )
+{
+    uint32_t i;
+
+    for ( i = 0; i < count; i++ )
+    {
+        switch ( op[ i ].type )
+        {
+            case DefNode_Accession :
+            case DefNode_SpotName :
+            case DefNode_SpotGroup :
+            case DefNode_ReadName :
+                if ( data->values[ op[ i ].type ].str.s != NULL && data->values[ op[ i ].type ].str.sz > 0 )
                 {
-                    *d->writ = *d->writ + x;
+                    return true;
                 }
-            }
-            break;
+                break;
 
-        case DefNode_ReadId :
-        case DefNode_SpotLen :
-        case DefNode_ReadLen :
-            if ( d->values[ n->type] .u32 != NULL &&
-                 ( !d->optional || *d->values[ n->type ].u32 > 0 ) )
-            {
-                x = snprintf( s, sizeof( s ), "%u", *d->values[ n->type ].u32 );
-                if ( x < 0 || x >= sizeof( s ) )
+            case DefNode_SpotId :
+                if ( data->values[ op[ i ].type ].id != NULL && *data->values[ op[ i ].type ].id > 0 )
                 {
-                    d->rc = RC( rcExe, rcNamelist, rcExecuting, rcBuffer, rcInsufficient );
+                    return true;
                 }
-                else
+                break;
+
+            case DefNode_ReadId :
+            case DefNode_SpotLen :
+            case DefNode_ReadLen :
+                if ( data->values[ op[ i ].type ].u32 != NULL && *data->values[ op[ i ].type ].u32 > 0 )
                 {
-                    *d->writ = *d->writ + x;
+                    return true;
                 }
-            }
-            break;
-
-        default:
-            d->rc = RC( rcExe, rcNamelist, rcExecuting, rcId, rcInvalid );
-    } /* switch */
+                break;
 
-    if ( d->rc == 0 && !d->optional && n->type != DefNode_Optional )
-    {
-        if ( *d->writ < d->buf_sz )
-        {
-            strcat( d->buf, s );
-        }
-        else
-        {
-            d->rc = RC( rcExe, rcNamelist, rcExecuting, rcBuffer, rcInsufficient );
+            default :
+                break;
         }
     }
-    return d->rc != 0;
+    return false;
 }
 
 
-static rc_t Defline_Bind( DeflineData* data, const char* accession,
-            spotid_t* spotId, const char* spot_name, size_t spotname_sz,
-            const char* spot_group, size_t sgrp_sz, uint32_t* spot_len,
-            uint32_t* readId, const char* read_name, INSDC_coord_len rlabel_sz,
-            INSDC_coord_len* read_len )
+/* writes decimal digits of v to the end of s, returns pointer to the first digit */
+static char* Defline_UToDec( char* s, uint64_t v )
 {
-    if ( data == NULL )
+    do
     {
-        return RC( rcExe, rcNamelist, rcExecuting, rcMemory, rcInsufficient );
+        *--s = '0' + ( v % 10 );
+        v /= 10;
+    } while ( v > 0 );
+    return s;
+}
+
+
+/* keeps rendered spot part of def for the following reads of the spot */
+static void Defline_CacheStore( const Defline* def, DeflineData* data, const char* buf, size_t sz )
+{
+    uint32_t i;
+
+    if ( sz <= DEFLINE_CACHE_SIZE )
+    {
+        for ( i = 0; i < DEFLINE_CACHE_SLOTS; i++ )
+        {
+            if ( data->cache[ i ].def == NULL )
+            {
+                data->cache[ i ].def = def;
+                data->cache[ i ].sz = sz;
+                memcpy( data->cache[ i ].text, buf, sz );
+                break;
+            }
+        }
     }
-    data->values[ DefNode_Unknown ].str.s = NULL;
-    data->values[ DefNode_Text ].str.s = NULL;
-    data->values[ DefNode_Optional ].str.s = NULL;
-    data->values[ DefNode_Accession ].str.s = accession;
-    data->values[ DefNode_Accession ].str.sz = strlen( accession );
-    data->values[ DefNode_SpotId ].id = spotId;
-    data->values[ DefNode_SpotName ].str.s = spot_name;
-    data->values[ DefNode_SpotName ].str.sz = spotname_sz;
-    data->values[ DefNode_SpotGroup ].str.s = spot_group;
-    data->values[ DefNode_SpotGroup ].str.sz = sgrp_sz;
-    data->values[ DefNode_SpotLen ].u32 = spot_len;
-    data->values[ DefNode_ReadId ].u32 = readId;
-    data->values[ DefNode_ReadName ].str.s = read_name;
-    data->values[ DefNode_ReadName ].str.sz = rlabel_sz;
-    data->values[ DefNode_ReadLen ].u32 = read_len;
-    return 0;
 }
 
 
-static rc_t Defline_Build( const SLList* def, DeflineData* data, char* buf,
+/* content beyond buf_sz is not written but counted in writ,
+   so caller knows how much space is needed */
+static rc_t Defline_Build( const Defline* def, DeflineData* data, char* buf,
                            size_t buf_sz, size_t* writ )
 {
-    if ( data == NULL )
+    uint32_t i = 0;
+    size_t w = 0;
+    bool cached = def == NULL || def->spot_ops == 0;
+
+    if ( def == NULL || data == NULL || buf == NULL || writ == NULL )
     {
-        return RC( rcExe, rcNamelist, rcExecuting, rcMemory, rcInsufficient );
+        return RC( rcExe, rcNamelist, rcExecuting, rcParam, rcNull );
+    }
+
+    if ( !cached )
+    {
+        uint32_t c;
+        for ( c = 0; c < DEFLINE_CACHE_SLOTS; c++ )
+        {
+            if ( data->cache[ c ].def == def )
+            {
+                /* spot part rendered by a previous read, continue after it */
+                w = data->cache[ c ].sz;
+                if ( w < buf_sz )
+                {
+                    memcpy( buf, data->cache[ c ].text, w );
+                }
+                i = def->spot_ops;
+                cached = true;
+                break;
+            }
+        }
     }
 
-    data->rc = 0;
-    data->optional = false;
-    data->buf = buf;
-    data->buf_sz = buf_sz;
-    data->writ = writ;
+    for ( ; i < def->count; i++ )
+    {
+        const DeflineOp* op = &def->ops[ i ];
+        const char* s = NULL;
+        size_t sz = 0;
+        char num[ 24 ];
+        char* const num_end = &num[ sizeof( num ) ];
 
-    data->buf[ 0 ] = '\0';
-    *data->writ = 0;
+        if ( !cached && i == def->spot_ops )
+        {
+            if ( w < buf_sz )
+            {
+                Defline_CacheStore( def, data, buf, w );
+            }
+            cached = true;
+        }
+        switch ( op->type )
+        {
+            case DefNode_Optional :
+                if ( !Defline_HasValue( &op[ 1 ], op->len, data ) )
+                {
+                    i += op->len;
+                }
+                continue;
 
-    SLListDoUntil( def, Defline_Builder, data );
-    return data->rc;
+            case DefNode_Text :
+                s = op->text;
+                sz = op->len;
+                break;
+
+            case DefNode_Accession :
+            case DefNode_SpotName :
+            case DefNode_SpotGroup :
+            case DefNode_ReadName :
+                s = data->values[ op->type ].str.s;
+                sz = s == NULL ? 0 : data->values[ op->type ].str.sz;
+                break;
+
+            case DefNode_SpotId :
+                if ( data->values[ op->type ].id != NULL )
+                {
+                    int64_t id = *data->values[ op->type ].id;
+                    char* d = Defline_UToDec( num_end, id < 0 ? -id : id );
+                    if ( id < 0 )
+                    {
+                        *--d = '-';
+                    }
+                    s = d;
+                    sz = num_end - d;
+                }
+                break;
+
+            case DefNode_ReadId :
+            case DefNode_SpotLen :
+            case DefNode_ReadLen :
+                if ( data->values[ op->type ].u32 != NULL )
+                {
+                    s = Defline_UToDec( num_end, *data->values[ op->type ].u32 );
+                    sz = num_end - s;
+                }
+                break;
+
+            default:
+                return RC( rcExe, rcNamelist, rcExecuting, rcId, rcInvalid );
+        }
+        if ( w + sz < buf_sz )
+        {
+            memcpy( &buf[ w ], s, sz );
+        }
+        w += sz;
+    }
+    if ( !cached && w < buf_sz )
+    {
+        /* whole defline is made of spot values */
+        Defline_CacheStore( def, data, buf, w );
+    }
+    *writ = w;
+    if ( w >= buf_sz )
+    {
+        return RC( rcExe, rcNamelist, rcExecuting, rcBuffer, rcInsufficient );
+    }
+    buf[ w ] = '\0';
+    return 0;
 }
 
 
@@ -357,7 +466,7 @@ static rc_t DeflineNode_Add( SLList* list, DefNode** node,
 }
 
 
-static void Defline_Release( SLList* list );
+static void DeflineList_Release( SLList* list );
 
 
 static void CC DeflineNode_Whack( SLNode* node, void* data )
@@ -371,14 +480,14 @@ static void CC DeflineNode_Whack( SLNode* node, void* data )
         }
         else if ( n->type == DefNode_Optional )
         {
-            Defline_Release( n->data.optional );
+            DeflineList_Release( n->data.optional );
         }
         free( node );
     }
 }
 
 
-static void Defline_Release( SLList* list )
+static void DeflineList_Release( SLList* list )
 {
     if ( list != NULL )
     {
@@ -427,7 +536,7 @@ static void CC Defline_Dump( SLNode* node, void* data )
 #endif
 
 
-static rc_t Defline_Parse( SLList** def, const char* line )
+static rc_t DeflineList_Parse( SLList** def, const char* line )
 {
     rc_t rc = 0;
     size_t i, sz, text = 0, opt_vars = 0;
@@ -587,6 +696,143 @@ static rc_t Defline_Parse( SLList** def, const char* line )
     return rc;
 }
 
+
+static void CC Defline_Measure( SLNode* node, void* data )
+{
+    DefNode* n = ( DefNode* )node;
+    size_t* d = ( size_t* )data;
+
+    /* d[ 0 ] counts ops, d[ 1 ] counts literal bytes */
+    d[ 0 ]++;
+    if ( n->type == DefNode_Text )
+    {
+        d[ 1 ] += strlen( n->data.text );
+    }
+    else if ( n->type == DefNode_Optional )
+    {
+        SLListForEach( n->data.optional, Defline_Measure, data );
+    }
+}
+
+
+typedef struct Defline_CompileData_struct
+{
+    Defline* def;
+    char* text;
+} Defline_CompileData;
+
+
+static void CC Defline_CompileNode( SLNode* node, void* data )
+{
+    DefNode* n = ( DefNode* )node;
+    Defline_CompileData* d = ( Defline_CompileData* )data;
+    DeflineOp* op = &d->def->ops[ d->def->count++ ];
+
+    op->type = n->type;
+    op->len = 0;
+    op->text = NULL;
+    if ( n->type == DefNode_Text )
+    {
+        op->len = strlen( n->data.text );
+        op->text = d->text;
+        memcpy( d->text, n->data.text, op->len );
+        d->text += op->len;
+    }
+    else if ( n->type == DefNode_Optional )
+    {
+        uint32_t first = d->def->count;
+        SLListForEach( n->data.optional, Defline_CompileNode, data );
+        op->len = d->def->count - first;
+    }
+}
+
+
+/* true if op and its group use only values which stay the same for all reads of a spot */
+static bool Defline_IsSpotOp( const Defline* def, uint32_t i )
+{
+    switch ( def->ops[ i ].type )
+    {
+        case DefNode_Text :
+        case DefNode_Accession :
+        case DefNode_SpotId :
+        case DefNode_SpotName :
+        case DefNode_SpotGroup :
+        case DefNode_SpotLen :
+            return true;
+
+        case DefNode_Optional :
+            {
+                uint32_t j;
+                for ( j = i + 1; j <= i + def->ops[ i ].len; j++ )
+                {
+                    if ( def->ops[ j ].type != DefNode_Optional && !Defline_IsSpotOp( def, j ) )
+                    {
+                        return false;
+                    }
+                }
+            }
+            return true;
+
+        default :
+            return false;
+    }
+}
+
+
+/* flattens parsed template into single memory block: header, ops, literals */
+static rc_t Defline_Compile( const SLList* list, Defline** def )
+{
+    size_t sz[ 2 ] = { 0, 0 };
+    Defline_CompileData d;
+
+    SLListForEach( list, Defline_Measure, sz );
+    d.def = malloc( sizeof( Defline ) + ( sz[ 0 ] > 0 ? sz[ 0 ] - 1 : 0 ) * sizeof( DeflineOp ) + sz[ 1 ] );
+    if ( d.def == NULL )
+    {
+        return RC( rcExe, rcNamelist, rcConstructing, rcMemory, rcExhausted );
+    }
+    d.def->count = 0;
+    d.text = ( char* )&d.def->ops[ sz[ 0 ] > 0 ? sz[ 0 ] : 1 ];
+    SLListForEach( list, Defline_CompileNode, &d );
+    /* leading spot part ends at first op with a read value, whole groups only */
+    d.def->spot_ops = 0;
+    while ( d.def->spot_ops < d.def->count && Defline_IsSpotOp( d.def, d.def->spot_ops ) )
+    {
+        if ( d.def->ops[ d.def->spot_ops ].type == DefNode_Optional )
+        {
+            d.def->spot_ops += d.def->ops[ d.def->spot_ops ].len;
+        }
+        d.def->spot_ops++;
+    }
+    *def = d.def;
+    return 0;
+}
+
+
+static void Defline_Release( Defline* def )
+{
+    free( def );
+}
+
+
+static rc_t Defline_Parse( Defline** def, const char* line )
+{
+    SLList* list = NULL;
+    rc_t rc;
+
+    if ( def == NULL )
+    {
+        return RC( rcExe, rcNamelist, rcConstructing, rcParam, rcInvalid );
+    }
+    rc = DeflineList_Parse( &list, line );
+    if ( rc == 0 )
+    {
+        rc = Defline_Compile( list, def );
+    }
+    DeflineList_Release( list );
+    return rc;
+}
+
 /* ### ALIGNMENT_COUNT based filtering ##################################################### */
 
 typedef struct AlignedFilter_struct
@@ -2075,6 +2321,50 @@ static rc_t FastqReadLenFilterFactory_Make( const SRASplitterFactory** cself,
 
 /* ============== FASTQ read splitter ============================ */
 
+#define FASTQ_READ_KEY_OFFSET 5
+
+/* read number keys are shared by all read splitters, build them once before dumping */
+static rc_t FastqReadSplitter_MakeKeyBuf( char** key_buf )
+{
+    rc_t rc = 0;
+    const size_t key_offset = FASTQ_READ_KEY_OFFSET;
+
+    if ( *key_buf == NULL )
+    {
+        /* initial alloc key_buf: "  1\0  2\0...\0  9\0 10\0 11\0...\03220..\08192\0" */
+        if ( nreads_max > 9999 )
+        {
+            /* key_offset and sprintf format size are insufficient for keys longer than 4 digits */
+            rc = RC( rcExe, rcNode, rcExecuting, rcBuffer, rcInsufficient );
+        }
+        else
+        {
+            char* buf = malloc( nreads_max * key_offset );
+            if ( buf == NULL )
+            {
+                rc = RC( rcExe, rcNode, rcExecuting, rcMemory, rcExhausted );
+            }
+            else
+            {
+                /* fill buffer w/keys */
+                int i;
+                char* p = buf;
+                for ( i = 1; rc == 0 && i <= nreads_max; i++ )
+                {
+                    if ( sprintf( p, "%4u", i ) <= 0 )
+                    {
+                        rc = RC( rcExe, rcNode, rcExecuting, rcTransfer, rcIncomplete );
+                    }
+                    p += key_offset;
+                }
+                *key_buf = buf;
+            }
+        }
+    }
+    return rc;
+}
+
+
 char* FastqReadSplitter_key_buf = NULL;
 
 
@@ -2091,7 +2381,7 @@ static rc_t FastqReadSplitter_GetKeySet( const SRASplitter* cself, const SRASpli
 {
     rc_t rc = 0;
     FastqReadSplitter* self = ( FastqReadSplitter* )cself;
-    const size_t key_offset = 5;
+    const size_t key_offset = FASTQ_READ_KEY_OFFSET;
 
     if ( self == NULL || key == NULL )
     {
@@ -2102,37 +2392,7 @@ static rc_t FastqReadSplitter_GetKeySet( const SRASplitter* cself, const SRASpli
         uint32_t num_reads = 0;
 
         *keys = 0;
-        if ( FastqReadSplitter_key_buf == NULL )
-        {
-            /* initial alloc key_buf: "  1\0  2\0...\0  9\0 10\0 11\0...\03220..\08192\0" */
-            if ( nreads_max > 9999 )
-            {
-                /* key_offset and sprintf format size are insufficient for keys longer than 4 digits */
-                rc = RC( rcExe, rcNode, rcExecuting, rcBuffer, rcInsufficient );
-            }
-            else
-            {
-                FastqReadSplitter_key_buf = malloc( nreads_max * key_offset );
-                if ( FastqReadSplitter_key_buf == NULL )
-                {
-                    rc = RC( rcExe, rcNode, rcExecuting, rcMemory, rcExhausted );
-                }
-                else
-                {
-                    /* fill buffer w/keys */
-                    int i;
-                    char* p = FastqReadSplitter_key_buf;
-                    for ( i = 1; rc == 0 && i <= nreads_max; i++ )
-                    {
-                        if ( sprintf( p, "%4u", i ) <= 0 )
-                        {
-                            rc = RC( rcExe, rcNode, rcExecuting, rcTransfer, rcIncomplete );
-                        }
-                        p += key_offset;
-                    }
-                }
-            }
-        }
+        rc = FastqReadSplitter_MakeKeyBuf( &FastqReadSplitter_key_buf );
 
         if ( rc == 0 )
         {
@@ -2235,6 +2495,10 @@ static rc_t FastqReadSplitterFactory_Init( const SRASplitterFactory* cself )
                               FastqArgs.is_platform_cs_native, false, FastqArgs.fasta > 0, false, 
                               false, !FastqArgs.applyClip, FastqArgs.SuppressQualForCSKey, 0,
                               FastqArgs.offset, '\0', 0, 0 );
+        if ( rc == 0 )
+        {
+            rc = FastqReadSplitter_MakeKeyBuf( &FastqReadSplitter_key_buf );
+        }
     }
     return rc;
 }
@@ -2318,7 +2582,7 @@ static rc_t Fastq3ReadSplitter_GetKeySet( const SRASplitter* cself, const SRASpl
 {
     rc_t rc = 0;
     Fastq3ReadSplitter* self = ( Fastq3ReadSplitter* )cself;
-    const size_t key_offset = 5;
+    const size_t key_offset = FASTQ_READ_KEY_OFFSET;
 
     if ( self == NULL || key == NULL )
     {
@@ -2329,37 +2593,7 @@ static rc_t Fastq3ReadSplitter_GetKeySet( const SRASplitter* cself, const SRASpl
         uint32_t num_reads = 0;
 
         *keys = 0;
-        if ( Fastq3ReadSplitter_key_buf == NULL )
-        {
-            /* initial alloc key_buf: "  1\0  2\0...\0  9\0 10\0 11\0...\03220..\08192\0" */
-            if ( nreads_max > 9999 )
-            {
-                /* key_offset and sprintf format size are insufficient for keys longer than 4 digits */
-                rc = RC( rcExe, rcNode, rcExecuting, rcBuffer, rcInsufficient );
-            }
-            else
-            {
-                Fastq3ReadSplitter_key_buf = malloc( nreads_max * key_offset );
-                if ( Fastq3ReadSplitter_key_buf == NULL )
-                {
-                    rc = RC( rcExe, rcNode, rcExecuting, rcMemory, rcExhausted );
-                }
-                else
-                {
-                    /* fill buffer w/keys */
-                    int i;
-                    char* p = Fastq3ReadSplitter_key_buf;
-                    for ( i = 1; rc == 0 && i <= nreads_max; i++ )
-                    {
-                        if ( sprintf( p, "%4u", i ) <= 0 )
-                        {
-                            rc = RC( rcExe, rcNode, rcExecuting, rcTransfer, rcIncomplete );
-                        }
-                        p += key_offset;
-                    }
-                }
-            }
-        }
+        rc = FastqReadSplitter_MakeKeyBuf( &Fastq3ReadSplitter_key_buf );
 
         if ( rc == 0 )
         {
@@ -2448,6 +2682,10 @@ static rc_t Fastq3ReadSplitterFactory_Init( const SRASplitterFactory* cself )
                               FastqArgs.is_platform_cs_native, false, FastqArgs.fasta > 0, false, 
                               false, !FastqArgs.applyClip, FastqArgs.SuppressQualForCSKey, 0,
                               FastqArgs.offset, '\0', 0, 0 );
+        if ( rc == 0 )
+        {
+            rc = FastqReadSplitter_MakeKeyBuf( &Fastq3ReadSplitter_key_buf );
+        }
     }
     return rc;
 }
@@ -2519,6 +2757,7 @@ static rc_t Fastq3ReadSplitterFactory_Make( const SRASplitterFactory** cself,
 typedef struct FastqFormatterSplitter_struct
 {
     const char* accession;
+    size_t accession_sz;
     const FastqReader* reader;
     KDataBuffer* b[ 5 ];
     size_t bsz[ 5 ]; /* fifth is for fasta line wrap */
@@ -2559,6 +2798,34 @@ static rc_t FastqFormatterSplitter_WrapLine( const KDataBuffer* src, size_t src_
 }
 
 
+/* writes first count buffers as lines of one record with a single commit into the output */
+static rc_t FastqFormatterSplitter_WriteRecord( const SRASplitter* cself, FastqFormatterSplitter* self,
+                                                spotid_t spot, uint32_t count )
+{
+    uint32_t k;
+    size_t sz = count;
+    char* d = NULL;
+    rc_t rc;
+
+    for ( k = 0; k < count; k++ )
+    {
+        sz += self->bsz[ k ];
+    }
+    rc = SRASplitter_FileReserve( cself, sz, &d );
+    if ( rc == 0 )
+    {
+        for ( k = 0; k < count; k++ )
+        {
+            memcpy( d, self->b[ k ]->base, self->bsz[ k ] );
+            d += self->bsz[ k ];
+            *d++ = '\n';
+        }
+        rc = SRASplitter_FileCommit( cself, spot, sz );
+    }
+    return rc;
+}
+
+
 static rc_t FastqFormatterSplitter_DumpByRead( const SRASplitter* cself, spotid_t spot, const readmask_t* readmask )
 {
     rc_t rc = 0;
@@ -2579,13 +2846,19 @@ static rc_t FastqFormatterSplitter_DumpByRead( const SRASplitter* cself, spotid_
                 DeflineData def_data;
                 const char* spot_name = NULL, *spot_group = NULL, *read_name = NULL;
                 uint32_t readIdx, spot_len = 0;
-                uint32_t num_reads, readId, k;
+                uint32_t num_reads, readId;
                 size_t sname_sz, sgrp_sz;
                 INSDC_coord_len rlabel_sz = 0, read_len = 0;
 
                 if ( FastqArgs.b_defline || FastqArgs.q_defline )
                 {
                     rc = FastqReader_SpotInfo( self->reader, &spot_name, &sname_sz, &spot_group, &sgrp_sz, &spot_len, &num_reads );
+                    if ( rc == 0 )
+                    {
+                        /* spot values stay bound for all reads */
+                        rc = Defline_Bind( &def_data, self->accession, self->accession_sz, &spot, spot_name, sname_sz,
+                                           spot_group, sgrp_sz, &spot_len, &readIdx, NULL, 0, &read_len );
+                    }
                 }
                 else
                 {
@@ -2603,8 +2876,7 @@ static rc_t FastqFormatterSplitter_DumpByRead( const SRASplitter* cself, spotid_
                         rc = FastqReader_SpotReadInfo( self->reader, readId, NULL, &read_name, &rlabel_sz, NULL, &read_len );
                         if ( rc == 0 )
                         {
-                            rc = Defline_Bind( &def_data, self->accession, &spot, spot_name, sname_sz, spot_group, sgrp_sz,
-                                               &spot_len, &readIdx, read_name, rlabel_sz, &read_len );
+                            Defline_BindRead( &def_data, read_name, rlabel_sz );
                         }
                     }
                     if ( rc == 0 )
@@ -2658,13 +2930,9 @@ static rc_t FastqFormatterSplitter_DumpByRead( const SRASplitter* cself, spotid_
                     {
                         ( (char*)(self->b[0]->base) )[0] = '>';
                     }
-                    for ( k = 0; rc == 0 && k < ( FastqArgs.fasta ? 2 : 4); k++ )
+                    if ( rc == 0 )
                     {
-                        rc = SRASplitter_FileWrite( cself, spot, self->b[ k ]->base, self->bsz[ k ] );
-                        if ( rc == 0 )
-                        {
-                            rc = SRASplitter_FileWrite( cself, spot, "\n", 1 );
-                        }
+                        rc = FastqFormatterSplitter_WriteRecord( cself, self, spot, FastqArgs.fasta ? 2 : 4 );
                     }
                 }
             }
@@ -2681,15 +2949,10 @@ static rc_t FastqFormatterSplitter_DumpByRead( const SRASplitter* cself, spotid_
 
 static rc_t Fasta_dump( const SRASplitter* cself, FastqFormatterSplitter* self, spotid_t spot, uint32_t columns )
 {
-    uint32_t readId;
     rc_t rc = FastqFormatterSplitter_WrapLine( self->b[4], self->bsz[4], self->b[1], &self->bsz[1], columns );
-    for ( readId = 0; rc == 0 && readId < 2; readId++ )
+    if ( rc == 0 )
     {
-        rc = SRASplitter_FileWrite( cself, spot, self->b[readId]->base, self->bsz[ readId ] );
-        if ( rc == 0 )
-        {
-            rc = SRASplitter_FileWrite( cself, spot, "\n", 1 );
-        }
+        rc = FastqFormatterSplitter_WriteRecord( cself, self, spot, 2 );
     }
     return rc;
 }
@@ -2737,8 +3000,8 @@ static rc_t FastqFormatterSplitter_DumpBySpot( const SRASplitter* cself, spotid_
                                                    &spot_group, &sgrp_sz, &spot_len, NULL );
                         if ( rc == 0 )
                         {
-                            rc = Defline_Bind( &def_data, self->accession, &spot, spot_name,
-                                               sname_sz, spot_group, sgrp_sz, 
+                            rc = Defline_Bind( &def_data, self->accession, self->accession_sz, &spot, spot_name,
+                                               sname_sz, spot_group, sgrp_sz,
                                                &spot_len, &readId, NULL, 0, &spot_len );
                         }
                     }
@@ -2802,14 +3065,7 @@ static rc_t FastqFormatterSplitter_DumpBySpot( const SRASplitter* cself, spotid_
                         }
                         else
                         {
-                            for ( readId = 0; rc == 0 && readId < 4; readId++ )
-                            {
-                                rc = SRASplitter_FileWrite( cself, spot, self->b[readId]->base, self->bsz[ readId ] );
-                                if ( rc == 0 )
-                                {
-                                    rc = SRASplitter_FileWrite( cself, spot, "\n", 1 );
-                                }
-                            }
+                            rc = FastqFormatterSplitter_WriteRecord( cself, self, spot, 4 );
                         }
                     }
                 }
@@ -2881,6 +3137,7 @@ static rc_t FastqFormatterFactory_NewObj( const SRASplitterFactory* cself, const
         {
             int i;
             ( (FastqFormatterSplitter*)(*splitter) )->accession = self->accession;
+            ( (FastqFormatterSplitter*)(*splitter) )->accession_sz = strlen( self->accession );
             ( (FastqFormatterSplitter*)(*splitter) )->reader = self->reader;
             for ( i = 0; i < sizeof( self->buf ) / sizeof( self->buf[ 0 ] ); i++ )
             {
@@ -3661,11 +3918,12 @@ rc_t FastqDumper_Factories( const SRADumperFmt* fmt, const SRASplitterFactory**
 
     if ( rc == 0 )
     {
-        if ( FastqArgs.b_deffmt != NULL )
+        /* templates are compiled once and shared by all factory chains */
+        if ( FastqArgs.b_deffmt != NULL && FastqArgs.b_defline == NULL )
         {
             rc = Defline_Parse( &FastqArgs.b_defline, FastqArgs.b_deffmt );
         }
-        if ( FastqArgs.q_deffmt != NULL )
+        if ( rc == 0 && FastqArgs.q_deffmt != NULL && FastqArgs.q_defline == NULL )
         {
             rc = Defline_Parse( &FastqArgs.q_defline, FastqArgs.q_deffmt );
         }
@@ -200,6 +200,8 @@ rc_t SRADumper_Init(SRADumperFmt* fmt)
     fmt->arg_desc = NULL;
     fmt->add_arg = NULL;
     fmt->get_factory = SFFDumper_Factories;
+    /* file header is rewritten with total number of reads at the end */
+    fmt->single_threaded = true;
     fmt->gzip = false;
     fmt->bzip2 = false;
 
@@ -0,0 +1,538 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "bam_index.h"
+
+#include <klib/log.h>
+#include <sysalloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* the pseudo-bin with the offsets and counts of a reference, as written by samtools */
+#define BAI_MAX_BIN     37450
+#define BAI_META_BIN    37450
+/* the linear index has one entry per 16k of the reference */
+#define BAI_LIN_SHIFT   14
+#define BAI_UNSET       ( ( uint64_t )-1 )
+
+/* the fixed part of a record, without the block-size in front of it */
+#define BAM_REC_FIXED   32
+#define BAM_FLAG_UNMAPPED 0x4
+
+/* where the parser of the stream is */
+enum bam_index_state
+{
+    bis_magic = 0,      /* "BAM\1" and the length of the header-text */
+    bis_n_ref,          /* number of references, after the header-text */
+    bis_ref_name_len,   /* length of the name of a reference */
+    bis_ref_len,        /* length of a reference, after its name */
+    bis_rec_size,       /* block-size of a record */
+    bis_rec,            /* the record itself */
+    bis_failed          /* not a BAM-stream, nothing more is looked at */
+};
+
+
+typedef struct bai_bin
+{
+    uint32_t bin;
+    uint32_t n_chunk, chunk_cap;
+    uint64_t * chunk;           /* pairs of uncompressed positions [ beg, end ) */
+} bai_bin;
+
+
+typedef struct bai_ref
+{
+    bai_bin * bins;
+    uint32_t n_bin, bin_cap;
+    uint64_t * intv;            /* linear index, BAI_UNSET for the windows without records */
+    uint32_t n_intv, intv_cap;
+    uint64_t beg, end;          /* positions of the first and behind the last record */
+    uint64_t n_mapped, n_unmapped;
+} bai_ref;
+
+
+struct bam_index
+{
+    enum bam_index_state state;
+    rc_t rc;
+
+    /* the unit of the stream the parser waits for */
+    uint8_t * buf;
+    size_t buf_cap;
+    size_t have, need;
+    uint64_t skip;              /* bytes to pass over before the unit ( header-text, reference-name ) */
+    uint64_t upos;              /* position in the uncompressed stream */
+    uint64_t rec_start;         /* where the current record starts, its block-size included */
+
+    bai_ref * refs;
+    int32_t n_ref;
+    int32_t refs_seen;
+
+    /* the sort-order is checked along the way */
+    int32_t cur_ref;
+    int32_t last_pos;
+    bool no_coor_seen;
+    uint64_t n_no_coor;
+
+    /* bin -> index into refs[ cur_ref ].bins, -1 if not used yet */
+    int32_t slot[ BAI_MAX_BIN ];
+};
+
+
+static uint32_t get_le16( const uint8_t * p )
+{
+    return ( uint32_t )p[ 0 ] | ( ( uint32_t )p[ 1 ] << 8 );
+}
+
+
+static uint32_t get_le32( const uint8_t * p )
+{
+    return get_le16( p ) | ( get_le16( p + 2 ) << 16 );
+}
+
+
+/* the bin of the binning-index for the interval [ beg, end ), as in the SAM-spec */
+static uint32_t bai_reg2bin( int32_t beg, int32_t end )
+{
+    --end;
+    if ( beg >> 14 == end >> 14 ) return ( ( 1 << 15 ) - 1 ) / 7 + ( beg >> 14 );
+    if ( beg >> 17 == end >> 17 ) return ( ( 1 << 12 ) - 1 ) / 7 + ( beg >> 17 );
+    if ( beg >> 20 == end >> 20 ) return ( ( 1 << 9 ) - 1 ) / 7 + ( beg >> 20 );
+    if ( beg >> 23 == end >> 23 ) return ( ( 1 << 6 ) - 1 ) / 7 + ( beg >> 23 );
+    if ( beg >> 26 == end >> 26 ) return ( ( 1 << 3 ) - 1 ) / 7 + ( beg >> 26 );
+    return 0;
+}
+
+
+static void bai_fail( struct bam_index * self, rc_t rc )
+{
+    if ( self->rc == 0 )
+        self->rc = rc;
+    self->state = bis_failed;
+}
+
+
+static bool bai_grow( void ** p, uint32_t * cap, uint32_t needed, size_t elem_size )
+{
+    if ( needed > *cap )
+    {
+        uint32_t new_cap = ( *cap == 0 ) ? 16 : *cap;
+        void * n;
+        while ( new_cap < needed )
+            new_cap *= 2;
+        n = realloc( *p, new_cap * elem_size );
+        if ( n == NULL )
+            return false;
+        *p = n;
+        *cap = new_cap;
+    }
+    return true;
+}
+
+
+/* the parser waits for the next size bytes of the stream, after passing over skip bytes */
+static bool bai_expect( struct bam_index * self, enum bam_index_state state, uint64_t skip, size_t size )
+{
+    if ( size > self->buf_cap )
+    {
+        uint8_t * b = realloc( self->buf, size );
+        if ( b == NULL )
+            return false;
+        self->buf = b;
+        self->buf_cap = size;
+    }
+    self->state = state;
+    self->skip = skip;
+    self->need = size;
+    self->have = 0;
+    return true;
+}
+
+
+static rc_t bai_add_chunk( bai_ref * ref, bai_bin * bin, uint64_t beg, uint64_t end )
+{
+    /* the records of a bin that follow each other in the stream make one chunk */
+    if ( bin->n_chunk > 0 && bin->chunk[ 2 * bin->n_chunk - 1 ] == beg )
+        bin->chunk[ 2 * bin->n_chunk - 1 ] = end;
+    else if ( !bai_grow( ( void ** )&bin->chunk, &bin->chunk_cap, bin->n_chunk + 1, 2 * sizeof bin->chunk[ 0 ] ) )
+        return RC( rcExe, rcIndex, rcConstructing, rcMemory, rcExhausted );
+    else
+    {
+        bin->chunk[ 2 * bin->n_chunk ] = beg;
+        bin->chunk[ 2 * bin->n_chunk + 1 ] = end;
+        bin->n_chunk++;
+    }
+    return 0;
+}
+
+
+static rc_t bai_add_record( struct bam_index * self, const uint8_t * rec, size_t size )
+{
+    int32_t ref_id = ( int32_t )get_le32( rec );
+    int32_t pos = ( int32_t )get_le32( rec + 4 );
+    uint32_t l_read_name = rec[ 8 ];
+    uint32_t n_cigar = get_le16( rec + 12 );
+    uint32_t flag = get_le16( rec + 14 );
+    const uint8_t * cigar = rec + BAM_REC_FIXED + l_read_name;
+    int32_t ref_len = 0, end;
+    uint32_t i, bin_nr, w;
+    bai_ref * ref;
+    bai_bin * bin;
+    rc_t rc;
+
+    if ( BAM_REC_FIXED + l_read_name + 4 * ( size_t )n_cigar > size || ref_id >= self->n_ref || ref_id < -1 )
+        return RC( rcExe, rcIndex, rcConstructing, rcData, rcCorrupt );
+
+    /* the unplaced records come last, they are only counted */
+    if ( ref_id < 0 || pos < 0 )
+    {
+        self->no_coor_seen = true;
+        self->n_no_coor++;
+        return 0;
+    }
+    if ( self->no_coor_seen || ref_id < self->cur_ref || ( ref_id == self->cur_ref && pos < self->last_pos ) )
+        return RC( rcExe, rcIndex, rcConstructing, rcData, rcOutoforder );
+
+    if ( ref_id != self->cur_ref )
+    {
+        /* the bins of the previous reference are complete, the lookup starts over */
+        if ( self->cur_ref >= 0 )
+        {
+            ref = &self->refs[ self->cur_ref ];
+            for ( i = 0; i < ref->n_bin; ++i )
+                self->slot[ ref->bins[ i ].bin ] = -1;
+        }
+        self->cur_ref = ref_id;
+    }
+    self->last_pos = pos;
+    ref = &self->refs[ ref_id ];
+
+    /* M, D, N, = and X consume the reference */
+    for ( i = 0; i < n_cigar; ++i )
+    {
+        uint32_t op = get_le32( cigar + 4 * i );
+        switch ( op & 0xF )
+        {
+            case 0 : case 2 : case 3 : case 7 : case 8 : ref_len += op >> 4; break;
+        }
+    }
+    end = pos + ( ( ( flag & BAM_FLAG_UNMAPPED ) == 0 && ref_len > 0 ) ? ref_len : 1 );
+
+    bin_nr = bai_reg2bin( pos, end );
+    if ( self->slot[ bin_nr ] < 0 )
+    {
+        if ( !bai_grow( ( void ** )&ref->bins, &ref->bin_cap, ref->n_bin + 1, sizeof ref->bins[ 0 ] ) )
+            return RC( rcExe, rcIndex, rcConstructing, rcMemory, rcExhausted );
+        bin = &ref->bins[ ref->n_bin ];
+        memset( bin, 0, sizeof *bin );
+        bin->bin = bin_nr;
+        self->slot[ bin_nr ] = ( int32_t )ref->n_bin++;
+    }
+    bin = &ref->bins[ self->slot[ bin_nr ] ];
+    rc = bai_add_chunk( ref, bin, self->rec_start, self->upos );
+    if ( rc != 0 )
+        return rc;
+
+    /* the linear index: the first record that overlaps a window */
+    w = ( uint32_t )( ( end - 1 ) >> BAI_LIN_SHIFT );
+    if ( w >= ref->n_intv )
+    {
+        if ( !bai_grow( ( void ** )&ref->intv, &ref->intv_cap, w + 1, sizeof ref->intv[ 0 ] ) )
+            return RC( rcExe, rcIndex, rcConstructing, rcMemory, rcExhausted );
+        for ( i = ref->n_intv; i <= w; ++i )
+            ref->intv[ i ] = BAI_UNSET;
+        ref->n_intv = w + 1;
+    }
+    for ( i = ( uint32_t )( pos >> BAI_LIN_SHIFT ); i <= w; ++i )
+    {
+        if ( ref->intv[ i ] == BAI_UNSET )
+            ref->intv[ i ] = self->rec_start;
+    }
+
+    if ( ref->n_mapped + ref->n_unmapped == 0 )
+        ref->beg = self->rec_start;
+    ref->end = self->upos;
+    if ( flag & BAM_FLAG_UNMAPPED )
+        ref->n_unmapped++;
+    else
+        ref->n_mapped++;
+    return 0;
+}
+
+
+/* a unit of the stream is complete in self->buf */
+static void bai_unit( struct bam_index * self )
+{
+    rc_t rc = 0;
+    bool ok = true;
+    switch ( self->state )
+    {
+        case bis_magic :
+            if ( memcmp( self->buf, "BAM\1", 4 ) != 0 )
+                rc = RC( rcExe, rcIndex, rcConstructing, rcFormat, rcInvalid );
+            else
+                ok = bai_expect( self, bis_n_ref, get_le32( self->buf + 4 ), 4 );
+            break;
+
+        case bis_n_ref :
+            self->n_ref = ( int32_t )get_le32( self->buf );
+            if ( self->n_ref < 0 )
+                rc = RC( rcExe, rcIndex, rcConstructing, rcFormat, rcInvalid );
+            else if ( self->n_ref > 0 && ( self->refs = calloc( self->n_ref, sizeof self->refs[ 0 ] ) ) == NULL )
+                ok = false;
+            else
+                ok = bai_expect( self, self->n_ref > 0 ? bis_ref_name_len : bis_rec_size, 0, 4 );
+            break;
+
+        case bis_ref_name_len :
+            ok = bai_expect( self, bis_ref_len, get_le32( self->buf ), 4 );
+            break;
+
+        case bis_ref_len :
+            ok = bai_expect( self, ++self->refs_seen < self->n_ref ? bis_ref_name_len : bis_rec_size, 0, 4 );
+            break;
+
+        case bis_rec_size :
+            {
+                uint32_t block_size = get_le32( self->buf );
+                self->rec_start = self->upos - 4;
+                if ( block_size < BAM_REC_FIXED )
+                    rc = RC( rcExe, rcIndex, rcConstructing, rcData, rcCorrupt );
+                else
+                    ok = bai_expect( self, bis_rec, 0, block_size );
+            }
+            break;
+
+        case bis_rec :
+            rc = bai_add_record( self, self->buf, self->need );
+            if ( rc == 0 )
+                ok = bai_expect( self, bis_rec_size, 0, 4 );
+            break;
+
+        case bis_failed :
+            break;
+    }
+    if ( rc == 0 && !ok )
+        rc = RC( rcExe, rcIndex, rcConstructing, rcMemory, rcExhausted );
+    if ( rc != 0 )
+        bai_fail( self, rc );
+}
+
+
+rc_t make_bam_index( struct bam_index ** self )
+{
+    rc_t rc = 0;
+    struct bam_index * idx = calloc( 1, sizeof *idx );
+    *self = NULL;
+    if ( idx == NULL )
+        rc = RC( rcExe, rcIndex, rcConstructing, rcMemory, rcExhausted );
+    else
+    {
+        uint32_t i;
+        for ( i = 0; i < BAI_MAX_BIN; ++i )
+            idx->slot[ i ] = -1;
+        idx->cur_ref = -1;
+        if ( !bai_expect( idx, bis_magic, 0, 8 ) )
+        {
+            rc = RC( rcExe, rcIndex, rcConstructing, rcMemory, rcExhausted );
+            free( idx );
+        }
+        else
+            *self = idx;
+    }
+    if ( rc != 0 )
+        (void)LOGERR( klogErr, rc, "cannot create bam-index" );
+    return rc;
+}
+
+
+void bam_index_feed( struct bam_index * self, const char * data, size_t size )
+{
+    while ( size > 0 && self->state != bis_failed )
+    {
+        size_t n;
+        if ( self->skip > 0 )
+        {
+            n = ( self->skip < size ) ? ( size_t )self->skip : size;
+            self->skip -= n;
+        }
+        else
+        {
+            n = self->need - self->have;
+            if ( n > size )
+                n = size;
+            memmove( self->buf + self->have, data, n );
+            self->have += n;
+        }
+        data += n;
+        size -= n;
+        self->upos += n;
+        if ( self->skip == 0 && self->have == self->need )
+            bai_unit( self );
+    }
+}
+
+
+/* ----------------------------------------------------------------------------------------------- */
+
+
+typedef struct bai_out
+{
+    KFile * dst;
+    uint64_t pos;
+    rc_t rc;
+    size_t len;
+    uint8_t buf[ 64 * 1024 ];
+} bai_out;
+
+
+static void bai_flush( bai_out * out )
+{
+    if ( out->rc == 0 && out->len > 0 )
+    {
+        size_t num_writ;
+        out->rc = KFileWriteAll( out->dst, out->pos, out->buf, out->len, &num_writ );
+        out->pos += num_writ;
+    }
+    out->len = 0;
+}
+
+
+static void bai_put( bai_out * out, uint64_t value, uint32_t bytes )
+{
+    uint32_t i;
+    if ( out->len + bytes > sizeof out->buf )
+        bai_flush( out );
+    for ( i = 0; i < bytes; ++i )
+    {
+        out->buf[ out->len++ ] = ( uint8_t )( value & 0xFF );
+        value >>= 8;
+    }
+}
+
+
+static void bai_write_ref( bai_out * out, bai_ref * ref, bam_index_voffset_func voffset, void * data )
+{
+    uint32_t i, j;
+    bool has_meta = ( ref->n_mapped + ref->n_unmapped > 0 );
+    uint64_t last;
+
+    bai_put( out, ref->n_bin + ( has_meta ? 1 : 0 ), 4 );
+    for ( i = 0; i < ref->n_bin; ++i )
+    {
+        bai_bin * bin = &ref->bins[ i ];
+        uint32_t n = 0;
+        /* translated into virtual offsets, chunks that meet in the same bgzf-block are merged */
+        for ( j = 0; j < bin->n_chunk; ++j )
+        {
+            uint64_t beg = voffset( data, bin->chunk[ 2 * j ] );
+            uint64_t end = voffset( data, bin->chunk[ 2 * j + 1 ] );
+            if ( n > 0 && ( bin->chunk[ 2 * n - 1 ] >> 16 ) == ( beg >> 16 ) )
+                bin->chunk[ 2 * n - 1 ] = end;
+            else
+            {
+                bin->chunk[ 2 * n ] = beg;
+                bin->chunk[ 2 * n + 1 ] = end;
+                n++;
+            }
+        }
+        bai_put( out, bin->bin, 4 );
+        bai_put( out, n, 4 );
+        for ( j = 0; j < 2 * n; ++j )
+            bai_put( out, bin->chunk[ j ], 8 );
+    }
+    if ( has_meta )
+    {
+        bai_put( out, BAI_META_BIN, 4 );
+        bai_put( out, 2, 4 );
+        bai_put( out, voffset( data, ref->beg ), 8 );
+        bai_put( out, voffset( data, ref->end ), 8 );
+        bai_put( out, ref->n_mapped, 8 );
+        bai_put( out, ref->n_unmapped, 8 );
+    }
+
+    /* the windows without a record of their own get the offset of the window before them */
+    bai_put( out, ref->n_intv, 4 );
+    last = BAI_UNSET;
+    for ( i = 0; i < ref->n_intv && last == BAI_UNSET; ++i )
+        last = ref->intv[ i ];
+    last = ( last == BAI_UNSET ) ? 0 : voffset( data, last );
+    for ( i = 0; i < ref->n_intv; ++i )
+    {
+        if ( ref->intv[ i ] != BAI_UNSET )
+            last = voffset( data, ref->intv[ i ] );
+        bai_put( out, last, 8 );
+    }
+}
+
+
+rc_t bam_index_write( struct bam_index * self, KFile * dst, bam_index_voffset_func voffset, void * data )
+{
+    rc_t rc = self->rc;
+    if ( rc == 0 && ( self->state != bis_rec_size || self->have != 0 ) )
+        rc = RC( rcExe, rcIndex, rcWriting, rcData, rcCorrupt ); /* the stream ended in the middle */
+    if ( rc == 0 )
+    {
+        int32_t i;
+        bai_out * out = calloc( 1, sizeof *out );
+        if ( out == NULL )
+            return RC( rcExe, rcIndex, rcWriting, rcMemory, rcExhausted );
+        out->dst = dst;
+        bai_put( out, 'B', 1 );
+        bai_put( out, 'A', 1 );
+        bai_put( out, 'I', 1 );
+        bai_put( out, 1, 1 );
+        bai_put( out, ( uint32_t )self->n_ref, 4 );
+        for ( i = 0; i < self->n_ref; ++i )
+            bai_write_ref( out, &self->refs[ i ], voffset, data );
+        bai_put( out, self->n_no_coor, 8 );
+        bai_flush( out );
+        rc = out->rc;
+        free( out );
+    }
+    return rc;
+}
+
+
+void release_bam_index( struct bam_index * self )
+{
+    if ( self != NULL )
+    {
+        int32_t i;
+        uint32_t j;
+        for ( i = 0; i < self->n_ref; ++i )
+        {
+            bai_ref * ref = &self->refs[ i ];
+            for ( j = 0; j < ref->n_bin; ++j )
+                free( ref->bins[ j ].chunk );
+            free( ref->bins );
+            free( ref->intv );
+        }
+        free( self->refs );
+        free( self->buf );
+        free( self );
+    }
+}
@@ -0,0 +1,62 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_bam_index_
+#define _h_bam_index_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <klib/rc.h>
+#include <kfs/file.h>
+
+/* builds a BAI-index of a BAM-file while it is written: it reads the uncompressed BAM-stream
+   ( header and records ), the positions in it are translated into virtual file-offsets at the end,
+   when the compressed positions of all blocks are known.
+   the records have to be sorted by reference and position, otherwise no index is written */
+
+struct bam_index;
+
+rc_t make_bam_index( struct bam_index ** self );
+
+/* the uncompressed BAM-stream, in pieces of any size, in order */
+void bam_index_feed( struct bam_index * self, const char * data, size_t size );
+
+/* translates an uncompressed position of the stream into a virtual file-offset */
+typedef uint64_t ( CC * bam_index_voffset_func )( void * data, uint64_t upos );
+
+/* writes the index into dst, fails with rcOutoforder if the records were not sorted
+   and with rcCorrupt if the stream was not a complete BAM-file */
+rc_t bam_index_write( struct bam_index * self, KFile * dst, bam_index_voffset_func voffset, void * data );
+
+void release_bam_index( struct bam_index * self );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_bam_index_ */
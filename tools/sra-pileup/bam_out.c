@@ -0,0 +1,691 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "bam_out.h"
+#include "cg_tools.h"
+
+#include <klib/log.h>
+#include <sysalloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* the fixed part of a record in front of the read-name, including the block-size */
+#define BAM_CORE_SIZE 36
+
+#define BAM_OFS_REF_ID      4
+#define BAM_OFS_POS         8
+#define BAM_OFS_NAME_LEN    12
+#define BAM_OFS_MAPQ        13
+#define BAM_OFS_BIN         14
+#define BAM_OFS_N_CIGAR     16
+#define BAM_OFS_FLAG        18
+#define BAM_OFS_L_SEQ       20
+#define BAM_OFS_NEXT_REF_ID 24
+#define BAM_OFS_NEXT_POS    28
+#define BAM_OFS_TLEN        32
+
+/* room for a tag with an integer-value */
+#define BAM_TAG_INT_SIZE 7
+
+typedef struct bam_ref
+{
+    const char * name;      /* 0-terminated, points into bam_dict.names */
+    size_t name_len;
+    int32_t id;
+} bam_ref;
+
+
+/* the references of the written header, sorted by name for bam_ref_id() */
+static struct
+{
+    char * names;
+    bam_ref * refs;
+    uint32_t count;
+} bam_dict;
+
+
+/* bases to 4-bit codes: "=ACMGRSVTWYHKDBN", everything else is 'N' */
+static const uint8_t bam_nt16[ 256 ] =
+{
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  0, 15, 15,
+    15,  1, 14,  2, 13, 15, 15,  4, 11, 15, 15, 12, 15,  3, 15, 15,
+    15, 15,  5,  6,  8, 15,  7,  9, 15, 10, 15, 15, 15, 15, 15, 15,
+    15,  1, 14,  2, 13, 15, 15,  4, 11, 15, 15, 12, 15,  3, 15, 15,
+    15, 15,  5,  6,  8, 15,  7,  9, 15, 10, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15
+};
+
+
+static void put_le16( char * p, uint32_t value )
+{
+    p[ 0 ] = ( char )( value & 0xFF );
+    p[ 1 ] = ( char )( ( value >> 8 ) & 0xFF );
+}
+
+
+static void put_le32( char * p, uint32_t value )
+{
+    put_le16( p, value & 0xFFFF );
+    put_le16( p + 2, value >> 16 );
+}
+
+
+static int cmp_name( const char * a, size_t a_len, const char * b, size_t b_len )
+{
+    int res = memcmp( a, b, a_len < b_len ? a_len : b_len );
+    if ( res == 0 && a_len != b_len )
+        res = ( a_len < b_len ) ? -1 : 1;
+    return res;
+}
+
+
+static int CC cmp_bam_ref( const void * a, const void * b )
+{
+    const bam_ref * ra = a;
+    const bam_ref * rb = b;
+    return cmp_name( ra->name, ra->name_len, rb->name, rb->name_len );
+}
+
+
+/* the value of the field "XX:" in a tab-separated header-line */
+static const char * header_field( const char * line, size_t len, const char * key, size_t * value_len )
+{
+    size_t i = 0;
+    while ( i < len )
+    {
+        size_t end = i;
+        while ( end < len && line[ end ] != '\t' )
+            end++;
+        if ( end - i >= 3 && line[ i ] == key[ 0 ] && line[ i + 1 ] == key[ 1 ] && line[ i + 2 ] == ':' )
+        {
+            *value_len = end - i - 3;
+            return &line[ i + 3 ];
+        }
+        i = end + 1;
+    }
+    return NULL;
+}
+
+
+/* calls f for every @SQ-line with a name, in the order of the text */
+static rc_t for_each_sq_line( const char * text, size_t len,
+                              rc_t ( * f )( const char * name, size_t name_len, uint32_t ref_len, void * data ),
+                              void * data )
+{
+    rc_t rc = 0;
+    size_t i = 0;
+    while ( rc == 0 && i < len )
+    {
+        size_t end = i;
+        while ( end < len && text[ end ] != '\n' )
+            end++;
+        if ( end - i > 4 && memcmp( &text[ i ], "@SQ\t", 4 ) == 0 )
+        {
+            size_t name_len, ln_len;
+            const char * name = header_field( &text[ i + 4 ], end - i - 4, "SN", &name_len );
+            const char * ln = header_field( &text[ i + 4 ], end - i - 4, "LN", &ln_len );
+            if ( name != NULL && name_len > 0 )
+            {
+                uint32_t ref_len = 0;
+                size_t j;
+                for ( j = 0; ln != NULL && j < ln_len && ln[ j ] >= '0' && ln[ j ] <= '9'; ++j )
+                    ref_len = ref_len * 10 + ( ln[ j ] - '0' );
+                rc = f( name, name_len, ref_len, data );
+            }
+        }
+        i = end + 1;
+    }
+    return rc;
+}
+
+
+typedef struct header_ctx
+{
+    uint32_t count;
+    size_t names_size;
+    char * dst;             /* NULL: only count */
+} header_ctx;
+
+
+static rc_t CC on_sq_line( const char * name, size_t name_len, uint32_t ref_len, void * data )
+{
+    header_ctx * hctx = data;
+    if ( hctx->dst != NULL )
+    {
+        /* the references in the binary header, the names are copied into the dictionary */
+        char * p = hctx->dst;
+        char * name_copy = &bam_dict.names[ hctx->names_size ];
+        bam_ref * ref = &bam_dict.refs[ hctx->count ];
+
+        put_le32( p, ( uint32_t )( name_len + 1 ) );
+        memmove( p + 4, name, name_len );
+        p[ 4 + name_len ] = 0;
+        put_le32( p + 4 + name_len + 1, ref_len );
+        hctx->dst = p + 4 + name_len + 1 + 4;
+
+        memmove( name_copy, name, name_len );
+        name_copy[ name_len ] = 0;
+        ref->name = name_copy;
+        ref->name_len = name_len;
+        ref->id = ( int32_t )hctx->count;
+    }
+    hctx->count++;
+    hctx->names_size += name_len + 1;
+    return 0;
+}
+
+
+rc_t write_bam_header( const char * text, size_t len )
+{
+    rc_t rc = 0;
+    header_ctx hctx;
+    size_t size;
+    char * buffer;
+
+    release_bam_header();
+    memset( &hctx, 0, sizeof hctx );
+    for_each_sq_line( text, len, on_sq_line, &hctx );
+
+    /* magic, l_text, text, n_ref, per reference: l_name, name + 0, l_ref */
+    size = 4 + 4 + len + 4 + hctx.names_size + 8 * ( size_t )hctx.count;
+    buffer = malloc( size );
+    bam_dict.names = malloc( hctx.names_size + 1 );
+    bam_dict.refs = malloc( ( hctx.count + 1 ) * sizeof bam_dict.refs[ 0 ] );
+    if ( buffer == NULL || bam_dict.names == NULL || bam_dict.refs == NULL )
+    {
+        rc = RC( rcExe, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        (void)LOGERR( klogErr, rc, "cannot create bam-header" );
+    }
+    else
+    {
+        memmove( buffer, "BAM\1", 4 );
+        put_le32( buffer + 4, ( uint32_t )len );
+        memmove( buffer + 8, text, len );
+        put_le32( buffer + 8 + len, hctx.count );
+
+        hctx.count = 0;
+        hctx.names_size = 0;
+        hctx.dst = buffer + 8 + len + 4;
+        for_each_sq_line( text, len, on_sq_line, &hctx );
+        bam_dict.count = hctx.count;
+        qsort( bam_dict.refs, bam_dict.count, sizeof bam_dict.refs[ 0 ], cmp_bam_ref );
+
+        rc = write_2_kout( buffer, size ); /* out_buf.c */
+    }
+    if ( buffer != NULL )
+        free( buffer );
+    return rc;
+}
+
+
+void release_bam_header( void )
+{
+    if ( bam_dict.names != NULL )
+        free( bam_dict.names );
+    if ( bam_dict.refs != NULL )
+        free( bam_dict.refs );
+    memset( &bam_dict, 0, sizeof bam_dict );
+}
+
+
+int32_t bam_ref_id( const char * name, size_t len )
+{
+    uint32_t lo = 0, hi = bam_dict.count;
+    while ( lo < hi )
+    {
+        uint32_t mid = lo + ( hi - lo ) / 2;
+        const bam_ref * ref = &bam_dict.refs[ mid ];
+        int cmp = cmp_name( name, len, ref->name, ref->name_len );
+        if ( cmp == 0 )
+            return ref->id;
+        else if ( cmp < 0 )
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return -1;
+}
+
+
+/* ----------------------------------------------------------------------------------------------- */
+
+
+/* the bin of the binning-index for the interval [ beg, end ), as in the SAM-spec */
+static uint32_t bam_reg2bin( int32_t beg, int32_t end )
+{
+    --end;
+    if ( beg >> 14 == end >> 14 ) return ( ( 1 << 15 ) - 1 ) / 7 + ( beg >> 14 );
+    if ( beg >> 17 == end >> 17 ) return ( ( 1 << 12 ) - 1 ) / 7 + ( beg >> 17 );
+    if ( beg >> 20 == end >> 20 ) return ( ( 1 << 9 ) - 1 ) / 7 + ( beg >> 20 );
+    if ( beg >> 23 == end >> 23 ) return ( ( 1 << 6 ) - 1 ) / 7 + ( beg >> 23 );
+    if ( beg >> 26 == end >> 26 ) return ( ( 1 << 3 ) - 1 ) / 7 + ( beg >> 26 );
+    return 0;
+}
+
+
+rc_t bam_rec_begin( out_buf * out, size_t * rec )
+{
+    rc_t rc = reserve_out_buf( out, BAM_CORE_SIZE );
+    if ( rc == 0 )
+    {
+        *rec = out->used;
+        memset( &out->data[ out->used ], 0, BAM_CORE_SIZE );
+        out->used += BAM_CORE_SIZE;
+    }
+    return rc;
+}
+
+
+rc_t bam_rec_name_done( out_buf * out, size_t rec )
+{
+    rc_t rc = reserve_out_buf( out, 1 );
+    if ( rc == 0 )
+    {
+        size_t name_len;
+        out_buf_char( out, 0 );
+        name_len = out->used - rec - BAM_CORE_SIZE;
+        if ( name_len > 255 )
+            rc = RC( rcExe, rcNoTarg, rcWriting, rcName, rcExcessive );
+        else
+            out->data[ rec + BAM_OFS_NAME_LEN ] = ( char )name_len;
+    }
+    return rc;
+}
+
+
+void bam_rec_core( out_buf * out, size_t rec, int32_t ref_id, int32_t pos, int32_t mapq, uint32_t flags,
+                   int32_t next_ref_id, int32_t next_pos, int32_t tlen )
+{
+    char * p = &out->data[ rec ];
+    put_le32( p + BAM_OFS_REF_ID, ( uint32_t )ref_id );
+    put_le32( p + BAM_OFS_POS, ( uint32_t )pos );
+    p[ BAM_OFS_MAPQ ] = ( char )( ( mapq < 0 || mapq > 255 ) ? 255 : mapq );
+    put_le16( p + BAM_OFS_FLAG, flags );
+    put_le32( p + BAM_OFS_NEXT_REF_ID, ( uint32_t )next_ref_id );
+    put_le32( p + BAM_OFS_NEXT_POS, ( uint32_t )next_pos );
+    put_le32( p + BAM_OFS_TLEN, ( uint32_t )tlen );
+}
+
+
+static int cigar_op_code( char c )
+{
+    switch ( c )
+    {
+        case 'M' : return 0;
+        case 'I' : return 1;
+        case 'D' : return 2;
+        case 'N' : return 3;
+        case 'S' : return 4;
+        case 'H' : return 5;
+        case 'P' : return 6;
+        case '=' : return 7;
+        case 'X' : return 8;
+    }
+    return -1;
+}
+
+
+/* appends one operation, the room for it has been reserved by the caller */
+static rc_t put_cigar_op( out_buf * out, char c, uint32_t op_len, int32_t * ref_len )
+{
+    int op = cigar_op_code( c );
+    if ( op < 0 )
+        return RC( rcExe, rcNoTarg, rcWriting, rcData, rcInvalid );
+    put_le32( &out->data[ out->used ], ( op_len << 4 ) | ( uint32_t )op );
+    out->used += 4;
+    /* M, D, N, =, X consume the reference */
+    if ( op == 0 || op == 2 || op == 3 || op == 7 || op == 8 )
+        *ref_len += op_len;
+    return 0;
+}
+
+
+static rc_t bam_rec_cigar_done( out_buf * out, size_t rec, int32_t pos, uint32_t n_ops, int32_t ref_len )
+{
+    char * p = &out->data[ rec ];
+    if ( n_ops > 0xFFFF )
+        return RC( rcExe, rcNoTarg, rcWriting, rcData, rcExcessive );
+    put_le16( p + BAM_OFS_N_CIGAR, n_ops );
+    put_le16( p + BAM_OFS_BIN, bam_reg2bin( pos, pos + ( ref_len > 0 ? ref_len : 1 ) ) );
+    return 0;
+}
+
+
+rc_t bam_rec_cigar( out_buf * out, size_t rec, int32_t pos, const char * cigar, size_t len )
+{
+    /* every operation needs at least 2 chars of text */
+    rc_t rc = reserve_out_buf( out, ( len / 2 + 1 ) * 4 );
+    if ( rc == 0 )
+    {
+        uint32_t n_ops = 0, op_len = 0;
+        int32_t ref_len = 0;
+        size_t i;
+        for ( i = 0; rc == 0 && i < len; ++i )
+        {
+            char c = cigar[ i ];
+            if ( c >= '0' && c <= '9' )
+                op_len = op_len * 10 + ( c - '0' );
+            else
+            {
+                rc = put_cigar_op( out, c, op_len, &ref_len );
+                n_ops++;
+                op_len = 0;
+            }
+        }
+        if ( rc == 0 )
+            rc = bam_rec_cigar_done( out, rec, pos, n_ops, ref_len );
+    }
+    return rc;
+}
+
+
+rc_t bam_rec_cig_ops( out_buf * out, size_t rec, int32_t pos, const CigOps * ops, uint32_t n_ops )
+{
+    rc_t rc = reserve_out_buf( out, n_ops * 4 );
+    if ( rc == 0 )
+    {
+        int32_t ref_len = 0;
+        uint32_t i;
+        for ( i = 0; rc == 0 && i < n_ops; ++i )
+            rc = put_cigar_op( out, ops[ i ].op, ops[ i ].oplen, &ref_len );
+        if ( rc == 0 )
+            rc = bam_rec_cigar_done( out, rec, pos, n_ops, ref_len );
+    }
+    return rc;
+}
+
+
+rc_t bam_rec_seq_qual( out_buf * out, size_t rec, const char * read, size_t read_len,
+                       const char * qual, size_t qual_len, const uint8_t * tab )
+{
+    rc_t rc = reserve_out_buf( out, ( read_len + 1 ) / 2 + read_len );
+    if ( rc == 0 )
+    {
+        char * p = &out->data[ out->used ];
+        size_t i;
+
+        put_le32( &out->data[ rec + BAM_OFS_L_SEQ ], ( uint32_t )read_len );
+
+        /* 2 bases per byte, the first one in the high nibble */
+        for ( i = 0; i + 1 < read_len; i += 2 )
+            *p++ = ( char )( ( bam_nt16[ ( uint8_t )read[ i ] ] << 4 ) | bam_nt16[ ( uint8_t )read[ i + 1 ] ] );
+        if ( i < read_len )
+            *p++ = ( char )( bam_nt16[ ( uint8_t )read[ i ] ] << 4 );
+
+        if ( qual != NULL && qual_len == read_len )
+        {
+            for ( i = 0; i < read_len; ++i )
+                p[ i ] = ( char )( tab[ ( uint8_t )qual[ i ] ] - 33 );
+        }
+        else
+            memset( p, 0xFF, read_len );
+        out->used = ( p + read_len ) - out->data;
+    }
+    return rc;
+}
+
+
+/* 'Z' and 'H' are both stored as 0-terminated text */
+static rc_t bam_rec_tag_text( out_buf * out, const char * tag, char type, const char * value, size_t len )
+{
+    rc_t rc = reserve_out_buf( out, len + 4 );
+    if ( rc == 0 )
+    {
+        out_buf_mem( out, tag, 2 );
+        out_buf_char( out, type );
+        out_buf_mem( out, value, len );
+        out_buf_char( out, 0 );
+    }
+    return rc;
+}
+
+
+rc_t bam_rec_tag_Z( out_buf * out, const char * tag, const char * value, size_t len )
+{
+    return bam_rec_tag_text( out, tag, 'Z', value, len );
+}
+
+
+rc_t bam_rec_tag_A( out_buf * out, const char * tag, char value )
+{
+    rc_t rc = reserve_out_buf( out, 4 );
+    if ( rc == 0 )
+    {
+        out_buf_mem( out, tag, 2 );
+        out_buf_char( out, 'A' );
+        out_buf_char( out, value );
+    }
+    return rc;
+}
+
+
+/* the smallest integer-type that holds the value, like samtools does it */
+rc_t bam_rec_tag_int( out_buf * out, const char * tag, int64_t value )
+{
+    rc_t rc = reserve_out_buf( out, BAM_TAG_INT_SIZE );
+    if ( rc == 0 )
+    {
+        char * p = &out->data[ out->used ];
+        p[ 0 ] = tag[ 0 ];
+        p[ 1 ] = tag[ 1 ];
+        if ( value < 0 )
+        {
+            if ( value >= -128 )
+            {
+                p[ 2 ] = 'c';
+                p[ 3 ] = ( char )value;
+                out->used += 4;
+            }
+            else if ( value >= -32768 )
+            {
+                p[ 2 ] = 's';
+                put_le16( p + 3, ( uint32_t )value );
+                out->used += 5;
+            }
+            else
+            {
+                p[ 2 ] = 'i';
+                put_le32( p + 3, ( uint32_t )value );
+                out->used += 7;
+            }
+        }
+        else
+        {
+            if ( value <= 0xFF )
+            {
+                p[ 2 ] = 'C';
+                p[ 3 ] = ( char )value;
+                out->used += 4;
+            }
+            else if ( value <= 0xFFFF )
+            {
+                p[ 2 ] = 'S';
+                put_le16( p + 3, ( uint32_t )value );
+                out->used += 5;
+            }
+            else
+            {
+                p[ 2 ] = 'I';
+                put_le32( p + 3, ( uint32_t )value );
+                out->used += 7;
+            }
+        }
+    }
+    return rc;
+}
+
+
+static int64_t parse_int64( const char * s, size_t len )
+{
+    int64_t res = 0;
+    bool neg = ( len > 0 && s[ 0 ] == '-' );
+    size_t i = ( neg || ( len > 0 && s[ 0 ] == '+' ) ) ? 1 : 0;
+    for ( ; i < len && s[ i ] >= '0' && s[ i ] <= '9'; ++i )
+        res = res * 10 + ( s[ i ] - '0' );
+    return neg ? -res : res;
+}
+
+
+/* the bits of a single-precision float, as BAM stores them */
+static uint32_t parse_float_bits( const char * s, size_t len )
+{
+    char buffer[ 64 ];
+    union { float f; uint32_t u; } value;
+
+    if ( len >= sizeof buffer )
+        len = sizeof buffer - 1;
+    memmove( buffer, s, len );
+    buffer[ len ] = 0;
+    value.f = ( float )strtod( buffer, NULL );
+    return value.u;
+}
+
+
+static rc_t bam_rec_tag_f( out_buf * out, const char * tag, const char * value, size_t len )
+{
+    rc_t rc = reserve_out_buf( out, 7 );
+    if ( rc == 0 )
+    {
+        char * p = &out->data[ out->used ];
+        p[ 0 ] = tag[ 0 ];
+        p[ 1 ] = tag[ 1 ];
+        p[ 2 ] = 'f';
+        put_le32( p + 3, parse_float_bits( value, len ) );
+        out->used += 7;
+    }
+    return rc;
+}
+
+
+/* "t,v1,v2,...": subtype t, then an int32 count and the values as that subtype */
+static rc_t bam_rec_tag_B( out_buf * out, const char * tag, const char * value, size_t len )
+{
+    rc_t rc = 0;
+    size_t elem_size, count = 0, i;
+
+    switch ( len > 0 ? value[ 0 ] : 0 )
+    {
+        case 'c' : case 'C' : elem_size = 1; break;
+        case 's' : case 'S' : elem_size = 2; break;
+        case 'i' : case 'I' : case 'f' : elem_size = 4; break;
+        default  : return RC( rcExe, rcNoTarg, rcWriting, rcFormat, rcUnsupported );
+    }
+    if ( len > 1 && value[ 1 ] != ',' )
+        return RC( rcExe, rcNoTarg, rcWriting, rcFormat, rcInvalid );
+    for ( i = 1; i < len; ++i )
+    {
+        if ( value[ i ] == ',' )
+            count++;
+    }
+
+    rc = reserve_out_buf( out, 8 + count * elem_size );
+    if ( rc == 0 )
+    {
+        char * p = &out->data[ out->used ];
+        p[ 0 ] = tag[ 0 ];
+        p[ 1 ] = tag[ 1 ];
+        p[ 2 ] = 'B';
+        p[ 3 ] = value[ 0 ];
+        put_le32( p + 4, ( uint32_t )count );
+        p += 8;
+
+        i = 1;
+        while ( i < len )
+        {
+            size_t end = ++i;  /* skip the comma */
+            while ( end < len && value[ end ] != ',' )
+                end++;
+            if ( value[ 0 ] == 'f' )
+                put_le32( p, parse_float_bits( &value[ i ], end - i ) );
+            else
+            {
+                uint32_t v = ( uint32_t )parse_int64( &value[ i ], end - i );
+                switch ( elem_size )
+                {
+                    case 1  : p[ 0 ] = ( char )v; break;
+                    case 2  : put_le16( p, v ); break;
+                    default : put_le32( p, v ); break;
+                }
+            }
+            p += elem_size;
+            i = end;
+        }
+        out->used += 8 + count * elem_size;
+    }
+    return rc;
+}
+
+
+rc_t bam_rec_tags_text( out_buf * out, const char * text, size_t len )
+{
+    rc_t rc = 0;
+    size_t i = 0;
+    while ( rc == 0 && i < len )
+    {
+        size_t end = i;
+        while ( end < len && text[ end ] != '\t' )
+            end++;
+        /* "XX:t:value" */
+        if ( end - i >= 5 && text[ i + 2 ] == ':' && text[ i + 4 ] == ':' )
+        {
+            const char * value = &text[ i + 5 ];
+            size_t value_len = end - i - 5;
+            switch ( text[ i + 3 ] )
+            {
+                case 'i' : rc = bam_rec_tag_int( out, &text[ i ], parse_int64( value, value_len ) ); break;
+                case 'A' : rc = bam_rec_tag_A( out, &text[ i ], value_len > 0 ? value[ 0 ] : ' ' ); break;
+                case 'f' : rc = bam_rec_tag_f( out, &text[ i ], value, value_len ); break;
+                case 'Z' :
+                case 'H' : rc = bam_rec_tag_text( out, &text[ i ], text[ i + 3 ], value, value_len ); break;
+                case 'B' : rc = bam_rec_tag_B( out, &text[ i ], value, value_len ); break;
+                default  : rc = RC( rcExe, rcNoTarg, rcWriting, rcFormat, rcUnsupported ); break;
+            }
+            if ( rc != 0 && GetRCObject( rc ) == ( enum RCObject )rcFormat )
+            {
+                PLOGERR( klogErr, ( klogErr, rc, "cannot write optional field '$(field)' as BAM",
+                                    "field=%.*s", ( int )( end - i ), &text[ i ] ) );
+            }
+        }
+        i = end + 1;
+    }
+    return rc;
+}
+
+
+void bam_rec_end( out_buf * out, size_t rec )
+{
+    put_le32( &out->data[ rec ], ( uint32_t )( out->used - rec - 4 ) );
+}
@@ -0,0 +1,84 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_bam_out_
+#define _h_bam_out_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <klib/rc.h>
+#include "out_buf.h"
+
+/* the header: magic, the text of the sam-header, the references taken from its @SQ-lines.
+   the references stay as the dictionary for bam_ref_id() until release_bam_header(), it is
+   filled before the first record and read-only afterwards: the slice-workers use it without a lock */
+rc_t write_bam_header( const char * text, size_t len );
+
+void release_bam_header( void );
+
+/* the position of a reference in the bam-header, -1 if it is not in there */
+int32_t bam_ref_id( const char * name, size_t len );
+
+
+/* a record is built in an out_buf with keep set, because the fixed part in front is filled in
+   after the variable fields are appended: bam_rec_begin() returns the offset of the record */
+rc_t bam_rec_begin( out_buf * out, size_t * rec );
+
+/* terminates the read-name, that was appended after bam_rec_begin() */
+rc_t bam_rec_name_done( out_buf * out, size_t rec );
+
+void bam_rec_core( out_buf * out, size_t rec, int32_t ref_id, int32_t pos, int32_t mapq, uint32_t flags,
+                   int32_t next_ref_id, int32_t next_pos, int32_t tlen );
+
+/* the text-cigar as binary operations, the bin is calculated from pos and the cigar */
+rc_t bam_rec_cigar( out_buf * out, size_t rec, int32_t pos, const char * cigar, size_t len );
+
+/* the same for a cigar that is already binary ( cg-treatments ), without going through its text */
+struct CigOps;
+rc_t bam_rec_cig_ops( out_buf * out, size_t rec, int32_t pos, const struct CigOps * ops, uint32_t n_ops );
+
+/* qual is phred+33 like in SAM, translated by tab ( quantization ), NULL or a different length: no quality */
+rc_t bam_rec_seq_qual( out_buf * out, size_t rec, const char * read, size_t read_len,
+                       const char * qual, size_t qual_len, const uint8_t * tab );
+
+/* optional fields, tag is 2 chars */
+rc_t bam_rec_tag_Z( out_buf * out, const char * tag, const char * value, size_t len );
+rc_t bam_rec_tag_A( out_buf * out, const char * tag, char value );
+rc_t bam_rec_tag_int( out_buf * out, const char * tag, int64_t value );
+
+/* optional fields as text "XX:t:value", separated by tabs */
+rc_t bam_rec_tags_text( out_buf * out, const char * text, size_t len );
+
+/* sets the block-size */
+void bam_rec_end( out_buf * out, size_t rec );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_bam_out_ */
@@ -0,0 +1,458 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "bgzf.h"
+
+#include <klib/log.h>
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+#include <sysalloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+/* like samtools: 0xFF00 bytes of data deflate into less than 64k, even if they do not compress */
+#define BGZF_BLOCK_DATA 0xFF00
+#define BGZF_BLOCK_MAX 0x10000
+#define BGZF_HDR_SIZE 18
+#define BGZF_FTR_SIZE 8
+
+/* every worker can deflate one block while the writer fills the next ones */
+#define BGZF_BLOCKS_PER_THREAD 2
+
+/* gzip-header with the extra-field 'BC', followed by the size of the block - 1 ( 16 bit ) */
+static const uint8_t bgzf_hdr[ BGZF_HDR_SIZE - 2 ] =
+{
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00
+};
+
+/* an empty block marks the end of a BGZF-file */
+static const uint8_t bgzf_eof[ 28 ] =
+{
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43,
+    0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+
+enum bgzf_block_state
+{
+    bbs_empty = 0,  /* owned by the writer, beeing filled */
+    bbs_filled,     /* waiting for a worker */
+    bbs_working,    /* beeing deflated by a worker */
+    bbs_done        /* deflated, waiting to be written by the writer */
+};
+
+
+typedef struct bgzf_block
+{
+    uint8_t data[ BGZF_BLOCK_DATA ];
+    uint8_t compressed[ BGZF_BLOCK_MAX ];
+    size_t data_len;
+    size_t compressed_len;
+    rc_t rc;
+    enum bgzf_block_state state;
+} bgzf_block;
+
+
+struct bgzf_writer;
+
+typedef struct bgzf_worker
+{
+    struct bgzf_writer * writer;
+    KThread * thread;
+    z_stream strm;
+    bool strm_ok;
+} bgzf_worker;
+
+
+typedef struct bgzf_writer
+{
+    KFile * dst;
+    uint64_t pos;
+    uint64_t upos;              /* uncompressed bytes written so far */
+
+    /* where each block starts in dst, for the virtual offsets of an index ( 8 bytes per 64k block ),
+       after bgzf_writer_finish() one more entry: where the eof-marker starts */
+    uint64_t * block_pos;
+    uint64_t block_pos_count;
+    uint64_t block_pos_cap;
+    bool finished;
+
+    /* a ring of blocks: block #n lives in blocks[ n % block_count ] */
+    bgzf_block * blocks;
+    uint32_t block_count;
+    uint64_t next_fill;         /* number of the block the writer fills */
+    uint64_t next_deflate;      /* number of the next block a worker takes */
+
+    /* num_threads == 0: there is one worker without thread, it deflates on the calling thread */
+    bgzf_worker * workers;
+    uint32_t num_threads;
+    uint32_t started;
+    KLock * lock;
+    KCondition * cond;
+    bool quit;
+} bgzf_writer;
+
+
+static void put_le16( uint8_t * p, uint32_t value )
+{
+    p[ 0 ] = ( uint8_t )( value & 0xFF );
+    p[ 1 ] = ( uint8_t )( ( value >> 8 ) & 0xFF );
+}
+
+
+static void put_le32( uint8_t * p, uint32_t value )
+{
+    put_le16( p, value & 0xFFFF );
+    put_le16( p + 2, value >> 16 );
+}
+
+
+static void deflate_block( z_stream * strm, bgzf_block * blk )
+{
+    uint8_t * p = blk->compressed;
+    int zres;
+
+    strm->next_in = blk->data;
+    strm->avail_in = ( uInt )blk->data_len;
+    strm->next_out = p + BGZF_HDR_SIZE;
+    strm->avail_out = BGZF_BLOCK_MAX - BGZF_HDR_SIZE - BGZF_FTR_SIZE;
+
+    zres = deflate( strm, Z_FINISH );
+    if ( zres != Z_STREAM_END )
+        blk->rc = RC( rcExe, rcFile, rcWriting, rcBuffer, rcInsufficient );
+    else
+    {
+        size_t len = BGZF_BLOCK_MAX - strm->avail_out;
+        memmove( p, bgzf_hdr, sizeof bgzf_hdr );
+        put_le16( p + BGZF_HDR_SIZE - 2, ( uint32_t )( len - 1 ) );
+        put_le32( p + len - 8, ( uint32_t )crc32( crc32( 0L, Z_NULL, 0 ), blk->data, ( uInt )blk->data_len ) );
+        put_le32( p + len - 4, ( uint32_t )blk->data_len );
+        blk->compressed_len = len;
+        blk->rc = 0;
+    }
+    deflateReset( strm );
+}
+
+
+static rc_t add_block_pos( bgzf_writer * self )
+{
+    if ( self->block_pos_count == self->block_pos_cap )
+    {
+        uint64_t cap = ( self->block_pos_cap == 0 ) ? 1024 : self->block_pos_cap * 2;
+        uint64_t * p = realloc( self->block_pos, cap * sizeof p[ 0 ] );
+        if ( p == NULL )
+            return RC( rcExe, rcFile, rcWriting, rcMemory, rcExhausted );
+        self->block_pos = p;
+        self->block_pos_cap = cap;
+    }
+    self->block_pos[ self->block_pos_count++ ] = self->pos;
+    return 0;
+}
+
+
+static rc_t write_block( bgzf_writer * self, bgzf_block * blk )
+{
+    rc_t rc = blk->rc;
+    if ( rc != 0 )
+        LOGERR( klogErr, rc, "deflating a bgzf-block failed" );
+    else if ( ( rc = add_block_pos( self ) ) != 0 )
+        LOGERR( klogErr, rc, "cannot record the position of a bgzf-block" );
+    else
+    {
+        size_t num_writ;
+        rc = KFileWriteAll( self->dst, self->pos, blk->compressed, blk->compressed_len, &num_writ );
+        if ( rc == 0 )
+            self->pos += num_writ;
+    }
+    blk->data_len = 0;
+    return rc;
+}
+
+
+static rc_t CC bgzf_worker_thread( const KThread *self, void *data )
+{
+    bgzf_worker * w = data;
+    bgzf_writer * bw = w->writer;
+
+    KLockAcquire( bw->lock );
+    while ( true )
+    {
+        if ( bw->next_deflate < bw->next_fill )
+        {
+            bgzf_block * blk = &bw->blocks[ bw->next_deflate++ % bw->block_count ];
+            blk->state = bbs_working;
+            KLockUnlock( bw->lock );
+
+            deflate_block( &w->strm, blk );
+
+            KLockAcquire( bw->lock );
+            blk->state = bbs_done;
+            KConditionBroadcast( bw->cond );
+        }
+        else if ( bw->quit )
+            break;
+        else
+            KConditionWait( bw->cond, bw->lock );
+    }
+    KLockUnlock( bw->lock );
+    return 0;
+}
+
+
+/* hands the block the writer has filled over to the workers,
+   then waits until the next block of the ring is written and can be filled */
+static rc_t submit_block( bgzf_writer * self )
+{
+    rc_t rc = 0;
+    bgzf_block * blk = &self->blocks[ self->next_fill % self->block_count ];
+
+    if ( self->num_threads == 0 )
+    {
+        deflate_block( &self->workers[ 0 ].strm, blk );
+        self->next_fill++;
+        return write_block( self, blk );
+    }
+
+    KLockAcquire( self->lock );
+    blk->state = bbs_filled;
+    self->next_fill++;
+    KConditionBroadcast( self->cond );
+
+    blk = &self->blocks[ self->next_fill % self->block_count ];
+    while ( rc == 0 && blk->state != bbs_empty )
+    {
+        if ( blk->state == bbs_done )
+        {
+            /* the oldest block in the ring, the ones before it are already written */
+            KLockUnlock( self->lock );
+            rc = write_block( self, blk );
+            KLockAcquire( self->lock );
+            blk->state = bbs_empty;
+        }
+        else
+            KConditionWait( self->cond, self->lock );
+    }
+    KLockUnlock( self->lock );
+    return rc;
+}
+
+
+static void whack_bgzf_writer( bgzf_writer * self )
+{
+    uint32_t i, n = ( self->num_threads > 0 ) ? self->num_threads : 1;
+    if ( self->lock != NULL )
+    {
+        KLockAcquire( self->lock );
+        self->quit = true;
+        if ( self->cond != NULL )
+            KConditionBroadcast( self->cond );
+        KLockUnlock( self->lock );
+    }
+    for ( i = 0; i < self->started; ++i )
+    {
+        rc_t status;
+        KThreadWait( self->workers[ i ].thread, &status );
+        KThreadRelease( self->workers[ i ].thread );
+    }
+    if ( self->workers != NULL )
+    {
+        for ( i = 0; i < n; ++i )
+        {
+            if ( self->workers[ i ].strm_ok )
+                deflateEnd( &self->workers[ i ].strm );
+        }
+        free( self->workers );
+    }
+    if ( self->cond != NULL ) KConditionRelease( self->cond );
+    if ( self->lock != NULL ) KLockRelease( self->lock );
+    if ( self->blocks != NULL ) free( self->blocks );
+    if ( self->block_pos != NULL ) free( self->block_pos );
+    free( self );
+}
+
+
+rc_t make_bgzf_writer( struct bgzf_writer ** self, KFile * dst, uint32_t num_threads, int level )
+{
+    rc_t rc = 0;
+    uint32_t i, n = ( num_threads > 0 ) ? num_threads : 1;
+    bgzf_writer * bw = calloc( 1, sizeof *bw );
+    *self = NULL;
+    if ( bw == NULL )
+    {
+        rc = RC( rcExe, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        (void)LOGERR( klogErr, rc, "cannot create bgzf-writer" );
+        return rc;
+    }
+
+    bw->dst = dst;
+    bw->num_threads = num_threads;
+    bw->block_count = ( num_threads > 0 ) ? num_threads * BGZF_BLOCKS_PER_THREAD : 1;
+    bw->blocks = calloc( bw->block_count, sizeof bw->blocks[ 0 ] );
+    bw->workers = calloc( n, sizeof bw->workers[ 0 ] );
+    if ( bw->blocks == NULL || bw->workers == NULL )
+    {
+        rc = RC( rcExe, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        (void)LOGERR( klogErr, rc, "cannot create bgzf-blocks" );
+    }
+
+    /* raw deflate ( negative window-bits ): the gzip-header and -footer are made by deflate_block() */
+    for ( i = 0; rc == 0 && i < n; ++i )
+    {
+        bgzf_worker * w = &bw->workers[ i ];
+        w->writer = bw;
+        if ( deflateInit2( &w->strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+        {
+            rc = RC( rcExe, rcNoTarg, rcConstructing, rcParam, rcInvalid );
+            (void)PLOGERR( klogErr, ( klogErr, rc, "cannot init deflate with level $(l)", "l=%d", level ) );
+        }
+        else
+            w->strm_ok = true;
+    }
+
+    if ( rc == 0 && num_threads > 0 )
+    {
+        rc = KLockMake ( &bw->lock );
+        if ( rc != 0 )
+        {
+            LOGERR( klogInt, rc, "KLockMake() failed" );
+        }
+        if ( rc == 0 )
+        {
+            rc = KConditionMake ( &bw->cond );
+            if ( rc != 0 )
+            {
+                LOGERR( klogInt, rc, "KConditionMake() failed" );
+            }
+        }
+        while ( rc == 0 && bw->started < num_threads )
+        {
+            bgzf_worker * w = &bw->workers[ bw->started ];
+            rc = KThreadMake ( &w->thread, bgzf_worker_thread, w );
+            if ( rc != 0 )
+            {
+                LOGERR( klogInt, rc, "KThreadMake() failed" );
+            }
+            else
+                bw->started++;
+        }
+    }
+
+    if ( rc == 0 )
+        *self = bw;
+    else
+        whack_bgzf_writer( bw );
+    return rc;
+}
+
+
+rc_t bgzf_writer_write( struct bgzf_writer * self, const char * data, size_t size )
+{
+    rc_t rc = 0;
+    while ( rc == 0 && size > 0 )
+    {
+        bgzf_block * blk = &self->blocks[ self->next_fill % self->block_count ];
+        size_t n = BGZF_BLOCK_DATA - blk->data_len;
+        if ( n > size )
+            n = size;
+        memmove( &blk->data[ blk->data_len ], data, n );
+        blk->data_len += n;
+        self->upos += n;
+        data += n;
+        size -= n;
+        if ( blk->data_len == BGZF_BLOCK_DATA )
+            rc = submit_block( self );
+    }
+    return rc;
+}
+
+
+rc_t bgzf_writer_finish( struct bgzf_writer * self )
+{
+    rc_t rc = 0;
+    if ( !self->finished )
+    {
+        bgzf_block * blk = &self->blocks[ self->next_fill % self->block_count ];
+        self->finished = true;
+        if ( blk->data_len > 0 )
+            rc = submit_block( self );
+
+        /* the blocks still in the ring, in the order they were filled */
+        if ( self->num_threads > 0 )
+        {
+            uint64_t nr = ( self->next_fill > self->block_count ) ? self->next_fill - self->block_count : 0;
+            for ( ; rc == 0 && nr < self->next_fill; ++nr )
+            {
+                blk = &self->blocks[ nr % self->block_count ];
+                KLockAcquire( self->lock );
+                while ( blk->state == bbs_filled || blk->state == bbs_working )
+                    KConditionWait( self->cond, self->lock );
+                KLockUnlock( self->lock );
+                if ( blk->state == bbs_done )
+                {
+                    rc = write_block( self, blk );
+                    blk->state = bbs_empty;
+                }
+            }
+        }
+
+        if ( rc == 0 )
+            rc = add_block_pos( self );
+        if ( rc == 0 )
+        {
+            size_t num_writ;
+            rc = KFileWriteAll( self->dst, self->pos, bgzf_eof, sizeof bgzf_eof, &num_writ );
+            if ( rc == 0 )
+                self->pos += num_writ;
+        }
+    }
+    return rc;
+}
+
+
+uint64_t bgzf_writer_voffset( const struct bgzf_writer * self, uint64_t upos )
+{
+    uint64_t nr = upos / BGZF_BLOCK_DATA;
+    if ( upos >= self->upos || nr >= self->block_pos_count )
+    {
+        /* the end of the data: the start of the eof-marker */
+        return ( self->block_pos_count > 0 ) ? self->block_pos[ self->block_pos_count - 1 ] << 16 : 0;
+    }
+    return ( self->block_pos[ nr ] << 16 ) | ( upos % BGZF_BLOCK_DATA );
+}
+
+
+rc_t release_bgzf_writer( struct bgzf_writer * self )
+{
+    rc_t rc = 0;
+    if ( self != NULL )
+    {
+        rc = bgzf_writer_finish( self );
+        whack_bgzf_writer( self );
+    }
+    return rc;
+}
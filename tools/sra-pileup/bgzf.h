@@ -0,0 +1,64 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_bgzf_
+#define _h_bgzf_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <klib/rc.h>
+#include <kfs/file.h>
+
+/* writer for the blocked gzip-format ( BGZF ) of BAM-files and tabix:
+   the data is cut into blocks of at most 0xFF00 bytes, each block is a complete gzip-member.
+   the blocks are deflated by worker-threads and written in order, the result is readable by gzip */
+
+struct bgzf_writer;
+
+/* num_threads == 0 ... deflate on the calling thread, level 0...9 ( 0 = stored blocks ),
+   does not take ownership of dst */
+rc_t make_bgzf_writer( struct bgzf_writer ** self, KFile * dst, uint32_t num_threads, int level );
+
+/* only from one thread at a time */
+rc_t bgzf_writer_write( struct bgzf_writer * self, const char * data, size_t size );
+
+/* writes the pending blocks and the end-of-file marker, nothing can be written afterwards */
+rc_t bgzf_writer_finish( struct bgzf_writer * self );
+
+/* after bgzf_writer_finish(): the virtual file-offset of an uncompressed position, as used by BAM-indices
+   ( start of the block in the file << 16 | position in the block ) */
+uint64_t bgzf_writer_voffset( const struct bgzf_writer * self, uint64_t upos );
+
+/* finishes the output if not done yet, stops the worker-threads */
+rc_t release_bgzf_writer( struct bgzf_writer * self );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_bgzf_ */
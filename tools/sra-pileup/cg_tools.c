@@ -26,6 +26,7 @@
 
 #include "cg_tools.h"
 #include "debug.h"
+#include "dyn_string.h"
 #include <klib/out.h>
 
 #include <klib/printf.h>
@@ -101,6 +102,60 @@ int32_t ExplodeCIGAR( CigOps dst[], uint32_t len, char const cigar[], uint32_t c
 }
 
 
+/* "00" ... "99": CG-operations are almost always shorter than 100, these take a single lookup */
+static const char two_digits[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+
+static size_t fmt_cigar_elem( char * dst, uint32_t cig_oplen, char cig_op )
+{
+    size_t n;
+    if ( cig_oplen < 10 )
+    {
+        dst[ 0 ] = ( char )( '0' + cig_oplen );
+        n = 1;
+    }
+    else if ( cig_oplen < 100 )
+    {
+        dst[ 0 ] = two_digits[ cig_oplen * 2 ];
+        dst[ 1 ] = two_digits[ cig_oplen * 2 + 1 ];
+        n = 2;
+    }
+    else
+    {
+        char tmp[ MAX_CIG_OP_CHARS ];
+        size_t i = 0;
+        while ( cig_oplen > 0 )
+        {
+            tmp[ i++ ] = ( char )( '0' + ( cig_oplen % 10 ) );
+            cig_oplen /= 10;
+        }
+        for ( n = 0; i > 0; ++n )
+            dst[ n ] = tmp[ --i ];
+    }
+    dst[ n++ ] = cig_op;
+    return n;
+}
+
+
+uint32_t ImplodeCIGAR( char dst[], CigOps const ops[], uint32_t n_ops )
+{
+    uint32_t i, j;
+    for ( i = j = 0; i < n_ops; ++i )
+        j += fmt_cigar_elem( &dst[ j ], ops[ i ].oplen, ops[ i ].op );
+    return j;
+}
+
+
 typedef struct cgOp_s
 {
     uint16_t length;
@@ -454,22 +509,7 @@ static rc_t CIGAR_to_CG_Ops( const cg_cigar_input * input,
 
 static rc_t adjust_cigar( const cg_cigar_input * input, cg_cigar_temp * tmp, cg_cigar_output * output )
 {
-    rc_t rc = 0;
-    unsigned i, j;
-
-    print_CG_cigar( __LINE__, tmp->cigOp, tmp->opCnt, NULL );
-
-    /* remove zero length ops */
-    for ( j = i = 0; i < tmp->opCnt; )
-    {
-        if ( tmp->cigOp[ j ].length == 0 )
-        {
-            ++j;
-            --(tmp->opCnt);
-            continue;
-        }
-        tmp->cigOp[ i++ ] = tmp->cigOp[ j++ ];
-    }
+    uint32_t i, n;
 
     print_CG_cigar( __LINE__, tmp->cigOp, tmp->opCnt, NULL );
 
@@ -484,26 +524,24 @@ static rc_t adjust_cigar( const cg_cigar_input * input, cg_cigar_temp * tmp, cg_
         output->edit_dist = input->edit_dist;
     }
 
-    /* merge adjacent ops */
-    for ( i = tmp->opCnt; i > 1; )
+    /* remove zero length ops and merge adjacent ops in one pass, straight into the binary output */
+    for ( i = n = 0; i < tmp->opCnt; ++i )
     {
-        --i;
-        if ( tmp->cigOp[ i - 1 ].code == tmp->cigOp[ i ].code )
+        const cgOp * op = &tmp->cigOp[ i ];
+        if ( op->length > 0 )
         {
-            tmp->cigOp[ i - 1 ].length += tmp->cigOp[ i ].length;
-            memmove( &tmp->cigOp[ i ], &tmp->cigOp[ i + 1 ], ( tmp->opCnt - 1 - i ) * sizeof( tmp->cigOp[ 0 ] ) );
-            --(tmp->opCnt);
+            if ( n > 0 && output->cig_ops[ n - 1 ].op == op->code )
+                output->cig_ops[ n - 1 ].oplen += op->length;
+            else
+                SetCigOp( &output->cig_ops[ n++ ], op->code, op->length );
         }
     }
-    print_CG_cigar( __LINE__, tmp->cigOp, tmp->opCnt, NULL );
-    for ( i = j = 0; i < tmp->opCnt && rc == 0; ++i )
-    {
-        size_t sz;
-        rc = string_printf( &output->cigar[ j ], sizeof( output->cigar ) - j, &sz, "%u%c", tmp->cigOp[ i ].length, tmp->cigOp[ i ].code );
-        j += sz;
-    }
-    output->cigar_len = j;
-    return rc;
+    output->n_cig_ops = n;
+
+    /* opCnt < MAX_READ_LEN, the text fits into output->cigar */
+    output->cigar_len = ImplodeCIGAR( output->cigar, output->cig_ops, n );
+    output->cigar[ output->cigar_len ] = 0;
+    return 0;
 }
 
 
@@ -519,6 +557,7 @@ rc_t make_cg_cigar( const cg_cigar_input * input, cg_cigar_output * output )
         memmove( &output->cigar[ 0 ], &input->p_cigar.ptr[ 0 ], input->p_cigar.len );
         output->cigar_len = input->p_cigar.len;
         output->cigar[ output->cigar_len ] = 0;
+        output->n_cig_ops = 0;
         output->edit_dist = input->edit_dist;
         output->p_cigar.ptr = output->cigar;
         output->p_cigar.len = output->cigar_len;
@@ -564,37 +603,29 @@ static char merge_M_type_ops( char a, char b )
 }
 
 
-static size_t fmt_cigar_elem( char * dst, uint32_t cig_oplen, char cig_op )
-{
-    size_t num_writ;
-    rc_t rc = string_printf ( dst, 11, &num_writ, "%d%c", cig_oplen, cig_op );
-    assert ( rc == 0 && num_writ > 1 );
-    return num_writ;
-}
-
-uint32_t CombineCIGAR( char dst[], CigOps const seqOp[], uint32_t seq_len,
+uint32_t CombineCIGAR( CigOps dst[], uint32_t dst_len, CigOps const seqOp[], uint32_t seq_len,
                        uint32_t refPos, CigOps const refOp[], uint32_t ref_len )
 {
     bool done = false;
-    uint32_t ciglen = 0, last_ciglen = 0, last_cig_oplen = 0;
+    bool overflow = false;
+    uint32_t n_ops = 0;
     int32_t si = 0, ri = 0;
-    char last_cig_op = '0'; /* never used operation, forces a mismatch in MACRO_BUILD_CIGAR */
     CigOps seq_cop = { 0, 0, 0, 0 }, ref_cop = { 0, 0, 0, 0 };
     int32_t seq_pos = 0;        /** seq_pos is tracked roughly - with every extraction from seqOp **/
     int32_t ref_pos = 0;        /** ref_pos is tracked precisely - with every delta and consumption in cigar **/
     int32_t delta = refPos;     /*** delta in relative positions of seq and ref **/
                                 /*** when delta < 0 - rewind or extend the reference ***/
                                 /*** wher delta > 0 - skip reference  ***/
+/* extends the last operation in place if it is of the same kind, otherwise appends a new one */
 #define MACRO_BUILD_CIGAR(OP,OPLEN) \
-	if( last_cig_oplen > 0 && last_cig_op == OP){							\
-                last_cig_oplen += OPLEN;								\
-                ciglen = last_ciglen + fmt_cigar_elem( dst + last_ciglen, last_cig_oplen,last_cig_op );	\
-        } else {											\
-                last_ciglen = ciglen;									\
-                last_cig_oplen = OPLEN;									\
-                last_cig_op    = OP;									\
-                ciglen = ciglen      + fmt_cigar_elem( dst + last_ciglen, last_cig_oplen, last_cig_op );	\
-        }
+    do {                                                                        \
+        if ( n_ops > 0 && dst[ n_ops - 1 ].oplen > 0 && dst[ n_ops - 1 ].op == OP ) \
+            dst[ n_ops - 1 ].oplen += OPLEN;                                    \
+        else if ( n_ops < dst_len )                                             \
+            SetCigOp( &dst[ n_ops++ ], OP, OPLEN );                             \
+        else                                                                    \
+            overflow = true;                                                    \
+    } while ( 0 )
     while( !done )
     {
         while ( delta < 0 )
@@ -743,7 +774,8 @@ uint32_t CombineCIGAR( char dst[], CigOps const seqOp[], uint32_t seq_len,
             }
         }
     }
-    return ciglen;
+#undef MACRO_BUILD_CIGAR
+    return overflow ? dst_len + 1 : n_ops;
 }
 
 
@@ -767,6 +799,7 @@ rc_t merge_cg_cigar( const cg_cigar_input * input, cg_cigar_output * output )
         memmove( &output->cigar[ 0 ], &input->p_cigar.ptr[ 0 ], input->p_cigar.len );
         output->cigar_len = input->p_cigar.len;
         output->cigar[ output->cigar_len ] = 0;
+        output->n_cig_ops = 0;
         output->edit_dist = input->edit_dist;
         rc = 0;
     }
@@ -804,6 +837,7 @@ rc_t make_cg_merge( const cg_cigar_input * input, cg_cigar_output * output )
         memmove( &output->cigar[ 0 ], &input->p_cigar.ptr[ 0 ], input->p_cigar.len );
         output->cigar_len = input->p_cigar.len;
         output->cigar[ output->cigar_len ] = 0;
+        output->n_cig_ops = 0;
         output->edit_dist = input->edit_dist;
         rc = 0;
     }
@@ -1689,9 +1723,9 @@ rc_t change_rna_splicing_cigar( uint32_t cigar_len, char * cigar, rna_splice_can
         *NM_adjustment = sum_of_n_lengths;
     return rc;
 }
-rc_t cg_canonical_print_cigar( const char * cigar, size_t cigar_len)
+rc_t cg_canonical_print_cigar( struct dyn_string * out, const char * cigar, size_t cigar_len)
 {
-    rc_t rc;
+    rc_t rc = 0;
     if ( cigar_len > 0 )
     {
         int i,total_cnt,cnt;
@@ -1705,7 +1739,7 @@ rc_t cg_canonical_print_cigar( const char * cigar, size_t cigar_len)
                         } else if(op==cigar[i]){ /** merging consequitive ops **/
                                 total_cnt+=cnt;
                         } else {
-                                if(total_cnt > 0) KOutMsg( "%d%c", total_cnt,op );
+                                if(total_cnt > 0 && rc == 0) rc = out_2_dyn_string( out, "%d%c", total_cnt,op );
                                 total_cnt=cnt;
                         }
                         op=cigar[i];
@@ -1714,10 +1748,10 @@ rc_t cg_canonical_print_cigar( const char * cigar, size_t cigar_len)
                         assert(0); /*** should never happen inside this function ***/
                 }
         }
-        if(total_cnt && op) KOutMsg( "%d%c", total_cnt,op );
+        if(total_cnt && op && rc == 0) rc = out_2_dyn_string( out, "%d%c", total_cnt,op );
     }
     else
-        rc = KOutMsg( "*" );
+        rc = out_2_dyn_string( out, "*" );
     return rc;
 }
 
@@ -50,6 +50,19 @@ typedef struct ptr_len
     uint32_t len;
 } ptr_len;
 
+/* longest text of a single cigar-operation: 10 digits and the op-code */
+#define MAX_CIG_OP_CHARS 11
+
+
+typedef struct CigOps
+{
+    char op;
+    int8_t   ref_sign; /* 0;+1;-1; ref_offset = ref_sign * offset */
+    int8_t   seq_sign; /* 0;+1;-1; seq_offset = seq_sign * offset */
+    uint32_t oplen;
+} CigOps;
+
+
 typedef struct cg_cigar_input
 {
     ptr_len p_cigar;
@@ -68,6 +81,10 @@ typedef struct cg_cigar_output
     char cigar[ MAX_CG_CIGAR_LEN ];
     uint32_t cigar_len;
 
+    /* the treated cigar as binary operations, n_cig_ops is 0 if only the text is valid */
+    CigOps cig_ops[ MAX_READ_LEN ];
+    uint32_t n_cig_ops;
+
     ptr_len p_cigar;
     ptr_len p_read;
     ptr_len p_quality;
@@ -86,18 +103,17 @@ rc_t make_cg_cigar( const cg_cigar_input * input, cg_cigar_output * output );
 rc_t make_cg_merge( const cg_cigar_input * input, cg_cigar_output * output );
 
 
-typedef struct CigOps
-{
-    char op;
-    int8_t   ref_sign; /* 0;+1;-1; ref_offset = ref_sign * offset */
-    int8_t   seq_sign; /* 0;+1;-1; seq_offset = seq_sign * offset */
-    uint32_t oplen;
-} CigOps;
-
-
+/* the text-cigar as binary operations */
 int32_t ExplodeCIGAR( CigOps dst[], uint32_t len, char const cigar[], uint32_t ciglen );
 
-uint32_t CombineCIGAR( char dst[], CigOps const seqOp[], uint32_t seq_len,
+/* the binary operations as text-cigar, dst has to have room for MAX_CIG_OP_CHARS per operation,
+   returns the number of chars written ( not 0-terminated ) */
+uint32_t ImplodeCIGAR( char dst[], CigOps const ops[], uint32_t n_ops );
+
+/* combines the cigar of an evidence-alignment with the cigar of its allele,
+   writes at most dst_len binary operations into dst, returns how many it wrote,
+   or dst_len + 1 if the combined cigar does not fit ( dst is incomplete then ) */
+uint32_t CombineCIGAR( CigOps dst[], uint32_t dst_len, CigOps const seqOp[], uint32_t seq_len,
                        uint32_t refPos, CigOps const refOp[], uint32_t ref_len );
 
 #define RNA_SPLICE_UNKNOWN 0
@@ -132,6 +148,8 @@ rc_t check_rna_splicing_candidates_against_ref( struct ReferenceObj const * ref_
                                                 rna_splice_candidates * candidates );
 
 rc_t change_rna_splicing_cigar( uint32_t cigar_len, char * cigar, rna_splice_candidates * candidates, uint32_t * NM_adjustment );
-rc_t cg_canonical_print_cigar( const char * cigar, size_t cigar_len);
+/* prints via KOutMsg() if out is NULL, else appends to out */
+struct dyn_string;
+rc_t cg_canonical_print_cigar( struct dyn_string * out, const char * cigar, size_t cigar_len);
 
 #endif
@@ -702,6 +702,43 @@ rc_t prepare_ref_iter( prepare_ctx *ctx,
 }
 
 
+rc_t open_prepare_ctx( prepare_ctx *ctx,
+                       const VDBManager *vdb_mgr,
+                       VSchema *vdb_schema,
+                       const char * path )
+{
+    rc_t rc;
+    ctx->seq_tab = NULL;
+    ctx->reflist = NULL;
+    rc = VDBManagerOpenDBRead ( vdb_mgr, &ctx->db, vdb_schema, "%s", path );
+    if ( rc != 0 )
+    {
+        ctx->db = NULL;
+        PLOGERR( klogErr, ( klogErr, rc, "failed to open '$(path)'", "path=%s", path ) );
+    }
+    else
+    {
+        rc = prepare_reflist( ctx );
+    }
+    return rc;
+}
+
+
+void close_prepare_ctx( prepare_ctx *ctx )
+{
+    if ( ctx->reflist != NULL )
+    {
+        ReferenceList_Release( ctx->reflist );
+        ctx->reflist = NULL;
+    }
+    if ( ctx->db != NULL )
+    {
+        VDatabaseRelease ( ctx->db );
+        ctx->db = NULL;
+    }
+}
+
+
 /* =========================================================================================== */
 
 
@@ -133,6 +133,15 @@ rc_t prepare_ref_iter( prepare_ctx *ctx,
                        const char * path,
                        BSTree * regions );
 
+/* opens only the database and the reference-list of path, the caller
+   adds the sections himself ( the worker-threads of a parallel pileup ) */
+rc_t open_prepare_ctx( prepare_ctx *ctx,
+                       const VDBManager *vdb_mgr,
+                       VSchema *vdb_schema,
+                       const char * path );
+
+void close_prepare_ctx( prepare_ctx *ctx );
+
 rc_t prepare_plset_iter( prepare_ctx *ctx,
                          const VDBManager *vdb_mgr,
                          VSchema *vdb_schema,
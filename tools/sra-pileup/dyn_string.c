@@ -28,6 +28,7 @@
 #include <klib/text.h>
 #include <klib/printf.h>
 #include <klib/out.h>
+#include <string.h>
 
 typedef struct dyn_string
 {
@@ -136,7 +137,28 @@ rc_t add_string_2_dyn_string( struct dyn_string *self, const char * s )
 }
 
 
-rc_t print_2_dyn_string( struct dyn_string * self, const char *fmt, ... )
+rc_t add_buf_2_dyn_string( struct dyn_string *self, const char * buf, size_t len )
+{
+    rc_t rc = 0;
+    if ( self->data_len + len + 1 > self->allocated )
+    {
+        /* grow at least by half, the output of a whole chunk is collected this way */
+        size_t new_size = self->allocated + ( self->allocated >> 1 );
+        if ( new_size < self->data_len + len + 1 )
+            new_size = self->data_len + len + 1;
+        rc = expand_dyn_string( self, new_size );
+    }
+    if ( rc == 0 )
+    {
+        memmove( &(self->data[ self->data_len ]), buf, len );
+        self->data_len += len;
+        self->data[ self->data_len ] = 0;
+    }
+    return rc;
+}
+
+
+rc_t vprint_2_dyn_string( struct dyn_string * self, const char *fmt, va_list args )
 {
     rc_t rc = 0;
     bool not_enough;
@@ -144,14 +166,14 @@ rc_t print_2_dyn_string( struct dyn_string * self, const char *fmt, ... )
     do
     {
         size_t num_writ;
-        va_list args;
-        va_start ( args, fmt );
+        va_list args_copy;
+        va_copy ( args_copy, args );
         rc = string_vprintf ( &(self->data[ self->data_len ]), 
                               self->allocated - ( self->data_len + 1 ),
                               &num_writ,
                               fmt,
-                              args );
-        va_end ( args );
+                              args_copy );
+        va_end ( args_copy );
 
         if ( rc == 0 )
         {
@@ -161,13 +183,42 @@ rc_t print_2_dyn_string( struct dyn_string * self, const char *fmt, ... )
         not_enough = ( GetRCState( rc ) == rcInsufficient );
         if ( not_enough )
         {
-            rc = expand_dyn_string( self, self->allocated + ( num_writ * 2 ) );
+            /* grow at least by half, like add_buf_2_dyn_string() */
+            size_t new_size = self->allocated + ( self->allocated >> 1 );
+            if ( new_size < self->allocated + ( num_writ * 2 ) )
+                new_size = self->allocated + ( num_writ * 2 );
+            rc = expand_dyn_string( self, new_size );
         }
     } while ( not_enough && rc == 0 );
     return rc;
 }
 
 
+rc_t print_2_dyn_string( struct dyn_string * self, const char *fmt, ... )
+{
+    rc_t rc;
+    va_list args;
+    va_start ( args, fmt );
+    rc = vprint_2_dyn_string( self, fmt, args );
+    va_end ( args );
+    return rc;
+}
+
+
+rc_t out_2_dyn_string( struct dyn_string * self, const char *fmt, ... )
+{
+    rc_t rc;
+    va_list args;
+    va_start ( args, fmt );
+    if ( self != NULL )
+        rc = vprint_2_dyn_string( self, fmt, args );
+    else
+        rc = KOutVMsg( fmt, args );
+    va_end ( args );
+    return rc;
+}
+
+
 rc_t print_dyn_string( struct dyn_string * self )
 {
     if ( self != NULL )
@@ -32,6 +32,7 @@ extern "C" {
 #endif
 
 #include <klib/rc.h>
+#include <stdarg.h>
 
 struct dyn_string;
 
@@ -43,7 +44,11 @@ rc_t expand_dyn_string( struct dyn_string *self, size_t new_size );
 rc_t add_char_2_dyn_string( struct dyn_string *self, const char c );
 char * dyn_string_char( struct dyn_string *self, uint32_t idx );
 rc_t add_string_2_dyn_string( struct dyn_string *self, const char * s );
+rc_t add_buf_2_dyn_string( struct dyn_string *self, const char * buf, size_t len );
+rc_t vprint_2_dyn_string( struct dyn_string * self, const char *fmt, va_list args );
 rc_t print_2_dyn_string( struct dyn_string * self, const char *fmt, ... );
+/* appends to self, or prints via KOutMsg() if self is NULL */
+rc_t out_2_dyn_string( struct dyn_string * self, const char *fmt, ... );
 rc_t print_dyn_string( struct dyn_string * self );
 size_t dyn_string_len( struct dyn_string * self );
 
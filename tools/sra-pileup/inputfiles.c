@@ -80,6 +80,7 @@ static rc_t append_database( input_files *self, const VDatabase * db,
 
             id->db = db;
             id->reflist = reflist;
+            id->reflist_options = reflist_options;
             id->path = string_dup( path, string_size( path ) );
 
             rc = VectorAppend( &self->dbs, &idx, id );
@@ -64,6 +64,7 @@ typedef struct input_database
     char * path;
     const VDatabase * db;
     const ReferenceList *reflist;
+    uint32_t reflist_options;   /* to make another reflist for the same db */
     void * prim_ctx;
     void * sec_ctx;
     void * ev_ctx;
@@ -0,0 +1,271 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "mate_hash.h"
+#include <sysalloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* 1024 slots a 24 bytes to start with, the table doubles if it is 70% full */
+#define MATE_HASH_MIN_BITS 10
+#define MATE_HASH_FILL_PERCENT 70
+
+static uint64_t mate_hash_slot( const mate_hash * self, int64_t key )
+{
+    /* fibonacci-hashing: the upper bits of the product are well mixed even for consecutive row-ids */
+    return ( ( uint64_t )key * 0x9E3779B97F4A7C15ULL ) >> self->shift;
+}
+
+
+static rc_t mate_hash_alloc( mate_hash * self, uint32_t bits )
+{
+    rc_t rc = 0;
+    self->entries = calloc( ( size_t )1 << bits, sizeof *( self->entries ) );
+    if ( self->entries == NULL )
+    {
+        self->capacity = 0;
+        rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+    }
+    else
+    {
+        self->capacity = ( ( uint64_t )1 << bits );
+        self->shift = 64 - bits;
+    }
+    self->count = 0;
+    return rc;
+}
+
+
+rc_t mate_hash_init( mate_hash * self, size_t max_bytes )
+{
+    self->max_bytes = max_bytes;
+    self->peak = 0;
+    return mate_hash_alloc( self, MATE_HASH_MIN_BITS );
+}
+
+
+void mate_hash_release( mate_hash * self )
+{
+    if ( self->entries != NULL )
+    {
+        free( self->entries );
+        self->entries = NULL;
+    }
+    self->capacity = 0;
+    self->count = 0;
+}
+
+
+void mate_hash_clear( mate_hash * self )
+{
+    if ( self->peak > 0 )
+    {
+        /* a table grown for one big reference is not wiped in full for every small one after it:
+           if the last fill needed fewer slots, a smaller zeroed table replaces it */
+        uint32_t bits = MATE_HASH_MIN_BITS;
+        while ( self->peak * 100 > ( ( uint64_t )1 << bits ) * MATE_HASH_FILL_PERCENT )
+            ++bits;
+        if ( ( ( uint64_t )1 << bits ) < self->capacity )
+        {
+            mate_hash old = *self;
+            if ( mate_hash_alloc( self, bits ) == 0 )
+                free( old.entries );
+            else
+                *self = old;
+        }
+        if ( self->count > 0 )
+        {
+            /* the table fits the last fill, wiping it costs no more than filling it did */
+            memset( self->entries, 0, self->capacity * sizeof *( self->entries ) );
+            self->count = 0;
+        }
+        self->peak = 0;
+    }
+}
+
+
+/* returns the slot of the key, or the empty slot where it would go */
+static mate_hash_entry * mate_hash_find( const mate_hash * self, int64_t key )
+{
+    uint64_t mask = self->capacity - 1;
+    uint64_t idx = mate_hash_slot( self, key );
+    while ( self->entries[ idx ].key != 0 && self->entries[ idx ].key != key )
+        idx = ( idx + 1 ) & mask;
+    return &self->entries[ idx ];
+}
+
+
+static rc_t mate_hash_grow( mate_hash * self )
+{
+    rc_t rc = 0;
+    uint64_t new_capacity = self->capacity * 2;
+    if ( self->max_bytes > 0 && new_capacity * sizeof *( self->entries ) > self->max_bytes )
+        rc = RC( rcApp, rcNoTarg, rcInserting, rcMemory, rcExhausted );
+    else
+    {
+        mate_hash old = *self;
+        rc = mate_hash_alloc( self, 64 - old.shift + 1 );
+        if ( rc != 0 )
+            *self = old;
+        else
+        {
+            uint64_t idx;
+            for ( idx = 0; idx < old.capacity; ++idx )
+            {
+                if ( old.entries[ idx ].key != 0 )
+                    *( mate_hash_find( self, old.entries[ idx ].key ) ) = old.entries[ idx ];
+            }
+            self->count = old.count;
+            free( old.entries );
+        }
+    }
+    return rc;
+}
+
+
+rc_t mate_hash_set( mate_hash * self, int64_t key, uint64_t a, uint64_t b )
+{
+    rc_t rc = 0;
+    mate_hash_entry * e;
+    if ( key <= 0 )
+        return RC( rcApp, rcNoTarg, rcInserting, rcParam, rcInvalid );
+
+    e = mate_hash_find( self, key );
+    if ( e->key == 0 )
+    {
+        /* a new key: make room first if the table is getting too full */
+        if ( ( self->count + 1 ) * 100 > self->capacity * MATE_HASH_FILL_PERCENT )
+        {
+            rc = mate_hash_grow( self );
+            if ( rc == 0 )
+                e = mate_hash_find( self, key );
+        }
+        if ( rc == 0 )
+        {
+            e->key = key;
+            if ( ++self->count > self->peak )
+                self->peak = self->count;
+        }
+    }
+    if ( rc == 0 )
+    {
+        e->a = a;
+        e->b = b;
+    }
+    return rc;
+}
+
+
+rc_t mate_hash_get( const mate_hash * self, int64_t key, uint64_t * a, uint64_t * b )
+{
+    const mate_hash_entry * e;
+    if ( key <= 0 )
+        return RC( rcApp, rcNoTarg, rcSearching, rcItem, rcNotFound );
+    e = mate_hash_find( self, key );
+    if ( e->key == 0 )
+        return RC( rcApp, rcNoTarg, rcSearching, rcItem, rcNotFound );
+    *a = e->a;
+    *b = e->b;
+    return 0;
+}
+
+
+rc_t mate_hash_remove( mate_hash * self, int64_t key )
+{
+    uint64_t mask = self->capacity - 1;
+    uint64_t hole;
+    mate_hash_entry * e;
+
+    if ( key <= 0 )
+        return RC( rcApp, rcNoTarg, rcRemoving, rcItem, rcNotFound );
+    e = mate_hash_find( self, key );
+    if ( e->key == 0 )
+        return RC( rcApp, rcNoTarg, rcRemoving, rcItem, rcNotFound );
+
+    /* backward-shift deletion: move the following entries of the cluster into the hole,
+       if their home-slot allows it, no tombstones needed */
+    hole = ( uint64_t )( e - self->entries );
+    for ( ;; )
+    {
+        uint64_t idx = ( hole + 1 ) & mask;
+        for ( ;; )
+        {
+            uint64_t home;
+            if ( self->entries[ idx ].key == 0 )
+            {
+                self->entries[ hole ].key = 0;
+                self->count--;
+                return 0;
+            }
+            home = mate_hash_slot( self, self->entries[ idx ].key );
+            /* can the entry at idx be moved to hole? ( is home cyclically outside of ( hole, idx ] ) */
+            if ( ( ( idx - home ) & mask ) >= ( ( idx - hole ) & mask ) )
+                break;
+            idx = ( idx + 1 ) & mask;
+        }
+        self->entries[ hole ] = self->entries[ idx ];
+        hole = idx;
+    }
+}
+
+
+static int CC cmp_entry_keys( const void * p1, const void * p2 )
+{
+    const mate_hash_entry * e1 = *( const mate_hash_entry ** )p1;
+    const mate_hash_entry * e2 = *( const mate_hash_entry ** )p2;
+    if ( e1->key < e2->key )
+        return -1;
+    return ( e1->key > e2->key );
+}
+
+
+rc_t mate_hash_visit( const mate_hash * self,
+                      rc_t ( CC * f ) ( int64_t key, uint64_t a, uint64_t b, void * data ),
+                      void * data )
+{
+    rc_t rc = 0;
+    if ( self->count > 0 )
+    {
+        /* the callers depend on the order of the row-ids ( like a KVector-visit ) */
+        const mate_hash_entry ** sorted = malloc( self->count * sizeof *sorted );
+        if ( sorted == NULL )
+            rc = RC( rcApp, rcNoTarg, rcVisiting, rcMemory, rcExhausted );
+        else
+        {
+            uint64_t idx, n = 0;
+            for ( idx = 0; idx < self->capacity; ++idx )
+            {
+                if ( self->entries[ idx ].key != 0 )
+                    sorted[ n++ ] = &self->entries[ idx ];
+            }
+            qsort( sorted, n, sizeof *sorted, cmp_entry_keys );
+            for ( idx = 0; idx < n && rc == 0; ++idx )
+                rc = f( sorted[ idx ]->key, sorted[ idx ]->a, sorted[ idx ]->b, data );
+            free( ( void * ) sorted );
+        }
+    }
+    return rc;
+}
@@ -0,0 +1,83 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_mate_hash_
+#define _h_mate_hash_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <klib/rc.h>
+
+/* open-addressed hash ( linear probing ) from a row-id to a 128-bit value,
+   used by the mate-caches instead of a pair of sparse KVector's.
+   keys have to be > 0 ( row-ids ), 0 marks an empty slot */
+
+typedef struct mate_hash_entry
+{
+    int64_t key;
+    uint64_t a;
+    uint64_t b;
+} mate_hash_entry;
+
+
+typedef struct mate_hash
+{
+    mate_hash_entry * entries;
+    uint64_t capacity;      /* number of slots, a power of 2 */
+    uint64_t count;         /* number of used slots */
+    uint64_t peak;          /* highest count since the last clear */
+    uint32_t shift;         /* 64 - log2( capacity ), for the hash-function */
+    size_t max_bytes;       /* memory-budget for the slots, 0 ... no limit */
+} mate_hash;
+
+
+rc_t mate_hash_init( mate_hash * self, size_t max_bytes );
+
+void mate_hash_release( mate_hash * self );
+
+/* empties the hash, shrinks the slots to what the highest count since the last clear needed */
+void mate_hash_clear( mate_hash * self );
+
+/* inserts or replaces, rcExhausted if growing would exceed the memory-budget */
+rc_t mate_hash_set( mate_hash * self, int64_t key, uint64_t a, uint64_t b );
+
+/* rcNotFound if the key is not in the hash */
+rc_t mate_hash_get( const mate_hash * self, int64_t key, uint64_t * a, uint64_t * b );
+
+rc_t mate_hash_remove( mate_hash * self, int64_t key );
+
+/* visits the entries in ascending order of the key, stops at the first rc != 0 */
+rc_t mate_hash_visit( const mate_hash * self,
+                      rc_t ( CC * f ) ( int64_t key, uint64_t a, uint64_t b, void * data ),
+                      void * data );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_mate_hash_ */
@@ -37,15 +37,8 @@ void release_matecache( matecache * const self )
             uint32_t idx;
             for ( idx = 0; idx < self->count; ++idx )
             {
-                if ( self->per_file[ idx ].same_ref_64 != NULL )
-                    KVectorRelease( self->per_file[ idx ].same_ref_64 );
-                if ( self->per_file[ idx ].same_ref_16 != NULL )
-                    KVectorRelease( self->per_file[ idx ].same_ref_16 );
-
-                if ( self->per_file[ idx ].unaligned_64_a != NULL )
-                    KVectorRelease( self->per_file[ idx ].unaligned_64_a );
-                if ( self->per_file[ idx ].unaligned_64_b != NULL )
-                    KVectorRelease( self->per_file[ idx ].unaligned_64_b );
+                mate_hash_release( &self->per_file[ idx ].same_ref );
+                mate_hash_release( &self->per_file[ idx ].unaligned );
             }
             free( self->per_file );
         }
@@ -54,7 +47,7 @@ void release_matecache( matecache * const self )
 }
 
 
-rc_t make_matecache( matecache **self, uint32_t count )
+rc_t make_matecache( matecache **self, uint32_t count, size_t budget )
 {
     rc_t rc = 0;
 
@@ -79,26 +72,15 @@ rc_t make_matecache( matecache **self, uint32_t count )
             uint32_t idx;
             for ( idx = 0; idx < count && rc == 0; ++idx )
             {
-                rc = KVectorMake( &( mc->per_file[ idx ].same_ref_64 ) );
+                rc = mate_hash_init( &( mc->per_file[ idx ].same_ref ), budget ); /* mate_hash.c */
                 if ( rc != 0 )
-                    (void)LOGERR( klogErr, rc, "cannot create KVector (same-ref) U64" );
+                    (void)LOGERR( klogErr, rc, "cannot create hash (same-ref)" );
                 else
                 {
-                    rc = KVectorMake( &( mc->per_file[ idx ].same_ref_16 ) );
+                    /* no budget here: the unaligned entries are the filter for the unaligned reads with regions */
+                    rc = mate_hash_init( &( mc->per_file[ idx ].unaligned ), 0 );
                     if ( rc != 0 )
-                        (void)LOGERR( klogErr, rc, "cannot create KVector (same-ref) U16" );
-                    else
-                    {
-                        rc = KVectorMake( &( mc->per_file[ idx ].unaligned_64_a ) );
-                        if ( rc != 0 )
-                            (void)LOGERR( klogErr, rc, "cannot create KVector (unaligned a) U64" );
-                        else
-                        {
-                            rc = KVectorMake( &( mc->per_file[ idx ].unaligned_64_b ) );
-                            if ( rc != 0 )
-                                (void)LOGERR( klogErr, rc, "cannot create KVector (unaligned b) U64" );
-                        }
-                    }
+                        (void)LOGERR( klogErr, rc, "cannot create hash (unaligned)" );
                 }
             }
             if ( rc == 0 )
@@ -172,19 +154,22 @@ rc_t matecache_insert_same_ref( matecache * const self,
     rc_t rc = matecache_check( self, db_idx, &mcpf );
     if ( rc == 0 )
     {
-        uint64_t ref_pos_and_tlen = ref_pos;
+        uint64_t ref_pos_and_tlen = ( uint32_t )ref_pos;
         ref_pos_and_tlen <<= 32;
         ref_pos_and_tlen |= tlen;
-        rc = KVectorSetU64( mcpf->same_ref_64, key, ref_pos_and_tlen );
+        rc = mate_hash_set( &mcpf->same_ref, key, ref_pos_and_tlen, flags );
         if ( rc != 0 )
-            (void)LOGERR( klogErr, rc, "cannot insert into KVector (same-ref) U64" );
-        else
         {
-            rc = KVectorSetU16( mcpf->same_ref_16, key, flags );
-            if ( rc != 0 )
-                (void)LOGERR( klogErr, rc, "cannot insert into KVector (same-ref) U16" );
+            if ( GetRCState( rc ) == rcExhausted )
+            {
+                /* the memory-budget ( or the memory ) is used up: this mate will be read from the table */
+                mcpf->dropped_same_ref++;
+                rc = 0;
+            }
+            else
+                (void)LOGERR( klogErr, rc, "cannot insert into hash (same-ref)" );
         }
-        if ( rc == 0 )
+        else
         {
             mcpf->stat_same_ref.count++;
             if ( mcpf->stat_same_ref.count > mcpf->maxcount_same_ref )
@@ -203,30 +188,15 @@ rc_t matecache_lookup_same_ref( const matecache * const self, uint32_t db_idx, i
     rc_t rc = matecache_check( self, db_idx, &mcpf );
     if ( rc == 0 )
     {
-        uint64_t value64;
+        uint64_t ref_pos_and_tlen, value_flags;
         mcpf->stat_same_ref.lookups++;
-        rc = KVectorGetU64( mcpf->same_ref_64, key, &value64 );
-        if ( rc != 0 )
+        rc = mate_hash_get( &mcpf->same_ref, key, &ref_pos_and_tlen, &value_flags ); /* rcNotFound is expected */
+        if ( rc == 0 )
         {
-            if ( GetRCState( rc ) != rcNotFound )
-                (void)LOGERR( klogErr, rc, "cannot retrieve value (same-ref) U64" );
-        }
-        else
-        {
-            uint16_t value16;
-            rc = KVectorGetU16( mcpf->same_ref_16, key, &value16 );
-            if ( rc != 0 )
-            {
-                if ( GetRCState( rc ) != rcNotFound )
-                    (void)LOGERR( klogErr, rc, "cannot retrieve value (same-ref) U16" );
-            }
-            else
-            {
-                *ref_pos = ( value64 >> 32 );
-                *tlen = ( value64 & 0xFFFFFFFF );
-                *flags = value16;
-                mcpf->stat_same_ref.finds++;
-            }
+            *ref_pos = ( ref_pos_and_tlen >> 32 );
+            *tlen = ( ref_pos_and_tlen & 0xFFFFFFFF );
+            *flags = ( uint32_t )value_flags;
+            mcpf->stat_same_ref.finds++;
         }
     }
     return rc;
@@ -239,49 +209,16 @@ rc_t matecache_remove_same_ref( matecache * const self, uint32_t db_idx, int64_t
     rc_t rc = matecache_check( self, db_idx, &mcpf );
     if ( rc == 0 )
     {
-        rc = KVectorUnset( mcpf->same_ref_64, key );
+        rc = mate_hash_remove( &mcpf->same_ref, key );
         if ( rc != 0 )
-            (void)LOGERR( klogErr, rc, "cannot remove from same-ref-cache (64bit)" );
-        else
-        {
-            rc = KVectorUnset( mcpf->same_ref_16, key );
-            if ( rc != 0 )
-                (void)LOGERR( klogErr, rc, "cannot remove from same-ref-cache (16bit)" );
-        }
-        if ( rc == 0 && mcpf->stat_same_ref.count > 0 )
+            (void)LOGERR( klogErr, rc, "cannot remove from same-ref-cache" );
+        else if ( mcpf->stat_same_ref.count > 0 )
             mcpf->stat_same_ref.count--;
     }
     return rc;
 }
 
 
-static rc_t matecache_clear_same_ref_per_file( matecache_per_file * const mcpf )
-{
-    rc_t rc = KVectorRelease( mcpf->same_ref_64 );
-    if ( rc != 0 )
-        (void)LOGERR( klogErr, rc, "cannot release same-ref-cache (64bit)" );
-    else
-    {
-        rc = KVectorRelease( mcpf->same_ref_16 );
-        if ( rc != 0 )
-            (void)LOGERR( klogErr, rc, "cannot release same-ref-cache (16bit)" );
-        else
-        {
-            rc = KVectorMake( &mcpf->same_ref_64 );
-            if ( rc != 0 )
-                (void)LOGERR( klogErr, rc, "cannot make same-ref-cache (64bit)" );
-            else
-            {
-                rc = KVectorMake( &mcpf->same_ref_16 );
-                if ( rc != 0 )
-                    (void)LOGERR( klogErr, rc, "cannot make same-ref-cache (16bit)" );
-            }
-        }
-    }
-    return rc;
-}
-
-
 rc_t matecache_clear_same_ref( matecache * const self )
 {
     rc_t rc = 0;
@@ -293,9 +230,9 @@ rc_t matecache_clear_same_ref( matecache * const self )
     else
     {
         uint32_t idx;
-        for ( idx = 0; idx < self->count && rc == 0; ++idx )
+        for ( idx = 0; idx < self->count; ++idx )
         {
-            rc = matecache_clear_same_ref_per_file( &self->per_file[ idx ] );
+            mate_hash_clear( &self->per_file[ idx ].same_ref );
         }
         self->flashes++;
    }
@@ -325,6 +262,8 @@ rc_t matecache_report( const matecache * const self )
                 rc = KOutMsg( "matecache[ %u ].lookups = %,lu\n", idx, self->per_file[ idx ].stat_same_ref.lookups );
             if ( rc == 0 )
                 rc = KOutMsg( "matecache[ %u ].finds = %,lu\n", idx, self->per_file[ idx ].stat_same_ref.finds );
+            if ( rc == 0 )
+                rc = KOutMsg( "matecache[ %u ].dropped = %,lu\n", idx, self->per_file[ idx ].dropped_same_ref );
             if ( rc == 0 )
                 rc = KOutMsg( "unaligned:\n" );
             if ( rc == 0 )
@@ -348,19 +287,13 @@ rc_t matecache_insert_unaligned( matecache * const self,
     rc_t rc = matecache_check( self, db_idx, &mcpf );
     if ( rc == 0 )
     {
-        uint64_t ref_pos_and_ref_idx = ref_pos;
+        uint64_t ref_pos_and_ref_idx = ( uint32_t )ref_pos;
         ref_pos_and_ref_idx <<= 32;
         ref_pos_and_ref_idx |= ref_idx;
-        rc = KVectorSetU64( mcpf->unaligned_64_a, key, ref_pos_and_ref_idx );
+        rc = mate_hash_set( &mcpf->unaligned, key, ref_pos_and_ref_idx, ( uint64_t )seq_id );
         if ( rc != 0 )
-            (void)LOGERR( klogErr, rc, "cannot insert into KVector (unaligned a) U64" );
+            (void)LOGERR( klogErr, rc, "cannot insert into hash (unaligned)" );
         else
-        {
-            rc = KVectorSetU64( mcpf->unaligned_64_b, key, seq_id );
-            if ( rc != 0 )
-                (void)LOGERR( klogErr, rc, "cannot insert into KVector (unaligned b) U64" );
-        }
-        if ( rc == 0 )
         {
             mcpf->stat_unaligned.count++;
             mcpf->stat_unaligned.inserts++;
@@ -377,30 +310,15 @@ rc_t matecache_lookup_unaligned( const matecache * const self, uint32_t db_idx,
     rc_t rc = matecache_check( self, db_idx, &mcpf );
     if ( rc == 0 )
     {
-        uint64_t value64_a;
+        uint64_t ref_pos_and_ref_idx, value_seq_id;
         mcpf->stat_unaligned.lookups++;
-        rc = KVectorGetU64( mcpf->unaligned_64_a, key, &value64_a );
-        if ( rc != 0 )
+        rc = mate_hash_get( &mcpf->unaligned, key, &ref_pos_and_ref_idx, &value_seq_id ); /* rcNotFound is expected */
+        if ( rc == 0 )
         {
-            if ( GetRCState( rc ) != rcNotFound )
-                (void)LOGERR( klogErr, rc, "cannot retrieve value (unaligned a) U64" );
-        }
-        else
-        {
-            uint64_t value64_b;
-            rc = KVectorGetU64( mcpf->unaligned_64_b, key, &value64_b );
-            if ( rc != 0 )
-            {
-                if ( GetRCState( rc ) != rcNotFound )
-                    (void)LOGERR( klogErr, rc, "cannot retrieve value (unaligned b) U64" );
-            }
-            else
-            {
-                *seq_id = ( int64_t )value64_b;
-                *ref_pos = ( value64_a >> 32 );
-                *ref_idx = ( value64_a & 0xFFFFFFFF );
-                mcpf->stat_unaligned.finds++;
-            }
+            *seq_id = ( int64_t )value_seq_id;
+            *ref_pos = ( ref_pos_and_ref_idx >> 32 );
+            *ref_idx = ( ref_pos_and_ref_idx & 0xFFFFFFFF );
+            mcpf->stat_unaligned.finds++;
         }
     }
     return rc;
@@ -414,10 +332,10 @@ typedef struct visit_ctx
 } visit_ctx;
 
 
-static rc_t CC on_seq_id( uint64_t key, int64_t value, void *user_data )
+static rc_t CC on_seq_id( int64_t key, uint64_t a, uint64_t b, void *user_data )
 {
     visit_ctx * vctx = user_data;
-    return vctx->f( value, ( int64_t )key, vctx->user_data );
+    return vctx->f( ( int64_t )b, key, vctx->user_data );
 }
 
 
@@ -433,7 +351,62 @@ rc_t foreach_unaligned_entry( const matecache * const self,
         visit_ctx vctx;
         vctx.f = f;
         vctx.user_data = user_data;
-        rc = KVectorVisitI64 ( mcpf->unaligned_64_b, false, on_seq_id, &vctx );
+        rc = mate_hash_visit( &mcpf->unaligned, on_seq_id, &vctx ); /* in order of the align-id */
+    }
+    return rc;
+}
+
+
+static rc_t CC on_unaligned_entry( int64_t key, uint64_t a, uint64_t b, void *user_data )
+{
+    matecache_per_file * dst = user_data;
+    rc_t rc = mate_hash_set( &dst->unaligned, key, a, b );
+    if ( rc != 0 )
+        (void)LOGERR( klogErr, rc, "cannot insert into hash (unaligned)" );
+    return rc;
+}
+
+
+static void matecache_add_stat( matecache_stat * dst, const matecache_stat * src )
+{
+    dst->count += src->count;
+    dst->lookups += src->lookups;
+    dst->finds += src->finds;
+    dst->inserts += src->inserts;
+}
+
+
+rc_t matecache_merge( matecache * const self, const matecache * const src )
+{
+    rc_t rc = 0;
+    if ( self == NULL || src == NULL )
+    {
+        rc = RC( rcApp, rcNoTarg, rcAccessing, rcSelf, rcNull );
+        (void)LOGERR( klogErr, rc, "cannot merge matecache" );
+    }
+    else if ( self->count != src->count )
+    {
+        rc = RC( rcApp, rcNoTarg, rcAccessing, rcParam, rcInvalid );
+        (void)LOGERR( klogErr, rc, "cannot merge matecache" );
+    }
+    else
+    {
+        uint32_t idx;
+        for ( idx = 0; idx < self->count && rc == 0; ++idx )
+        {
+            const matecache_per_file * s = &src->per_file[ idx ];
+            matecache_per_file * d = &self->per_file[ idx ];
+            rc = mate_hash_visit( &s->unaligned, on_unaligned_entry, d );
+            if ( rc == 0 )
+            {
+                matecache_add_stat( &d->stat_same_ref, &s->stat_same_ref );
+                matecache_add_stat( &d->stat_unaligned, &s->stat_unaligned );
+                if ( d->maxcount_same_ref < s->maxcount_same_ref )
+                    d->maxcount_same_ref = s->maxcount_same_ref;
+                d->dropped_same_ref += s->dropped_same_ref;
+            }
+        }
+        self->flashes += src->flashes;
     }
     return rc;
 }
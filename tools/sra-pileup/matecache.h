@@ -41,6 +41,8 @@ extern "C" {
 
 #include <insdc/sra.h>
 
+#include "mate_hash.h"
+
 typedef struct matecache_stat
 {
     uint64_t count;
@@ -52,15 +54,13 @@ typedef struct matecache_stat
 
 typedef struct matecache_per_file
 {
-    KVector *same_ref_64;   /* ref-pos and ref-idx */
-    KVector *same_ref_16;   /* flags */
-
-    KVector *unaligned_64_a;  /* ref-pos and ref-idx */
-    KVector *unaligned_64_b;  /* seq_spot_id */
+    mate_hash same_ref;     /* a: ref-pos and tlen, b: flags */
+    mate_hash unaligned;    /* a: ref-pos and ref-idx, b: seq_spot_id */
 
     matecache_stat stat_same_ref;
     matecache_stat stat_unaligned;
     uint64_t maxcount_same_ref;
+    uint64_t dropped_same_ref;  /* not inserted because of the memory-budget */
 } matecache_per_file;
 
 
@@ -74,7 +74,9 @@ typedef struct matecache
 
 /* general cache functions */
 
-rc_t make_matecache( matecache **self, uint32_t count );
+/* budget ... max. bytes for the same-ref-cache of each input-file, 0 = no limit
+   ( if it is full, the mates are read from the table instead ) */
+rc_t make_matecache( matecache **self, uint32_t count, size_t budget );
 
 void release_matecache( matecache * const self );
 
@@ -82,6 +84,10 @@ rc_t matecache_clear_same_ref( matecache * const self );
 
 rc_t matecache_report( const matecache * const self );
 
+/* takes the unaligned entries and the statistic of src over into self,
+   src was filled by a worker-thread for a slice of a reference */
+rc_t matecache_merge( matecache * const self, const matecache * const src );
+
 
 /* cache functions for aligned mates on the same reference */
 
@@ -0,0 +1,137 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "out_buf.h"
+#include "dyn_string.h"
+
+#include <klib/out.h>
+#include <sysalloc.h>
+#include <stdlib.h>
+
+
+rc_t init_out_buf( out_buf * self, size_t size, struct dyn_string * dst )
+{
+    rc_t rc = 0;
+    self->data = malloc( size );
+    if ( self->data == NULL )
+    {
+        self->size = 0;
+        rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+    }
+    else
+        self->size = size;
+    self->used = 0;
+    self->dst = dst;
+    self->keep = false;
+    return rc;
+}
+
+
+void release_out_buf( out_buf * self )
+{
+    if ( self->data != NULL )
+    {
+        free( self->data );
+        self->data = NULL;
+    }
+    self->size = 0;
+    self->used = 0;
+}
+
+
+rc_t write_2_kout( const char * buffer, size_t size )
+{
+    rc_t rc = 0;
+    KWrtWriter writer = KOutWriterGet();
+    void * data = KOutDataGet();
+    while ( rc == 0 && size > 0 )
+    {
+        size_t num_writ = 0;
+        rc = writer( data, buffer, size, &num_writ );
+        if ( rc == 0 )
+        {
+            if ( num_writ == 0 )
+                rc = RC( rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete );
+            buffer += num_writ;
+            size -= num_writ;
+        }
+    }
+    return rc;
+}
+
+
+rc_t flush_out_buf( out_buf * self )
+{
+    rc_t rc = 0;
+    if ( self->used > 0 )
+    {
+        if ( self->dst != NULL )
+            rc = add_buf_2_dyn_string( self->dst, self->data, self->used );
+        else
+            rc = write_2_kout( self->data, self->used );
+        self->used = 0;
+    }
+    return rc;
+}
+
+
+rc_t reserve_out_buf( out_buf * self, size_t n )
+{
+    rc_t rc = 0;
+    if ( self->used + n > self->size && self->keep )
+    {
+        /* the caller flushes when it is done with the bytes already in the buffer */
+        size_t new_size = self->size * 2;
+        char * p;
+        if ( new_size < self->used + n )
+            new_size = self->used + n;
+        p = realloc( self->data, new_size );
+        if ( p == NULL )
+            rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        else
+        {
+            self->data = p;
+            self->size = new_size;
+        }
+    }
+    else if ( self->used + n > self->size )
+    {
+        rc = flush_out_buf( self );
+        if ( rc == 0 && n > self->size )
+        {
+            /* a single line larger than the whole buffer */
+            char * p = realloc( self->data, n );
+            if ( p == NULL )
+                rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+            else
+            {
+                self->data = p;
+                self->size = n;
+            }
+        }
+    }
+    return rc;
+}
@@ -0,0 +1,154 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_out_buf_
+#define _h_out_buf_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <klib/rc.h>
+#include <string.h>
+
+struct dyn_string;
+
+/* output-buffer for pileup-lines and sam-records: lines are formatted directly into it,
+   it is written out in one piece when full ( or after each record ) */
+typedef struct out_buf
+{
+    char * data;
+    size_t size;
+    size_t used;
+    struct dyn_string * dst;    /* NULL: write to the KOut-handler, else append to dst */
+    bool keep;                  /* grow instead of flushing: written bytes can still be patched */
+} out_buf;
+
+rc_t init_out_buf( out_buf * self, size_t size, struct dyn_string * dst );
+/* does not flush! */
+void release_out_buf( out_buf * self );
+rc_t flush_out_buf( out_buf * self );
+/* makes room for at least n more bytes, flushes or grows the buffer */
+rc_t reserve_out_buf( out_buf * self, size_t n );
+
+/* writes directly to the current KOut-handler, no size-limit like KOutMsg() */
+rc_t write_2_kout( const char * buffer, size_t size );
+
+
+/* the appenders do not check for space: call reserve_out_buf() first */
+static __inline__ void out_buf_char( out_buf * self, char c )
+{
+    self->data[ self->used++ ] = c;
+}
+
+
+static __inline__ void out_buf_mem( out_buf * self, const char * s, size_t len )
+{
+    memmove( &self->data[ self->used ], s, len );
+    self->used += len;
+}
+
+
+/* at most 10 chars */
+static __inline__ void out_buf_u32( out_buf * self, uint32_t value )
+{
+    char tmp[ 10 ];
+    uint32_t i = 0;
+    do
+    {
+        tmp[ i++ ] = '0' + ( value % 10 );
+        value /= 10;
+    } while ( value > 0 );
+    while ( i > 0 )
+        self->data[ self->used++ ] = tmp[ --i ];
+}
+
+
+/* at most 11 chars */
+static __inline__ void out_buf_i32( out_buf * self, int32_t value )
+{
+    if ( value < 0 )
+    {
+        self->data[ self->used++ ] = '-';
+        out_buf_u32( self, ( uint32_t )( -( int64_t )value ) );
+    }
+    else
+        out_buf_u32( self, ( uint32_t )value );
+}
+
+
+/* at most 20 chars */
+static __inline__ void out_buf_u64( out_buf * self, uint64_t value )
+{
+    char tmp[ 20 ];
+    uint32_t i = 0;
+    do
+    {
+        tmp[ i++ ] = '0' + ( value % 10 );
+        value /= 10;
+    } while ( value > 0 );
+    while ( i > 0 )
+        self->data[ self->used++ ] = tmp[ --i ];
+}
+
+
+/* at most 20 chars */
+static __inline__ void out_buf_i64( out_buf * self, int64_t value )
+{
+    if ( value < 0 )
+    {
+        self->data[ self->used++ ] = '-';
+        out_buf_u64( self, ( uint64_t )( -( value + 1 ) ) + 1 );
+    }
+    else
+        out_buf_u64( self, ( uint64_t )value );
+}
+
+
+/* copies len bytes of src translated by tab, back to front if reverse is set */
+static __inline__ void out_buf_translate( out_buf * self, const uint8_t * tab,
+                                          const char * src, size_t len, bool reverse )
+{
+    char * dst = &self->data[ self->used ];
+    size_t i;
+    if ( reverse )
+    {
+        for ( i = 0; i < len; ++i )
+            dst[ i ] = tab[ ( uint8_t )src[ len - i - 1 ] ];
+    }
+    else
+    {
+        for ( i = 0; i < len; ++i )
+            dst[ i ] = tab[ ( uint8_t )src[ i ] ];
+    }
+    self->used += len;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_out_buf_ */
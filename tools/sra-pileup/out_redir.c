@@ -25,6 +25,8 @@
 */
 
 #include "out_redir.h"
+#include "bgzf.h"
+#include "bam_index.h"
 
 #include <kfs/directory.h>
 #include <kfs/buffile.h>
@@ -35,18 +37,34 @@
 static rc_t CC out_redir_callback( void * self, const char * buffer, size_t bufsize, size_t * num_writ )
 {
     out_redir * redir = ( out_redir * )self;
-    rc_t rc = KFileWriteAll( redir->kfile, redir->pos, buffer, bufsize, num_writ );
-    if ( rc == 0 )
-        redir->pos += *num_writ;
+    rc_t rc;
+    if ( redir->bgzf != NULL )
+    {
+        if ( redir->bai != NULL )
+            bam_index_feed( redir->bai, buffer, bufsize ); /* bam_index.c */
+        rc = bgzf_writer_write( redir->bgzf, buffer, bufsize ); /* bgzf.c */
+        *num_writ = ( rc == 0 ) ? bufsize : 0;
+    }
+    else
+    {
+        rc = KFileWriteAll( redir->kfile, redir->pos, buffer, bufsize, num_writ );
+        if ( rc == 0 )
+            redir->pos += *num_writ;
+    }
     return rc;
 }
 
 
-rc_t init_out_redir( out_redir * self, enum out_redir_mode mode, const char * filename, size_t bufsize )
+rc_t init_out_redir( out_redir * self, enum out_redir_mode mode, const char * filename, size_t bufsize,
+                     uint32_t num_threads, int level )
 {
     rc_t rc;
     KFile *output_file;
 
+    self->bgzf = NULL;
+    self->bai = NULL;
+    self->bai_name = NULL;
+
     if ( filename != NULL )
     {
         KDirectory *dir;
@@ -71,18 +89,20 @@ rc_t init_out_redir( out_redir * self, enum out_redir_mode mode, const char * fi
         {
             case orm_gzip  : rc = KFileMakeGzipForWrite( &temp_file, output_file ); break;
             case orm_bzip2 : rc = KFileMakeBzip2ForWrite( &temp_file, output_file ); break;
+            /* the bgzf-writer is not a KFile: it writes whole blocks into the output-file */
+            case orm_bgzf  : rc = make_bgzf_writer( &self->bgzf, output_file, num_threads, level ); break;
             case orm_uncompressed : break;
         }
         if ( rc == 0 )
         {
-            if ( mode != orm_uncompressed )
+            if ( mode != orm_uncompressed && mode != orm_bgzf )
             {
                 KFileRelease( output_file );
                 output_file = temp_file;
             }
 
             /* wrap the output/compressed-file in buffering, if requested */
-            if ( bufsize != 0 )
+            if ( bufsize != 0 && mode != orm_bgzf )
             {
                 rc = KBufFileMakeWrite( &temp_file, output_file, false, bufsize );
                 if ( rc == 0 )
@@ -108,13 +128,95 @@ rc_t init_out_redir( out_redir * self, enum out_redir_mode mode, const char * fi
 }
 
 
-void release_out_redir( out_redir * self )
+rc_t out_redir_index_bam( out_redir * self, const char * filename )
+{
+    rc_t rc = 0;
+    if ( self->bgzf == NULL || filename == NULL )
+        rc = RC( rcExe, rcIndex, rcConstructing, rcParam, rcInvalid );
+    else
+    {
+        rc = make_bam_index( &self->bai ); /* bam_index.c */
+        if ( rc == 0 )
+            self->bai_name = filename;
+    }
+    return rc;
+}
+
+
+static uint64_t CC out_redir_voffset( void * data, uint64_t upos )
+{
+    return bgzf_writer_voffset( data, upos ); /* bgzf.c */
+}
+
+
+static rc_t out_redir_write_bai( out_redir * self )
+{
+    KDirectory *dir;
+    rc_t rc = KDirectoryNativeDir( &dir );
+    if ( rc != 0 )
+        LOGERR( klogInt, rc, "KDirectoryNativeDir() failed" );
+    else
+    {
+        KFile *bai_file;
+        rc = KDirectoryCreateFile ( dir, &bai_file, false, 0664, kcmInit, "%s.bai", self->bai_name );
+        if ( rc != 0 )
+            PLOGERR( klogErr, ( klogErr, rc, "cannot create '$(name).bai'", "name=%s", self->bai_name ) );
+        else
+        {
+            rc = bam_index_write( self->bai, bai_file, out_redir_voffset, self->bgzf ); /* bam_index.c */
+            KFileRelease( bai_file );
+            if ( rc != 0 )
+            {
+                if ( GetRCState( rc ) == rcOutoforder )
+                {
+                    /* not an error: unsorted output just cannot be indexed */
+                    PLOGMSG( klogWarn, ( klogWarn, "'$(name)' is not sorted by position, no index written",
+                                         "name=%s", self->bai_name ) );
+                    rc = 0;
+                }
+                else
+                    PLOGERR( klogErr, ( klogErr, rc, "writing '$(name).bai' failed", "name=%s", self->bai_name ) );
+                KDirectoryRemove( dir, true, "%s.bai", self->bai_name );
+            }
+        }
+        KDirectoryRelease( dir );
+    }
+    return rc;
+}
+
+
+rc_t release_out_redir( out_redir * self )
 {
-    KFileRelease( self->kfile );
+    rc_t rc = 0, rc2;
+    if ( self->bgzf != NULL )
+    {
+        /* the last block and the eof-marker */
+        rc = bgzf_writer_finish( self->bgzf ); /* bgzf.c */
+        if ( rc != 0 )
+            LOGERR( klogErr, rc, "finishing the bgzf-output failed" );
+        else if ( self->bai != NULL )
+            rc = out_redir_write_bai( self );
+        rc2 = release_bgzf_writer( self->bgzf );
+        if ( rc == 0 )
+            rc = rc2;
+        self->bgzf = NULL;
+    }
+    release_bam_index( self->bai ); /* bam_index.c */
+    self->bai = NULL;
+    /* flushes what is left in the buffer */
+    rc2 = KFileRelease( self->kfile );
+    if ( rc2 != 0 )
+    {
+        LOGERR( klogErr, rc2, "finishing the output failed" );
+        if ( rc == 0 )
+            rc = rc2;
+    }
+    self->kfile = NULL;
     if( self->org_writer != NULL )
     {
         KOutHandlerSet( self->org_writer, self->org_data );
     }
     self->org_writer = NULL;
+    return rc;
 }
 
@@ -39,11 +39,15 @@ extern "C" {
 
 #include <kfs/file.h>
 
+struct bgzf_writer;
+struct bam_index;
+
 enum out_redir_mode
 {
     orm_uncompressed = 0,
     orm_gzip,
-    orm_bzip2
+    orm_bzip2,
+    orm_bgzf
 };
 
 
@@ -53,12 +57,22 @@ typedef struct out_redir
     KWrtWriter org_writer;
     void* org_data;
     KFile* kfile;
+    struct bgzf_writer * bgzf;   /* orm_bgzf: the output goes through it into kfile */
+    struct bam_index * bai;      /* orm_bgzf: builds the index of the BAM-output, written at release */
+    const char * bai_name;
     uint64_t pos;
 } out_redir;
 
 
-rc_t init_out_redir( out_redir * self, enum out_redir_mode mode, const char * filename, size_t bufsize );
+/* for orm_bgzf: num_threads deflate the blocks, level 0...9 */
+rc_t init_out_redir( out_redir * self, enum out_redir_mode mode, const char * filename, size_t bufsize,
+                     uint32_t num_threads, int level );
+
+/* for orm_bgzf into a file: writes "<filename>.bai" at release, filename is not copied,
+   if the records were not sorted there is a warning and no index */
+rc_t out_redir_index_bam( out_redir * self, const char * filename );
 
-void release_out_redir( out_redir * self );
+/* returns the failure of writing the end of the output, a truncated file is an error */
+rc_t release_out_redir( out_redir * self );
 
 #endif
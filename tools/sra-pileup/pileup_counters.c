@@ -25,6 +25,8 @@
 */
 
 #include <klib/out.h>
+#include <klib/text.h>
+#include <klib/sort.h>
 
 #include "ref_walker_0.h"
 #include "4na_ascii.h"
@@ -38,138 +40,190 @@ static uint32_t percent( uint32_t v1, uint32_t v2 )
     return res;
 }
 
+/* the insert/delete fragments seen at one reference position: the bases go into a
+   bump arena, the tallies into a small open-addressing hash, both reset per position */
 typedef struct indel_fragment
 {
-    BSTNode node;
-    const char * bases;
+    uint32_t offset;    /* of the bases in the arena */
     uint32_t len;
     uint32_t count;
+    uint32_t slot;      /* where it is in the hash */
 } indel_fragment;
 
 
-static indel_fragment * make_indel_fragment( const char * bases, uint32_t len )
+typedef struct indel_fragments
 {
-    indel_fragment * res = malloc( sizeof * res );
-    if ( res != NULL )
-    {
-        res->bases = string_dup ( bases, len );
-        if ( res->bases == NULL )
-        {
-            free( res );
-            res = NULL;
-        }
-        else
-        {
-            res->len = len;
-            res->count = 1;
-        }
-    }
-    return res;
-}
+    indel_fragment * entries;
+    uint32_t * slots;           /* index + 1 into entries, 0 = free */
+    char * arena;
+    uint32_t count;
+    uint32_t entries_cap;
+    uint32_t slots_cap;         /* power of 2 */
+    uint32_t arena_used;
+    uint32_t arena_cap;
+} indel_fragments;
 
 
-static void CC free_indel_fragment( BSTNode * n, void * data )
+static void init_fragments( indel_fragments * fragments )
 {
-    indel_fragment * fragment = ( indel_fragment * ) n;
-    if ( fragment != NULL )
-    {
-        free( ( void * ) fragment->bases );
-        free( fragment );
-    }
+    memset( fragments, 0, sizeof *fragments );
 }
 
 
-static void free_fragments( BSTree * fragments )
-{    
-    BSTreeWhack ( fragments, free_indel_fragment, NULL );
+static void release_fragments( indel_fragments * fragments )
+{
+    free( fragments->entries );
+    free( fragments->slots );
+    free( fragments->arena );
+    init_fragments( fragments );
 }
 
 
-typedef struct find_fragment_ctx
+static void reset_fragments( indel_fragments * fragments )
 {
-    const char * bases;
-    uint32_t len;
-} find_fragment_ctx;
+    uint32_t i;
+    for ( i = 0; i < fragments->count; ++i )
+        fragments->slots[ fragments->entries[ i ].slot ] = 0;
+    fragments->count = 0;
+    fragments->arena_used = 0;
+}
 
 
-static int CC cmp_fragment_vs_find_ctx( const void *item, const BSTNode *n )
+static uint32_t hash_fragment( const char * bases, uint32_t len )
 {
-    const indel_fragment * fragment = ( const indel_fragment * )n;
-    const find_fragment_ctx * fctx = ( const find_fragment_ctx * )item;
-    return string_cmp ( fctx->bases, fctx->len, fragment->bases, fragment->len, -1 );
+    /* FNV-1a over the length and the bases */
+    uint32_t h = 2166136261u ^ len;
+    uint32_t i;
+    for ( i = 0; i < len; ++i )
+    {
+        h ^= ( uint8_t )bases[ i ];
+        h *= 16777619u;
+    }
+    return h;
 }
 
 
-static int CC cmp_fragment_vs_fragment( const BSTNode *item, const BSTNode *n )
+static uint32_t find_slot( const indel_fragments * fragments, const char * bases, uint32_t len, uint32_t hash )
 {
-    const indel_fragment * f1 = ( const indel_fragment * )item;
-    const indel_fragment * f2 = ( const indel_fragment * )n;
-    return string_cmp ( f1->bases, f1->len, f2->bases, f2->len, -1 );
+    uint32_t const mask = fragments->slots_cap - 1;
+    uint32_t slot = hash & mask;
+    for ( ;; )
+    {
+        uint32_t const idx = fragments->slots[ slot ];
+        if ( idx == 0 )
+            return slot;
+        else
+        {
+            const indel_fragment * f = &fragments->entries[ idx - 1 ];
+            if ( f->len == len && memcmp( fragments->arena + f->offset, bases, len ) == 0 )
+                return slot;
+        }
+        slot = ( slot + 1 ) & mask;
+    }
 }
 
 
-static void count_indel_fragment( BSTree * fragments, const INSDC_4na_bin *bases, uint32_t len )
+static bool grow_fragments( indel_fragments * fragments )
 {
-    find_fragment_ctx fctx;
-
-    fctx.bases = malloc( len );
-    if ( fctx.bases != NULL )
+    if ( fragments->count == fragments->entries_cap )
     {
-        indel_fragment * fragment;
+        uint32_t new_cap = fragments->entries_cap == 0 ? 16 : fragments->entries_cap * 2;
+        indel_fragment * entries = realloc( fragments->entries, new_cap * sizeof *entries );
+        if ( entries == NULL )
+            return false;
+        fragments->entries = entries;
+        fragments->entries_cap = new_cap;
+    }
+    if ( ( fragments->count + 1 ) * 2 > fragments->slots_cap )
+    {
+        uint32_t new_cap = fragments->slots_cap == 0 ? 32 : fragments->slots_cap * 2;
+        uint32_t * slots = calloc( new_cap, sizeof *slots );
         uint32_t i;
-
-        fctx.len = len;
-        for ( i = 0; i < len; ++i )
-            ( ( char * )fctx.bases )[ i ] = _4na_to_ascii( bases[ i ], false );
-
-        fragment = ( indel_fragment * ) BSTreeFind ( fragments, &fctx, cmp_fragment_vs_find_ctx );
-        if ( fragment == NULL )
+        if ( slots == NULL )
+            return false;
+        free( fragments->slots );
+        fragments->slots = slots;
+        fragments->slots_cap = new_cap;
+        for ( i = 0; i < fragments->count; ++i )
         {
-            fragment = make_indel_fragment( fctx.bases, len );
-            if ( fragment != NULL )
-            {
-                rc_t rc = BSTreeInsert ( fragments, ( BSTNode * )fragment, cmp_fragment_vs_fragment );
-                if ( rc != 0 )
-                    free_indel_fragment( ( BSTNode * )fragment, NULL );
-            }
+            indel_fragment * f = &fragments->entries[ i ];
+            const char * bases = fragments->arena + f->offset;
+            f->slot = find_slot( fragments, bases, f->len, hash_fragment( bases, f->len ) );
+            slots[ f->slot ] = i + 1;
         }
-        else
-            fragment->count++;
-
-        free( ( void * ) fctx.bases );
     }
+    return true;
 }
 
 
-typedef struct walk_fragment_ctx
+static void count_indel_fragment( indel_fragments * fragments, const INSDC_4na_bin *bases, uint32_t len )
 {
-    rc_t rc;
-    uint32_t n;
-} walk_fragment_ctx;
+    char * dst;
+    uint32_t i, hash, slot;
 
+    if ( fragments->arena == NULL || fragments->arena_cap - fragments->arena_used < len )
+    {
+        uint32_t new_cap = fragments->arena_cap == 0 ? 4096 : fragments->arena_cap;
+        char * arena;
+        while ( new_cap - fragments->arena_used < len )
+            new_cap *= 2;
+        arena = realloc( fragments->arena, new_cap );
+        if ( arena == NULL )
+            return;
+        fragments->arena = arena;
+        fragments->arena_cap = new_cap;
+    }
 
-static void CC on_fragment( BSTNode *n, void *data )
-{
-    walk_fragment_ctx * wctx = data;
-    const indel_fragment * fragment = ( const indel_fragment * )n;
-    if ( wctx->rc == 0 )
+    /* translate into the free end of the arena, keep it there only if it is new */
+    dst = fragments->arena + fragments->arena_used;
+    for ( i = 0; i < len; ++i )
+        dst[ i ] = _4na_to_ascii( bases[ i ], false );
+
+    if ( !grow_fragments( fragments ) )
+        return;
+
+    hash = hash_fragment( dst, len );
+    slot = find_slot( fragments, dst, len, hash );
+    if ( fragments->slots[ slot ] != 0 )
+        fragments->entries[ fragments->slots[ slot ] - 1 ].count++;
+    else
     {
-        if ( wctx->n == 0 )
-            wctx->rc = KOutMsg( "%u-%.*s", fragment->count, fragment->len, fragment->bases );
-        else
-            wctx->rc = KOutMsg( "|%u-%.*s", fragment->count, fragment->len, fragment->bases );
-        wctx->n++;
+        indel_fragment * f = &fragments->entries[ fragments->count++ ];
+        f->offset = fragments->arena_used;
+        f->len = len;
+        f->count = 1;
+        f->slot = slot;
+        fragments->slots[ slot ] = fragments->count;
+        fragments->arena_used += len;
     }
 }
 
 
-static rc_t print_fragments( BSTree * fragments )
+static int CC cmp_fragments( const void *item, const void *n, void *data )
 {
-    walk_fragment_ctx wctx;
-    wctx.rc = 0;
-    wctx.n = 0;
-    BSTreeForEach ( fragments, false, on_fragment, &wctx );
-    return wctx.rc;
+    const indel_fragment * f1 = item;
+    const indel_fragment * f2 = n;
+    const char * arena = data;
+    return string_cmp ( arena + f1->offset, f1->len, arena + f2->offset, f2->len, -1 );
+}
+
+
+static rc_t print_fragments( struct dyn_string * out, indel_fragments * fragments )
+{
+    rc_t rc = 0;
+    uint32_t i;
+
+    /* printed in the order of the bases, as the BSTree used to do;
+       sorting moves the entries, so the hash is done for this position */
+    if ( fragments->count > 1 )
+        ksort ( fragments->entries, fragments->count, sizeof fragments->entries[ 0 ], cmp_fragments, fragments->arena );
+
+    for ( i = 0; rc == 0 && i < fragments->count; ++i )
+    {
+        const indel_fragment * f = &fragments->entries[ i ];
+        rc = out_2_dyn_string( out, i == 0 ? "%u-%.*s" : "|%u-%.*s", f->count, f->len, fragments->arena + f->offset );
+    }
+    return rc;
 }
 
 /* =========================================================================================== */
@@ -184,11 +238,27 @@ typedef struct pileup_counters
     uint32_t reverse;
     uint32_t starting;
     uint32_t ending;
-    BSTree insert_fragments;
-    BSTree delete_fragments;
+    bool count_indels;      /* the mismatch lines do not print them */
+    indel_fragments insert_fragments;
+    indel_fragments delete_fragments;
 } pileup_counters;
 
 
+static void init_counters( pileup_counters * counters, bool count_indels )
+{
+    counters->count_indels = count_indels;
+    init_fragments( &(counters->insert_fragments) );
+    init_fragments( &(counters->delete_fragments) );
+}
+
+
+static void release_counters( pileup_counters * counters )
+{
+    release_fragments( &(counters->insert_fragments) );
+    release_fragments( &(counters->delete_fragments) );
+}
+
+
 static void clear_counters( pileup_counters * counters )
 {
     uint32_t i;
@@ -202,8 +272,8 @@ static void clear_counters( pileup_counters * counters )
     counters->reverse = 0;
     counters->starting = 0;
     counters->ending = 0;
-    BSTreeInit( &(counters->insert_fragments) );
-    BSTreeInit( &(counters->delete_fragments) );
+    reset_fragments( &(counters->insert_fragments) );
+    reset_fragments( &(counters->delete_fragments) );
 }
 
 
@@ -240,7 +310,8 @@ static void walk_counter_state( ReferenceIterator *ref_iter, int32_t state, bool
         const INSDC_4na_bin *bases;
         uint32_t n = ReferenceIteratorBasesInserted ( ref_iter, &bases );
         (counters->inserts) += n;
-        count_indel_fragment( &(counters->insert_fragments), bases, n );
+        if ( counters->count_indels )
+            count_indel_fragment( &(counters->insert_fragments), bases, n );
     }
 
     if ( ( state & align_iter_delete ) == align_iter_delete )
@@ -251,7 +322,8 @@ static void walk_counter_state( ReferenceIterator *ref_iter, int32_t state, bool
         if ( bases != NULL )
         {
             (counters->deletes) += n;
-            count_indel_fragment( &(counters->delete_fragments), bases, n );
+            if ( counters->count_indels )
+                count_indel_fragment( &(counters->delete_fragments), bases, n );
             free( (void *) bases );
         }
     }
@@ -264,7 +336,8 @@ static void walk_counter_state( ReferenceIterator *ref_iter, int32_t state, bool
 }
 
 
-static rc_t print_counter_line( const char * ref_name,
+static rc_t print_counter_line( struct dyn_string * out,
+                                const char * ref_name,
                                 INSDC_coord_zero ref_pos,
                                 INSDC_4na_bin ref_base,
                                 uint32_t depth,
@@ -272,47 +345,44 @@ static rc_t print_counter_line( const char * ref_name,
 {
     char c = _4na_to_ascii( ref_base, false );
 
-    rc_t rc = KOutMsg( "%s\t%u\t%c\t%u\t", ref_name, ref_pos + 1, c, depth );
+    rc_t rc = out_2_dyn_string( out, "%s\t%u\t%c\t%u\t", ref_name, ref_pos + 1, c, depth );
 
     if ( rc == 0 && counters->matches > 0 )
-        rc = KOutMsg( "%u", counters->matches );
+        rc = out_2_dyn_string( out, "%u", counters->matches );
 
     if ( rc == 0 /* && counters->mismatches[ 0 ] > 0 */ )
-        rc = KOutMsg( "\t%u-A", counters->mismatches[ 0 ] );
+        rc = out_2_dyn_string( out, "\t%u-A", counters->mismatches[ 0 ] );
 
     if ( rc == 0 /* && counters->mismatches[ 1 ] > 0 */ )
-        rc = KOutMsg( "\t%u-C", counters->mismatches[ 1 ] );
+        rc = out_2_dyn_string( out, "\t%u-C", counters->mismatches[ 1 ] );
 
     if ( rc == 0 /* && counters->mismatches[ 2 ] > 0 */ )
-        rc = KOutMsg( "\t%u-G", counters->mismatches[ 2 ] );
+        rc = out_2_dyn_string( out, "\t%u-G", counters->mismatches[ 2 ] );
 
     if ( rc == 0 /* && counters->mismatches[ 3 ] > 0 */ )
-        rc = KOutMsg( "\t%u-T", counters->mismatches[ 3 ] );
+        rc = out_2_dyn_string( out, "\t%u-T", counters->mismatches[ 3 ] );
 
     if ( rc == 0 )
-        rc = KOutMsg( "\tI:" );
+        rc = out_2_dyn_string( out, "\tI:" );
     if ( rc == 0 )
-        rc = print_fragments( &(counters->insert_fragments) );
+        rc = print_fragments( out, &(counters->insert_fragments) );
 
     if ( rc == 0 )
-        rc = KOutMsg( "\tD:" );
+        rc = out_2_dyn_string( out, "\tD:" );
     if ( rc == 0 )
-        rc = print_fragments( &(counters->delete_fragments) );
+        rc = print_fragments( out, &(counters->delete_fragments) );
 
     if ( rc == 0 )
-        rc = KOutMsg( "\t%u%%", percent( counters->forward, counters->reverse ) );
+        rc = out_2_dyn_string( out, "\t%u%%", percent( counters->forward, counters->reverse ) );
 
     if ( rc == 0 && counters->starting > 0 )
-        rc = KOutMsg( "\tS%u", counters->starting );
+        rc = out_2_dyn_string( out, "\tS%u", counters->starting );
 
     if ( rc == 0 && counters->ending > 0 )
-        rc = KOutMsg( "\tE%u", counters->ending );
+        rc = out_2_dyn_string( out, "\tE%u", counters->ending );
 
     if ( rc == 0 )
-        rc = KOutMsg( "\n" );
-
-    free_fragments( &(counters->insert_fragments) );
-    free_fragments( &(counters->delete_fragments) );
+        rc = out_2_dyn_string( out, "\n" );
 
     return rc;
 }
@@ -329,7 +399,8 @@ static rc_t CC walk_counters_enter_ref_pos( walk_data * data )
 
 static rc_t CC walk_counters_exit_ref_pos( walk_data * data )
 {
-    rc_t rc = print_counter_line( data->ref_name, data->ref_pos, data->ref_base, data->depth, data->data );
+    rc_t rc = print_counter_line( data->options->out, data->ref_name, data->ref_pos,
+                                  data->ref_base, data->depth, data->data );
     return rc;
 }
 
@@ -344,6 +415,7 @@ rc_t walk_counters( ReferenceIterator *ref_iter, pileup_options *options )
     walk_data data;
     walk_funcs funcs;
     pileup_counters counters;
+    rc_t rc;
 
     data.ref_iter = ref_iter;
     data.options = options;
@@ -363,14 +435,18 @@ rc_t walk_counters( ReferenceIterator *ref_iter, pileup_options *options )
 
     funcs.on_placement = walk_counters_placement;
 
-    return walk_0( &data, &funcs );
+    init_counters( &counters, true );
+    rc = walk_0( &data, &funcs );
+    release_counters( &counters );
+    return rc;
 }
 
 
 /* =========================================================================================== */
 
 
-static rc_t print_mismatches_line( const char * ref_name,
+static rc_t print_mismatches_line( struct dyn_string * out,
+                                   const char * ref_name,
                                    INSDC_coord_zero ref_pos,
                                    uint32_t depth,
                                    uint32_t min_mismatch_percent,
@@ -385,12 +461,9 @@ static rc_t print_mismatches_line( const char * ref_name,
                                     counters->mismatches[ 3 ];
 	if ( total_mismatches * 100 >= min_mismatch_percent * depth) 
         {
-                rc = KOutMsg( "%s\t%u\t%u\t%u\n", ref_name, ref_pos + 1, depth, total_mismatches );
+                rc = out_2_dyn_string( out, "%s\t%u\t%u\t%u\n", ref_name, ref_pos + 1, depth, total_mismatches );
         }
     }
-    
-    free_fragments( &(counters->insert_fragments) );
-    free_fragments( &(counters->delete_fragments) );
 
     return rc;
 }
@@ -407,7 +480,7 @@ static rc_t CC walk_mismatches_enter_ref_pos( walk_data * data )
 
 static rc_t CC walk_mismatches_exit_ref_pos( walk_data * data )
 {
-    rc_t rc = print_mismatches_line( data->ref_name, data->ref_pos,
+    rc_t rc = print_mismatches_line( data->options->out, data->ref_name, data->ref_pos,
                                      data->depth, data->options->min_mismatch, data->data );
     return rc;
 }
@@ -424,6 +497,7 @@ rc_t walk_mismatches( ReferenceIterator *ref_iter, pileup_options * options )
     walk_data data;
     walk_funcs funcs;
     pileup_counters counters;
+    rc_t rc;
 
     data.ref_iter = ref_iter;
     data.options = options;
@@ -443,5 +517,8 @@ rc_t walk_mismatches( ReferenceIterator *ref_iter, pileup_options * options )
 
     funcs.on_placement = walk_mismatches_placement;
 
-    return walk_0( &data, &funcs );
+    init_counters( &counters, false );
+    rc = walk_0( &data, &funcs );
+    release_counters( &counters );
+    return rc;
 }
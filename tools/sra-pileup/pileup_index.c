@@ -63,7 +63,7 @@ static rc_t CC walk_index_exit_ref_pos( walk_data * data )
     if ( ic->forward + ic->reverse == 0 )
         return 0;
     else
-        return KOutMsg( "%s\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\n", 
+        return out_2_dyn_string( data->options->out, "%s\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\n", 
                      data->ref_name, data->ref_pos + 1, 
                      ic->base_counts[ 0 ], ic->base_counts[ 1 ], ic->base_counts[ 2 ], ic->base_counts[ 3 ],
                      ic->inserts, ic->deletes, percent( ic->forward, ic->reverse ) );
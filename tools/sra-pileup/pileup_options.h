@@ -33,6 +33,9 @@ extern "C" {
 
 #include "ref_regions.h"
 #include "cmdline_cmn.h"
+#include "dyn_string.h"
+
+struct perf_log;
 
 typedef struct pileup_options
 {
@@ -48,9 +51,12 @@ typedef struct pileup_options
     uint32_t min_mismatch;
     uint32_t merge_dist;
     uint32_t source_table;
+    uint32_t threads;       /* number of worker-threads piling up chunks of references in parallel */
     uint32_t function;  /* sra_pileup_samtools, sra_pileup_counters, sra_pileup_stat, 
                            sra_pileup_report_ref, sra_pileup_report_ref_ext, sra_pileup_debug, etc */
     struct skiplist * skiplist;     /* from ref_regions.h */
+    struct dyn_string * out;        /* if not NULL: walkers collect output here instead of KOutMsg() */
+    struct perf_log * perf_log;     /* from perf_log.h, lines per minute if --timing is given */
 } pileup_options;
 
 
@@ -77,7 +77,7 @@ static rc_t CC walk_varcount_exit_ref_pos( walk_data * data )
 
                           A   B   C   D   E   F   G   H   I   J   K   L   M   N
 */                         
-        return KOutMsg( "%s\t%u\t%c\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\n", 
+        return out_2_dyn_string( data->options->out, "%s\t%u\t%c\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\n", 
                      data->ref_name, data->ref_pos + 1, ref_base, data->depth,
 
                      vc->base_counts[ 0 ], vc->base_counts[ 1 ], vc->base_counts[ 2 ], vc->base_counts[ 3 ],
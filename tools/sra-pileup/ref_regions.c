@@ -274,73 +274,66 @@ static void free_reference_region( struct reference_region * self )
 }
 
 
+/* the ranges-vector is sorted by start, merging is done in one pass:
+   the surviving ranges are collected in a new vector instead of removing
+   them one by one ( every VectorRemove shifts the tail of the vector ) */
 static void merge_overlapping_ranges( struct reference_region * self )
 {
-    uint32_t n = VectorLength( &self->ranges );
-    uint32_t i = 0;
+    uint32_t i, n = VectorLength( &self->ranges );
     struct reference_range * a = NULL;
-    while ( i < n )
+    Vector merged;
+
+    VectorInit ( &merged, 0, n > 0 ? n : 5 );
+    for ( i = 0; i < n; ++i )
     {
         struct reference_range * b = VectorGet ( &self->ranges, i );
-        bool remove = false;
-        if ( a != NULL )
+        if ( a != NULL && range_overlapp( a, b ) )
         {
-            remove = range_overlapp( a, b );
-            if ( remove )
-            {
-                struct reference_range * r;
+            if ( b->end > a->end )
                 a->end = b->end;
-                VectorRemove ( &self->ranges, i, (void**)&r );
-                free( r );
-                n--;
-            }
+            free_range( b );
         }
-        if ( !remove )
+        else
         {
+            VectorAppend ( &merged, NULL, b );
             a = b;
-            ++i;
         }
     }
+    VectorWhack ( &self->ranges, NULL, NULL );
+    self->ranges = merged;
 }
 
 
 static void merge_close_ranges_and_create_filter( struct reference_region * self, uint64_t merge_diff )
 {
-    uint32_t n = VectorLength( &self->ranges );
-    uint32_t i = 0;
+    uint32_t i, n = VectorLength( &self->ranges );
     struct reference_range * a = NULL;
-    while ( i < n )
+    Vector merged;
+
+    VectorInit ( &merged, 0, n > 0 ? n : 5 );
+    for ( i = 0; i < n; ++i )
     {
         struct reference_range * b = VectorGet ( &self->ranges, i );
-        bool remove = false;
-        if ( a != NULL )
+        /* get the distance between a and b */
+        if ( a != NULL && range_distance( a, b ) < merge_diff )
         {
-            /* get the distance between a and b */
-            uint64_t d = range_distance( a, b );
-            remove = ( d < merge_diff );
-            if ( remove )
-            {
-                struct reference_range * r;
-
-                /* add the gap to the skip-vector of a */
-                struct skip_range * sr = make_skip_range( a->end + 1, b->start - 1 );
+            /* add the gap to the skip-vector of a */
+            struct skip_range * sr = make_skip_range( a->end + 1, b->start - 1 );
+            if ( sr != NULL )
                 VectorAppend ( &( a->skip ), NULL, sr );
 
-                /* expand a to merge with b */
-                a->end = b->end;
-
-                /* remove b */
-                VectorRemove ( &self->ranges, i, (void**)&r );
-                free( r );
-                n--;
-            }
+            /* expand a to merge with b */
+            a->end = b->end;
+            free_range( b );
         }
-        if ( !remove )
+        else
         {
+            VectorAppend ( &merged, NULL, b );
             a = b;
-            ++i;
         }
     }
+    VectorWhack ( &self->ranges, NULL, NULL );
+    self->ranges = merged;
 }
 
 
@@ -595,13 +588,16 @@ uint64_t get_ref_range_end( const struct reference_range * range )
 /* =========================================================================================== */
 
 
+/* the skip-ranges of one reference are kept in a flat array sorted by start,
+   skiplist_is_skip_position() walks it with a cursor that only moves forward
+   as long as the pileup does, that makes the lookup O(1) amortized */
 struct skiplist_ref_node
 {
     BSTNode node;
     const char * name;
-    int32_t current_id;
-    const struct skip_range * current_skip_range;
-    Vector skip_ranges;     /* holds skip_range structs */
+    uint32_t current_id;
+    uint32_t count;
+    struct skip_range * ranges;
 } skiplist_ref_node;
 
 
@@ -613,48 +609,52 @@ struct skiplist
 } skiplist;
 
 
-/* helper func to detect if the given reference_region has ranges to be skiped */
-static bool reference_region_has_skip_ranges( const struct reference_region * r )
+/* helper func to count the ranges to be skipped in the given reference_region */
+static uint32_t reference_region_count_skip_ranges( const struct reference_region * r )
 {
-    bool res = false;
+    uint32_t res = 0;
     uint32_t i, n = VectorLength( &r->ranges );
-    for ( i = 0; i < n && !res; ++i )
+    for ( i = 0; i < n; ++i )
     {
         const struct reference_range * rr = VectorGet ( &( r->ranges ), i );
-        if ( VectorLength( &rr->skip ) > 0 ) res = true;
+        res += VectorLength( &rr->skip );
     }
     return res;
 }
 
 
 /* helper to create a skiplist-node, walk the given the ref-region fo find and enter all skip positions */
-static struct skiplist_ref_node * make_skiplist_ref_node( const struct reference_region * r )
+static struct skiplist_ref_node * make_skiplist_ref_node( const struct reference_region * r, uint32_t count )
 {
     struct skiplist_ref_node * res = calloc( 1, sizeof *res );
     if ( res != NULL )
     {
-        uint32_t i, n = VectorLength( &r->ranges );
-        res->name = string_dup_measure ( r->name, NULL );
-        VectorInit ( &res->skip_ranges, 0, 5 );
-        /* walk the ranges-Vector of the reference-region */
-        for ( i = 0; i < n; ++i )
+        res->ranges = malloc( count * sizeof *( res->ranges ) );
+        if ( res->ranges == NULL )
         {
-            const struct reference_range * rr = VectorGet ( &( r->ranges ), i );
-            /* walk the skip-Vector of the reference-range */
-            uint32_t j, n1 = VectorLength( &rr->skip );
-            for ( j = 0; j < n1; ++j )
+            free( ( void * ) res );
+            res = NULL;
+        }
+        else
+        {
+            uint32_t i, n = VectorLength( &r->ranges );
+            res->name = string_dup_measure ( r->name, NULL );
+            /* walk the ranges-Vector of the reference-region,
+               the ranges and the skips within them are already sorted */
+            for ( i = 0; i < n; ++i )
             {
-                const struct skip_range * sr = VectorGet ( &( rr->skip ), j );
-                if ( sr != NULL )
+                const struct reference_range * rr = VectorGet ( &( r->ranges ), i );
+                /* walk the skip-Vector of the reference-range */
+                uint32_t j, n1 = VectorLength( &rr->skip );
+                for ( j = 0; j < n1; ++j )
                 {
-                    struct skip_range * csr = make_skip_range( sr->start, sr->end );
-                    if ( csr != NULL )
-                        VectorAppend ( &( res->skip_ranges ), NULL, csr );
+                    const struct skip_range * sr = VectorGet ( &( rr->skip ), j );
+                    if ( sr != NULL && res->count < count )
+                        res->ranges[ res->count++ ] = *sr;
                 }
             }
+            res->current_id = 0;
         }
-        res->current_id = 0;
-        res->current_skip_range = VectorGet ( &( res->skip_ranges ), 0 );
     }
     return res;
 }
@@ -677,9 +677,10 @@ static void CC visit_region_node_for_skiplist( BSTNode *n, void *data )
     if ( r != NULL && skl != NULL )
     {
         /* walk the reference-region, detect if we even have something to skip in here */
-        if ( reference_region_has_skip_ranges( r ) )
+        uint32_t count = reference_region_count_skip_ranges( r );
+        if ( count > 0 )
         {
-            struct skiplist_ref_node * srn = make_skiplist_ref_node( r );
+            struct skiplist_ref_node * srn = make_skiplist_ref_node( r, count );
             if ( srn != NULL )
             {
                 BSTreeInsert ( &(skl->nodes), ( BSTNode * )srn, srn_vs_srn_wrapper );
@@ -714,7 +715,7 @@ static void CC release_skiplist_entry( BSTNode * n, void * data )
 {
     struct skiplist_ref_node * node = ( struct skiplist_ref_node * )n;
     if ( node->name != NULL ) free( ( void * ) node->name );
-    VectorWhack ( &node->skip_ranges, release_skip, NULL );     /* wrapper callback reused from above */
+    if ( node->ranges != NULL ) free( ( void * ) node->ranges );
     free( ( void * ) node );
 }
 
@@ -742,19 +743,34 @@ void skiplist_enter_ref( struct skiplist * list, const char * name )
 {
     if ( list != NULL )
     {
-        if ( name == NULL )
-            list->current = NULL;
-        else
-        {
-            struct skiplist_ref_node * cur_node = ( struct skiplist_ref_node * )BSTreeFind ( &( list->nodes ), name, pchar_vs_srn_cmp );
-            list->current = cur_node;
+        struct skiplist_ref_node * cur_node = NULL;
+        if ( name != NULL )
+            cur_node = ( struct skiplist_ref_node * )BSTreeFind ( &( list->nodes ), name, pchar_vs_srn_cmp );
+        /* a reference without skip-ranges is not in the tree */
+        if ( cur_node != NULL )
             cur_node->current_id = 0;
-            cur_node->current_skip_range = VectorGet ( &( cur_node->skip_ranges ), 0 );
-        }
+        list->current = cur_node;
     }
 }
 
 
+/* find the first skip-range in ranges[ lo ... hi ) that does not end before pos */
+static uint32_t skiplist_search( const struct skip_range * ranges, uint32_t lo, uint32_t hi, uint64_t pos )
+{
+    while ( lo < hi )
+    {
+        uint32_t mid = lo + ( ( hi - lo ) >> 1 );
+        if ( ranges[ mid ].end < pos )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+
+#define SKIPLIST_LINEAR_STEPS 8
+
 bool skiplist_is_skip_position( struct skiplist * list, uint64_t pos )
 {
     if ( list != NULL )
@@ -762,14 +778,31 @@ bool skiplist_is_skip_position( struct skiplist * list, uint64_t pos )
         struct skiplist_ref_node * cur_node = list->current;
         if ( cur_node != NULL )
         {
-            const struct skip_range * curr_skip_range = cur_node->current_skip_range;
-            if ( curr_skip_range != NULL )
+            const struct skip_range * ranges = cur_node->ranges;
+            uint32_t id = cur_node->current_id;
+            uint32_t count = cur_node->count;
+
+            if ( id > 0 && pos <= ranges[ id - 1 ].end )
+            {
+                /* pos moved backwards: search the part behind the cursor */
+                id = skiplist_search( ranges, 0, id, pos );
+            }
+            else
             {
-                if ( pos < curr_skip_range->start ) return false;
-                if ( pos <= curr_skip_range->end ) return true;
-                cur_node->current_id++;
-                cur_node->current_skip_range = VectorGet ( &( cur_node->skip_ranges ), cur_node->current_id );
+                /* the common case: pos stays in front of the cursor or moves a little;
+                   larger jumps ( chunks of a parallel pileup ) fall back to a binary search */
+                uint32_t steps = 0;
+                while ( id < count && pos > ranges[ id ].end && steps < SKIPLIST_LINEAR_STEPS )
+                {
+                    ++id;
+                    ++steps;
+                }
+                if ( id < count && pos > ranges[ id ].end )
+                    id = skiplist_search( ranges, id + 1, count, pos );
             }
+            cur_node->current_id = id;
+            if ( id < count )
+                return ( pos >= ranges[ id ].start );
         }
     }
     return false;
@@ -779,17 +812,17 @@ bool skiplist_is_skip_position( struct skiplist * list, uint64_t pos )
 static void CC skiplist_report_cb( BSTNode *n, void *data )
 {
     const struct skiplist_ref_node * node = ( const struct skiplist_ref_node * )n;
-    uint32_t nr = VectorLength( &( node->skip_ranges ) );
+    uint32_t nr = node->count;
 
     KOutMsg( "\n-[%s]:\n", node->name );
-    if ( n == 0 )
+    if ( nr == 0 )
         KOutMsg( " no ranges!\n" );
     else
     {
         uint32_t i;
         for ( i = 0; i < nr; ++i )
         {
-            const struct skip_range * sr = ( const struct skip_range * ) VectorGet ( &( node->skip_ranges ), i );
+            const struct skip_range * sr = &( node->ranges[ i ] );
             KOutMsg( "  %u ... %u\n", sr->start, sr->end );
         }
     }
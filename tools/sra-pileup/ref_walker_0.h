@@ -47,6 +47,7 @@ struct tool_rec
     int32_t tlen;   /* template-len, for statistical analysis */
     uint32_t quality_len;
     uint8_t * quality;  /* ptr to quality... ( for sam-output ) */
+    struct qual_slab * slab;    /* pooled storage the quality points into ( NULL if none ) */
 };
 
 
@@ -26,7 +26,12 @@
 
 #include <align/manager.h>
 #include <align/iterator.h>
+#include <vdb/manager.h>
+#include <vdb/database.h>
 #include <kapp/main.h>
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
 #include <ctype.h>
 #include <sysalloc.h>
 
@@ -34,6 +39,9 @@
 #include "cg_tools.h"
 #include "rna_splice_log.h"
 #include "sam-aligned.h"
+#include "dyn_string.h"
+#include "out_buf.h"
+#include "bam_out.h"
 
 const char * PRIM_TABLE = "PRIMARY_ALIGNMENT";
 const char * SEC_TABLE = "SECONDARY_ALIGNMENT";
@@ -107,6 +115,16 @@ const char * EV_AL_TABLE = "EVIDENCE_ALIGNMENT";
 #define COL_ALIGN_GROUP "(ascii)ALIGN_GROUP"
 #define COL_RNA_ORIENTATION "(ascii)RNA_ORIENTATION"
 
+/* initial size of the record-buffer of a prim/sec-context, it grows for longer records */
+#define SAM_REC_BUF_SIZE ( 16 * 1024 )
+
+/* room for a number in a sam-record, together with the tab/tag around it */
+#define SAM_NUM_CHARS 24
+
+/* requested ranges on a reference closer than this share one placement-iterator ( and its cursors ),
+   this way a REFERENCE-chunk is read only once, even if many small regions are in it */
+#define REGION_CLUSTER_GAP ( 64 * 1024 )
+
 enum align_table_type
 {
     att_primary = 0,
@@ -136,6 +154,16 @@ typedef struct align_cmn_context
 } align_cmn_context;
 
 
+/* some of the sorted, disjoint ranges of a reference_region ( sam-dump-opts.h ),
+   covered by one placement-iterator */
+typedef struct region_cluster
+{
+    const Vector * ranges;  /* NULL: no filtering */
+    uint32_t first;
+    uint32_t count;
+} region_cluster;
+
+
 typedef struct align_table_context
 {
     CigOps * cig_op_buffer;
@@ -176,6 +204,18 @@ typedef struct align_table_context
 
     /* the common part repeats for evidence-alignment */
     align_cmn_context eval;
+
+    /* NULL: the records are printed via KOutMsg(), else into the output-buffer of a slice */
+    struct dyn_string * out;
+
+    /* prim/sec-records are formatted into this one and flushed to out ( or KOut ) once per record */
+    out_buf rec;
+
+    /* the position of the reference in the bam-header, -2 until it is looked up */
+    int32_t bam_ref_id;
+
+    /* only alignments starting in one of these ranges are printed */
+    region_cluster cluster;
 } align_table_context;
 
 
@@ -218,12 +258,16 @@ static void invalidate_all_column_idx( align_table_context * const atx )
 
 static void init_align_table_context( align_table_context * const atx,
                                       const uint32_t db_idx,
-                                      const ReferenceObj* ref_obj )
+                                      const ReferenceObj* ref_obj,
+                                      struct dyn_string * out )
 {
     atx->db_idx = db_idx;
     atx->ref_obj = ref_obj;
+    atx->out = out;
     atx->cig_op_buffer = NULL;
     atx->cig_op_buffer_len = 0;
+    atx->bam_ref_id = -2;
+    atx->cluster.ranges = NULL;
     invalidate_all_column_idx( atx );
 }
 
@@ -235,6 +279,7 @@ static void free_align_table_context( align_table_context * atx )
         if ( atx->cig_op_buffer != NULL )
             free( atx->cig_op_buffer );
 
+        release_out_buf( &atx->rec );
         VCursorRelease( atx->cmn.cursor );
         VCursorRelease( atx->eval.cursor );
         free( atx );
@@ -543,9 +588,11 @@ static rc_t add_table_pl_iter( const samdump_opts * const opts,
                                INSDC_coord_zero ref_pos,
                                INSDC_coord_len ref_len,
                                const char * spot_group,
+                               const region_cluster * cluster,
                                const char * table_name,
                                align_id_src id_src_selector,
-                               Vector * const context_list )
+                               Vector * const context_list,
+                               struct dyn_string * out )
 {
     rc_t rc = 0;
     align_table_context * atx;
@@ -560,7 +607,9 @@ static rc_t add_table_pl_iter( const samdump_opts * const opts,
     }
     else
     {
-        init_align_table_context( atx, idb->db_idx, ref_obj );
+        init_align_table_context( atx, idb->db_idx, ref_obj, out );
+        if ( cluster != NULL )
+            atx->cluster = *cluster;
         rc = ReferenceObj_Idx( ref_obj, &atx->ref_idx );
         if ( rc != 0 )
         {
@@ -584,6 +633,16 @@ static rc_t add_table_pl_iter( const samdump_opts * const opts,
             }
         }
         if ( rc == 0 )
+        {
+            rc = init_out_buf( &atx->rec, SAM_REC_BUF_SIZE, out ); /* out_buf.c */
+            if ( rc != 0 )
+            {
+                (void)PLOGERR( klogInt, ( klogInt, rc, "record-buffer-allocation for $(tn) failed", "tn=%s", table_name ) );
+            }
+            /* the fixed part of a bam-record is filled in after the rest of it is appended */
+            atx->rec.keep = ( opts->output_format == of_bam );
+        }
+        if ( rc == 0 )
         {
             ext_0.data = atx;
             /* we must put the atx-ptr into a global list, in order to close everything later at the end... */
@@ -640,7 +699,9 @@ static rc_t add_pl_iters( const samdump_opts * const opts,
                           INSDC_coord_zero ref_pos,
                           INSDC_coord_len ref_len,
                           const char * spot_group,
-                          Vector * const context_list )
+                          const region_cluster * cluster,
+                          Vector * const context_list,
+                          struct dyn_string * out )
 {
     KNamelist *tables;
     rc_t rc = VDatabaseListTbl( idb->db, &tables );
@@ -652,14 +713,14 @@ static rc_t add_pl_iters( const samdump_opts * const opts,
     {
         if ( opts->dump_primary_alignments && namelist_contains( tables, PRIM_TABLE ) ) /* read_fkt.c */
         {
-            rc = add_table_pl_iter( opts, set_iter, ref_obj, idb, ref_pos, ref_len, spot_group, 
-                                    PRIM_TABLE, primary_align_ids, context_list );
+            rc = add_table_pl_iter( opts, set_iter, ref_obj, idb, ref_pos, ref_len, spot_group, cluster,
+                                    PRIM_TABLE, primary_align_ids, context_list, out );
         }
 
         if ( rc == 0 && opts->dump_secondary_alignments && namelist_contains( tables, SEC_TABLE ) )
         {
-            rc = add_table_pl_iter( opts, set_iter, ref_obj, idb, ref_pos, ref_len, spot_group, 
-                                    SEC_TABLE, secondary_align_ids, context_list );
+            rc = add_table_pl_iter( opts, set_iter, ref_obj, idb, ref_pos, ref_len, spot_group, cluster,
+                                    SEC_TABLE, secondary_align_ids, context_list, out );
         }
 
         if ( rc == 0 )
@@ -673,8 +734,8 @@ static rc_t add_pl_iters( const samdump_opts * const opts,
 
             if ( b0 || b1 )
             {
-                rc = add_table_pl_iter( opts, set_iter, ref_obj, idb, ref_pos, ref_len, spot_group, 
-                                        EV_INT_TABLE, evidence_align_ids, context_list );
+                rc = add_table_pl_iter( opts, set_iter, ref_obj, idb, ref_pos, ref_len, spot_group, cluster,
+                                        EV_INT_TABLE, evidence_align_ids, context_list, out );
             }
         }
         KNamelistRelease( tables );
@@ -719,7 +780,9 @@ static rc_t prepare_whole_files( const samdump_opts * const opts,
                                 0,                  /* where it starts on the reference */
                                 ref_len,            /* the whole length of this reference/chromosome */
                                 NULL,               /* no spotgroup re-grouping (yet) */
-                                context_list
+                                NULL,               /* no regions to filter by */
+                                context_list,
+                                NULL                /* print via KOutMsg() */
                                 );
                         ReferenceObj_Release( ref_obj );
                     }
@@ -751,33 +814,39 @@ static void CC on_region( BSTNode *n, void *data )
         rctx->rc = ReferenceList_Find( rctx->idb->reflist, &ref_obj, ref_rgn->name, string_size( ref_rgn->name ) );
         if ( rctx->rc == 0 )
         {
+            INSDC_coord_len len;
+            /* the ranges are sorted and do not overlap ( sam-dump-regions.c ), the ones close to each other
+               are dumped by one placement-iterator, the alignments in the gaps are filtered out later */
             uint32_t range_idx, range_count = VectorLength( &ref_rgn->ranges );
+            uint32_t cluster_first = 0;
+            uint64_t cluster_end = 0;
+            /* "ref", "ref:100" and "ref:100-" are open ( end == 0 ), they go up to the end of the reference */
+            rctx->rc = ReferenceObj_SeqLength( ref_obj, &len );
+            if ( rctx->rc == 0 )
+                resolve_ref_region_ends( ref_rgn, len );
             for ( range_idx = 0; range_idx < range_count && rctx->rc == 0; ++range_idx )
             {
                 range * r = VectorGet( &ref_rgn->ranges, range_idx );
-                if ( r != NULL )
+                range * next = ( range_idx + 1 < range_count ) ? VectorGet( &ref_rgn->ranges, range_idx + 1 ) : NULL;
+                if ( r->end > cluster_end )
+                    cluster_end = r->end;
+                if ( rctx->rc == 0 && ( next == NULL || next->start > cluster_end + REGION_CLUSTER_GAP ) )
                 {
-                    INSDC_coord_len len;
-                    if ( r->start == 0 && r->end == 0 )
-                    {
-                        r->start = 1;
-                        rctx->rc = ReferenceObj_SeqLength( ref_obj, &len );
-                        if ( rctx->rc == 0 )
-                            r->end = ( r->start + len );
-                    }
-                    else
-                    {
-                        len = ( r->end - r->start + 1 );
-                    }
-                    if ( rctx->rc == 0 )
-                    {
-                        rctx->rc = add_pl_iters( rctx->opts, rctx->set_iter, ref_obj, rctx->idb,
-                            r->start,           /* where the range starts on the reference */
-                            len,                /* the length of this range */
-                            NULL,               /* no spotgroup re-grouping (yet) */
-                            rctx->context_list
-                            );
-                    }
+                    const range * first = VectorGet( &ref_rgn->ranges, cluster_first );
+                    region_cluster cluster;
+                    cluster.ranges = &ref_rgn->ranges;
+                    cluster.first = cluster_first;
+                    cluster.count = range_idx - cluster_first + 1;
+                    rctx->rc = add_pl_iters( rctx->opts, rctx->set_iter, ref_obj, rctx->idb,
+                        first->start,                       /* where the first range starts on the reference */
+                        cluster_end - first->start + 1,     /* up to the end of the last range */
+                        NULL,                               /* no spotgroup re-grouping (yet) */
+                        &cluster,                           /* print only what starts in one of the ranges */
+                        rctx->context_list,
+                        NULL                                /* print via KOutMsg() */
+                        );
+                    cluster_first = range_idx + 1;
+                    cluster_end = 0;
                 }
             }
             ReferenceObj_Release( ref_obj );
@@ -790,6 +859,25 @@ static void CC on_region( BSTNode *n, void *data )
 }
 
 
+/* does an alignment starting at pos start in one of the ranges of the cluster? */
+static bool pos_in_cluster( const region_cluster * cluster, INSDC_coord_zero pos )
+{
+    uint32_t lo = cluster->first, hi = cluster->first + cluster->count;
+    while ( lo < hi )
+    {
+        uint32_t mid = lo + ( hi - lo ) / 2;
+        const range * r = VectorGet( cluster->ranges, mid );
+        if ( ( uint64_t )pos < r->start )
+            hi = mid;
+        else if ( ( uint64_t )pos > r->end )
+            lo = mid + 1;
+        else
+            return true;
+    }
+    return false;
+}
+
+
 static rc_t prepare_regions( const samdump_opts * const opts,
                              const input_files * const ifs,
                              PlacementSetIterator * const set_iter,
@@ -831,6 +919,7 @@ static const char *equal_sign = "=";
 
 
 static rc_t print_qslice( const samdump_opts * const opts,
+                          struct dyn_string * out,
                           bool reverse,
                           const char * source,
                           uint32_t source_str_len,
@@ -848,39 +937,76 @@ static rc_t print_qslice( const samdump_opts * const opts,
         if ( len > 0 )
         {
             const char * ptr = &source[ *source_offset ];
-            rc = dump_quality_33( opts, ptr, len, reverse ); /* sam-dump-opts.c */
+            rc = dump_quality_33( opts, out, ptr, len, reverse ); /* sam-dump-opts.c */
             if ( rc == 0 )
             {
-                rc = KOutMsg( "\t" );
+                rc = out_2_dyn_string( out, "\t" );
                 if ( rc == 0 )
                     *source_offset += len;
             }
         }
         else
-            rc = KOutMsg( "*\t" );
+            rc = out_2_dyn_string( out, "*\t" );
+    }
+    return rc;
+}
+
+
+#define CIG_OPS_PER_PRINT 32
+
+/* prints binary cigar-operations, without building the whole text-cigar first */
+static rc_t print_cig_ops( struct dyn_string * out, const CigOps * ops, uint32_t n_ops )
+{
+    char buf[ CIG_OPS_PER_PRINT * MAX_CIG_OP_CHARS ];
+    rc_t rc = 0;
+    uint32_t i;
+    for ( i = 0; rc == 0 && i < n_ops; i += CIG_OPS_PER_PRINT )
+    {
+        uint32_t n = ( n_ops - i ) < CIG_OPS_PER_PRINT ? ( n_ops - i ) : CIG_OPS_PER_PRINT;
+        uint32_t len = ImplodeCIGAR( buf, &ops[ i ], n );
+        if ( out != NULL )
+            rc = add_buf_2_dyn_string( out, buf, len );
+        else
+            rc = KOutMsg( "%.*s", len, buf );
     }
     return rc;
 }
 
 
-static rc_t modify_and_print_cigar( const char * cigar,
-                                    size_t cigar_len,
+static rc_t modify_and_print_cigar( struct dyn_string * out,
+                                    const cg_cigar_output * cgc_output,
                                     CigOps *ref_cig,
                                     int32_t ref_cig_len,
                                     INSDC_coord_zero ref_pos,
                                     uint32_t read_len )
 {
     rc_t rc;
-    if ( cigar_len > 0 )
+    if ( cgc_output->p_cigar.len > 0 )
     {
-        char cigbuf[ MAX_CG_CIGAR_LEN ];
-        CigOps al_cig[ 1024 ];
-        ExplodeCIGAR( al_cig, 1024, cigar, cigar_len );
-        CombineCIGAR( cigbuf, al_cig, read_len, ref_pos, ref_cig, ref_cig_len );
-        rc = KOutMsg( "%s\t", cigbuf );
+        CigOps al_cig_buf[ 1024 ];
+        CigOps cmb_cig[ 1024 ];
+        const CigOps * al_cig = cgc_output->cig_ops;
+        uint32_t n_cmb;
+
+        /* the cg-treatments leave the binary cigar behind, only an untreated one has to be parsed */
+        if ( cgc_output->n_cig_ops == 0 )
+        {
+            ExplodeCIGAR( al_cig_buf, 1024, cgc_output->p_cigar.ptr, cgc_output->p_cigar.len );
+            al_cig = al_cig_buf;
+        }
+        n_cmb = CombineCIGAR( cmb_cig, 1024, al_cig, read_len, ref_pos, ref_cig, ref_cig_len );
+        if ( n_cmb > 1024 )
+        {
+            rc = RC( rcExe, rcNoTarg, rcProcessing, rcData, rcExcessive );
+            (void)LOGERR( klogErr, rc, "combined cigar of evidence alignment is too long" );
+        }
+        else
+            rc = print_cig_ops( out, cmb_cig, n_cmb );
+        if ( rc == 0 )
+            rc = out_2_dyn_string( out, "\t" );
     }
     else
-        rc = KOutMsg( "*\t" );
+        rc = out_2_dyn_string( out, "*\t" );
     return rc;
 }
 
@@ -923,6 +1049,7 @@ static rc_t cg_cigar_treatments( enum cigar_treatment what_treatment,
                                  const align_cmn_context * acc )
 {
     rc_t rc = 0;
+    cgc_output->n_cig_ops = 0;
     switch ( what_treatment )
     {
         case ct_unchanged : cgc_output->p_cigar.len  = cgc_input->p_cigar.len;
@@ -992,14 +1119,14 @@ static rc_t print_evidence_alignment_cg_sam( const samdump_opts * const opts,
         {
             if ( spot_group_len > 0 )
                 /* SAM-FIELD: QNAME     constructed from spot-group/seq-name */
-                rc = KOutMsg( "%.*s-1:%.*s\t", spot_group_len, spot_group, seq_name_len, seq_name );
+                rc = out_2_dyn_string( atx->out, "%.*s-1:%.*s\t", spot_group_len, spot_group, seq_name_len, seq_name );
 
         }
         else
         {
             if ( seq_name_len > 0 )
                 /* SAM-FIELD: QNAME     constructed from allel-id/sub-id */
-                rc = KOutMsg( "%.*s/ALLELE_%li.%u\t", seq_name_len, seq_name, rec->id, ploidy_idx );
+                rc = out_2_dyn_string( atx->out, "%.*s/ALLELE_%li.%u\t", seq_name_len, seq_name, rec->id, ploidy_idx );
         }
     }
 
@@ -1027,7 +1154,7 @@ static rc_t print_evidence_alignment_cg_sam( const samdump_opts * const opts,
     /* SAM-FIELD: POS       SRA-column: REF_POS + 1 */
     /* SAM-FIELD: MAPQ      SRA-column: MAPQ ( from evidence-alignment-table, not from allel! ) */
     if ( rc == 0 )
-        rc = KOutMsg( "%u\t%s\t%i\t%d\t", sam_flags, ref_name, allele_pos + ref_pos + 1, mapq );
+        rc = out_2_dyn_string( atx->out, "%u\t%s\t%i\t%d\t", sam_flags, ref_name, allele_pos + ref_pos + 1, mapq );
 
     /* get READ, QUALITY and EIDT_DIST before cigar manipulation because we need/change these values */
     if ( rc == 0 )
@@ -1041,8 +1168,8 @@ static rc_t print_evidence_alignment_cg_sam( const samdump_opts * const opts,
         if ( rc == 0 )
             rc = cg_cigar_treatments( opts->cigar_treatment, &cgc_input, &cgc_output, align_id, &atx->eval );
         if ( rc == 0 )
-            rc = modify_and_print_cigar( cgc_output.p_cigar.ptr, cgc_output.p_cigar.len,
-                                         atx->cig_op_buffer, ref_cig_len, ref_pos, cgc_output.p_read.len );
+            rc = modify_and_print_cigar( atx->out, &cgc_output, atx->cig_op_buffer, ref_cig_len,
+                                         ref_pos, cgc_output.p_read.len );
     }
 
     /* SAM-FIELD: RNEXT     SRA-column: MATE_REF_NAME '*' no mates! */
@@ -1050,23 +1177,23 @@ static rc_t print_evidence_alignment_cg_sam( const samdump_opts * const opts,
     /* SAM-FIELD: TLEN      SRA-column: TEMPLATE_LEN '0' not in table */
     /* SAM-FIELD: SEQ       SRA-column: READ  */
     if ( rc == 0 )
-        rc = KOutMsg( "*\t0\t0\t%.*s\t", cgc_output.p_read.len, cgc_output.p_read.ptr );
+        rc = out_2_dyn_string( atx->out, "*\t0\t0\t%.*s\t", cgc_output.p_read.len, cgc_output.p_read.ptr );
 
     /* SAM-FIELD: QUAL      SRA-column: SAM_QUALITY */
     if ( rc == 0 && cgc_output.p_quality.len > 0 )
-        rc = dump_quality_33( opts, cgc_output.p_quality.ptr, cgc_output.p_quality.len, false ); /* sam-dump-opts.c */
+        rc = dump_quality_33( opts, atx->out, cgc_output.p_quality.ptr, cgc_output.p_quality.len, false ); /* sam-dump-opts.c */
 
     /* OPT SAM-FIELD: RG     SRA-column: SEQ_SPOT_GROUP */
     if ( rc == 0 && spot_group_len > 0 )
-        rc = KOutMsg( "\tRG:Z:%.*s", spot_group_len, spot_group );
+        rc = out_2_dyn_string( atx->out, "\tRG:Z:%.*s", spot_group_len, spot_group );
 
     if ( rc == 0 && cgc_output.p_tags.len > 0 )
-        rc = KOutMsg( "\t%.*s", cgc_output.p_tags.len, cgc_output.p_tags.ptr );
+        rc = out_2_dyn_string( atx->out, "\t%.*s", cgc_output.p_tags.len, cgc_output.p_tags.ptr );
 
     /* OPT SAM-FIELD: ZI     SRA-column: rec->id */
     /* OPT SAM-FIELD: ZA     SRA-column: ploidy_idx */
     if ( rc == 0 )
-        rc = KOutMsg( "\tZI:i:%li\tZA:i:%u", rec->id, ploidy_idx );
+        rc = out_2_dyn_string( atx->out, "\tZI:i:%li\tZA:i:%u", rec->id, ploidy_idx );
 
     /* OPT SAM-FIELD: NH     SRA-column: ALIGNMENT_COUNT */
     if ( rc == 0 && atx->eval.al_count_idx != COL_NOT_AVAILABLE )
@@ -1075,19 +1202,19 @@ static rc_t print_evidence_alignment_cg_sam( const samdump_opts * const opts,
         uint32_t al_count_len;
         rc = read_uint8_ptr( align_id, cursor, atx->eval.al_count_idx, &al_count, &al_count_len, "ALIGNMENT_COUNT" );
         if ( rc == 0 && al_count_len > 0 )
-            rc = KOutMsg( "\tNH:i:%u", *al_count );
+            rc = out_2_dyn_string( atx->out, "\tNH:i:%u", *al_count );
     }
 
     /* OPT SAM-FIELD: NM     SRA-column: EDIT_DISTANCE */
     if ( rc == 0 )
-        rc = KOutMsg( "\tNM:i:%u", cgc_output.edit_dist );
+        rc = out_2_dyn_string( atx->out, "\tNM:i:%u", cgc_output.edit_dist );
 
     /* OPT SAM-FIELD: XI     SRA-column: ALIGN_ID */
     if ( rc == 0 && opts->print_alignment_id_in_column_xi )
-        rc = KOutMsg( "\tXI:i:%u", align_id );
+        rc = out_2_dyn_string( atx->out, "\tXI:i:%u", align_id );
 
     if ( rc == 0 )
-        rc = KOutMsg( "\n" );
+        rc = out_2_dyn_string( atx->out, "\n" );
 
     return rc;
 }
@@ -1117,14 +1244,14 @@ static rc_t print_evidence_alignment_cg_ev_dnb( const samdump_opts * const opts,
         {
             if ( spot_group_len > 0 )
                 /* SAM-FIELD: QNAME     constructed from spot-group/seq-name */
-                rc = KOutMsg( "%.*s-1:%.*s\t", spot_group_len, spot_group, seq_name_len, seq_name );
+                rc = out_2_dyn_string( atx->out, "%.*s-1:%.*s\t", spot_group_len, spot_group, seq_name_len, seq_name );
 
         }
         else
         {
             if ( seq_name_len > 0 )
                 /* SAM-FIELD: QNAME     constructed from allel-id/sub-id */
-                rc = KOutMsg( "%.*s/ALLELE_%li.%u\t", seq_name_len, seq_name, rec->id, ploidy_idx );
+                rc = out_2_dyn_string( atx->out, "%.*s/ALLELE_%li.%u\t", seq_name_len, seq_name, rec->id, ploidy_idx );
         }
     }
 
@@ -1152,7 +1279,7 @@ static rc_t print_evidence_alignment_cg_ev_dnb( const samdump_opts * const opts,
     /* SAM-FIELD: POS       SRA-column: REF_POS + 1 */
     /* SAM-FIELD: MAPQ      SRA-column: MAPQ ( from evidence-alignment-table, not from allel! ) */
     if ( rc == 0 )
-        rc = KOutMsg( "%u\tALLELE_%li.%u\t%i\t%d\t", sam_flags, rec->id, ploidy_idx, ref_pos + 1, mapq );
+        rc = out_2_dyn_string( atx->out, "%u\tALLELE_%li.%u\t%i\t%d\t", sam_flags, rec->id, ploidy_idx, ref_pos + 1, mapq );
 
     /* get READ, QUALITY and EIDT_DIST before cigar manipulation because we need/change these values */
     if ( rc == 0 )
@@ -1166,8 +1293,14 @@ static rc_t print_evidence_alignment_cg_ev_dnb( const samdump_opts * const opts,
         if ( rc == 0 )
         rc = cg_cigar_treatments( opts->cigar_treatment, &cgc_input, &cgc_output, align_id, &atx->eval );
         if ( rc == 0 )
-            rc = cg_canonical_print_cigar( cgc_output.p_cigar.ptr, cgc_output.p_cigar.len);
-	    if(rc == 0) rc = KOutMsg( "\t");
+        {
+            /* the binary cigar of the cg-treatments is already canonical */
+            if ( cgc_output.n_cig_ops > 0 )
+                rc = print_cig_ops( atx->out, cgc_output.cig_ops, cgc_output.n_cig_ops );
+            else
+                rc = cg_canonical_print_cigar( atx->out, cgc_output.p_cigar.ptr, cgc_output.p_cigar.len );
+        }
+	    if(rc == 0) rc = out_2_dyn_string( atx->out, "\t");
     }
 
     /* SAM-FIELD: RNEXT     SRA-column: MATE_REF_NAME '*' no mates! */
@@ -1175,18 +1308,18 @@ static rc_t print_evidence_alignment_cg_ev_dnb( const samdump_opts * const opts,
     /* SAM-FIELD: TLEN      SRA-column: TEMPLATE_LEN '0' not in table */
     /* SAM-FIELD: SEQ       SRA-column: READ  */
     if ( rc == 0 )
-        rc = KOutMsg( "*\t0\t0\t%.*s\t", cgc_output.p_read.len, cgc_output.p_read.ptr );
+        rc = out_2_dyn_string( atx->out, "*\t0\t0\t%.*s\t", cgc_output.p_read.len, cgc_output.p_read.ptr );
 
     /* SAM-FIELD: QUAL      SRA-column: SAM_QUALITY */
     if ( rc == 0 && cgc_output.p_quality.len > 0 )
-        rc = dump_quality_33( opts, cgc_output.p_quality.ptr, cgc_output.p_quality.len, false ); /* sam-dump-opts.c */
+        rc = dump_quality_33( opts, atx->out, cgc_output.p_quality.ptr, cgc_output.p_quality.len, false ); /* sam-dump-opts.c */
 
     /* OPT SAM-FIELD: RG     SRA-column: SEQ_SPOT_GROUP */
     if ( rc == 0 && spot_group_len > 0 )
-        rc = KOutMsg( "\tRG:Z:%.*s", spot_group_len, spot_group );
+        rc = out_2_dyn_string( atx->out, "\tRG:Z:%.*s", spot_group_len, spot_group );
 
     if ( rc == 0 && cgc_output.p_tags.len > 0 )
-        rc = KOutMsg( "\t%.*s", cgc_output.p_tags.len, cgc_output.p_tags.ptr );
+        rc = out_2_dyn_string( atx->out, "\t%.*s", cgc_output.p_tags.len, cgc_output.p_tags.ptr );
 
     /* OPT SAM-FIELD: NH     SRA-column: ALIGNMENT_COUNT */
     if ( rc == 0 && atx->eval.al_count_idx != COL_NOT_AVAILABLE )
@@ -1195,19 +1328,19 @@ static rc_t print_evidence_alignment_cg_ev_dnb( const samdump_opts * const opts,
         uint32_t al_count_len;
         rc = read_uint8_ptr( align_id, cursor, atx->eval.al_count_idx, &al_count, &al_count_len, "ALIGNMENT_COUNT" );
         if ( rc == 0 && al_count_len > 0 )
-            rc = KOutMsg( "\tNH:i:%u", *al_count );
+            rc = out_2_dyn_string( atx->out, "\tNH:i:%u", *al_count );
     }
 
     /* OPT SAM-FIELD: NM     SRA-column: EDIT_DISTANCE */
     if ( rc == 0 )
-        rc = KOutMsg( "\tNM:i:%u", cgc_output.edit_dist );
+        rc = out_2_dyn_string( atx->out, "\tNM:i:%u", cgc_output.edit_dist );
 
     /* OPT SAM-FIELD: XI     SRA-column: ALIGN_ID */
     if ( rc == 0 && opts->print_alignment_id_in_column_xi )
-        rc = KOutMsg( "\tXI:i:%u", align_id );
+        rc = out_2_dyn_string( atx->out, "\tXI:i:%u", align_id );
 
     if ( rc == 0 )
-        rc = KOutMsg( "\n" );
+        rc = out_2_dyn_string( atx->out, "\n" );
 
     return rc;
 }
@@ -1273,43 +1406,43 @@ static rc_t print_alignment_sam_ev( const samdump_opts * const opts,
                 if ( rc == 0 )
                 {
                     if ( opts->print_cg_names )
-                        rc = KOutMsg( "-1:0\t" );
+                        rc = out_2_dyn_string( atx->out, "-1:0\t" );
                     else
-                        rc = KOutMsg( "ALLELE_%li.%u\t", rec->id, ploidy_idx + 1 );
+                        rc = out_2_dyn_string( atx->out, "ALLELE_%li.%u\t", rec->id, ploidy_idx + 1 );
                 }
 
                 if ( rc == 0 )
-                    rc = KOutMsg( "0\t%s\t%u\t%d\t", ref_name, pos + 1, rec->mapq );
+                    rc = out_2_dyn_string( atx->out, "0\t%s\t%u\t%d\t", ref_name, pos + 1, rec->mapq );
 
                 /* SAM-FIELD: CIGAR     SRA-column: CIGAR_SHORT / CIGAR_LONG sliced!!! */
                 if ( rc == 0 )
-                    rc = KOutMsg( "%.*s\t", cigar_slice_len, transformed_cigar );
+                    rc = out_2_dyn_string( atx->out, "%.*s\t", cigar_slice_len, transformed_cigar );
 
                 /* SAM-FIELD: RNEXT     SRA-column: MATE_REF_NAME ( !!! row_len can be zero !!! ) */
                 /* SAM-FIELD: PNEXT     SRA-column: MATE_REF_POS + 1 ( !!! row_len can be zero !!! ) */
                 /* SAM-FIELD: TLEN      SRA-column: TEMPLATE_LEN ( !!! row_len can be zero !!! ) */
                 /* SAM-FIELD: SEQ       SRA-column: READ sliced!!! */
                 if ( rc == 0 )
-                    rc = KOutMsg( "*\t0\t0\t%.*s\t", read_slice_len, read );
+                    rc = out_2_dyn_string( atx->out, "*\t0\t0\t%.*s\t", read_slice_len, read );
 
                 /* SAM-FIELD: QUAL      SRA-column: SAM_QUALITY sliced!!! */
                 if ( rc == 0 )
-                    rc = print_qslice( opts, false, quality, quality_str_len, &quality_offset, read_len_vector, read_len_vector_len, ploidy_idx );
+                    rc = print_qslice( opts, atx->out, false, quality, quality_str_len, &quality_offset, read_len_vector, read_len_vector_len, ploidy_idx );
 
                 /* OPT SAM-FIELD: RG     SRA-column: ploidy_idx */
                 if ( rc == 0 )
-                    rc = KOutMsg( "RG:Z:ALLELE_%u", ploidy_idx + 1 );
+                    rc = out_2_dyn_string( atx->out, "RG:Z:ALLELE_%u", ploidy_idx + 1 );
 
                 /* OPT SAM-FIELD: XI     SRA-column: ALIGN_ID */
                 if ( rc == 0 && opts->print_alignment_id_in_column_xi )
-                    rc = KOutMsg( "\tXI:i:%u", rec->id );
+                    rc = out_2_dyn_string( atx->out, "\tXI:i:%u", rec->id );
 
                 /* OPT SAM-FIELD: NM     SRA-column: EDIT_DISTANCE sliced!!! */
                 if ( rc == 0 && ( ploidy_idx < edit_dist_vector_len ) )
-                    rc = KOutMsg( "\tNM:i:%u", edit_dist_vector[ ploidy_idx ] );
+                    rc = out_2_dyn_string( atx->out, "\tNM:i:%u", edit_dist_vector[ ploidy_idx ] );
 
                 if ( rc == 0 )
-                    rc = KOutMsg( "\n" );
+                    rc = out_2_dyn_string( atx->out, "\n" );
             }
 
             /* we do that here per ALLEL-READ, not at the end per ALLEL, because we have to test which alignments
@@ -1358,35 +1491,97 @@ static rc_t print_alignment_sam_ev( const samdump_opts * const opts,
 }
 
 
-static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
-                                    const char * ref_name,
-                                    INSDC_coord_zero pos,
-                                    matecache * const mc,
-                                    struct rna_splice_dict * splice_dict,
-                                    const PlacementRecord * const rec,
-                                    const align_table_context * const atx )
+/* the field-writers for a sam-record in an out_buf: they reserve the space they need */
+
+static rc_t out_sam_char( out_buf * out, char c )
+{
+    rc_t rc = reserve_out_buf( out, 1 );
+    if ( rc == 0 )
+        out_buf_char( out, c );
+    return rc;
+}
+
+
+/* appends "str" and the terminator-char ( usually the tab ) */
+static rc_t out_sam_str( out_buf * out, const char * str, size_t len, char term )
+{
+    rc_t rc = reserve_out_buf( out, len + 1 );
+    if ( rc == 0 )
+    {
+        out_buf_mem( out, str, len );
+        out_buf_char( out, term );
+    }
+    return rc;
+}
+
+
+/* appends an optional string-field: "\tXX:Z:str", tag has to be 6 chars long */
+static rc_t out_sam_str_tag( out_buf * out, const char * tag, const char * str, size_t len )
+{
+    rc_t rc = reserve_out_buf( out, len + 6 );
+    if ( rc == 0 )
+    {
+        out_buf_mem( out, tag, 6 );
+        out_buf_mem( out, str, len );
+    }
+    return rc;
+}
+
+
+/* appends an optional integer-field: "\tXX:i:value", tag has to be 6 chars long */
+static rc_t out_sam_u32_tag( out_buf * out, const char * tag, uint32_t value )
+{
+    rc_t rc = reserve_out_buf( out, SAM_NUM_CHARS );
+    if ( rc == 0 )
+    {
+        out_buf_mem( out, tag, 6 );
+        out_buf_u32( out, value );
+    }
+    return rc;
+}
+
+
+/* what the SAM- and the BAM-record need to know about the mate */
+typedef struct ps_mate
 {
-    uint32_t sam_flags = 0, NM_adjustments = 0, seq_spot_id_len, mate_ref_pos_len = 0, mate_ref_name_len = string_size( ref_name );
-    INSDC_coord_zero mate_ref_pos = 0;
-    INSDC_coord_len tlen = 0;
-    int64_t mate_align_id = 0, id = rec->id;
     const int64_t * seq_spot_id;
-    const char * mate_ref_name = ref_name;
+    uint32_t seq_spot_id_len;
+    uint32_t sam_flags;
+    const char * ref_name;          /* "=" if the mate is on the same reference, length 0: no mate */
+    uint32_t ref_name_len;
+    INSDC_coord_zero ref_pos;
+    uint32_t ref_pos_len;
+    INSDC_coord_len tlen;
+} ps_mate;
+
+
+/* looks up the mate in the cache or reads it from the table, inserts this alignment into the cache
+   for its mate, the sam-flags are massaged if we are not dumping unaligned reads */
+static rc_t read_ps_mate( const samdump_opts * const opts,
+                          const char * ref_name,
+                          uint32_t ref_name_len,
+                          INSDC_coord_zero pos,
+                          matecache * const mc,
+                          int64_t id,
+                          align_table_context * const atx,
+                          ps_mate * const m )
+{
+    int64_t mate_align_id = 0;
     const VCursor * cursor = atx->cmn.cursor;
-    cg_cigar_output cgc_output;
-    rna_splice_candidates candidates; /* in cg_tools.h */
-    bool rna_not_homogeneous_flag = false;
 
     /* SAM-FIELD: NONE      SRA-column: MATE_ALIGN_ID ( int64 ) ... for cache lookup's */
     rc_t rc = read_int64( id, cursor, atx->mate_align_id_idx, &mate_align_id, 0, "MATE_ALIGN_ID" );
 
-    candidates.count = 0;
-    candidates.fwd_matched = 0;
-    candidates.rev_matched = 0;
+    m->sam_flags = 0;
+    m->ref_name = ref_name;
+    m->ref_name_len = ref_name_len;
+    m->ref_pos = 0;
+    m->ref_pos_len = 0;
+    m->tlen = 0;
 
     /* pre-read seq-spot-id, needed for unaligned cache and SAM-field QNAME */
     if ( rc == 0 )
-        rc = read_int64_ptr( id, cursor, atx->cmn.seq_spot_id_idx, &seq_spot_id, &seq_spot_id_len, "SEQ_SPOT_ID" );
+        rc = read_int64_ptr( id, cursor, atx->cmn.seq_spot_id_idx, &m->seq_spot_id, &m->seq_spot_id_len, "SEQ_SPOT_ID" );
 
     /* try to find the info about the mate in the CACHE... */
     if ( rc == 0 )
@@ -1395,7 +1590,7 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
         {
             if ( opts->use_mate_cache && mc != NULL )
             {
-                rc = matecache_lookup_same_ref( mc, atx->db_idx, mate_align_id, &mate_ref_pos, &sam_flags, &tlen );
+                rc = matecache_lookup_same_ref( mc, atx->db_idx, mate_align_id, &m->ref_pos, &m->sam_flags, &m->tlen );
                 if ( rc == 0 )
                 {
                     /* we found it in the the sam-ref-matecache */
@@ -1404,9 +1599,9 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
 
                     /* cache entry-found! (on the same reference) -> that means we have now mate_ref_pos, flags and tlen */
                     matecache_remove_same_ref( mc, atx->db_idx, mate_align_id );
-                    mate_ref_name = equal_sign;
-                    mate_ref_name_len = 1;
-                    mate_ref_pos_len = 1;
+                    m->ref_name = equal_sign;
+                    m->ref_name_len = 1;
+                    m->ref_pos_len = 1;
 
                     /* read the read-filter column and adjust the sam-flags value to reflect the presense
                        of the flag SRA_READ_FILTER_REJECT, if it is there switch 0x200 on, of not switch 0x200 off */
@@ -1414,14 +1609,14 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
                     if ( rc == 0 && read_filter_len > 0 )
                     {
                         if ( ( read_filter[ 0 ] & READ_FILTER_REJECT ) == READ_FILTER_REJECT )
-                            sam_flags |= 0x200;
+                            m->sam_flags |= 0x200;
                         else
-                            sam_flags &= ~0x200;
+                            m->sam_flags &= ~0x200;
 
                         if ( ( read_filter[ 0 ] & READ_FILTER_CRITERIA ) == READ_FILTER_CRITERIA )
-                            sam_flags |= 0x400;
+                            m->sam_flags |= 0x400;
                         else
-                            sam_flags &= ~0x400;
+                            m->sam_flags &= ~0x400;
                     }
                 }
                 else
@@ -1441,140 +1636,135 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
             /* no cache entry-found OR do not use mate-cache
                ---> that means we have to read it from the table... */
 
-            rc = read_char_ptr( id, cursor, atx->mate_ref_name_idx, &mate_ref_name, &mate_ref_name_len, "MATE_REF_NAME" );
+            rc = read_char_ptr( id, cursor, atx->mate_ref_name_idx, &m->ref_name, &m->ref_name_len, "MATE_REF_NAME" );
             if ( rc == 0 )
-                rc = read_INSDC_coord_zero( id, cursor, atx->mate_ref_pos_idx, &mate_ref_pos, 0, "MATE_REF_POS" );
+                rc = read_INSDC_coord_zero( id, cursor, atx->mate_ref_pos_idx, &m->ref_pos, 0, "MATE_REF_POS" );
             if ( rc == 0 )
-                rc = read_INSDC_coord_len( id, cursor, atx->tlen_idx, &tlen, 0, "TLEN" );
+                rc = read_INSDC_coord_len( id, cursor, atx->tlen_idx, &m->tlen, 0, "TLEN" );
             if ( rc == 0 )
-                rc = read_uint32( id, cursor, atx->sam_flags_idx, &sam_flags, 0, "SAM_FLAGS" );
+                rc = read_uint32( id, cursor, atx->sam_flags_idx, &m->sam_flags, 0, "SAM_FLAGS" );
 
             if ( rc == 0 )
             {
                 int32_t cmp = -1;
-                if ( mate_ref_name_len > 0 )
+                if ( m->ref_name_len > 0 )
                 {
-                    size_t ref_name_len = string_size( ref_name );
-                    size_t cmp_len = ( mate_ref_name_len > ref_name_len ? mate_ref_name_len : ref_name_len );
-                    cmp = string_cmp( mate_ref_name, mate_ref_name_len, ref_name, ref_name_len, cmp_len );
+                    size_t cmp_len = ( m->ref_name_len > ref_name_len ? m->ref_name_len : ref_name_len );
+                    cmp = string_cmp( m->ref_name, m->ref_name_len, ref_name, ref_name_len, cmp_len );
                     if ( cmp == 0 )
                     {
-                        mate_ref_name = equal_sign;
-                        mate_ref_name_len = 1;
+                        m->ref_name = equal_sign;
+                        m->ref_name_len = 1;
                     }
                 }
 
                 if ( opts->use_mate_cache )
                 {
-                    if ( mate_align_id != 0 && mate_ref_name_len > 0 && cmp == 0 )
+                    if ( mate_align_id != 0 && m->ref_name_len > 0 && cmp == 0 )
                     {
                         /* now that we have the data, store it in sam-ref-cache it the mate is on the same ref. */
-                        uint32_t mate_flags = calc_mate_flags( sam_flags );
-                        rc = matecache_insert_same_ref( mc, atx->db_idx, id, pos, mate_flags, -tlen );
+                        uint32_t mate_flags = calc_mate_flags( m->sam_flags );
+                        rc = matecache_insert_same_ref( mc, atx->db_idx, id, pos, mate_flags, -m->tlen );
                     }
 
-                    if ( mate_align_id == 0 && mate_ref_name_len == 0 && opts->print_half_unaligned_reads &&
+                    if ( mate_align_id == 0 && m->ref_name_len == 0 && opts->print_half_unaligned_reads &&
                          atx->align_table_type == att_primary )
                     {
                         int64_t key = id;
-                        rc = matecache_insert_unaligned( mc, atx->db_idx, key, pos, atx->ref_idx, *seq_spot_id );
+                        rc = matecache_insert_unaligned( mc, atx->db_idx, key, pos, atx->ref_idx, *m->seq_spot_id );
                     }
                 }
             }
         }
     }
 
-    if ( rc == 0 && opts->use_matepair_filter && !filter_by_matepair_dist( opts, tlen ) )
-        return 0;
-
-    /* SAM-FIELD: QNAME     SRA-column: SEQ_SPOT_ID ( int64 ) */
-    if ( rc == 0 )
-    {
-        if ( seq_spot_id_len > 0 )
-        {
-            if ( opts->print_spot_group_in_name | opts->print_cg_names )
-            {
-                const char * spot_group;
-                uint32_t spot_group_len;
-                rc = read_char_ptr( id, cursor, atx->cmn.seq_spot_group_idx, &spot_group, &spot_group_len, "SPOT_GROUP" );
-                if ( rc == 0 )
-                    rc = dump_name( opts, *seq_spot_id, spot_group, spot_group_len ); /* sam-dump-opts.c */
-            }
-            else
-                rc = dump_name( opts, *seq_spot_id, NULL, 0 ); /* sam-dump-opts.c */
-        }
-        else
-            rc = KOutMsg( "*" );
-    }
-
-    if ( rc == 0 )
-        rc = KOutMsg( "\t" );
-
     /* massage the sam-flag if we are not dumping unaligned reads... */
-    if ( !opts->dump_unaligned_reads    /** not going to dump unaligned **/
-         && ( sam_flags & 0x1 )         /** but we have sequenced multiple fragments **/
-         && ( sam_flags & 0x8 ) )       /** and not all of them align **/
+    if ( !opts->dump_unaligned_reads      /** not going to dump unaligned **/
+         && ( m->sam_flags & 0x1 )        /** but we have sequenced multiple fragments **/
+         && ( m->sam_flags & 0x8 ) )      /** and not all of them align **/
         /*** remove flags talking about multiple reads **/
         /* turn off 0x001 0x008 0x040 0x080 */
-        sam_flags &= ~0xC9;
+        m->sam_flags &= ~0xC9;
 
-    /* SAM-FIELD: FLAG      SRA-column: SAM_FLAGS ( uint32 ) */
-    /* SAM-FIELD: RNAME     SRA-column: REF_NAME / REF_SEQ_ID ( char * ) */
-    /* SAM-FIELD: POS       SRA-column: REF_POS + 1 */
-    /* SAM-FIELD: MAPQ      SRA-column: MAPQ */
-    if ( rc == 0 )
-        rc = KOutMsg( "%u\t%s\t%u\t%d\t", sam_flags, ref_name, pos + 1, rec->mapq );
+    return rc;
+}
+
+
+/* the cigar and READ/QUALITY/EDIT_DIST after cg- and rna-splicing-treatment */
+typedef struct ps_cigar
+{
+    cg_cigar_output cgc_output;
+    rna_splice_candidates candidates; /* in cg_tools.h */
+    char * temp_cigar;
+    uint32_t NM_adjustments;
+    bool rna_not_homogeneous_flag;
+} ps_cigar;
+
+
+static rc_t treat_ps_cigar( const samdump_opts * const opts,
+                            INSDC_coord_zero pos,
+                            struct rna_splice_dict * splice_dict,
+                            const PlacementRecord * const rec,
+                            align_table_context * const atx,
+                            ps_cigar * const c )
+{
+    int64_t id = rec->id;
+    cg_cigar_output * cgc_output = &c->cgc_output;
+    cg_cigar_input cgc_input;
+    static char const *bogus_quality = "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!";
 
     /* get READ, QUALITY and EIDT_DIST before cigar manipulation because we need/change these values */
-    if ( rc == 0 )
-        rc = get_READ_QUALITY_EDIT_DIST( &cgc_output, id, &atx->cmn );
+    rc_t rc = get_READ_QUALITY_EDIT_DIST( cgc_output, id, &atx->cmn );
+
+    c->candidates.count = 0;
+    c->candidates.fwd_matched = 0;
+    c->candidates.rev_matched = 0;
+    c->temp_cigar = NULL;
+    c->NM_adjustments = 0;
+    c->rna_not_homogeneous_flag = false;
 
-    /* SAM-FIELD: CIGAR     SRA-column: CIGAR_SHORT / with or without treatment */
     if ( rc == 0 )
     {
-        cg_cigar_input cgc_input;
-        char * temp_cigar = NULL;
-        static char const *bogus_quality = "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!";
-
-        rc = read_char_ptr( id, cursor, atx->cmn.cigar_idx, &cgc_input.p_cigar.ptr, &cgc_input.p_cigar.len, "CIGAR" );
+        rc = read_char_ptr( id, atx->cmn.cursor, atx->cmn.cigar_idx, &cgc_input.p_cigar.ptr, &cgc_input.p_cigar.len, "CIGAR" );
         if ( rc == 0 )
         {
-            if ( cgc_output.p_quality.len == 0 )
+            if ( cgc_output->p_quality.len == 0 )
             {
-                cgc_output.p_quality.ptr = bogus_quality;
-                cgc_output.p_quality.len = 35;
+                cgc_output->p_quality.ptr = bogus_quality;
+                cgc_output->p_quality.len = 35;
             }
-            rc = cg_cigar_treatments( opts->cigar_treatment, &cgc_input, &cgc_output, id, &atx->cmn );
+            rc = cg_cigar_treatments( opts->cigar_treatment, &cgc_input, cgc_output, id, &atx->cmn );
         }
 
         if ( opts->rna_splicing )
         {
 	    { /*** reset previous identification of N to D ***/
 		int i;
-		char *c=(char*)cgc_output.p_cigar.ptr;
-		for(i=0;i< cgc_output.p_cigar.len;i++){
-		    if(c[i]=='N') c[i]='D';
+		char *s=(char*)cgc_output->p_cigar.ptr;
+		cgc_output->n_cig_ops = 0; /* the text is changed, the binary cigar is stale */
+		for(i=0;i< cgc_output->p_cigar.len;i++){
+		    if(s[i]=='N') s[i]='D';
 		}
 	    }
             /* discover which cigar-operations could be a RNA-splice ( it is a D-operation with min length of 10 ) */
-            rc = discover_rna_splicing_candidates( cgc_output.p_cigar.len, cgc_output.p_cigar.ptr, 10, &candidates ); /* cg_tools.c */
-            if ( rc == 0 && candidates.count > 0 )
+            rc = discover_rna_splicing_candidates( cgc_output->p_cigar.len, cgc_output->p_cigar.ptr, 10, &c->candidates ); /* cg_tools.c */
+            if ( rc == 0 && c->candidates.count > 0 )
             {
                 /* we discover by comparing against the reference if a candidate is a RNA-splice and if it is forward or reverse */
-                rc = check_rna_splicing_candidates_against_ref( rec->ref, opts->rna_splice_level, pos, &candidates ); /* cg_tools.c */
-                if ( rc == 0 && ( candidates.fwd_matched > 0 || candidates.rev_matched > 0 ) )
+                rc = check_rna_splicing_candidates_against_ref( rec->ref, opts->rna_splice_level, pos, &c->candidates ); /* cg_tools.c */
+                if ( rc == 0 && ( c->candidates.fwd_matched > 0 || c->candidates.rev_matched > 0 ) )
                 {
                     /* set the warning-flag that we have an alignment with not homogeneous RNA-splices */
-                    if ( candidates.fwd_matched > 0 && candidates.rev_matched > 0 )
-                        rna_not_homogeneous_flag = true;
+                    if ( c->candidates.fwd_matched > 0 && c->candidates.rev_matched > 0 )
+                        c->rna_not_homogeneous_flag = true;
 
-                    temp_cigar = malloc( cgc_output.p_cigar.len + 1 ); /* temp_cigar will be released at the end of this block */
-                    if ( temp_cigar != NULL )
+                    c->temp_cigar = malloc( cgc_output->p_cigar.len + 1 ); /* temp_cigar will be released by release_ps_cigar() */
+                    if ( c->temp_cigar != NULL )
                     {
                         /* create a new cigarstring by applying the candidates to the cigar-string */
-                        rc = change_rna_splicing_cigar( cgc_output.p_cigar.len, temp_cigar, &candidates, &NM_adjustments ); /* cg_tools.c */
+                        rc = change_rna_splicing_cigar( cgc_output->p_cigar.len, c->temp_cigar, &c->candidates, &c->NM_adjustments ); /* cg_tools.c */
                         if ( rc == 0 )
-                            cgc_output.p_cigar.ptr = temp_cigar;
+                            cgc_output->p_cigar.ptr = c->temp_cigar;
                     }
                 }
 
@@ -1583,9 +1773,9 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
                 {
                     /* record all the candidates... */
                     uint32_t c_idx;
-                    for ( c_idx = 0; c_idx < candidates.count; c_idx++ )
+                    for ( c_idx = 0; c_idx < c->candidates.count; c_idx++ )
                     {
-                        rna_splice_candidate * candidate = &( candidates.candidates[ c_idx ] );
+                        rna_splice_candidate * candidate = &( c->candidates.candidates[ c_idx ] );
                         splice_dict_entry entry;
                         uint32_t intron_pos = pos + candidate->ref_offset;
                         if ( rna_splice_dict_get( splice_dict, intron_pos, candidate->len, &entry ) )
@@ -1603,45 +1793,179 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
                 }
 
             }
-            if ( candidates.cigops != NULL )
-                free( ( void * ) candidates.cigops );
+            if ( c->candidates.cigops != NULL )
+                free( ( void * ) c->candidates.cigops );
+        }
+    }
+    return rc;
+}
+
+
+static void release_ps_cigar( ps_cigar * const c, int64_t id, const char * ref_name, INSDC_coord_zero pos )
+{
+    if ( c->temp_cigar != NULL )
+        free( c->temp_cigar );
+
+    /* print a log-info if have to because RNA-splicing is requested and we have not homogeneous bits */
+    if ( c->rna_not_homogeneous_flag )
+    {
+        KLogLevel tmp_lvl = KLogLevelGet();
+        KLogLevelSet( klogInfo );
+
+        (void)PLOGMSG( klogInfo, ( klogInfo, "not homogeneous RNA-splices found in alignment #$(an) at $(ref).$(pos)", 
+                        "an=%lu,ref=%s,pos=%u", id, ref_name, pos ) );
+
+        KLogLevelSet( tmp_lvl );
+    }
+}
+
+
+/* XS:A:+/-  from the detected RNA-splicing, or from the RNA_ORIENTATION - column, 0 if none */
+static rc_t get_ps_xs( const samdump_opts * const opts,
+                       int64_t id,
+                       const align_table_context * const atx,
+                       const ps_cigar * const c,
+                       char * xs )
+{
+    rc_t rc = 0;
+    *xs = 0;
+    if ( opts->rna_splicing )
+    {
+        /* analysis of rna-splicing explicitly requested at the commandline */
+        if ( c->candidates.fwd_matched > 0 )
+            *xs = '+';
+        else if ( c->candidates.rev_matched > 0 )
+            *xs = '-';
+    }
+    else if ( atx->rna_orientation_idx != COL_NOT_AVAILABLE )
+    {
+        /* have a look if we have a RNA_ORIENTATION - column available */
+        const char * rna_orientation;
+        uint32_t rna_orientation_len;
+        rc = read_char_ptr( id, atx->cmn.cursor, atx->rna_orientation_idx,
+                            &rna_orientation, &rna_orientation_len, "RNA_ORIENTATION" );
+        if ( rc == 0 && rna_orientation_len > 0 )
+            *xs = rna_orientation[ 0 ];
+    }
+    return rc;
+}
+
+
+/* the whole record is formatted into atx->rec, and handed over with a single write at the end */
+static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
+                                    const char * ref_name,
+                                    INSDC_coord_zero pos,
+                                    matecache * const mc,
+                                    struct rna_splice_dict * splice_dict,
+                                    const PlacementRecord * const rec,
+                                    align_table_context * const atx )
+{
+    uint32_t ref_name_len = string_size( ref_name );
+    int64_t id = rec->id;
+    const VCursor * cursor = atx->cmn.cursor;
+    out_buf * out = &atx->rec;
+    ps_mate m;
+    ps_cigar c;
+    char xs;
+
+    rc_t rc = read_ps_mate( opts, ref_name, ref_name_len, pos, mc, id, atx, &m );
+
+    if ( rc == 0 && opts->use_matepair_filter && !filter_by_matepair_dist( opts, m.tlen ) )
+        return 0;
+
+    /* SAM-FIELD: QNAME     SRA-column: SEQ_SPOT_ID ( int64 ) */
+    if ( rc == 0 )
+    {
+        if ( m.seq_spot_id_len > 0 )
+        {
+            if ( opts->print_spot_group_in_name | opts->print_cg_names )
+            {
+                const char * spot_group;
+                uint32_t spot_group_len;
+                rc = read_char_ptr( id, cursor, atx->cmn.seq_spot_group_idx, &spot_group, &spot_group_len, "SPOT_GROUP" );
+                if ( rc == 0 )
+                    rc = dump_name_2_out_buf( opts, out, *m.seq_spot_id, spot_group, spot_group_len ); /* sam-dump-opts.c */
+            }
+            else
+                rc = dump_name_2_out_buf( opts, out, *m.seq_spot_id, NULL, 0 ); /* sam-dump-opts.c */
         }
+        else
+            rc = out_sam_char( out, '*' );
+    }
+
+    if ( rc == 0 )
+        rc = out_sam_char( out, '\t' );
+
+    /* SAM-FIELD: FLAG      SRA-column: SAM_FLAGS ( uint32 ) */
+    /* SAM-FIELD: RNAME     SRA-column: REF_NAME / REF_SEQ_ID ( char * ) */
+    /* SAM-FIELD: POS       SRA-column: REF_POS + 1 */
+    /* SAM-FIELD: MAPQ      SRA-column: MAPQ */
+    if ( rc == 0 )
+    {
+        rc = reserve_out_buf( out, ref_name_len + 3 * SAM_NUM_CHARS );
         if ( rc == 0 )
-            rc = KOutMsg( "%.*s\t", cgc_output.p_cigar.len, cgc_output.p_cigar.ptr );
+        {
+            out_buf_u32( out, m.sam_flags );
+            out_buf_char( out, '\t' );
+            out_buf_mem( out, ref_name, ref_name_len );
+            out_buf_char( out, '\t' );
+            out_buf_u32( out, pos + 1 );
+            out_buf_char( out, '\t' );
+            out_buf_i32( out, rec->mapq );
+            out_buf_char( out, '\t' );
+        }
+    }
 
-        if ( temp_cigar != NULL )
-            free( temp_cigar );
+    /* SAM-FIELD: CIGAR     SRA-column: CIGAR_SHORT / with or without treatment */
+    if ( rc == 0 )
+        rc = treat_ps_cigar( opts, pos, splice_dict, rec, atx, &c );
+    else
+    {
+        c.temp_cigar = NULL;
+        c.rna_not_homogeneous_flag = false;
     }
+    if ( rc == 0 )
+        rc = out_sam_str( out, c.cgc_output.p_cigar.ptr, c.cgc_output.p_cigar.len, '\t' );
 
     /* SAM-FIELD: RNEXT     SRA-column: MATE_REF_NAME ( !!! row_len can be zero !!! ) */
     /* SAM-FIELD: PNEXT     SRA-column: MATE_REF_POS + 1 ( !!! row_len can be zero !!! ) */
     /* SAM-FIELD: TLEN      SRA-column: TEMPLATE_LEN ( !!! row_len can be zero !!! ) */
     if ( rc == 0 )
     {
-        if ( mate_ref_name_len > 0 )
-        {
-            rc = KOutMsg( "%.*s\t%u\t%d\t", mate_ref_name_len, mate_ref_name, mate_ref_pos + 1, tlen );
-        }
-        else
+        rc = reserve_out_buf( out, m.ref_name_len + 2 * SAM_NUM_CHARS );
+        if ( rc == 0 )
         {
-            if ( mate_ref_pos_len == 0 )
-                rc = KOutMsg( "*\t0\t%d\t", tlen );
+            if ( m.ref_name_len > 0 )
+            {
+                out_buf_mem( out, m.ref_name, m.ref_name_len );
+                out_buf_char( out, '\t' );
+                out_buf_u32( out, m.ref_pos + 1 );
+            }
             else
-                rc = KOutMsg( "*\t%u\t%d\t", mate_ref_pos, tlen );
+            {
+                out_buf_mem( out, "*\t", 2 );
+                if ( m.ref_pos_len == 0 )
+                    out_buf_char( out, '0' );
+                else
+                    out_buf_u32( out, m.ref_pos );
+            }
+            out_buf_char( out, '\t' );
+            out_buf_i32( out, m.tlen );
+            out_buf_char( out, '\t' );
         }
     }
 
     /* SAM-FIELD: SEQ       SRA-column: READ */
     if ( rc == 0 )
-        rc = KOutMsg( "%.*s\t", cgc_output.p_read.len, cgc_output.p_read.ptr );
+        rc = out_sam_str( out, c.cgc_output.p_read.ptr, c.cgc_output.p_read.len, '\t' );
 
     /* SAM-FIELD: QUAL      SRA-column: SAM_QUALITY */
     if ( rc == 0 )
     {
-        if ( cgc_output.p_quality.len > 0 )
-            rc = dump_quality_33( opts, cgc_output.p_quality.ptr, cgc_output.p_quality.len, false );
+        if ( c.cgc_output.p_quality.len > 0 )
+            rc = dump_quality_33_2_out_buf( opts, out, c.cgc_output.p_quality.ptr, c.cgc_output.p_quality.len, false );
         else
-            rc = KOutMsg( "*" );
+            rc = out_sam_char( out, '*' );
     }
 
     /* OPT SAM-FIELD: RG     SRA-column: SPOT_GROUP */
@@ -1651,15 +1975,22 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
         uint32_t spot_grp_len;
         rc = read_char_ptr( id, cursor, atx->cmn.seq_spot_group_idx, &spot_grp, &spot_grp_len, "SPOT_GROUP" );
         if ( rc == 0 && spot_grp_len > 0 )
-            rc = KOutMsg( "\tRG:Z:%.*s", spot_grp_len, spot_grp );
+            rc = out_sam_str_tag( out, "\tRG:Z:", spot_grp, spot_grp_len );
     }
 
-    if ( rc == 0 && cgc_output.p_tags.len > 0 )
-        rc = KOutMsg( "\t%.*s", cgc_output.p_tags.len, cgc_output.p_tags.ptr );
+    if ( rc == 0 && c.cgc_output.p_tags.len > 0 )
+    {
+        rc = reserve_out_buf( out, c.cgc_output.p_tags.len + 1 );
+        if ( rc == 0 )
+        {
+            out_buf_char( out, '\t' );
+            out_buf_mem( out, c.cgc_output.p_tags.ptr, c.cgc_output.p_tags.len );
+        }
+    }
 
     /* OPT SAM-FIELD: XI     SRA-column: ALIGN_ID */
     if ( rc == 0 && opts->print_alignment_id_in_column_xi )
-        rc = KOutMsg( "\tXI:i:%u", id );
+        rc = out_sam_u32_tag( out, "\tXI:i:", ( uint32_t )id );
 
     /* to match sam-tools output: in case we are dumping this in CG-mode.... */
     if ( rc == 0 && ( opts->cigar_treatment != ct_unchanged ) && ( atx->al_group_idx != COL_NOT_AVAILABLE ) )
@@ -1674,7 +2005,9 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
             {
                 if ( align_grp[ i ] == '_' )
                 {
-                    rc = KOutMsg( "\tZI:i:%.*s\tZA:i:%.1s", i, align_grp, align_grp + i + 1 );
+                    rc = out_sam_str_tag( out, "\tZI:i:", align_grp, i );
+                    if ( rc == 0 )
+                        rc = out_sam_str_tag( out, "\tZA:i:", align_grp + i + 1, 1 );
                     break;
                 }
             }
@@ -1688,69 +2021,203 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
         uint32_t al_count_len;
         rc = read_uint8_ptr( id, cursor, atx->cmn.al_count_idx, &al_count, &al_count_len, "ALIGNMENT_COUNT" );
         if ( rc == 0 && al_count_len > 0 )
-            rc = KOutMsg( "\tNH:i:%u", *al_count );
+            rc = out_sam_u32_tag( out, "\tNH:i:", *al_count );
     }
 
     /* OPT SAM-FIELD: NM     SRA-column: EDIT_DISTANCE */
     if ( rc == 0 )
-        rc = KOutMsg( "\tNM:i:%u", ( cgc_output.edit_dist - NM_adjustments ) );
+        rc = out_sam_u32_tag( out, "\tNM:i:", ( c.cgc_output.edit_dist - c.NM_adjustments ) );
 
     /* OPT SAM-FIELD: XS:A:+/-  SRA-column: RNA-SPLICING detected via computation, or from the RNA_ORIENTATION - column */
     if ( rc == 0 )
-    {
-        if ( opts->rna_splicing )
-        {
-            /* analysis of rna-splicing explicitly requested at the commandline */
-            if ( candidates.fwd_matched > 0 || candidates.rev_matched > 0 )
-            {
-                if ( candidates.fwd_matched > 0 )
-                    rc = KOutMsg( "\tXS:A:+" );
-                else 
-                    rc = KOutMsg( "\tXS:A:-" );
-            }
-/*
-            uint32_t i;
-            KOutMsg( "\tXS:A:" );
-            for ( i = 0; i < candidates.count; ++i )
-            {
-                rna_splice_candidate * rsc = &candidates.candidates[ i ];
-                KOutMsg( "( offs=%u | len=%u | op_idx=%u | matech=%u )", rsc->offset, rsc->len, rsc->op_idx, rsc->matched );
-            }
-*/
-
-        }
-        else
-        {
-            /* have a look if we have a RNA_ORIENTATION - column available */
-            if ( atx->rna_orientation_idx != COL_NOT_AVAILABLE )
-            {
-                const char * rna_orientation;
-                uint32_t rna_orientation_len;
-                rc = read_char_ptr( id, cursor, atx->rna_orientation_idx,
-                                    &rna_orientation, &rna_orientation_len, "RNA_ORIENTATION" );
-                if ( rc == 0 && rna_orientation_len > 0 )
-                {
-                    rc = KOutMsg( "\tXS:A:%c", rna_orientation[ 0 ] );
-                }
-            }
-        }
-    }
+        rc = get_ps_xs( opts, id, atx, &c, &xs );
+    if ( rc == 0 && xs != 0 )
+        rc = out_sam_str_tag( out, "\tXS:A:", &xs, 1 );
 
+    /* hand the whole record over at once, on error the rest of it is dropped */
     if ( rc == 0 )
-        rc = KOutMsg( "\n" );
+        rc = out_sam_char( out, '\n' );
+    if ( rc == 0 )
+        rc = flush_out_buf( out ); /* out_buf.c */
+    else
+        out->used = 0;
 
-    /* print a log-info if have to because RNA-splicing is requested and we have not homogeneous bits */
-    if ( rna_not_homogeneous_flag )
-    {
-        KLogLevel tmp_lvl = KLogLevelGet();
-        KLogLevelSet( klogInfo );
+    release_ps_cigar( &c, id, ref_name, pos );
+    return rc;
+}
 
-        (void)PLOGMSG( klogInfo, ( klogInfo, "not homogeneous RNA-splices found in alignment #$(an) at $(ref).$(pos)", 
-                        "an=%lu,ref=%s,pos=%u", id, ref_name, pos ) );
 
-        KLogLevelSet( tmp_lvl );
-    }
+/* the same alignment as binary record, the fields are the ones of print_alignment_sam_ps():
+   the record is built in atx->rec, which grows instead of flushing ( keep is set for of_bam ) */
+static rc_t print_alignment_bam_ps( const samdump_opts * const opts,
+                                    const char * ref_name,
+                                    INSDC_coord_zero pos,
+                                    matecache * const mc,
+                                    struct rna_splice_dict * splice_dict,
+                                    const PlacementRecord * const rec,
+                                    align_table_context * const atx )
+{
+    uint32_t ref_name_len = string_size( ref_name );
+    int64_t id = rec->id;
+    const VCursor * cursor = atx->cmn.cursor;
+    out_buf * out = &atx->rec;
+    size_t brec = 0;
+    ps_mate m;
+    ps_cigar c;
+    char xs;
+
+    rc_t rc = read_ps_mate( opts, ref_name, ref_name_len, pos, mc, id, atx, &m );
+
+    if ( rc == 0 && opts->use_matepair_filter && !filter_by_matepair_dist( opts, m.tlen ) )
+        return 0;
+
+    /* all the records of this context are on the same reference */
+    if ( rc == 0 && atx->bam_ref_id < -1 )
+    {
+        atx->bam_ref_id = bam_ref_id( ref_name, ref_name_len ); /* bam_out.c */
+        if ( atx->bam_ref_id < 0 )
+        {
+            rc = RC( rcExe, rcNoTarg, rcWriting, rcName, rcNotFound );
+            (void)PLOGERR( klogErr, ( klogErr, rc, "reference '$(ref)' is not in the header", "ref=%s", ref_name ) );
+        }
+    }
+
+    /* QNAME, terminated by 0 */
+    if ( rc == 0 )
+        rc = bam_rec_begin( out, &brec ); /* bam_out.c */
+    if ( rc == 0 )
+    {
+        if ( m.seq_spot_id_len > 0 )
+        {
+            if ( opts->print_spot_group_in_name | opts->print_cg_names )
+            {
+                const char * spot_group;
+                uint32_t spot_group_len;
+                rc = read_char_ptr( id, cursor, atx->cmn.seq_spot_group_idx, &spot_group, &spot_group_len, "SPOT_GROUP" );
+                if ( rc == 0 )
+                    rc = dump_name_2_out_buf( opts, out, *m.seq_spot_id, spot_group, spot_group_len ); /* sam-dump-opts.c */
+            }
+            else
+                rc = dump_name_2_out_buf( opts, out, *m.seq_spot_id, NULL, 0 ); /* sam-dump-opts.c */
+        }
+        else
+            rc = out_sam_char( out, '*' );
+    }
+    if ( rc == 0 )
+        rc = bam_rec_name_done( out, brec );
+
+    /* FLAG, REFID, POS, MAPQ, NEXT-REFID, NEXT-POS, TLEN */
+    if ( rc == 0 )
+    {
+        int32_t next_ref_id = -1, next_pos = -1;
+        if ( m.ref_name_len > 0 )
+        {
+            if ( m.ref_name == equal_sign )
+                next_ref_id = atx->bam_ref_id;
+            else
+                next_ref_id = bam_ref_id( m.ref_name, m.ref_name_len );
+            /* a mate on a reference missing from the header is unplaced: both fields are -1 */
+            if ( next_ref_id >= 0 )
+                next_pos = m.ref_pos;
+        }
+        bam_rec_core( out, brec, atx->bam_ref_id, pos, rec->mapq, m.sam_flags, next_ref_id, next_pos, m.tlen );
+    }
+
+    /* CIGAR, with the bin calculated from it */
+    if ( rc == 0 )
+        rc = treat_ps_cigar( opts, pos, splice_dict, rec, atx, &c );
+    else
+    {
+        c.temp_cigar = NULL;
+        c.rna_not_homogeneous_flag = false;
+    }
+    if ( rc == 0 )
+    {
+        if ( c.cgc_output.n_cig_ops > 0 )
+            rc = bam_rec_cig_ops( out, brec, pos, c.cgc_output.cig_ops, c.cgc_output.n_cig_ops );
+        else
+            rc = bam_rec_cigar( out, brec, pos, c.cgc_output.p_cigar.ptr, c.cgc_output.p_cigar.len );
+    }
+
+    /* SEQ and QUAL */
+    if ( rc == 0 )
+        rc = bam_rec_seq_qual( out, brec, c.cgc_output.p_read.ptr, c.cgc_output.p_read.len,
+                               c.cgc_output.p_quality.ptr, c.cgc_output.p_quality.len, opts->qual_33_2_ascii );
+
+    /* RG */
+    if ( rc == 0 && ( atx->cmn.seq_spot_group_idx != COL_NOT_AVAILABLE ) )
+    {
+        const char * spot_grp = NULL;
+        uint32_t spot_grp_len;
+        rc = read_char_ptr( id, cursor, atx->cmn.seq_spot_group_idx, &spot_grp, &spot_grp_len, "SPOT_GROUP" );
+        if ( rc == 0 && spot_grp_len > 0 )
+            rc = bam_rec_tag_Z( out, "RG", spot_grp, spot_grp_len );
+    }
+
+    /* the tags of the cg-treatment are text */
+    if ( rc == 0 && c.cgc_output.p_tags.len > 0 )
+        rc = bam_rec_tags_text( out, c.cgc_output.p_tags.ptr, c.cgc_output.p_tags.len );
+
+    /* XI */
+    if ( rc == 0 && opts->print_alignment_id_in_column_xi )
+        rc = bam_rec_tag_int( out, "XI", ( uint32_t )id );
+
+    /* ZI and ZA from the ALIGN_GROUP "zi_za" */
+    if ( rc == 0 && ( opts->cigar_treatment != ct_unchanged ) && ( atx->al_group_idx != COL_NOT_AVAILABLE ) )
+    {
+        const char * align_grp;
+        uint32_t align_grp_len;
+        rc = read_char_ptr( id, cursor, atx->al_group_idx, &align_grp, &align_grp_len, "ALIGN_GROUP" );
+        if ( rc == 0 && align_grp_len > 0 )
+        {
+            uint32_t i;
+            for ( i = 0; rc == 0 && i < align_grp_len - 1; ++i )
+            {
+                if ( align_grp[ i ] == '_' )
+                {
+                    int64_t zi = 0;
+                    uint32_t j;
+                    for ( j = 0; j < i && isdigit( align_grp[ j ] ); ++j )
+                        zi = zi * 10 + ( align_grp[ j ] - '0' );
+                    rc = bam_rec_tag_int( out, "ZI", zi );
+                    if ( rc == 0 )
+                        rc = bam_rec_tag_int( out, "ZA", align_grp[ i + 1 ] - '0' );
+                    break;
+                }
+            }
+        }
+    }
 
+    /* NH */
+    if ( rc == 0 && atx->cmn.al_count_idx != COL_NOT_AVAILABLE )
+    {
+        const uint8_t * al_count;
+        uint32_t al_count_len;
+        rc = read_uint8_ptr( id, cursor, atx->cmn.al_count_idx, &al_count, &al_count_len, "ALIGNMENT_COUNT" );
+        if ( rc == 0 && al_count_len > 0 )
+            rc = bam_rec_tag_int( out, "NH", *al_count );
+    }
+
+    /* NM */
+    if ( rc == 0 )
+        rc = bam_rec_tag_int( out, "NM", ( uint32_t )( c.cgc_output.edit_dist - c.NM_adjustments ) );
+
+    /* XS */
+    if ( rc == 0 )
+        rc = get_ps_xs( opts, id, atx, &c, &xs );
+    if ( rc == 0 && xs != 0 )
+        rc = bam_rec_tag_A( out, "XS", xs );
+
+    /* hand the whole record over at once, on error the rest of it is dropped */
+    if ( rc == 0 )
+    {
+        bam_rec_end( out, brec );
+        rc = flush_out_buf( out ); /* out_buf.c */
+    }
+    else
+        out->used = 0;
+
+    release_ps_cigar( &c, id, ref_name, pos );
     return rc;
 }
 
@@ -1781,9 +2248,9 @@ static rc_t print_alignment_fastx( const samdump_opts * const opts,
     }
 
     if ( opts->output_format == of_fastq )
-        rc = KOutMsg( "@" );
+        rc = out_2_dyn_string( atx->out, "@" );
     else
-        rc = KOutMsg( ">" );
+        rc = out_2_dyn_string( atx->out, ">" );
 
     /* SAM-FIELD: QNAME     1.row: name */
     if ( rc == 0 )
@@ -1796,20 +2263,20 @@ static rc_t print_alignment_fastx( const samdump_opts * const opts,
                 uint32_t spot_grp_len;
                 rc = read_char_ptr( rec->id, cursor, atx->cmn.seq_spot_group_idx, &spot_grp, &spot_grp_len, "SEQ_SPOT_GROUP" );
                 if ( rc == 0 )
-                    rc = dump_name( opts, *seq_spot_id, spot_grp, spot_grp_len ); /* sam-dump-opts.c */
+                    rc = dump_name( opts, atx->out, *seq_spot_id, spot_grp, spot_grp_len ); /* sam-dump-opts.c */
             }
             else
-                rc = dump_name( opts, *seq_spot_id, NULL, 0 ); /* sam-dump-opts.c */
+                rc = dump_name( opts, atx->out, *seq_spot_id, NULL, 0 ); /* sam-dump-opts.c */
         }
         else
-            rc = KOutMsg( "*" );
+            rc = out_2_dyn_string( atx->out, "*" );
 
         if ( rc == 0 )
         {
             uint32_t seq_read_id;
             rc = read_uint32( rec->id, cursor, atx->cmn.seq_read_id_idx, &seq_read_id, 0, "SEQ_READ_ID" );
             if ( rc == 0 )
-                rc = KOutMsg( "/%u", seq_read_id );
+                rc = out_2_dyn_string( atx->out, "/%u", seq_read_id );
         }
     }
 
@@ -1822,15 +2289,15 @@ static rc_t print_alignment_fastx( const samdump_opts * const opts,
     {
         switch( atx->align_table_type )
         {
-        case att_primary    :   rc = KOutMsg( " primary" ); break;
-        case att_secondary  :   rc = KOutMsg( " secondary" ); break;
-        case att_evidence   :   rc = KOutMsg( " evidence" ); break;
+        case att_primary    :   rc = out_2_dyn_string( atx->out, " primary" ); break;
+        case att_secondary  :   rc = out_2_dyn_string( atx->out, " secondary" ); break;
+        case att_evidence   :   rc = out_2_dyn_string( atx->out, " evidence" ); break;
         }
     }
 
     /* against what reference aligned, at what position, with what mapping-quality */
     if ( rc == 0 )
-        rc = KOutMsg( " ref=%s pos=%u mapq=%i\n", ref_name, pos + 1, rec->mapq );
+        rc = out_2_dyn_string( atx->out, " ref=%s pos=%u mapq=%i\n", ref_name, pos + 1, rec->mapq );
 
     /* READ at a new line */
     if ( rc == 0 )
@@ -1841,16 +2308,16 @@ static rc_t print_alignment_fastx( const samdump_opts * const opts,
         if ( rc == 0 )
         {
             if ( read_size > 0 )
-                rc = KOutMsg( "%.*s\n", read_size, read );
+                rc = out_2_dyn_string( atx->out, "%.*s\n", read_size, read );
             else
-                rc = KOutMsg( "*\n" );
+                rc = out_2_dyn_string( atx->out, "*\n" );
         }
     }
 
     /* QUALITY on a new line if in fastq-mode */
     if ( rc == 0 && opts->output_format == of_fastq )
     {
-        rc = KOutMsg( "+\n" );
+        rc = out_2_dyn_string( atx->out, "+\n" );
         if ( rc == 0 )
         {
             const char * quality;
@@ -1859,12 +2326,12 @@ static rc_t print_alignment_fastx( const samdump_opts * const opts,
             if ( rc == 0 )
             {
                 if ( quality_size > 0 )
-                    rc = dump_quality_33( opts, quality, quality_size, false );
+                    rc = dump_quality_33( opts, atx->out, quality, quality_size, false );
                 else
-                    rc = KOutMsg( "*" );
+                    rc = out_2_dyn_string( atx->out, "*" );
             }
             if ( rc == 0 )
-                rc = KOutMsg( "\n" );
+                rc = out_2_dyn_string( atx->out, "\n" );
         }
     }
 
@@ -1916,7 +2383,8 @@ static rc_t walk_position( const samdump_opts * const opts,
                         rc = RC( rcExe, rcNoTarg, rcReading, rcParam, rcNull );
                         LOGERR( klogInt, rc, "no placement-record-context available" );
                     }
-                    else
+                    /* skip the alignments in the gaps between the requested ranges */
+                    else if ( atx->cluster.ranges == NULL || pos_in_cluster( &atx->cluster, pos ) )
                     {
                         if ( opts->output_format == of_sam )
                         {
@@ -1925,6 +2393,8 @@ static rc_t walk_position( const samdump_opts * const opts,
                             else
                                 rc = print_alignment_sam_ps( opts, ref_name, pos, mc, splice_dict, rec, atx );
                         }
+                        else if ( opts->output_format == of_bam )
+                            rc = print_alignment_bam_ps( opts, ref_name, pos, mc, splice_dict, rec, atx );
                         else
                             rc = print_alignment_fastx( opts, ref_name, pos, mc, rec, atx );
                     }
@@ -2094,11 +2564,14 @@ static void CC destroy_align_table_context( void *item, void *data )
 }
 
 
-static rc_t print_all_aligned_spots_of_this_reference( const samdump_opts * const opts,
-                                                       const input_database * const ids,
-                                                       matecache * const mc,
-                                                       const AlignMgr * const a_mgr,
-                                                       const ReferenceObj * const ref_obj )
+static rc_t print_aligned_spots_of_this_slice( const samdump_opts * const opts,
+                                               const input_database * const ids,
+                                               matecache * const mc,
+                                               const AlignMgr * const a_mgr,
+                                               const ReferenceObj * const ref_obj,
+                                               INSDC_coord_zero ref_pos,
+                                               INSDC_coord_len ref_len,
+                                               struct dyn_string * out )
 {
     PlacementSetIterator * set_iter;
     /* the we ask the alignment-manager to produce a placement-set-iterator... */
@@ -2111,22 +2584,19 @@ static rc_t print_all_aligned_spots_of_this_reference( const samdump_opts * cons
     {
         /* here we need a vector to passed along into the creation of the iterators */
         Vector context_list;
-        INSDC_coord_len ref_len;
 
         VectorInit ( &context_list, 0, 5 );
 
-        rc = ReferenceObj_SeqLength( ref_obj, &ref_len );
+        rc = add_pl_iters( opts, set_iter, ref_obj, ids,
+            ref_pos,            /* where it starts on the reference */
+            ref_len,            /* the length of the slice */
+            NULL,               /* no spotgroup re-grouping (yet) */
+            NULL,               /* the slices are not filtered by regions */
+            &context_list,
+            out                 /* NULL: print via KOutMsg() */
+            );
         if ( rc == 0 )
-        {
-            rc = add_pl_iters( opts, set_iter, ref_obj, ids,
-                0,                  /* where it starts on the reference */
-                ref_len,            /* the whole length of this reference/chromosome */
-                NULL,               /* no spotgroup re-grouping (yet) */
-                &context_list
-                );
-            if ( rc == 0 )
-                rc = walk_placements( opts, set_iter, mc );
-        }
+            rc = walk_placements( opts, set_iter, mc );
 
         /* walk the context_list to free the align_table_context records, close/free the cursors... */
         VectorWhack ( &context_list, destroy_align_table_context, NULL );
@@ -2136,6 +2606,20 @@ static rc_t print_all_aligned_spots_of_this_reference( const samdump_opts * cons
 }
 
 
+static rc_t print_all_aligned_spots_of_this_reference( const samdump_opts * const opts,
+                                                       const input_database * const ids,
+                                                       matecache * const mc,
+                                                       const AlignMgr * const a_mgr,
+                                                       const ReferenceObj * const ref_obj )
+{
+    INSDC_coord_len ref_len;
+    rc_t rc = ReferenceObj_SeqLength( ref_obj, &ref_len );
+    if ( rc == 0 )
+        rc = print_aligned_spots_of_this_slice( opts, ids, mc, a_mgr, ref_obj, 0, ref_len, NULL );
+    return rc;
+}
+
+
 /*
    the user did not specify regions, print all alignments from all input-files
    this is strategy #1 to do this, create a ref_iter for every reference each
@@ -2177,6 +2661,409 @@ static rc_t print_all_aligned_spots_0( const samdump_opts * const opts,
 }
 
 
+/* =========================================================================================== */
+/* strategy #1 on worker-threads
+
+   The references are cut into slices of SAM_SLICE_LEN. Each worker dumps a slice with a
+   reflist and cursors of its own into the output-buffer of the slice. The main-thread prints
+   the buffers in slice-order, workers do not run more than SAM_SLICES_AHEAD slices per thread
+   ahead of it. An alignment is printed only in the slice it starts in ( see walk_position() ),
+   the output is the same as the one of print_all_aligned_spots_0(). */
+
+#define SAM_SLICE_LEN ( 1024 * 1024 )
+#define SAM_SLICES_AHEAD 2
+#define SAM_SLICE_OUT ( 64 * 1024 )
+
+typedef struct sam_slice
+{
+    uint32_t db_idx;
+    uint32_t ref_idx;
+    INSDC_coord_zero start;
+    INSDC_coord_len len;
+    struct dyn_string * out;    /* output of the slice, written by a worker-thread */
+    matecache * mc;             /* mate-cache of the slice, the main-thread merges the unaligned entries */
+    rc_t rc;
+    bool done;
+} sam_slice;
+
+
+typedef struct sam_pool
+{
+    const samdump_opts * opts;
+    const input_files * ifs;
+    const AlignMgr * a_mgr;
+    sam_slice * slices;
+    uint32_t slice_count;
+    KLock * lock;
+    KCondition * cond;
+    uint32_t next;              /* next slice to be taken by a worker */
+    uint32_t printed;           /* number of slices printed by the main-thread */
+    uint32_t ahead;             /* how many slices can be taken beyond the printed ones */
+    bool quit;
+} sam_pool;
+
+
+typedef struct sam_worker
+{
+    sam_pool * pool;
+    KThread * thread;
+    input_database * dbs;       /* one per input-database, opened on first use */
+} sam_worker;
+
+
+/* the rna-splice-log and the perf-log are written while walking the references */
+static bool use_parallel_dump( const samdump_opts * const opts )
+{
+    if ( opts->no_mt || opts->num_threads < 2 )
+        return false;
+    if ( opts->rna_splice_log != NULL )
+        return false;
+#if _DEBUGGING
+    if ( opts->perf_log != NULL )
+        return false;
+#endif
+    return true;
+}
+
+
+/* in the order of print_all_aligned_spots_0(), only counts the slices if slices is NULL */
+static rc_t make_slices( const input_files * const ifs, sam_slice * slices, uint32_t * count )
+{
+    rc_t rc = 0;
+    uint32_t db_idx, n = 0;
+    for ( db_idx = 0; db_idx < ifs->database_count && rc == 0; ++db_idx )
+    {
+        const input_database * ids = VectorGet( &ifs->dbs, db_idx );
+        if ( ids != NULL )
+        {
+            uint32_t refobj_count;
+            rc = ReferenceList_Count( ids->reflist, &refobj_count );
+            if ( rc == 0 && refobj_count > 0 )
+            {
+                uint32_t ref_idx;
+                for ( ref_idx = 0; ref_idx < refobj_count && rc == 0; ++ref_idx )
+                {
+                    const ReferenceObj * ref_obj;
+                    rc = ReferenceList_Get( ids->reflist, &ref_obj, ref_idx );
+                    if ( rc == 0 && ref_obj != NULL )
+                    {
+                        INSDC_coord_len ref_len;
+                        rc = ReferenceObj_SeqLength( ref_obj, &ref_len );
+                        if ( rc == 0 )
+                        {
+                            uint32_t start = 0;
+                            do
+                            {
+                                if ( slices != NULL )
+                                {
+                                    sam_slice * slice = &slices[ n ];
+                                    slice->db_idx = db_idx;
+                                    slice->ref_idx = ref_idx;
+                                    slice->start = start;
+                                    slice->len = ( ref_len - start > SAM_SLICE_LEN ) ? SAM_SLICE_LEN : ref_len - start;
+                                }
+                                n++;
+                                start += SAM_SLICE_LEN;
+                            } while ( start < ref_len );
+                        }
+                        ReferenceObj_Release( ref_obj );
+                    }
+                }
+            }
+        }
+    }
+    *count = n;
+    return rc;
+}
+
+
+static void sam_worker_whack( sam_worker * w )
+{
+    if ( w->dbs != NULL )
+    {
+        uint32_t i;
+        for ( i = 0; i < w->pool->ifs->database_count; ++i )
+        {
+            /* the path is borrowed from the input-files */
+            if ( w->dbs[ i ].reflist != NULL ) ReferenceList_Release( w->dbs[ i ].reflist );
+            if ( w->dbs[ i ].db != NULL ) VDatabaseRelease( w->dbs[ i ].db );
+        }
+        free( w->dbs );
+        w->dbs = NULL;
+    }
+}
+
+
+static rc_t sam_worker_init( sam_worker * w, sam_pool * pool )
+{
+    rc_t rc = 0;
+    w->pool = pool;
+    w->thread = NULL;
+    w->dbs = calloc( pool->ifs->database_count, sizeof w->dbs[ 0 ] );
+    if ( w->dbs == NULL )
+    {
+        rc = RC( rcExe, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        (void)LOGERR( klogErr, rc, "cannot create worker-structure" );
+    }
+    return rc;
+}
+
+
+/* the cursors and the reflist of the main-thread cannot be shared, the worker opens the database again */
+static rc_t sam_worker_get_db( sam_worker * w, uint32_t db_idx, const input_database ** idb )
+{
+    rc_t rc = 0;
+    input_database * dst = &w->dbs[ db_idx ];
+    if ( dst->reflist == NULL )
+    {
+        const input_database * src = VectorGet( &w->pool->ifs->dbs, db_idx );
+        if ( src == NULL )
+        {
+            rc = RC( rcExe, rcNoTarg, rcReading, rcItem, rcNotFound );
+            (void)LOGERR( klogInt, rc, "input-database not found" );
+        }
+        else
+        {
+            const VDBManager * mgr;
+            rc = VDatabaseOpenManagerRead( src->db, &mgr );
+            if ( rc != 0 )
+            {
+                (void)LOGERR( klogInt, rc, "VDatabaseOpenManagerRead() failed" );
+            }
+            else
+            {
+                rc = VDBManagerOpenDBRead( mgr, &dst->db, NULL, "%s", src->path );
+                if ( rc != 0 )
+                {
+                    (void)PLOGERR( klogErr, ( klogErr, rc, "cannot open db '$(t)'", "t=%s", src->path ) );
+                }
+                else
+                {
+                    rc = ReferenceList_MakeDatabase( &dst->reflist, dst->db, src->reflist_options, 0, NULL, 0 );
+                    if ( rc != 0 )
+                    {
+                        (void)PLOGERR( klogErr, ( klogErr, rc, "cannot create reflist for '$(t)'", "t=%s", src->path ) );
+                        dst->reflist = NULL;
+                    }
+                }
+                VDBManagerRelease( mgr );
+            }
+            dst->db_idx = src->db_idx;
+            dst->path = src->path;
+        }
+    }
+    if ( rc == 0 )
+        *idb = dst;
+    return rc;
+}
+
+
+static rc_t sam_slice_run( sam_worker * w, sam_slice * slice )
+{
+    const samdump_opts * opts = w->pool->opts;
+    const input_database * idb;
+    rc_t rc = sam_worker_get_db( w, slice->db_idx, &idb );
+    if ( rc == 0 )
+        rc = allocated_dyn_string ( &slice->out, SAM_SLICE_OUT );
+    if ( rc == 0 && opts->use_mate_cache )
+    {
+        /* all workers hold a slice-cache at the same time: they share the budget */
+        size_t budget = opts->matecache_size;
+        if ( opts->num_threads > 1 )
+            budget /= opts->num_threads;
+        rc = make_matecache( &slice->mc, w->pool->ifs->database_count, budget );
+    }
+    if ( rc == 0 )
+    {
+        const ReferenceObj * ref_obj;
+        rc = ReferenceList_Get( idb->reflist, &ref_obj, slice->ref_idx );
+        if ( rc == 0 && ref_obj != NULL )
+        {
+            rc = print_aligned_spots_of_this_slice( opts, idb, slice->mc, w->pool->a_mgr, ref_obj,
+                                                    slice->start, slice->len, slice->out );
+            ReferenceObj_Release( ref_obj );
+        }
+    }
+    return rc;
+}
+
+
+static rc_t CC sam_worker_thread( const KThread *self, void *data )
+{
+    sam_worker * w = data;
+    sam_pool * pool = w->pool;
+    rc_t rc = 0;
+
+    while ( rc == 0 )
+    {
+        sam_slice * slice = NULL;
+
+        KLockAcquire( pool->lock );
+        while ( !pool->quit && pool->next < pool->slice_count &&
+                pool->next >= pool->printed + pool->ahead )
+        {
+            KConditionWait( pool->cond, pool->lock );
+        }
+        if ( !pool->quit && pool->next < pool->slice_count )
+            slice = &pool->slices[ pool->next++ ];
+        KLockUnlock( pool->lock );
+
+        if ( slice == NULL )
+            break;
+
+        rc = sam_slice_run( w, slice );
+
+        KLockAcquire( pool->lock );
+        slice->rc = rc;
+        slice->done = true;
+        KConditionBroadcast( pool->cond );
+        KLockUnlock( pool->lock );
+    }
+    return rc;
+}
+
+
+static rc_t print_all_aligned_spots_parallel( const samdump_opts * const opts,
+                                              const input_files * const ifs,
+                                              matecache * const mc,
+                                              const AlignMgr * const a_mgr )
+{
+    sam_pool pool;
+    sam_worker * workers = NULL;
+    uint32_t i, started = 0, threads = opts->num_threads;
+    rc_t rc;
+
+    memset( &pool, 0, sizeof pool );
+    pool.opts = opts;
+    pool.ifs = ifs;
+    pool.a_mgr = a_mgr;
+
+    rc = make_slices( ifs, NULL, &pool.slice_count );
+    if ( rc != 0 || pool.slice_count == 0 )
+        return rc;
+
+    pool.slices = calloc( pool.slice_count, sizeof pool.slices[ 0 ] );
+    if ( pool.slices == NULL )
+    {
+        rc = RC( rcExe, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        (void)LOGERR( klogErr, rc, "cannot create slices" );
+        return rc;
+    }
+    rc = make_slices( ifs, pool.slices, &pool.slice_count );
+
+    if ( threads > pool.slice_count )
+        threads = pool.slice_count;
+    pool.ahead = threads * SAM_SLICES_AHEAD;
+
+    if ( rc == 0 )
+    {
+        workers = calloc( threads, sizeof workers[ 0 ] );
+        if ( workers == NULL )
+        {
+            rc = RC( rcExe, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+            (void)LOGERR( klogErr, rc, "cannot create workers" );
+        }
+    }
+    if ( rc == 0 )
+    {
+        rc = KLockMake ( &pool.lock );
+        if ( rc != 0 )
+        {
+            LOGERR( klogInt, rc, "KLockMake() failed" );
+        }
+    }
+    if ( rc == 0 )
+    {
+        rc = KConditionMake ( &pool.cond );
+        if ( rc != 0 )
+        {
+            LOGERR( klogInt, rc, "KConditionMake() failed" );
+        }
+    }
+
+    while ( rc == 0 && started < threads )
+    {
+        sam_worker * w = &workers[ started ];
+        rc = sam_worker_init( w, &pool );
+        if ( rc == 0 )
+        {
+            rc = KThreadMake ( &w->thread, sam_worker_thread, w );
+            if ( rc != 0 )
+            {
+                LOGERR( klogInt, rc, "KThreadMake() failed" );
+            }
+        }
+        if ( rc == 0 )
+            started++;
+        else
+            sam_worker_whack( w );
+    }
+
+    /* print the slices in order as they are done */
+    for ( i = 0; i < pool.slice_count && rc == 0; ++i )
+    {
+        sam_slice * slice = &pool.slices[ i ];
+
+        KLockAcquire( pool.lock );
+        while ( !slice->done )
+            KConditionWait( pool.cond, pool.lock );
+        KLockUnlock( pool.lock );
+
+        rc = slice->rc;
+        if ( rc == 0 )
+            rc = write_2_kout( dyn_string_char( slice->out, 0 ), dyn_string_len( slice->out ) ); /* out_buf.c */
+        if ( rc == 0 && slice->mc != NULL && mc != NULL )
+            rc = matecache_merge( mc, slice->mc ); /* matecache.c */
+        if ( slice->out != NULL )
+        {
+            free_dyn_string( slice->out );
+            slice->out = NULL;
+        }
+        if ( slice->mc != NULL )
+        {
+            release_matecache( slice->mc );
+            slice->mc = NULL;
+        }
+
+        KLockAcquire( pool.lock );
+        pool.printed = i + 1;
+        KConditionBroadcast( pool.cond );
+        KLockUnlock( pool.lock );
+    }
+
+    if ( pool.lock != NULL )
+    {
+        KLockAcquire( pool.lock );
+        pool.quit = true;
+        if ( pool.cond != NULL )
+            KConditionBroadcast( pool.cond );
+        KLockUnlock( pool.lock );
+    }
+
+    for ( i = 0; i < started; ++i )
+    {
+        rc_t status;
+        KThreadWait ( workers[ i ].thread, &status );
+        KThreadRelease ( workers[ i ].thread );
+        sam_worker_whack( &workers[ i ] );
+    }
+
+    /* in case of an error: the slices done by the workers, but not printed anymore */
+    for ( i = 0; i < pool.slice_count; ++i )
+    {
+        if ( pool.slices[ i ].out != NULL ) free_dyn_string( pool.slices[ i ].out );
+        if ( pool.slices[ i ].mc != NULL ) release_matecache( pool.slices[ i ].mc );
+    }
+
+    if ( pool.cond != NULL ) KConditionRelease( pool.cond );
+    if ( pool.lock != NULL ) KLockRelease( pool.lock );
+    if ( workers != NULL ) free( workers );
+    free( pool.slices );
+
+    return rc;
+}
+
+
 /*
    the user did not specify regions, print all alignments from all input-files
    this is strategy #2 to do this, throw all iterators for all input-files and all there references
@@ -2282,7 +3169,11 @@ rc_t print_aligned_spots( const samdump_opts * const opts,
             /* the user did not specify regions to be printed ==> print all alignments */
             switch( opts->dump_mode )
             {
-                case dm_one_ref_at_a_time : rc = print_all_aligned_spots_0( opts, ifs, mc, a_mgr ); break;
+                case dm_one_ref_at_a_time : if ( use_parallel_dump( opts ) )
+                                                rc = print_all_aligned_spots_parallel( opts, ifs, mc, a_mgr );
+                                            else
+                                                rc = print_all_aligned_spots_0( opts, ifs, mc, a_mgr );
+                                            break;
                 case dm_prepare_all_refs  : rc = print_all_aligned_spots_1( opts, ifs, mc, a_mgr ); break;
             }
         }
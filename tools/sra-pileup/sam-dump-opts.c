@@ -33,476 +33,11 @@
 #include <sysalloc.h>
 
 #define CURSOR_CACHE_SIZE 256*1024*1024
+#define DEFAULT_THREADS 6
+#define MAX_THREADS 64
 
 /* =========================================================================================== */
 
-
-int cmp_pchar( const char * a, const char * b )
-{
-    int res = 0;
-    if ( ( a != NULL )&&( b != NULL ) )
-    {
-        size_t len_a = string_size( a );
-        size_t len_b = string_size( b );
-        res = string_cmp ( a, len_a, b, len_b, ( len_a < len_b ) ? len_b : len_a );
-    }
-    return res;
-}
-
-
-/* =========================================================================================== */
-
-
-static range * make_range( const uint64_t start, const uint64_t end )
-{
-    range *res = calloc( sizeof *res, 1 );
-    if ( res != NULL )
-    {
-        res->start = start;
-        res->end = end;
-    }
-    return res;
-}
-
-
-static int cmp_range( const range * a, const range * b )
-{
-
-    int res = ( a->start - b->start );
-    if ( res == 0 )
-        res = ( a->end - b->end );
-    return res;
-}
-
-
-static bool range_overlapp( const range * a, const range * b )
-{
-    return ( !( ( b->end < a->start ) || ( b->start > a->end ) ) );
-}
-
-
-/* =========================================================================================== */
-
-
-static reference_region * make_reference_region( const char *name )
-{
-    reference_region *res = calloc( sizeof *res, 1 );
-    if ( res != NULL )
-    {
-        res->name = string_dup_measure ( name, NULL );
-        if ( res->name == NULL )
-        {
-            free( res );
-            res = NULL;
-        }
-        else
-            VectorInit ( &res->ranges, 0, 5 );
-    }
-    return res;
-}
-
-
-static int CC cmp_range_wrapper( const void *item, const void *n )
-{   return cmp_range( item, n ); }
-
-
-static rc_t add_ref_region_range( reference_region * self, const uint64_t start, const uint64_t end )
-{
-    rc_t rc = 0;
-    range *r = make_range( start, end );
-    if ( r == NULL )
-        rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
-    else
-    {
-        rc = VectorInsert ( &self->ranges, r, NULL, cmp_range_wrapper );
-        if ( rc != 0 )
-            free( r );
-    }
-    return rc;
-}
-
-
-#define RR_NAME  1
-#define RR_START 2
-#define RR_END   3
-
-
-static void put_c( char *s, size_t size, size_t *dst, char c )
-{
-    if ( *dst < ( size - 1 ) )
-        s[ *dst ] = c;
-    (*dst)++;
-}
-
-static void finish_txt( char *s, size_t size, size_t *dst )
-{
-    if ( *dst > size )
-        s[ size - 1 ] = 0;
-    else
-        s[ *dst ] = 0;
-    *dst = 0;
-}
-
-static uint64_t finish_num( char *s, size_t size, size_t *dst )
-{
-    uint64_t res = 0;
-    char *endp;
-    finish_txt( s, size, dst );
-    res = strtou64( s, &endp, 10 );
-    return res;
-}
-
-
-/* s = refname:1000-2000 */
-static void parse_definition( const char *s, char * name, size_t len,
-                              uint64_t *start, uint64_t *end )
-{
-    size_t n = string_size( s );
-
-    *start = 0;
-    *end   = 0;
-    name[ 0 ] = 0;
-    if ( n > 0 )
-    {
-        size_t i, st, dst = 0;
-        char tmp[ 32 ];
-        st = RR_NAME;
-        for ( i = 0; i < n; ++i )
-        {
-            char c = s[ i ];
-            switch( st )
-            {
-                case RR_NAME  : if ( c == ':' )
-                                {
-                                    finish_txt( name, len, &dst );
-                                    st = RR_START;
-                                }
-                                else
-                                {
-                                    put_c( name, len, &dst, c );
-                                }
-                                break;
-
-                case RR_START : if ( c == '-' )
-                                {
-                                    *start = finish_num( tmp, sizeof tmp, &dst );
-                                    st = RR_END;
-                                }
-                                else if ( ( c >= '0' )&&( c <= '9' ) )
-                                {
-                                    put_c( tmp, sizeof tmp, &dst, c );
-                                }
-                                break;
-
-                case RR_END   : if ( ( c >= '0' )&&( c <= '9' ) )
-                                {
-                                    put_c( tmp, sizeof tmp, &dst, c );
-                                }
-                                break;
-            }
-        }
-        switch( st )
-        {
-            case RR_NAME  : finish_txt( name, len, &dst );
-                            break;
-
-            case RR_START : *start = finish_num( tmp, sizeof tmp, &dst );
-                            break;
-
-            case RR_END   : *end = finish_num( tmp, sizeof tmp, &dst );
-                            break;
-        }
-    }
-}
-
-
-static void CC release_range_wrapper( void * item, void * data )
-{
-    free( item );
-}
-
-
-static void free_reference_region( reference_region * self )
-{
-    free( (void*)self->name );
-    VectorWhack ( &self->ranges, release_range_wrapper, NULL );
-    free( self );
-}
-
-
-static void check_ref_region_ranges( reference_region * self )
-{
-    uint32_t n = VectorLength( &self->ranges );
-    uint32_t i = 0;
-    range *a = NULL;
-    while ( i < n )
-    {
-        range *b = VectorGet ( &self->ranges, i );
-        bool remove = false;
-        if ( a != NULL )
-        {
-            remove = range_overlapp( a, b );
-            if ( remove )
-            {
-                range *r;
-                a->end = b->end;
-                VectorRemove ( &self->ranges, i, (void**)&r );
-                free( r );
-                n--;
-            }
-        }
-        if ( !remove )
-        {
-            a = b;
-            ++i;
-        }
-    }
-}
-
-
-/* =========================================================================================== */
-
-
-static int CC reference_vs_pchar_wrapper( const void *item, const BSTNode *n )
-{
-    const reference_region * r = ( const reference_region * )n;
-    return cmp_pchar( (const char *)item, r->name );
-}
-
-static reference_region * find_reference_region( BSTree * regions, const char * name )
-{
-    return ( reference_region * ) BSTreeFind ( regions, name, reference_vs_pchar_wrapper );
-}
-
-
-typedef struct frrl
-{
-    const char * name;
-    size_t len;
-} frrl;
-
-
-static int cmp_pchar_vs_len( const char * a, const char * b, size_t len_b )
-{
-    int res = 0;
-    if ( ( a != NULL )&&( b != NULL ) )
-    {
-        size_t len_a = string_size( a );
-        res = string_cmp ( a, len_a, b, len_b, ( len_a < len_b ) ? len_b : len_a );
-    }
-    return res;
-}
-
-static int CC reference_vs_frr_wrapper( const void *item, const BSTNode *n )
-{
-    const reference_region * r = ( const reference_region * )n;
-    const frrl * ctx = item;
-    return cmp_pchar_vs_len( r->name, ctx->name, ctx->len );
-}
-
-static reference_region * find_reference_region_len( BSTree * regions, const char * name, size_t len )
-{
-    frrl ctx;
-    ctx.name = name;
-    ctx.len  = len;
-    return ( reference_region * ) BSTreeFind ( regions, &ctx, reference_vs_frr_wrapper );
-}
-
-
-static int CC ref_vs_ref_wrapper( const BSTNode *item, const BSTNode *n )
-{
-   const reference_region * a = ( const reference_region * )item;
-   const reference_region * b = ( const reference_region * )n;
-   return cmp_pchar( a->name, b->name );
-}
-
-static rc_t add_refrange( BSTree * regions, const char * name, const uint64_t start, const uint64_t end )
-{
-    rc_t rc;
-
-    reference_region * r = find_reference_region( regions, name );
-    if ( r == NULL )
-    {
-        r = make_reference_region( name );
-        if ( r == NULL )
-            rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
-        else
-            rc = add_ref_region_range( r, start, end );
-        if ( rc == 0 )
-            rc = BSTreeInsert ( regions, (BSTNode *)r, ref_vs_ref_wrapper );
-        if ( rc != 0 )
-            free_reference_region( r );
-    }
-    else
-    {
-        rc = add_ref_region_range( r, start, end );
-    }
-    return rc;
-}
-
-
-static rc_t parse_and_add_region( BSTree * regions, const char * s )
-{
-    rc_t rc = 0;
-    uint64_t start, end;
-    char name[ 64 ];
-    parse_definition( s, name, sizeof name, &start, &end );
-    if ( name[ 0 ] == 0 )
-        rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
-    else
-    {
-        uint64_t start_0based = ( start > 0 ) ? start - 1 : 0;
-        uint64_t end_0based = ( end > 0 ) ? end - 1 : 0;
-        if ( end_0based != 0 && end_0based < start_0based )
-        {
-            uint64_t temp = end_0based;
-            end_0based = start_0based;
-            start_0based = temp;
-        }
-        rc = add_refrange( regions, name, start_0based, end_0based );
-    }
-    return rc;
-}
-
-
-static void CC check_refrange_wrapper( BSTNode *n, void *data )
-{
-    check_ref_region_ranges( ( reference_region * ) n );
-}
-
-
-static void check_ref_regions( BSTree * regions )
-{
-    BSTreeForEach ( regions, false, check_refrange_wrapper, NULL );
-}
-
-
-static void CC release_ref_region_wrapper( BSTNode *n, void * data )
-{
-    free_reference_region( ( reference_region * ) n );
-}
-
-
-static void free_ref_regions( BSTree * regions )
-{    
-    BSTreeWhack ( regions, release_ref_region_wrapper, NULL );
-}
-
-
-static void CC count_ref_region_wrapper( BSTNode *n, void *data )
-{   
-    reference_region * r = ( reference_region * ) n;
-    uint32_t * count = ( uint32_t * ) data;
-    *count += VectorLength( &(r->ranges) );
-}
-
-
-static uint32_t count_ref_regions( BSTree * regions )
-{
-    uint32_t res = 0;
-    BSTreeForEach ( regions, false, count_ref_region_wrapper, &res );
-    return res;
-}
-
-
-/* =========================================================================================== */
-
-
-static void CC foreach_reference_wrapper( BSTNode *n, void *data )
-{   
-    reference_region * r = ( reference_region * ) n;
-    foreach_reference_func * func = ( foreach_reference_func * )data;
-
-    if ( func->rc == 0 )
-        func->rc = func->on_reference( r->name, &(r->ranges), func->data );
-}
-
-
-rc_t foreach_reference( BSTree * regions,
-    rc_t ( CC * on_reference ) ( const char * name, Vector *ranges, void *data ), 
-    void *data )
-{
-    foreach_reference_func func;
-
-    func.on_reference = on_reference;
-    func.data = data;
-    func.rc = 0;
-    BSTreeForEach ( regions, false, foreach_reference_wrapper, &func );
-    return func.rc;
-}
-
-
-/* =========================================================================================== */
-
-/* s = 1000-2000 */
-static void parse_matepair_definition( const char *s, uint64_t *start, uint64_t *end )
-{
-    size_t n = string_size( s );
-    if ( n > 0 )
-    {
-        size_t i, st, dst = 0;
-        char tmp[ 32 ];
-        st = RR_START;
-        for ( i = 0; i < n; ++i )
-        {
-            char c = s[ i ];
-            switch( st )
-            {
-                case RR_START : if ( c == '-' )
-                                {
-                                    *start = finish_num( tmp, sizeof tmp, &dst );
-                                    st = RR_END;
-                                }
-                                else if ( ( c >= '0' )&&( c <= '9' ) )
-                                {
-                                    put_c( tmp, sizeof tmp, &dst, c );
-                                }
-                                break;
-
-                case RR_END   : if ( ( c >= '0' )&&( c <= '9' ) )
-                                {
-                                    put_c( tmp, sizeof tmp, &dst, c );
-                                }
-                                break;
-            }
-        }
-        switch( st )
-        {
-            case RR_START : *start = finish_num( tmp, sizeof tmp, &dst );
-                            break;
-
-            case RR_END   : *end = finish_num( tmp, sizeof tmp, &dst );
-                            break;
-        }
-    }
-}
-
-
-static rc_t parse_and_add_matepair_dist( Vector * dist_vector, const char * s )
-{
-    rc_t rc = 0;
-    uint64_t start = 0, end = 0;
-    range *r;
-
-    if ( cmp_pchar( s, "unknown" ) != 0 )
-        parse_matepair_definition( s, &start, &end );
-
-    r = make_range( start, end );
-    if ( r == NULL )
-    {
-        rc = RC( rcExe, rcNoTarg, rcValidating, rcMemory, rcExhausted );
-        (void)LOGERR( klogErr, rc, "error storing matepair-distance" );
-    }
-    else
-    {
-        rc = VectorInsert ( dist_vector, r, NULL, cmp_range_wrapper );
-        if ( rc != 0 )
-            free( r );
-    }
-    return rc;
-}
-
-
 bool filter_by_matepair_dist( const samdump_opts * opts, int32_t tlen )
 {
     bool res = false;
@@ -738,6 +273,31 @@ static rc_t gather_flag_options( Args * args, samdump_opts * opts )
     }
 
 
+    {
+        bool bgzf, bam;
+
+        /* do we have to compress the output in bgzf-blocks ? */
+        rc = get_bool_option( args, OPT_BGZF, &bgzf );
+        if ( rc != 0 ) return rc;
+
+        /* do we have to write binary records ( they are always in bgzf-blocks ) ? */
+        rc = get_bool_option( args, OPT_BAM, &bam );
+        if ( rc != 0 ) return rc;
+
+        if ( ( bgzf || bam ) && opts->output_compression != oc_none )
+        {
+            rc = RC( rcExe, rcNoTarg, rcValidating, rcParam, rcInvalid );
+            (void)PLOGERR( klogErr, ( klogErr, rc, "the parameter '--$(p1)' excludes '--$(p2)' and '--$(p3)'",
+                          "p1=%s,p2=%s,p3=%s", bam ? OPT_BAM : OPT_BGZF, OPT_GZIP, OPT_BZIP2 ) );
+            return rc;
+        }
+        if ( bgzf || bam )
+            opts->output_compression = oc_bgzf;
+        if ( bam )
+            opts->output_format = of_bam;
+    }
+
+
     {
         bool fasta, fastq;
 
@@ -745,6 +305,13 @@ static rc_t gather_flag_options( Args * args, samdump_opts * opts )
         /* output in FASTQ - mode  ? */
         rc = gather_2_bool( args, OPT_FASTA, OPT_FASTQ, &fasta, &fastq );
         if ( rc != 0 ) return rc;
+        if ( ( fasta || fastq ) && opts->output_format == of_bam )
+        {
+            rc = RC( rcExe, rcNoTarg, rcValidating, rcParam, rcInvalid );
+            (void)PLOGERR( klogErr, ( klogErr, rc, "the parameters '--$(p1)' and '--$(p2)' are mutually exclusive",
+                          "p1=%s,p2=%s", OPT_BAM, fasta ? OPT_FASTA : OPT_FASTQ ) );
+            return rc;
+        }
         if ( fasta )
             opts->output_format = of_fasta;
         if ( fastq )
@@ -920,6 +487,14 @@ static rc_t gather_int_options( Args * args, samdump_opts * opts )
             opts->cursor_cache_size = ( size_t )cs;
     }
 
+    if ( rc == 0 )
+    {
+        uint32_t mb;
+        rc = get_uint32_option( args, OPT_MATECACHE_SIZE, 0, &mb, false );
+        if ( rc == 0 )
+            opts->matecache_size = ( size_t )mb * 1024 * 1024;
+    }
+
     if ( rc == 0 )
     {
         uint32_t mode;
@@ -935,6 +510,23 @@ static rc_t gather_int_options( Args * args, samdump_opts * opts )
         }
     }
 
+    if ( rc == 0 )
+    {
+        rc = get_uint32_option( args, OPT_THREADS, DEFAULT_THREADS, &opts->num_threads, false );
+        if ( rc == 0 && opts->num_threads > MAX_THREADS )
+            opts->num_threads = MAX_THREADS;
+    }
+
+    if ( rc == 0 )
+    {
+        rc = get_uint32_option( args, OPT_BGZF_LEVEL, 6, &opts->bgzf_level, false );
+        if ( rc == 0 && opts->bgzf_level > 9 )
+        {
+            rc = RC( rcExe, rcArgv, rcProcessing, rcParam, rcInvalid );
+            (void)PLOGERR( klogErr, ( klogErr, rc, "option '$(t)' has to be 0...9", "t=%s", OPT_BGZF_LEVEL ) );
+        }
+    }
+
     if ( rc == 0 )
         rc = get_int32_options( args, OPT_MIN_MAPQ, &opts->min_mapq, &opts->use_min_mapq );
 
@@ -1140,6 +732,39 @@ static rc_t gather_string_options( Args * args, samdump_opts * opts )
         yes         |       yes         |   fa  ha  hu
 
 *********************************************************************************************/
+/* the binary records are written for the aligned reads only, in the slices of the references */
+static rc_t check_bam_options( samdump_opts * opts )
+{
+    rc_t rc = 0;
+    const char * excluded = NULL;
+    if ( opts->dump_unaligned_reads )
+        excluded = OPT_UNALIGNED;
+    else if ( opts->dump_unaligned_only )
+        excluded = OPT_UNALIGNED_ONLY;
+    else if ( opts->dump_cg_evidence )
+        excluded = OPT_CG_EVIDENCE;
+    else if ( opts->dump_cg_ev_dnb )
+        excluded = OPT_CG_EV_DNB;
+    else if ( opts->dump_cg_sam )
+        excluded = OPT_CG_SAM;
+    else if ( opts->header_mode == hm_none )
+        excluded = OPT_NO_HDR;  /* the references of the records are looked up in the header */
+    if ( excluded != NULL )
+    {
+        rc = RC( rcExe, rcNoTarg, rcValidating, rcParam, rcUnsupported );
+        (void)PLOGERR( klogErr, ( klogErr, rc, "the parameters '--$(p1)' and '--$(p2)' are mutually exclusive",
+                      "p1=%s,p2=%s", OPT_BAM, excluded ) );
+    }
+    else
+    {
+        /* no unaligned mates are written, they do not have to be cached */
+        opts->print_half_unaligned_reads = false;
+        opts->print_fully_unaligned_reads = false;
+    }
+    return rc;
+}
+
+
 static void gather_unaligned_options( samdump_opts * opts )
 {
     if ( opts->region_count == 0 )
@@ -1162,6 +787,28 @@ static void gather_unaligned_options( samdump_opts * opts )
     }
 }
 
+
+/* the quality-dumpers translate every byte with one lookup, quantized or not */
+static void make_quality_tables( samdump_opts * opts )
+{
+    uint32_t i;
+    bool quantize = ( opts->qual_quant != NULL );
+    for ( i = 0; i < 256; ++i )
+    {
+        uint8_t qual = ( uint8_t )i;
+        if ( quantize )
+            qual = opts->qual_quant_matrix[ qual ];
+        opts->qual_2_ascii[ i ] = ( uint8_t )( qual + 33 );
+    }
+    for ( i = 0; i < 256; ++i )
+    {
+        if ( quantize )
+            opts->qual_33_2_ascii[ i ] = opts->qual_2_ascii[ ( uint8_t )( i - 33 ) ];
+        else
+            opts->qual_33_2_ascii[ i ] = ( uint8_t )i;
+    }
+}
+
 /* =========================================================================================== */
 
 
@@ -1239,6 +886,7 @@ void report_options( const samdump_opts * opts )
         case oc_none  : KOutMsg( "output-compression    : none\n" ); break;
         case oc_gzip  : KOutMsg( "output-compression    : gzip\n" ); break;
         case oc_bzip2 : KOutMsg( "output-compression    : bzip2\n" ); break;
+        case oc_bgzf  : KOutMsg( "output-compression    : bgzf ( level %u )\n", opts->bgzf_level ); break;
         default       : KOutMsg( "output-compression    : unknown\n" ); break;
     }
 
@@ -1247,6 +895,7 @@ void report_options( const samdump_opts * opts )
         case of_sam   : KOutMsg( "output-format         : SAM\n" ); break;
         case of_fasta : KOutMsg( "output-format         : FASTA\n" ); break;
         case of_fastq : KOutMsg( "output-format         : FASTQ\n" ); break;
+        case of_bam   : KOutMsg( "output-format         : BAM\n" ); break;
         default       : KOutMsg( "output-format         : unknown\n" ); break;
     }
 
@@ -1325,6 +974,7 @@ void report_options( const samdump_opts * opts )
     KOutMsg( "outputfile            : %s\n",  opts->outputfile );
     KOutMsg( "outputbuffer-size     : %u\n",  opts->output_buffer_size );
     KOutMsg( "cursor-cache-size     : %u\n",  opts->cursor_cache_size );
+    KOutMsg( "matecache-size        : %lu\n", opts->matecache_size );
 
     KOutMsg( "use mate-cache        : %s\n",  opts->use_mate_cache ? "YES" : "NO" );
     KOutMsg( "force legacy code     : %s\n",  opts->force_legacy ? "YES" : "NO" );
@@ -1334,7 +984,8 @@ void report_options( const samdump_opts * opts )
     KOutMsg( "rna-splice-level      : %u\n",  opts->rna_splice_level );
     KOutMsg( "rna-splice-log        : %s\n",  opts->rna_splice_log_file );
 
-    KOutMsg( "multithreading        : %s\n",  opts->no_mt ? "NO" : "YES" );    
+    KOutMsg( "multithreading        : %s\n",  opts->no_mt ? "NO" : "YES" );
+    KOutMsg( "threads               : %u\n",  opts->num_threads );    
 
 #if _DEBUGGING
     if ( opts->timing_file != NULL )
@@ -1375,7 +1026,7 @@ void release_options( samdump_opts * opts )
 
     VNamelistRelease( opts->hdr_comments );
     VNamelistRelease( opts->input_files );
-    VectorWhack ( &opts->mp_dist, release_range_wrapper, NULL );
+    free_ranges( &opts->mp_dist );
 }
 
 /* =========================================================================================== */
@@ -1394,6 +1045,10 @@ rc_t gather_options( Args * args, samdump_opts * opts )
         rc = gather_matepair_distances( args, opts );
     if ( rc == 0 )
         gather_unaligned_options( opts );
+    if ( rc == 0 && opts->output_format == of_bam )
+        rc = check_bam_options( opts );
+    if ( rc == 0 )
+        make_quality_tables( opts );
     return rc;
 }
 
@@ -1423,7 +1078,7 @@ bool is_this_alignment_requested( const samdump_opts * opts, const char *refname
 }
 
 
-rc_t dump_name( const samdump_opts * opts, int64_t seq_spot_id,
+rc_t dump_name( const samdump_opts * opts, struct dyn_string * out, int64_t seq_spot_id,
                 const char * spot_group, uint32_t spot_group_len )
 {
     rc_t rc;
@@ -1431,9 +1086,9 @@ rc_t dump_name( const samdump_opts * opts, int64_t seq_spot_id,
     if ( opts->print_cg_names )
     {
         if ( spot_group != NULL && spot_group_len != 0 )
-            rc = KOutMsg( "%.*s-1:%lu", spot_group_len, spot_group, seq_spot_id );
+            rc = out_2_dyn_string( out, "%.*s-1:%lu", spot_group_len, spot_group, seq_spot_id );
         else
-            rc = KOutMsg( "%lu", seq_spot_id );
+            rc = out_2_dyn_string( out, "%lu", seq_spot_id );
     }
     else
     {
@@ -1441,19 +1096,19 @@ rc_t dump_name( const samdump_opts * opts, int64_t seq_spot_id,
         {
             /* we do have to print a prefix */
             if ( opts->print_spot_group_in_name && spot_group != NULL && spot_group_len > 0 )
-                rc = KOutMsg( "%s.%lu.%.*s", opts->qname_prefix, seq_spot_id, spot_group_len, spot_group );
+                rc = out_2_dyn_string( out, "%s.%lu.%.*s", opts->qname_prefix, seq_spot_id, spot_group_len, spot_group );
             else
             /* we do NOT have to append the spot-group */
-                rc = KOutMsg( "%s.%lu", opts->qname_prefix, seq_spot_id );
+                rc = out_2_dyn_string( out, "%s.%lu", opts->qname_prefix, seq_spot_id );
         }
         else
         {
             /* we do NOT have to print a prefix */
             if ( opts->print_spot_group_in_name && spot_group != NULL && spot_group_len > 0 )
-                rc = KOutMsg( "%lu.%.*s", seq_spot_id, spot_group_len, spot_group );
+                rc = out_2_dyn_string( out, "%lu.%.*s", seq_spot_id, spot_group_len, spot_group );
             else
             /* we do NOT have to append the spot-group */
-                rc = KOutMsg( "%lu", seq_spot_id );
+                rc = out_2_dyn_string( out, "%lu", seq_spot_id );
         }
     }
     return rc;
@@ -1595,7 +1250,16 @@ rc_t dump_quality( const samdump_opts * opts, char const *quality, uint32_t qual
 }
 
 
-rc_t dump_quality_33( const samdump_opts * opts, char const *quality, uint32_t qual_len, bool reverse )
+static rc_t write_quality( struct dyn_string * out, const char * buffer, size_t size )
+{
+    if ( out == NULL )
+        return KOutMsg( "%.*s", ( uint32_t ) size, buffer );
+    return add_buf_2_dyn_string( out, buffer, size );
+}
+
+
+rc_t dump_quality_33( const samdump_opts * opts, struct dyn_string * out,
+                      char const *quality, uint32_t qual_len, bool reverse )
 {
     uint32_t i;
     rc_t rc = 0;
@@ -1614,7 +1278,7 @@ rc_t dump_quality_33( const samdump_opts * opts, char const *quality, uint32_t q
                 buffer [ size ] = ( opts->qual_quant_matrix[ qual ] + 33 );
                 if ( ++ size == sizeof buffer )
                 {
-                    rc = KOutMsg( "%.*s", ( uint32_t ) size, buffer );
+                    rc = write_quality( out, buffer, size );
                     if ( rc != 0 )
                         break;
                     size = 0;
@@ -1628,7 +1292,7 @@ rc_t dump_quality_33( const samdump_opts * opts, char const *quality, uint32_t q
                 buffer [ size ] = quality[ qual_len - i - 1 ];
                 if ( ++ size == sizeof buffer )
                 {
-                    rc = KOutMsg( "%.*s", ( uint32_t ) size, buffer );
+                    rc = write_quality( out, buffer, size );
                     if ( rc != 0 )
                         break;
                     size = 0;
@@ -1646,7 +1310,7 @@ rc_t dump_quality_33( const samdump_opts * opts, char const *quality, uint32_t q
                 buffer [ size ] = opts->qual_quant_matrix[ qual ] + 33;
                 if ( ++ size == sizeof buffer )
                 {
-                    rc = KOutMsg( "%.*s", ( uint32_t ) size, buffer );
+                    rc = write_quality( out, buffer, size );
                     if ( rc != 0 )
                         break;
                     size = 0;
@@ -1656,12 +1320,89 @@ rc_t dump_quality_33( const samdump_opts * opts, char const *quality, uint32_t q
         }
         else
         {
-            rc = KOutMsg( "%.*s", qual_len, quality );
+            rc = write_quality( out, quality, qual_len );
         }
     }
 
     if ( rc == 0 && size != 0 )
-        rc = KOutMsg( "%.*s", ( uint32_t ) size, buffer );
+        rc = write_quality( out, buffer, size );
 
     return rc;
 }
+
+
+/* room for a 64-bit number and the separators around it */
+#define NAME_NUMBER_CHARS 24
+
+rc_t dump_name_2_out_buf( const samdump_opts * opts, out_buf * out, int64_t seq_spot_id,
+                          const char * spot_group, uint32_t spot_group_len )
+{
+    rc_t rc;
+    size_t prefix_len = 0;
+    bool with_spot_group = ( spot_group != NULL && spot_group_len > 0 );
+
+    if ( !opts->print_cg_names )
+    {
+        with_spot_group = ( with_spot_group && opts->print_spot_group_in_name );
+        if ( opts->qname_prefix != NULL )
+            prefix_len = string_size( opts->qname_prefix );
+    }
+    if ( !with_spot_group )
+        spot_group_len = 0;
+
+    rc = reserve_out_buf( out, prefix_len + spot_group_len + NAME_NUMBER_CHARS );
+    if ( rc == 0 )
+    {
+        if ( opts->print_cg_names )
+        {
+            /* "spotgroup-1:spotid" or "spotid" */
+            if ( with_spot_group )
+            {
+                out_buf_mem( out, spot_group, spot_group_len );
+                out_buf_mem( out, "-1:", 3 );
+            }
+            out_buf_u64( out, ( uint64_t )seq_spot_id );
+        }
+        else
+        {
+            /* "prefix.spotid.spotgroup", prefix and spotgroup are optional */
+            if ( opts->qname_prefix != NULL )
+            {
+                out_buf_mem( out, opts->qname_prefix, prefix_len );
+                out_buf_char( out, '.' );
+            }
+            out_buf_u64( out, ( uint64_t )seq_spot_id );
+            if ( with_spot_group )
+            {
+                out_buf_char( out, '.' );
+                out_buf_mem( out, spot_group, spot_group_len );
+            }
+        }
+    }
+    return rc;
+}
+
+
+rc_t dump_quality_2_out_buf( const samdump_opts * opts, out_buf * out,
+                             char const *quality, uint32_t qual_len, bool reverse )
+{
+    rc_t rc = reserve_out_buf( out, qual_len );
+    if ( rc == 0 )
+        out_buf_translate( out, opts->qual_2_ascii, quality, qual_len, reverse );
+    return rc;
+}
+
+
+rc_t dump_quality_33_2_out_buf( const samdump_opts * opts, out_buf * out,
+                                char const *quality, uint32_t qual_len, bool reverse )
+{
+    rc_t rc = reserve_out_buf( out, qual_len );
+    if ( rc == 0 )
+    {
+        if ( !reverse && opts->qual_quant == NULL )
+            out_buf_mem( out, quality, qual_len );
+        else
+            out_buf_translate( out, opts->qual_33_2_ascii, quality, qual_len, reverse );
+    }
+    return rc;
+}
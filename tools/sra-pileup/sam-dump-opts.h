@@ -45,6 +45,9 @@ extern "C" {
 #include <kapp/args.h>
 #include "perf_log.h"
 #include "rna_splice_log.h"
+#include "dyn_string.h"
+#include "out_buf.h"
+#include "sam-dump-regions.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -76,6 +79,9 @@ extern "C" {
 #define OPT_Q_QUANT     "qual-quant"
 #define OPT_GZIP        "gzip"
 #define OPT_BZIP2       "bzip2"
+#define OPT_BGZF        "bgzf"
+#define OPT_BGZF_LEVEL  "bgzf-level"
+#define OPT_BAM         "bam"
 #define OPT_FASTQ       "fastq"
 #define OPT_FASTA       "fasta"
 #define OPT_HDR_COMMENT "header-comment"
@@ -91,29 +97,16 @@ extern "C" {
 #define OPT_DUMP_MODE   "dump-mode"
 #define OPT_MIN_MAPQ    "min-mapq"
 #define OPT_NO_MATE_CACHE "no-mate-cache"
+#define OPT_MATECACHE_SIZE "matecache-size"
 #define OPT_LEGACY      "legacy"
 #define OPT_NEW         "new"
 #define OPT_RNA_SPLICE  "rna-splicing"
 #define OPT_RNA_SPLICEL "rna-splice-level"
 #define OPT_RNA_SPLICE_LOG "rna-splice-log"
 #define OPT_NO_MT       "disable-multithreading"
+#define OPT_THREADS     "threads"
 #define OPT_TIMING      "timing"
 
-typedef struct range
-{
-    uint64_t start;
-    uint64_t end;
-} range;
-
-
-typedef struct reference_region
-{
-    BSTNode node;
-    const char * name;      /* the name of the reference */
-    Vector ranges;          /* what regions on this reference */
-} reference_region;
-
-
 enum header_mode
 {
     hm_none = 0,    /* do not dump the headers at all */
@@ -126,14 +119,16 @@ enum output_format
 {
     of_sam = 0,     /* use sam-tools format */
     of_fasta,       /* use fasta-format */
-    of_fastq        /* use fastq-format */
+    of_fastq,       /* use fastq-format */
+    of_bam          /* binary records, compressed with bgzf */
 };
 
 enum output_compression
 {
     oc_none = 0,    /* do not compress output */
     oc_gzip,        /* compress output with gzip */
-    oc_bzip2        /* compress output with bzip2 */
+    oc_bzip2,       /* compress output with bzip2 */
+    oc_bgzf         /* compress output in bgzf-blocks */
 };
 
 enum cigar_treatment
@@ -207,6 +202,15 @@ typedef struct samdump_opts
 
     size_t cursor_cache_size;
 
+    /* max. bytes for the same-reference mate-cache of each input-file, 0...no limit */
+    size_t matecache_size;
+
+    /* how many worker-threads dump the slices of the references */
+    uint32_t num_threads;
+
+    /* the deflate-level of the bgzf-blocks 0...9 */
+    uint32_t bgzf_level;
+
     /* how the sam-headers are treated */
     enum header_mode header_mode;
 
@@ -263,23 +267,12 @@ typedef struct samdump_opts
     bool no_mt;
     
     uint8_t qual_quant_matrix[ 256 ];
-} samdump_opts;
-
-
-typedef struct foreach_reference_func
-{
-    rc_t ( CC * on_reference ) ( const char * name, Vector *ranges, void *data );
-    const char * name;
-    void * data;
-    rc_t rc;
-} foreach_reference_func;
-
 
-rc_t foreach_reference( BSTree * regions,
-    rc_t ( CC * on_reference ) ( const char * name, Vector *ranges, void *data ), 
-    void *data );
+    /* phred-value / phred_33-char to output-char, with quantization applied */
+    uint8_t qual_2_ascii[ 256 ];
+    uint8_t qual_33_2_ascii[ 256 ];
+} samdump_opts;
 
-int cmp_pchar( const char * a, const char * b );
 
 rc_t gather_options( Args * args, samdump_opts * opts );
 void report_options( const samdump_opts * opts );
@@ -290,7 +283,8 @@ bool filter_by_matepair_dist( const samdump_opts * opts, int32_t tlen );
 bool is_this_alignment_requested( const samdump_opts * opts, const char *refname, uint32_t refname_len,
                                   uint64_t start, uint64_t len );
 
-rc_t dump_name( const samdump_opts * opts, int64_t seq_spot_id,
+/* the dump-functions print via KOutMsg() if out is NULL, else they append to out */
+rc_t dump_name( const samdump_opts * opts, struct dyn_string * out, int64_t seq_spot_id,
                 const char * spot_group, uint32_t spot_group_len );
 
 rc_t dump_name_legacy( const samdump_opts * opts, const char * name, size_t name_len,
@@ -298,6 +292,17 @@ rc_t dump_name_legacy( const samdump_opts * opts, const char * name, size_t name
 
 rc_t dump_quality( const samdump_opts * opts, char const *quality, uint32_t qual_len, bool reverse );
 
-rc_t dump_quality_33( const samdump_opts * opts, char const *quality, uint32_t qual_len, bool reverse );
+rc_t dump_quality_33( const samdump_opts * opts, struct dyn_string * out,
+                      char const *quality, uint32_t qual_len, bool reverse );
+
+/* the same, but appending to a record that is formatted in an out_buf */
+rc_t dump_name_2_out_buf( const samdump_opts * opts, out_buf * out, int64_t seq_spot_id,
+                          const char * spot_group, uint32_t spot_group_len );
+
+rc_t dump_quality_2_out_buf( const samdump_opts * opts, out_buf * out,
+                             char const *quality, uint32_t qual_len, bool reverse );
+
+rc_t dump_quality_33_2_out_buf( const samdump_opts * opts, out_buf * out,
+                                char const *quality, uint32_t qual_len, bool reverse );
 
 #endif
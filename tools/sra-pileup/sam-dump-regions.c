@@ -0,0 +1,547 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+
+#include "sam-dump-regions.h"
+
+#include <klib/text.h>
+#include <klib/log.h>
+#include <sysalloc.h>
+
+#include <stdlib.h>
+#include <strtol.h>
+
+/* =========================================================================================== */
+
+
+int cmp_pchar( const char * a, const char * b )
+{
+    int res = 0;
+    if ( ( a != NULL )&&( b != NULL ) )
+    {
+        size_t len_a = string_size( a );
+        size_t len_b = string_size( b );
+        res = string_cmp ( a, len_a, b, len_b, ( len_a < len_b ) ? len_b : len_a );
+    }
+    return res;
+}
+
+
+/* =========================================================================================== */
+
+
+static range * make_range( const uint64_t start, const uint64_t end )
+{
+    range *res = calloc( sizeof *res, 1 );
+    if ( res != NULL )
+    {
+        res->start = start;
+        res->end = end;
+    }
+    return res;
+}
+
+
+static int cmp_range( const range * a, const range * b )
+{
+    /* the coordinates are 64 bit, their difference does not fit into an int */
+    if ( a->start != b->start )
+        return ( a->start < b->start ) ? -1 : 1;
+    if ( a->end != b->end )
+        return ( a->end < b->end ) ? -1 : 1;
+    return 0;
+}
+
+
+/* an end of 0 is open: the range goes up to the end of the reference */
+static uint64_t range_last( const range * r )
+{
+    return ( r->end == 0 ) ? UINT64_MAX : r->end;
+}
+
+
+static bool range_overlapp( const range * a, const range * b )
+{
+    return ( !( ( range_last( b ) < a->start ) || ( b->start > range_last( a ) ) ) );
+}
+
+
+/* =========================================================================================== */
+
+
+static reference_region * make_reference_region( const char *name )
+{
+    reference_region *res = calloc( sizeof *res, 1 );
+    if ( res != NULL )
+    {
+        res->name = string_dup_measure ( name, NULL );
+        if ( res->name == NULL )
+        {
+            free( res );
+            res = NULL;
+        }
+        else
+            VectorInit ( &res->ranges, 0, 5 );
+    }
+    return res;
+}
+
+
+static int CC cmp_range_wrapper( const void *item, const void *n )
+{   return cmp_range( item, n ); }
+
+
+static rc_t add_ref_region_range( reference_region * self, const uint64_t start, const uint64_t end )
+{
+    rc_t rc = 0;
+    range *r = make_range( start, end );
+    if ( r == NULL )
+        rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+    else
+    {
+        rc = VectorInsert ( &self->ranges, r, NULL, cmp_range_wrapper );
+        if ( rc != 0 )
+            free( r );
+    }
+    return rc;
+}
+
+
+#define RR_NAME  1
+#define RR_START 2
+#define RR_END   3
+
+
+static void put_c( char *s, size_t size, size_t *dst, char c )
+{
+    if ( *dst < ( size - 1 ) )
+        s[ *dst ] = c;
+    (*dst)++;
+}
+
+static void finish_txt( char *s, size_t size, size_t *dst )
+{
+    if ( *dst > size )
+        s[ size - 1 ] = 0;
+    else
+        s[ *dst ] = 0;
+    *dst = 0;
+}
+
+static uint64_t finish_num( char *s, size_t size, size_t *dst )
+{
+    uint64_t res = 0;
+    char *endp;
+    finish_txt( s, size, dst );
+    res = strtou64( s, &endp, 10 );
+    return res;
+}
+
+
+/* s = refname:1000-2000 */
+static void parse_definition( const char *s, char * name, size_t len,
+                              uint64_t *start, uint64_t *end )
+{
+    size_t n = string_size( s );
+
+    *start = 0;
+    *end   = 0;
+    name[ 0 ] = 0;
+    if ( n > 0 )
+    {
+        size_t i, st, dst = 0;
+        char tmp[ 32 ];
+        st = RR_NAME;
+        for ( i = 0; i < n; ++i )
+        {
+            char c = s[ i ];
+            switch( st )
+            {
+                case RR_NAME  : if ( c == ':' )
+                                {
+                                    finish_txt( name, len, &dst );
+                                    st = RR_START;
+                                }
+                                else
+                                {
+                                    put_c( name, len, &dst, c );
+                                }
+                                break;
+
+                case RR_START : if ( c == '-' )
+                                {
+                                    *start = finish_num( tmp, sizeof tmp, &dst );
+                                    st = RR_END;
+                                }
+                                else if ( ( c >= '0' )&&( c <= '9' ) )
+                                {
+                                    put_c( tmp, sizeof tmp, &dst, c );
+                                }
+                                break;
+
+                case RR_END   : if ( ( c >= '0' )&&( c <= '9' ) )
+                                {
+                                    put_c( tmp, sizeof tmp, &dst, c );
+                                }
+                                break;
+            }
+        }
+        switch( st )
+        {
+            case RR_NAME  : finish_txt( name, len, &dst );
+                            break;
+
+            case RR_START : *start = finish_num( tmp, sizeof tmp, &dst );
+                            break;
+
+            case RR_END   : *end = finish_num( tmp, sizeof tmp, &dst );
+                            break;
+        }
+    }
+}
+
+
+static void CC release_range_wrapper( void * item, void * data )
+{
+    free( item );
+}
+
+
+void free_ranges( Vector * ranges )
+{
+    VectorWhack ( ranges, release_range_wrapper, NULL );
+}
+
+
+static void free_reference_region( reference_region * self )
+{
+    free( (void*)self->name );
+    VectorWhack ( &self->ranges, release_range_wrapper, NULL );
+    free( self );
+}
+
+
+/* sorts out overlapping ranges: the ranges of a reference are sorted by start and disjoint afterwards,
+   a range of 0..0 ( the whole reference ) replaces all the others */
+static void check_ref_region_ranges( reference_region * self )
+{
+    uint32_t n = VectorLength( &self->ranges );
+    uint32_t i = 0;
+    range *a = NULL;
+    if ( n > 1 )
+    {
+        range *first = VectorGet ( &self->ranges, 0 );
+        if ( first->start == 0 && first->end == 0 )
+        {
+            while ( n > 1 )
+            {
+                range *r;
+                VectorRemove ( &self->ranges, --n, (void**)&r );
+                free( r );
+            }
+        }
+    }
+    while ( i < n )
+    {
+        range *b = VectorGet ( &self->ranges, i );
+        bool remove = false;
+        if ( a != NULL )
+        {
+            remove = range_overlapp( a, b );
+            if ( remove )
+            {
+                range *r;
+                if ( range_last( b ) > range_last( a ) )
+                    a->end = b->end;
+                VectorRemove ( &self->ranges, i, (void**)&r );
+                free( r );
+                n--;
+            }
+        }
+        if ( !remove )
+        {
+            a = b;
+            ++i;
+        }
+    }
+}
+
+
+/* resolves the open ends ( 0 ) to the last position of the reference, the ranges stay sorted and disjoint:
+   after check_ref_regions() only the last range of a reference can be open */
+void resolve_ref_region_ends( reference_region * self, uint64_t ref_len )
+{
+    uint32_t i, n = VectorLength( &self->ranges );
+    for ( i = 0; i < n; ++i )
+    {
+        range *r = VectorGet ( &self->ranges, i );
+        if ( r->end == 0 )
+            r->end = ( ref_len > r->start ) ? ref_len - 1 : r->start;
+    }
+}
+
+
+/* =========================================================================================== */
+
+
+static int CC reference_vs_pchar_wrapper( const void *item, const BSTNode *n )
+{
+    const reference_region * r = ( const reference_region * )n;
+    return cmp_pchar( (const char *)item, r->name );
+}
+
+static reference_region * find_reference_region( BSTree * regions, const char * name )
+{
+    return ( reference_region * ) BSTreeFind ( regions, name, reference_vs_pchar_wrapper );
+}
+
+
+typedef struct frrl
+{
+    const char * name;
+    size_t len;
+} frrl;
+
+
+static int cmp_pchar_vs_len( const char * a, const char * b, size_t len_b )
+{
+    int res = 0;
+    if ( ( a != NULL )&&( b != NULL ) )
+    {
+        size_t len_a = string_size( a );
+        res = string_cmp ( a, len_a, b, len_b, ( len_a < len_b ) ? len_b : len_a );
+    }
+    return res;
+}
+
+static int CC reference_vs_frr_wrapper( const void *item, const BSTNode *n )
+{
+    const reference_region * r = ( const reference_region * )n;
+    const frrl * ctx = item;
+    return cmp_pchar_vs_len( r->name, ctx->name, ctx->len );
+}
+
+reference_region * find_reference_region_len( BSTree * regions, const char * name, size_t len )
+{
+    frrl ctx;
+    ctx.name = name;
+    ctx.len  = len;
+    return ( reference_region * ) BSTreeFind ( regions, &ctx, reference_vs_frr_wrapper );
+}
+
+
+static int CC ref_vs_ref_wrapper( const BSTNode *item, const BSTNode *n )
+{
+   const reference_region * a = ( const reference_region * )item;
+   const reference_region * b = ( const reference_region * )n;
+   return cmp_pchar( a->name, b->name );
+}
+
+static rc_t add_refrange( BSTree * regions, const char * name, const uint64_t start, const uint64_t end )
+{
+    rc_t rc;
+
+    reference_region * r = find_reference_region( regions, name );
+    if ( r == NULL )
+    {
+        r = make_reference_region( name );
+        if ( r == NULL )
+            rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        else
+            rc = add_ref_region_range( r, start, end );
+        if ( rc == 0 )
+            rc = BSTreeInsert ( regions, (BSTNode *)r, ref_vs_ref_wrapper );
+        if ( rc != 0 )
+            free_reference_region( r );
+    }
+    else
+    {
+        rc = add_ref_region_range( r, start, end );
+    }
+    return rc;
+}
+
+
+rc_t parse_and_add_region( BSTree * regions, const char * s )
+{
+    rc_t rc = 0;
+    uint64_t start, end;
+    char name[ 64 ];
+    parse_definition( s, name, sizeof name, &start, &end );
+    if ( name[ 0 ] == 0 )
+        rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+    else
+    {
+        uint64_t start_0based = ( start > 0 ) ? start - 1 : 0;
+        uint64_t end_0based = ( end > 0 ) ? end - 1 : 0;
+        if ( end_0based != 0 && end_0based < start_0based )
+        {
+            uint64_t temp = end_0based;
+            end_0based = start_0based;
+            start_0based = temp;
+        }
+        rc = add_refrange( regions, name, start_0based, end_0based );
+    }
+    return rc;
+}
+
+
+static void CC check_refrange_wrapper( BSTNode *n, void *data )
+{
+    check_ref_region_ranges( ( reference_region * ) n );
+}
+
+
+void check_ref_regions( BSTree * regions )
+{
+    BSTreeForEach ( regions, false, check_refrange_wrapper, NULL );
+}
+
+
+static void CC release_ref_region_wrapper( BSTNode *n, void * data )
+{
+    free_reference_region( ( reference_region * ) n );
+}
+
+
+void free_ref_regions( BSTree * regions )
+{    
+    BSTreeWhack ( regions, release_ref_region_wrapper, NULL );
+}
+
+
+static void CC count_ref_region_wrapper( BSTNode *n, void *data )
+{   
+    reference_region * r = ( reference_region * ) n;
+    uint32_t * count = ( uint32_t * ) data;
+    *count += VectorLength( &(r->ranges) );
+}
+
+
+uint32_t count_ref_regions( BSTree * regions )
+{
+    uint32_t res = 0;
+    BSTreeForEach ( regions, false, count_ref_region_wrapper, &res );
+    return res;
+}
+
+
+/* =========================================================================================== */
+
+
+static void CC foreach_reference_wrapper( BSTNode *n, void *data )
+{   
+    reference_region * r = ( reference_region * ) n;
+    foreach_reference_func * func = ( foreach_reference_func * )data;
+
+    if ( func->rc == 0 )
+        func->rc = func->on_reference( r->name, &(r->ranges), func->data );
+}
+
+
+rc_t foreach_reference( BSTree * regions,
+    rc_t ( CC * on_reference ) ( const char * name, Vector *ranges, void *data ), 
+    void *data )
+{
+    foreach_reference_func func;
+
+    func.on_reference = on_reference;
+    func.data = data;
+    func.rc = 0;
+    BSTreeForEach ( regions, false, foreach_reference_wrapper, &func );
+    return func.rc;
+}
+
+
+/* =========================================================================================== */
+
+/* s = 1000-2000 */
+static void parse_matepair_definition( const char *s, uint64_t *start, uint64_t *end )
+{
+    size_t n = string_size( s );
+    if ( n > 0 )
+    {
+        size_t i, st, dst = 0;
+        char tmp[ 32 ];
+        st = RR_START;
+        for ( i = 0; i < n; ++i )
+        {
+            char c = s[ i ];
+            switch( st )
+            {
+                case RR_START : if ( c == '-' )
+                                {
+                                    *start = finish_num( tmp, sizeof tmp, &dst );
+                                    st = RR_END;
+                                }
+                                else if ( ( c >= '0' )&&( c <= '9' ) )
+                                {
+                                    put_c( tmp, sizeof tmp, &dst, c );
+                                }
+                                break;
+
+                case RR_END   : if ( ( c >= '0' )&&( c <= '9' ) )
+                                {
+                                    put_c( tmp, sizeof tmp, &dst, c );
+                                }
+                                break;
+            }
+        }
+        switch( st )
+        {
+            case RR_START : *start = finish_num( tmp, sizeof tmp, &dst );
+                            break;
+
+            case RR_END   : *end = finish_num( tmp, sizeof tmp, &dst );
+                            break;
+        }
+    }
+}
+
+
+rc_t parse_and_add_matepair_dist( Vector * dist_vector, const char * s )
+{
+    rc_t rc = 0;
+    uint64_t start = 0, end = 0;
+    range *r;
+
+    if ( cmp_pchar( s, "unknown" ) != 0 )
+        parse_matepair_definition( s, &start, &end );
+
+    r = make_range( start, end );
+    if ( r == NULL )
+    {
+        rc = RC( rcExe, rcNoTarg, rcValidating, rcMemory, rcExhausted );
+        (void)LOGERR( klogErr, rc, "error storing matepair-distance" );
+    }
+    else
+    {
+        rc = VectorInsert ( dist_vector, r, NULL, cmp_range_wrapper );
+        if ( rc != 0 )
+            free( r );
+    }
+    return rc;
+}
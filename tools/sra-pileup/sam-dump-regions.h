@@ -0,0 +1,96 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_sam_dump_regions_
+#define _h_sam_dump_regions_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+}
+#endif
+
+#include <klib/container.h>
+#include <klib/vector.h>
+#include <klib/rc.h>
+
+/* the coordinates of a range are 0-based and inclusive,
+   an end of 0 is open: the range goes up to the end of the reference */
+typedef struct range
+{
+    uint64_t start;
+    uint64_t end;
+} range;
+
+
+typedef struct reference_region
+{
+    BSTNode node;
+    const char * name;      /* the name of the reference */
+    Vector ranges;          /* what regions on this reference */
+} reference_region;
+
+
+/* parses "name[:from[-to]]" and adds it to the tree of reference_region's */
+rc_t parse_and_add_region( BSTree * regions, const char * s );
+
+/* sorts and merges the ranges of each reference */
+void check_ref_regions( BSTree * regions );
+
+/* resolves the open ends of the ranges of one reference, given its length */
+void resolve_ref_region_ends( reference_region * self, uint64_t ref_len );
+
+reference_region * find_reference_region_len( BSTree * regions, const char * name, size_t len );
+
+uint32_t count_ref_regions( BSTree * regions );
+void free_ref_regions( BSTree * regions );
+
+typedef struct foreach_reference_func
+{
+    rc_t ( CC * on_reference ) ( const char * name, Vector *ranges, void *data );
+    const char * name;
+    void * data;
+    rc_t rc;
+} foreach_reference_func;
+
+
+rc_t foreach_reference( BSTree * regions,
+    rc_t ( CC * on_reference ) ( const char * name, Vector *ranges, void *data ), 
+    void *data );
+
+int cmp_pchar( const char * a, const char * b );
+
+/* parses "from-to" or "unknown" and adds it to a vector of ranges */
+rc_t parse_and_add_matepair_dist( Vector * dist_vector, const char * s );
+
+void free_ranges( Vector * ranges );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
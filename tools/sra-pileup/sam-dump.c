@@ -75,6 +75,7 @@
 #include <assert.h>
 
 #include "debug.h"
+#include "mate_hash.h"
 /* #include "sam-dump.vers.h" */
 
 #if _ARCH_BITS == 64
@@ -85,7 +86,8 @@
 #define CURSOR_CACHE (256 * 1024 * 1024)
 #endif
 
-rc_t cg_canonical_print_cigar( const char * cigar, size_t cigar_len);
+struct dyn_string;
+rc_t cg_canonical_print_cigar( struct dyn_string * out, const char * cigar, size_t cigar_len);
 
 
 
@@ -200,7 +202,7 @@ typedef struct STable_struct
 
 typedef struct SCursCache_struct
 {
-    KVector* cache;
+    mate_hash cache;
     KVector* cache_unaligned_mate; /* keeps unaligned-mate for a half-aligned spots */
     uint32_t sam_flags;
     INSDC_coord_zero pnext;
@@ -431,7 +433,7 @@ static rc_t Cache_Init( SCursCache* c )
     {
 	rc_t rc;
         memset( c, 0, sizeof( *c ) );
-        rc=KVectorMake( &c->cache );
+        rc=mate_hash_init( &c->cache, 0 );
 	if(rc == 0){
 		rc=KVectorMake( &c->cache_unaligned_mate );
 	}
@@ -444,7 +446,7 @@ static void Cache_Close( char const *name, SCursCache* c )
 {
     if ( c != NULL )
     {
-        KVectorRelease( c->cache );
+        mate_hash_release( &c->cache );
         KVectorRelease( c->cache_unaligned_mate );
         if ( c->added > 0 )
         {
@@ -459,13 +461,14 @@ static void Cache_Close( char const *name, SCursCache* c )
 
 static rc_t Cache_Add( uint64_t key, SCurs const *curs, SCol const *cols )
 {
-    /* compact values for mate record to cache as:
-        pos_delta - 32bit, ref_proj - 11bit, flags - 11bit, rnext_idx - 10bit = 64bit
+    /* values for mate record to cache as 2 x 64bit:
+        a: pos_delta - 32bit, ref_proj - 32bit
+        b: flags - 32bit, rnext_idx - 32bit
     */
     rc_t rc = 0;
     ReferenceObj const *r = NULL;
     uint32_t rid = 0;
-    uint64_t val = 0;
+    bool added = false;
     int64_t mate_id = cols[ alg_MATE_ALIGN_ID ].len > 0 ? cols[ alg_MATE_ALIGN_ID ].base.i64[ 0 ] : 0;
 
     rc = ReferenceList_Find( gRefList, &r, cols[ alg_REF_NAME ].base.str, cols[ alg_REF_NAME ].len );
@@ -485,7 +488,7 @@ static rc_t Cache_Add( uint64_t key, SCurs const *curs, SCol const *cols )
             cols[ alg_TEMPLATE_LEN ].len > 0 ? cols[ alg_TEMPLATE_LEN ].base.i32[ 0 ] : 0));
     }
 #endif
-    if ( rc == 0 && !( rid & 0xFC00 ) )
+    if ( rc == 0 )
     {
         int64_t pos_delta64;
         int32_t pos_delta32;
@@ -539,23 +542,25 @@ static rc_t Cache_Add( uint64_t key, SCurs const *curs, SCol const *cols )
                 ref_proj = cols[ alg_TEMPLATE_LEN ].base.i32[ 0 ] - pos_delta32;
             }
 
-            if ( !( ref_proj & 0xFFFFF800 ) )
+            if ( ref_proj >= 0 && ref_proj <= 0xFFFFFFFF )
             {
-                val = ( pos_delta64 << 32 ) | ( ref_proj << 21 ) | ( cols[ alg_SAM_FLAGS ].base.u32[ 0 ] << 10 ) | rid;
-                rc = KVectorSetU64( curs->cache->cache, key, val );
+                uint64_t a = ( ( uint64_t )( uint32_t )pos_delta32 << 32 ) | ( uint64_t )ref_proj;
+                uint64_t b = ( ( uint64_t )cols[ alg_SAM_FLAGS ].base.u32[ 0 ] << 32 ) | rid;
+                rc = mate_hash_set( &curs->cache->cache, key, a, b );
+                added = ( rc == 0 );
             }
         }
     }
     ReferenceObj_Release( r );
 
 #if _DEBUGGING
-    if ( val == 0 )
+    if ( !added )
     {
         SAM_DUMP_DBG( 10, ( " --> out of range\n" ) );
     }
     else
     {
-        SAM_DUMP_DBG( 10, ( " --> %016lX\n", val ) );
+        SAM_DUMP_DBG( 10, ( " --> added\n" ) );
         curs->cache->added++;
     }
 #endif
@@ -563,20 +568,20 @@ static rc_t Cache_Add( uint64_t key, SCurs const *curs, SCol const *cols )
 }
 
 
-static rc_t Cache_Get( SCurs const *curs, uint64_t key, uint64_t* val )
+/* val[ 0 ]: pos_delta and ref_proj, val[ 1 ]: flags and rnext_idx */
+static rc_t Cache_Get( SCurs const *curs, uint64_t key, uint64_t val[ 2 ] )
 {
-    rc_t rc = KVectorGetU64( curs->cache->cache, key, val );
+    rc_t rc = mate_hash_get( &curs->cache->cache, key, &val[ 0 ], &val[ 1 ] );
     if ( rc == 0 )
     {
-        uint32_t id = ( *val & 0x3FF );
+        uint32_t id = ( uint32_t )( val[ 1 ] & 0xFFFFFFFF );
 #if _DEBUGGING
         curs->cache->hit++;
 #endif
-        KVectorUnset( curs->cache->cache, key );
+        mate_hash_remove( &curs->cache->cache, key );
         rc = ReferenceList_Get( gRefList, &curs->cache->ref, id );
         if ( rc != 0 )
         {
-            *val = 0;
             curs->cache->ref = NULL;
             rc = RC( rcExe, rcNoTarg, rcSearching, rcItem, rcNotFound );
 #if _DEBUGGING
@@ -585,18 +590,18 @@ static rc_t Cache_Get( SCurs const *curs, uint64_t key, uint64_t* val )
         }
         else
         {
-            SAM_DUMP_DBG( 10, ( "from cache row %li %016lX", key, *val ) );
+            SAM_DUMP_DBG( 10, ( "from cache row %li %016lX:%016lX", key, val[ 0 ], val[ 1 ] ) );
         }
     }
     return rc;
 }
 
 
-static void Cache_Unpack( uint64_t val, int64_t mate_id, SCurs const *curs, SCol* cols )
+static void Cache_Unpack( const uint64_t val[ 2 ], int64_t mate_id, SCurs const *curs, SCol* cols )
 {
-    int32_t pos_delta = ( val & 0xFFFFFFFF00000000 ) >> 32;
-    uint32_t ref_proj = ( val & 0x00000000FFE00000 ) >> 21;
-    uint32_t flags = ( val & 0x00000000001FFC00 ) >> 10;
+    int32_t pos_delta = ( int32_t )( val[ 0 ] >> 32 );
+    uint32_t ref_proj = ( uint32_t )( val[ 0 ] & 0xFFFFFFFF );
+    uint32_t flags = ( uint32_t )( val[ 1 ] >> 32 );
 
     if ( mate_id != 0 )
     {
@@ -1087,7 +1092,8 @@ static rc_t Cursor_ReadAlign( SCurs const *curs, int64_t row_id, SCol* cols, uin
     SCol* c = NULL;
     SCol* mate_id = NULL;
 #if USE_MATE_CACHE
-    uint64_t cache_val = 0;
+    uint64_t cache_val[ 2 ];
+    bool cache_hit = false;
     bool cache_miss = false;
 #endif /* USE_MATE_CACHE */
 
@@ -1102,13 +1108,14 @@ static rc_t Cursor_ReadAlign( SCurs const *curs, int64_t row_id, SCol* cols, uin
                 ( idx == alg_SAM_FLAGS || idx == alg_MATE_REF_NAME || idx == alg_MATE_REF_POS || idx == alg_TEMPLATE_LEN ) &&
                 mate_id->idx && mate_id->len > 0 && mate_id->base.i64[ 0 ] > 0 )
             {
-                if ( cache_val != 0 )
+                if ( cache_hit )
                 {
                     continue;
                 }
-                rc = Cache_Get( curs, mate_id->base.u64[ 0 ], &cache_val );
+                rc = Cache_Get( curs, mate_id->base.u64[ 0 ], cache_val );
                 if ( rc == 0 )
                 {
+                    cache_hit = true;
                     continue;
                 }
                 else if ( !( GetRCObject( rc ) == rcItem && GetRCState( rc ) == rcNotFound ) )
@@ -1174,7 +1181,7 @@ static rc_t Cursor_ReadAlign( SCurs const *curs, int64_t row_id, SCol* cols, uin
     else if ( curs->cache == NULL )
     {
     }
-    else if ( cache_val == 0 )
+    else if ( !cache_hit )
     {
         /* this row is not from cache */
         int64_t mate_align_id = ( mate_id != NULL && mate_id->len > 0 ) ? mate_id->base.i64[ 0 ] : 0;
@@ -1561,7 +1568,7 @@ rc_t DumpAlignedSAM( SAM_dump_ctx_t *const ctx,
         }
 	else if(ds->type == edstt_EvidenceAlignment)
 	{
-		rc = cg_canonical_print_cigar(cigar,cigLen);
+		rc = cg_canonical_print_cigar(NULL,cigar,cigLen);
 	}
         else
         {
@@ -1822,6 +1829,26 @@ static rc_t DumpUnalignedReads( SAM_dump_ctx_t *const ctx, SCol const calg_col[]
 }
 
 
+/* the ranges of a region are sorted and disjoint ( GetRegion() ): looks for the first one,
+   that does not end before start_zero */
+static bool RegionRangesOverlap( TAlignedRegion const *rgn, unsigned start_zero, unsigned end_exclusive )
+{
+    unsigned f = 0;
+    unsigned e = rgn->rq;
+
+    while ( f < e )
+    {
+        unsigned const m = ( ( f + e ) / 2 );
+
+        if ( ( unsigned )rgn->r[ m ].to < start_zero )
+            f = m + 1;
+        else
+            e = m;
+    }
+    return ( f < ( unsigned )rgn->rq && ( unsigned )rgn->r[ f ].from < end_exclusive );
+}
+
+
 static bool AlignRegionFilter( SCol const *cols )
 {
     if ( param->region_qty == 0 )
@@ -1840,16 +1867,9 @@ static bool AlignRegionFilter( SCol const *cols )
             {
                 unsigned const refStart_zero = cols[ alg_REF_POS ].base.coord0[ j ];
                 unsigned const refEnd_exclusive = refStart_zero + cols[ alg_REF_LEN ].base.coord_len[ j ];
-                unsigned k;
-                
-                for ( k = 0; k < param->region[ i ].rq; k++ )
-                {
-                    unsigned const from_zero = param->region[ i ].r[ k ].from;
-                    unsigned const to_inclusive = param->region[ i ].r[ k ].to;
-                    
-                    if ( from_zero < refEnd_exclusive && refStart_zero <= to_inclusive )
-                        return true;
-                }
+
+                if ( RegionRangesOverlap( &param->region[ i ], refStart_zero, refEnd_exclusive ) )
+                    return true;
             }
         }
     }
@@ -1887,6 +1907,105 @@ static bool AlignDistanceFilter( SCol const *cols )
 }
 
 
+typedef struct CigOps{
+	char op;
+	int8_t	 ref_sign; /*** 0;+1;-1; ref_offset = ref_sign * offset ***/
+	int8_t	 seq_sign; /*** 0;+1;-1; seq_offset = seq_sign * offset ***/
+	uint32_t oplen;
+} CigOps;
+
+static void SetCigOp(CigOps *dst,char op,uint32_t oplen)
+{
+	dst->op    = op;
+	dst->oplen = oplen;
+	switch(op) { /*MX= DN B IS PH*/
+	 case 'M': case 'X': case '=':
+		dst->ref_sign=+1;
+		dst->seq_sign=+1;
+		break;
+	 case 'D': case 'N':
+		dst->ref_sign=+1;
+                dst->seq_sign= 0;
+                break;
+	 case 'B': 
+		dst->ref_sign=-1;
+                dst->seq_sign= 0;
+                break;
+	 case 'S': case 'I':
+		dst->ref_sign= 0;
+                dst->seq_sign=+1;
+                break;
+	 case 'P': case 'H':
+	  case 0: /** terminating op **/
+		dst->ref_sign= 0;
+                dst->seq_sign= 0;
+                break;
+	  default:
+		assert(0);
+                break;
+	}
+}
+
+/* "00" ... "99": CG-operations are almost always shorter than 100, these take a single lookup */
+static char const two_digits[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* longest text of one cigar-operation: 10 digits and the op-code */
+#define CIG_OP_CHARS 11
+
+static unsigned FormatCigOp( char dst[], uint32_t oplen, char op )
+{
+    unsigned n;
+    
+    if ( oplen < 10 )
+    {
+        dst[ 0 ] = ( char )( '0' + oplen );
+        n = 1;
+    }
+    else if ( oplen < 100 )
+    {
+        dst[ 0 ] = two_digits[ oplen * 2 ];
+        dst[ 1 ] = two_digits[ oplen * 2 + 1 ];
+        n = 2;
+    }
+    else
+    {
+        char tmp[ CIG_OP_CHARS ];
+        unsigned i = 0;
+        
+        while ( oplen > 0 )
+        {
+            tmp[ i++ ] = ( char )( '0' + ( oplen % 10 ) );
+            oplen /= 10;
+        }
+        for ( n = 0; i > 0; ++n )
+            dst[ n ] = tmp[ --i ];
+    }
+    dst[ n++ ] = op;
+    return n;
+}
+
+/* dst has to have room for CIG_OP_CHARS per operation */
+static unsigned FormatCigOps( char dst[], CigOps const ops[], unsigned n_ops )
+{
+    unsigned i;
+    unsigned j;
+    
+    for ( i = j = 0; i < n_ops; ++i )
+        j += FormatCigOp( &dst[ j ], ops[ i ].oplen, ops[ i ].op );
+    return j;
+}
+
+
 typedef struct cgOp_s
 {
     uint16_t length;
@@ -2226,10 +2345,15 @@ static rc_t CIGAR_to_CG_Ops( cgOp op[], unsigned const maxOps,
 }
 
 
-static rc_t GenerateCGData( SCol cols[], unsigned style )
+/* if ops is not NULL it receives the generated cigar as binary operations ( room for 35 ),
+   *n_ops stays 0 if the cigar is left as it is */
+static rc_t GenerateCGData( SCol cols[], unsigned style, CigOps ops[], unsigned *n_ops )
 {
     rc_t rc = 0;
     
+    if ( n_ops != NULL )
+        *n_ops = 0;
+
     memset( &cols[ alg_CG_TAGS_STR], 0, sizeof( cols[ alg_CG_TAGS_STR ] ) );
     
     if ( cols[ alg_READ ].len == 35 && cols[ alg_SAM_QUALITY ].len == 35 )
@@ -2238,6 +2362,8 @@ static rc_t GenerateCGData( SCol cols[], unsigned style )
         static int32_t newEditDistance;
         unsigned gap[ 3 ] = { 0, 0, 0 };
         cgOp cigOp[ 35 ];
+        CigOps local_ops[ 35 ];
+        CigOps *const dst = ops != NULL ? ops : local_ops;
         unsigned opCnt;
         unsigned i;
         unsigned j;
@@ -2361,18 +2487,6 @@ static rc_t GenerateCGData( SCol cols[], unsigned style )
         {
         PRINT_CIGAR:
         CLEAN_CIGAR:
-            print_CG_cigar( __LINE__, cigOp, opCnt, NULL );
-            /* remove zero length ops */
-            for ( j = i = 0; i < opCnt; )
-            {
-                if ( cigOp[ j ].length == 0)
-                {
-                    ++j;
-                    --opCnt;
-                    continue;
-                }
-                cigOp[ i++ ] = cigOp[ j++ ];
-            }
             print_CG_cigar( __LINE__, cigOp, opCnt, NULL );
             if ( cols[ alg_EDIT_DISTANCE ].len )
             {
@@ -2384,23 +2498,20 @@ static rc_t GenerateCGData( SCol cols[], unsigned style )
                 cols[ alg_EDIT_DISTANCE ].base.v = &newEditDistance;
                 cols[ alg_EDIT_DISTANCE ].len = 1;
             }
-            /* merge adjacent ops */
-            for ( i = opCnt; i > 1; )
+            /* remove zero length ops and merge adjacent ops in one pass, straight into the binary cigar */
+            for ( i = j = 0; i < opCnt; ++i )
             {
-                --i;
-                if ( cigOp[ i - 1 ].code == cigOp[ i ].code )
+                if ( cigOp[ i ].length > 0 )
                 {
-                    cigOp[ i - 1 ].length += cigOp[ i ].length;
-                    memmove( &cigOp[ i ], &cigOp[ i + 1 ], ( opCnt - 1 - i ) * sizeof( cigOp[ 0 ] ) );
-                    --opCnt;
+                    if ( j > 0 && dst[ j - 1 ].op == cigOp[ i ].code )
+                        dst[ j - 1 ].oplen += cigOp[ i ].length;
+                    else
+                        SetCigOp( &dst[ j++ ], cigOp[ i ].code, cigOp[ i ].length );
                 }
             }
-            print_CG_cigar( __LINE__, cigOp, opCnt, NULL );
-            for ( i = j = 0; i < opCnt && rc == 0; ++i )
-            {
-                rc = string_printf( &newCIGAR[ j ], sizeof( newCIGAR ) - j, &sz, "%u%c", cigOp[ i ].length, cigOp[ i ].code);
-                j += sz;
-            }
+            if ( n_ops != NULL )
+                *n_ops = j;
+            j = FormatCigOps( newCIGAR, dst, j );
             cols[ alg_CIGAR ].base.v = newCIGAR;
             cols[ alg_CIGAR ].len = j;
         }
@@ -2464,7 +2575,7 @@ static bool DumpAlignedRow( SAM_dump_ctx_t *const ctx, DataSource *const ds,
     {
         if ( cg_style != 0 )
         {
-            rc = GenerateCGData( ds->cols, cg_style );
+            rc = GenerateCGData( ds->cols, cg_style, NULL, NULL );
             if ( rc != 0 )
             {
                 *prc = rc;
@@ -2590,45 +2701,6 @@ static rc_t DumpAlignedRowList_cb( SAM_dump_ctx_t *const ctx, TAlignedRegion con
 }
 
 
-typedef struct CigOps{
-	char op;
-	int8_t	 ref_sign; /*** 0;+1;-1; ref_offset = ref_sign * offset ***/
-	int8_t	 seq_sign; /*** 0;+1;-1; seq_offset = seq_sign * offset ***/
-	uint32_t oplen;
-} CigOps;
-
-static void SetCigOp(CigOps *dst,char op,uint32_t oplen)
-{
-	dst->op    = op;
-	dst->oplen = oplen;
-	switch(op) { /*MX= DN B IS PH*/
-	 case 'M': case 'X': case '=':
-		dst->ref_sign=+1;
-		dst->seq_sign=+1;
-		break;
-	 case 'D': case 'N':
-		dst->ref_sign=+1;
-                dst->seq_sign= 0;
-                break;
-	 case 'B': 
-		dst->ref_sign=-1;
-                dst->seq_sign= 0;
-                break;
-	 case 'S': case 'I':
-		dst->ref_sign= 0;
-                dst->seq_sign=+1;
-                break;
-	 case 'P': case 'H':
-	  case 0: /** terminating op **/
-		dst->ref_sign= 0;
-                dst->seq_sign= 0;
-                break;
-	  default:
-		assert(0);
-                break;
-	}
-}
-
 static unsigned ExplodeCIGAR( CigOps dst[], unsigned len, char const cigar[], unsigned ciglen )
 {
     unsigned i;
@@ -2733,13 +2805,14 @@ static char merge_M_type_ops(char a,char b)
 }
 
 
-static unsigned CombineCIGAR( char dst[], CigOps const seqOp[], unsigned seq_len,
+/* writes at most dst_len binary operations into dst, returns how many it wrote,
+   or dst_len + 1 if they do not fit */
+static unsigned CombineCIGAR( CigOps dst[], unsigned dst_len, CigOps const seqOp[], unsigned seq_len,
                               int refPos, CigOps const refOp[], unsigned ref_len )
 {
     bool     done=false;
-    unsigned ciglen=0,last_ciglen=0;
-    char     last_cig_op;
-    uint32_t last_cig_oplen=0;
+    bool     overflow=false;
+    unsigned n_ops=0;
     int	     si=0,ri=0;
     CigOps   seq_cop={0,0,0,0},ref_cop={0,0,0,0};
     int	     seq_pos=0; /** seq_pos is tracked roughly - with every extraction from seqOp **/
@@ -2747,16 +2820,17 @@ static unsigned CombineCIGAR( char dst[], CigOps const seqOp[], unsigned seq_len
     int	     delta=refPos; /*** delta in relative positions of seq and ref **/
 			   /*** when delta < 0 - rewind or extend the reference ***/
 			   /*** wher delta > 0 - skip reference  ***/
+/** extends the last operation in place if it is of the same kind, otherwise appends a new one **/
 #define MACRO_BUILD_CIGAR(OP,OPLEN) \
-	if( last_cig_oplen > 0 && last_cig_op == OP){							\
-                last_cig_oplen += OPLEN;								\
-                ciglen = last_ciglen + sprintf(dst+last_ciglen,"%d%c",last_cig_oplen,last_cig_op);	\
-        } else {											\
-                last_ciglen = ciglen;									\
-                last_cig_oplen = OPLEN;									\
-                last_cig_op    = OP;									\
-                ciglen = ciglen      + sprintf(dst+last_ciglen,"%d%c",last_cig_oplen,last_cig_op);	\
-        }
+	do {												\
+		if( n_ops > 0 && dst[n_ops-1].oplen > 0 && dst[n_ops-1].op == OP){			\
+			dst[n_ops-1].oplen += OPLEN;							\
+		} else if( n_ops < dst_len ){								\
+			SetCigOp(&dst[n_ops++],OP,OPLEN);						\
+		} else {										\
+			overflow = true;								\
+		}											\
+	} while(0)
     while(!done){
 	while(delta < 0){ 
 		ref_pos += delta; /** we will make it to back up this way **/
@@ -2859,7 +2933,8 @@ static unsigned CombineCIGAR( char dst[], CigOps const seqOp[], unsigned seq_len
 		}
         }
     }
-    return ciglen;
+#undef MACRO_BUILD_CIGAR
+    return overflow ? dst_len + 1 : n_ops;
 }
 
 
@@ -2923,21 +2998,34 @@ static rc_t DumpCGSAM( SAM_dump_ctx_t *const ctx, TAlignedRegion const *const rg
                                     rc = Cursor_ReadAlign( &ctx->eva.curs, rowAlign, ctx->eva.cols, 0 );
                                     if ( rc == 0 )
                                     {
+                                        CigOps op[ 36 ];
+                                        unsigned n_op = 0;
+                                        
                                         if(param->cg_style != 0)
-                                            rc = GenerateCGData( ctx->eva.cols, param->cg_style );
+                                            rc = GenerateCGData( ctx->eva.cols, param->cg_style, op, &n_op );
                                         if ( rc == 0 )
                                         {
                                             int const ploidy = ctx->eva.cols[ alg_REF_PLOIDY ].base.u32[ 0 ];
                                             int const readLen = ctx->eva.cols[ alg_READ ].len;
                                             INSDC_coord_zero refPos = ctx->eva.cols[ alg_REF_POS ].base.coord0[ 0 ];
-                                            CigOps op[ 36 ];
-                                            char cigbuf[ CG_CIGAR_STRING_MAX ];
+                                            CigOps cmb[ 64 ];
+                                            unsigned n_cmb;
+                                            char cigbuf[ 64 * CIG_OP_CHARS ];
                                             
-                                            memset( cigbuf, 0, CG_CIGAR_STRING_MAX );
-                                            ExplodeCIGAR( op, readLen, ctx->eva.cols[ alg_CIGAR ].base.str,
-                                                         ctx->eva.cols[ alg_CIGAR ].len );
-                                            ctx->eva.cols[ alg_CIGAR ].len = CombineCIGAR( cigbuf, op, readLen, refPos, 
-                                                                                          refCigOps + cigop_starts[ ploidy - 1 ], refLen[ ploidy - 1 ] );
+                                            /* the generated cigar is already binary, only an untreated one has to be parsed */
+                                            if ( n_op == 0 )
+                                                ExplodeCIGAR( op, readLen, ctx->eva.cols[ alg_CIGAR ].base.str,
+                                                             ctx->eva.cols[ alg_CIGAR ].len );
+                                            n_cmb = CombineCIGAR( cmb, 64, op, readLen, refPos,
+                                                                  refCigOps + cigop_starts[ ploidy - 1 ], refLen[ ploidy - 1 ] );
+                                            if ( n_cmb > 64 )
+                                            {
+                                                rc = RC( rcExe, rcData, rcProcessing, rcData, rcExcessive );
+                                                (void)PLOGERR( klogErr, ( klogErr, rc, "combined cigar of evidence alignment $(row) is too long",
+                                                                          "row=%li", rowAlign ) );
+                                                break;
+                                            }
+                                            ctx->eva.cols[ alg_CIGAR ].len = FormatCigOps( cigbuf, cmb, n_cmb );
                                             ctx->eva.cols[ alg_CIGAR ].base.str = cigbuf;
                                             ctx->eva.cols[ alg_REF_POS ].base.v = &refPos;
                                             refPos += ctx->evi.cols[ alg_REF_POS ].base.coord0[ 0 ] ;
@@ -2987,6 +3075,31 @@ static rc_t DumpCGSAM( SAM_dump_ctx_t *const ctx, TAlignedRegion const *const rg
 }
 
 
+/* the regions are sorted by name ( GetRegion() ), name is not 0-terminated */
+static int FindAlignedRegion( char const *name, size_t len )
+{
+    unsigned f = 0;
+    unsigned e = param->region_qty;
+
+    while ( f < e )
+    {
+        unsigned const m = ( ( f + e ) / 2 );
+        char const *const rname = param->region[ m ].name;
+        int diff = strncmp( name, rname, len );
+
+        if ( diff == 0 && rname[ len ] != 0 )
+            diff = -1;
+        if ( diff == 0 )
+            return m;
+        if ( diff < 0 )
+            e = m;
+        else
+            f = m + 1;
+    }
+    return -1;
+}
+
+
 static rc_t ForEachAlignedRegion( SAM_dump_ctx_t *const ctx, enum e_IDS_opts const Options,
     rc_t ( *user_func )( SAM_dump_ctx_t *ctx, TAlignedRegion const *rgn, int options, int which, int64_t *rows, SCol const *IDS ) )
 {
@@ -3055,21 +3168,23 @@ static rc_t ForEachAlignedRegion( SAM_dump_ctx_t *const ctx, enum e_IDS_opts con
 
             while ( ( rc = KIndexProjectText(iname, rowid + count, &rowid, &count, refname, sizeof( refname ), &sz ) ) == 0 )
             {
-                bool include;
-                unsigned r;
+                bool include = false;
+                unsigned r = 0;
                 unsigned max_to = UINT_MAX;
                 unsigned min_from = 0;
+                TAlignedRegion const *rgn = NULL;
                 
-                for ( include = false, r = 0; r < param->region_qty; ++r )
+                if ( param->region_qty > 0 )
                 {
-                    if ( sz == string_size( param->region[ r ].name ) &&
-                         memcmp( param->region[ r ].name, refname, sz ) == 0 )
+                    int const found = FindAlignedRegion( refname, sz );
+                    if ( found >= 0 )
                     {
+                        r = found;
+                        rgn = &param->region[ r ];
                         include = true;
                         max_to = param->region[ r ].max_to;
                         min_from = param->region[ r ].min_from;
                         param->region[ r ].printed++; /* new: mark a region as printed */
-                        break;
                     }
                 }
 
@@ -3084,6 +3199,7 @@ static rc_t ForEachAlignedRegion( SAM_dump_ctx_t *const ctx, enum e_IDS_opts con
                         if ( m & options )
                         {
                             unsigned lookback = 0;
+                            unsigned next_range = 0;
                             int64_t row;
                             int32_t row_start_offset;
                             unsigned pos;
@@ -3122,6 +3238,27 @@ static rc_t ForEachAlignedRegion( SAM_dump_ctx_t *const ctx, enum e_IDS_opts con
                                     row = 0;
                                     continue;
                                 }
+                                if ( rgn != NULL )
+                                {
+                                    /* jump over the chunks between the ranges, alignments starting
+                                       there do not reach into the next range */
+                                    int64_t const offset = row - rowid;
+                                    int64_t first;
+
+                                    while ( next_range < ( unsigned )rgn->rq &&
+                                            ( ( unsigned )rgn->r[ next_range ].to / maxseqlen ) < offset )
+                                        ++next_range;
+                                    if ( next_range == ( unsigned )rgn->rq )
+                                        break;
+                                    first = ( ( unsigned )rgn->r[ next_range ].from / maxseqlen ) - ( int64_t )lookback;
+                                    if ( first > offset )
+                                    {
+                                        row = rowid + first;
+                                        pos = first * maxseqlen;
+                                        if ( row >= endrow_exclusive )
+                                            break;
+                                    }
+                                }
                                 rc = Cursor_Read( &ctx->ref, row, 0, ~(0u) );
                                 if ( rc != 0 )
                                     break;
@@ -3280,8 +3417,8 @@ static rc_t DumpUnaligned( SAM_dump_ctx_t *const ctx, bool const aligned )
                         if ( rc == 0 )
                         {
 #if USE_MATE_CACHE
-                            uint64_t val;
-                            rc = Cache_Get( &ctx->pri.curs, min_prim_id, &val );
+                            uint64_t val[ 2 ];
+                            rc = Cache_Get( &ctx->pri.curs, min_prim_id, val );
                             if ( rc == 0 )
                             {
                                 ctx->pri.cols[ alg_REF_POS ].len = 0;
@@ -3330,7 +3467,7 @@ static rc_t FlushUnalignedRead_cb (uint64_t key, bool value,void *user_data)
 	rc = Cursor_Read( &ctx->seq, spot_id, seq_PRIMARY_ALIGNMENT_ID, ~(unsigned)0 );
 	if ( rc == 0 ) {
 		uint64_t rcount;
-		uint64_t val;
+		uint64_t val[ 2 ];
 		assert(ctx->seq.cols[ seq_PRIMARY_ALIGNMENT_ID ].len == 2);
 		if(ctx->seq.cols[ seq_PRIMARY_ALIGNMENT_ID ].base.i64[0]==0){
 			aligned_mate_id = ctx->seq.cols[ seq_PRIMARY_ALIGNMENT_ID ].base.i64[1];
@@ -3341,7 +3478,7 @@ static rc_t FlushUnalignedRead_cb (uint64_t key, bool value,void *user_data)
 		} else {
 			assert(0);
 		}
-                rc = Cache_Get( &ctx->pri.curs, aligned_mate_id, &val );
+                rc = Cache_Get( &ctx->pri.curs, aligned_mate_id, val );
                 if ( rc == 0 ) {
 			ctx->pri.cols[ alg_REF_POS ].len = 0;
 			Cache_Unpack( val, 0, &ctx->pri.curs, ctx->pri.cols );
@@ -4493,6 +4630,31 @@ static rc_t GetDistance( Args const *const args, struct params_s *const parms, u
 }
 
 
+/* the ranges are sorted by 'from', overlapping and adjacent ones are joined: that makes
+   them disjoint and sorted by 'to' too, for the binary search in RegionRangesOverlap() */
+static void MergeRegionRanges( TAlignedRegion *const r )
+{
+    int i;
+    int n = 0;
+
+    for ( i = 1; i < r->rq; ++i )
+    {
+        unsigned const from = r->r[ i ].from;
+        unsigned const to = r->r[ n ].to;
+
+        if ( from <= to || from - 1 == to )
+        {
+            if ( ( unsigned )r->r[ i ].to > to )
+                r->r[ n ].to = r->r[ i ].to;
+        }
+        else
+            r->r[ ++n ] = r->r[ i ];
+    }
+    if ( r->rq > 0 )
+        r->rq = n + 1;
+}
+
+
 static rc_t GetRegion( Args const *const args, struct params_s *const parms, unsigned const n )
 {
     rc_t rc;
@@ -4620,14 +4782,14 @@ static rc_t GetRegion( Args const *const args, struct params_s *const parms, uns
                     r->r[ 0 ].from = 0;
                     r->r[ 0 ].to = UINT_MAX;
                 }
+                MergeRegionRanges( r );
+                r->min_from = r->r[ 0 ].from;
                 for ( j = 0; j < r->rq; ++j )
                 {
                     unsigned const to = r->r[ j ].to;
-                    unsigned const from = r->r[ j ].from;
                     
                     SAM_DUMP_DBG( 2, ( "   range: [%u:%u]\n", r->r[ j ].from, to ) );
                     if ( r->max_to < to ) r->max_to = to;
-                    if ( r->min_from < from ) r->min_from = from;
                 }
             }
         }
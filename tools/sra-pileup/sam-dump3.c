@@ -37,6 +37,7 @@
 #include "matecache.h"
 #include "cg_tools.h"
 #include "out_redir.h"
+#include "bam_out.h"
 #include "sam-aligned.h"
 #include "sam-unaligned.h"
 
@@ -99,6 +100,17 @@ char const *sd_gzip_usage[]           = { "Compress output using gzip",
 char const *sd_bzip2_usage[]          = { "Compress output using bzip2",
                                        NULL };
 
+char const *sd_bgzf_usage[]           = { "Compress output in BGZF-blocks, deflated by the worker-threads",
+                                       NULL };
+
+char const *sd_bgzf_level_usage[]     = { "compression-level of the BGZF-blocks 0...9 (dflt:6)",
+                                       NULL };
+
+char const *sd_bam_usage[]            = { "Produce BAM-records instead of SAM-lines, implies --bgzf",
+                                           "aligned reads only, needs the header",
+                                           "with --output-file an index <file>.bai is written, if sorted",
+                                       NULL };
+
 char const *sd_qname_usage[]          = { "Add .SPOT_GROUP to QNAME",
                                        NULL };
 
@@ -151,6 +163,10 @@ char const *sd_min_mapq_usage[]       = { "min. mapq an alignment has to have, t
 char const *sd_no_mate_cache_usage[]  = { "do not use a mate-cache, slower but less memory usage",
                                        NULL };
 
+char const *sd_matecache_size_usage[] = { "max. size of the mate-cache per input-file in MB,",
+                                           "mates beyond it are read from the table (dflt:0...no limit)",
+                                       NULL };
+
 char const *rna_splice_usage[]        = { "modify cigar-string (replace .D. with .N.) and add output flags (XS:A:+/-) ",
                                            "when rna-splicing is detected by match to spliceosome recognition sites",
                                        NULL };
@@ -165,6 +181,10 @@ char const *rna_splice_log_usage[]    = { "file, into which rna-splice events ar
 
 char const *no_mt_usage[]             = { "disable multithreading", NULL };                                       
 
+char const *threads_usage[]           = { "number of threads dumping slices of the references in parallel,",
+                                           "default is 6, not used if regions are given",
+                                       NULL };
+
                                       
 OptDef SamDumpArgs[] =
 {
@@ -182,6 +202,9 @@ OptDef SamDumpArgs[] =
     { OPT_HIDE_IDENT,    "=", NULL, sd_identicalbases_usage, 0, false, false },  /* replace bases that match the reference with '=' */
     { OPT_GZIP,         NULL, NULL, sd_gzip_usage,           0, false, false },  /* compress the output with gzip */
     { OPT_BZIP2,        NULL, NULL, sd_bzip2_usage,          0, false, false },  /* compress the output with bzip2 */
+    { OPT_BGZF,         NULL, NULL, sd_bgzf_usage,           0, false, false },  /* compress the output in bgzf-blocks */
+    { OPT_BGZF_LEVEL,   NULL, NULL, sd_bgzf_level_usage,     0, true,  false },  /* deflate-level of the bgzf-blocks */
+    { OPT_BAM,          NULL, NULL, sd_bam_usage,            0, false, false },  /* output-format = bam ( instead of SAM ) */
     { OPT_SPOTGRP,       "g", NULL, sd_qname_usage,          0, false, false },  /* add spotgroup to qname */
     { OPT_FASTQ,        NULL, NULL, sd_fastq_usage,          0, false, false },  /* output-format = fastq ( instead of SAM ) */
     { OPT_FASTA,        NULL, NULL, sd_fasta_usage,          0, false, false },  /* output-format = fasta ( instead of SAM ) */
@@ -204,10 +227,12 @@ OptDef SamDumpArgs[] =
     { OPT_CURSOR_CACHE, NULL, NULL, sd_cur_cache_usage,      0, true,  false },  /* size of cursor cache */
     { OPT_MIN_MAPQ,     NULL, NULL, sd_min_mapq_usage,       0, true,  false },  /* minimal mapping quality */
     { OPT_NO_MATE_CACHE,NULL, NULL, sd_no_mate_cache_usage,  0, false, false },  /* do not use mate-cache */
+    { OPT_MATECACHE_SIZE,NULL, NULL, sd_matecache_size_usage, 0, true,  false }, /* memory-budget of mate-cache */
     { OPT_RNA_SPLICE,   NULL, NULL, rna_splice_usage,        0, false, false },  /* detect rna-splicing in sequence */
     { OPT_RNA_SPLICEL,  NULL, NULL, rna_splicel_usage,       0, true,  false },  /* level of rna-splicing detection */
     { OPT_RNA_SPLICE_LOG,  NULL, NULL, rna_splice_log_usage, 0, true,  false },  /* filename to log rna-splice events into */
     { OPT_NO_MT,        NULL, NULL, no_mt_usage,              0, false, false },   /* force new code-path */    
+    { OPT_THREADS,      NULL, NULL, threads_usage,           0, true,  false },  /* number of worker-threads */
     { OPT_DUMP_MODE,    NULL, NULL, NULL,                    0, true,  false },  /* how to produce aligned reads if no regions given */
     { OPT_CIGAR_TEST,   NULL, NULL, NULL,                    0, true,  false },  /* test cg-treatment of cigar string */
     { OPT_LEGACY,       NULL, NULL, NULL,                    0, false, false },  /* force legacy code-path */
@@ -231,6 +256,9 @@ char const *sd_usage_params[] =
     NULL,                       /* identical-bases */
     NULL,                       /* gzip */
     NULL,                       /* bzip2 */
+    NULL,                       /* bgzf */
+    "level",                    /* bgzf-level */
+    NULL,                       /* bam */
     NULL,                       /* qname */
     NULL,                       /* fasta */
     NULL,                       /* fastq */
@@ -253,10 +281,12 @@ char const *sd_usage_params[] =
     NULL,                       /* cursor cache */
     NULL,                       /* min_mapq */
     NULL,                       /* no mate-cache */
+    "MB",                       /* mate-cache size */
     NULL,                       /* detect rna-splicing in sequence */
     NULL,                       /* level of rna-splicing detection */
     NULL,                       /* file to log rna-splice-events into */
     NULL,                       /* no-mt */    
+    "count",                    /* threads */
     NULL,                       /* dump_mode */
     NULL,                       /* cigar test */
     NULL,                       /* force legacy code path */
@@ -339,6 +369,44 @@ static uint32_t tabsel_2_ReferenceList_Options( const samdump_opts * opts )
 }
 
 
+static rc_t CC collect_header_cb( void * self, const char * buffer, size_t bufsize, size_t * num_writ )
+{
+    *num_writ = bufsize;
+    return add_buf_2_dyn_string( self, buffer, bufsize ); /* dyn_string.c */
+}
+
+
+/* the text of the header is collected and written as the binary bam-header,
+   the references in it give the ref-id's of the records */
+static rc_t print_bam_header( const samdump_opts * const opts, input_files * ifs )
+{
+    struct dyn_string * text;
+    rc_t rc = allocated_dyn_string( &text, 4096 ); /* dyn_string.c */
+    if ( rc != 0 )
+        (void)LOGERR( klogErr, rc, "cannot allocate buffer for bam-header" );
+    else
+    {
+        KWrtWriter org_writer = KOutWriterGet();
+        void * org_data = KOutDataGet();
+
+        rc = KOutHandlerSet( collect_header_cb, text );
+        if ( rc == 0 )
+        {
+            rc_t rc2;
+
+            rc = print_headers( opts, ifs ); /* sam-hdr.c */
+            rc2 = KOutHandlerSet( org_writer, org_data );
+            if ( rc == 0 )
+                rc = rc2;
+        }
+        if ( rc == 0 )
+            rc = write_bam_header( dyn_string_char( text, 0 ), dyn_string_len( text ) ); /* bam_out.c */
+        free_dyn_string( text );
+    }
+    return rc;
+}
+
+
 static rc_t print_samdump( const samdump_opts * const opts )
 {
     KDirectory *dir;
@@ -382,12 +450,18 @@ static rc_t print_samdump( const samdump_opts * const opts )
                         rc = RC( rcExe, rcFile, rcReading, rcItem, rcNotFound );
                         (void)LOGERR( klogErr, rc, "input object(s) not found" );
                     }
+                    else if ( opts->output_format == of_bam && ifs->table_count > 0 )
+                    {
+                        /* legacy tables have no aligned reads */
+                        rc = RC( rcExe, rcFile, rcReading, rcFormat, rcUnsupported );
+                        (void)LOGERR( klogErr, rc, "BAM-output is only supported for databases" );
+                    }
                     else
                     {
                         matecache * mc = NULL;
 
                         if ( opts->use_mate_cache )
-                            rc = make_matecache( &mc, ifs->database_count );
+                            rc = make_matecache( &mc, ifs->database_count, opts->matecache_size );
 
                         if ( rc == 0 )
                         {
@@ -399,6 +473,8 @@ static rc_t print_samdump( const samdump_opts * const opts )
                             /* ------------------------------------------------------ */
                                 rc = print_headers( opts, ifs ); /* sam-hdr.c */
                             /* ------------------------------------------------------ */
+                            else if ( opts->output_format == of_bam )
+                                rc = print_bam_header( opts, ifs );
 
 
                             /* print output of aligned reads */
@@ -418,6 +494,8 @@ static rc_t print_samdump( const samdump_opts * const opts )
                                 /* ------------------------------------------------------ */
                             }
 
+                            release_bam_header(); /* bam_out.c */
+
                             if ( opts->use_mate_cache )
                             {
                                 if ( opts->report_cache )
@@ -475,9 +553,12 @@ static rc_t samdump_main( Args * args, const samdump_opts * const opts )
         case oc_none  : mode = orm_uncompressed; break;
         case oc_gzip  : mode = orm_gzip; break;
         case oc_bzip2 : mode = orm_bzip2; break;
+        case oc_bgzf  : mode = orm_bgzf; break;
     }
 
-    rc = init_out_redir( &redir, mode, opts->outputfile, opts->output_buffer_size ); /* from out_redir.c */
+    /* the bgzf-blocks are deflated by as many threads as dump the slices */
+    rc = init_out_redir( &redir, mode, opts->outputfile, opts->output_buffer_size,
+                         opts->no_mt ? 0 : opts->num_threads, ( int )opts->bgzf_level ); /* from out_redir.c */
     if ( rc == 0 )
     {
         if ( opts->report_options )
@@ -498,12 +579,20 @@ static rc_t samdump_main( Args * args, const samdump_opts * const opts )
             }
             else
             {
+                /* the index is built from the records while they are written */
+                if ( opts->output_format == of_bam && opts->outputfile != NULL )
+                    rc = out_redir_index_bam( &redir, opts->outputfile ); /* from out_redir.c */
             /* ------------------------------------------------------ */
-                rc = print_samdump( opts );
+                if ( rc == 0 )
+                    rc = print_samdump( opts );
             /* ------------------------------------------------------ */
             }
         }
-        release_out_redir( &redir ); /* from out_redir.c */
+        {
+            rc_t rc2 = release_out_redir( &redir ); /* from out_redir.c */
+            if ( rc == 0 )
+                rc = rc2;
+        }
     }
     return rc;
 }
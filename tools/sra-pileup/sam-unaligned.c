@@ -91,6 +91,12 @@ static rc_t prepare_prim_table_ctx( const samdump_opts * const opts,
 #define COL_SPOT_GROUP "(ascii)SPOT_GROUP"
 #define COL_NAME "(ascii)NAME"
 
+/* initial size of the record-buffer, it grows for longer records */
+#define UNALIGNED_REC_BUF_SIZE ( 16 * 1024 )
+
+/* room for a number in a sam-record, together with the tab/tag around it */
+#define UNALIGNED_NUM_CHARS 24
+
 typedef struct seq_table_ctx
 {
     const VCursor * cursor;
@@ -105,6 +111,9 @@ typedef struct seq_table_ctx
     uint32_t quality_idx;
     uint32_t spot_group_idx;
     uint32_t name_idx;
+
+    /* the sam-records are formatted into this one and written out once per record */
+    out_buf rec;
 } seq_table_ctx;
 
 
@@ -152,6 +161,8 @@ static rc_t prepare_seq_table_ctx( const samdump_opts * const opts,
         }
         KNamelistRelease( available_columns );
     }
+    if ( rc == 0 )
+        rc = init_out_buf( &stx->rec, UNALIGNED_REC_BUF_SIZE, NULL ); /* out_buf.c */
     return rc;
 }
 
@@ -368,6 +379,27 @@ static rc_t get_mate_info( const prim_table_ctx * const ptx,
 }
 
 
+static char complement_base( int c )
+{
+    static const char cmp_tbl [] =
+    {
+        'T', 'V', 'G', 'H', 'E', 'F', 'C', 'D',
+        'I', 'J', 'M', 'L', 'K', 'N', 'O', 'P',
+        'Q', 'Y', 'S', 'A', 'U', 'B', 'W', 'X',
+        'R', 'Z'
+    };
+
+    if ( isalpha ( c ) )
+    {
+        if ( islower ( c )  )
+             c = tolower ( cmp_tbl [ toupper ( c ) - 'A' ] );
+        else
+             c = cmp_tbl [ c - 'A' ];
+    }
+    return ( char ) c;
+}
+
+
 static rc_t print_sliced_read( const INSDC_dna_text * read,
                                uint32_t read_idx,
                                bool reverse,
@@ -382,27 +414,10 @@ static rc_t print_sliced_read( const INSDC_dna_text * read,
     }
     else
     {
-        const char cmp_tbl [] =
-        {
-            'T', 'V', 'G', 'H', 'E', 'F', 'C', 'D',
-            'I', 'J', 'M', 'L', 'K', 'N', 'O', 'P',
-            'Q', 'Y', 'S', 'A', 'U', 'B', 'W', 'X',
-            'R', 'Z'
-        };
-
         int32_t i = ( read_len[ read_idx ] - 1 );
         while( i >= 0 && rc == 0 )
         {
-            int c = ptr [ i ];
-            if ( isalpha ( c ) )
-            {
-                if ( islower ( c )  )
-                     c = tolower ( cmp_tbl [ toupper ( c ) - 'A' ] );
-                else
-                     c = cmp_tbl [ c - 'A' ];
-            }
-
-            rc = KOutMsg( "%c", ( char ) c );
+            rc = KOutMsg( "%c", complement_base( ptr [ i ] ) );
             i--;
         }
     }
@@ -410,6 +425,33 @@ static rc_t print_sliced_read( const INSDC_dna_text * read,
 }
 
 
+/* the same, but appended to a record in an out_buf, followed by a tab */
+static rc_t out_sliced_read( out_buf * out,
+                             const INSDC_dna_text * read,
+                             uint32_t read_idx,
+                             bool reverse,
+                             const INSDC_coord_zero * read_start,
+                             const INSDC_coord_len * read_len )
+{
+    uint32_t len = read_len[ read_idx ];
+    rc_t rc = reserve_out_buf( out, len + 1 );
+    if ( rc == 0 )
+    {
+        const INSDC_dna_text * ptr = read + read_start[ read_idx ];
+        if ( !reverse )
+            out_buf_mem( out, ptr, len );
+        else
+        {
+            uint32_t i;
+            for ( i = len; i > 0; --i )
+                out_buf_char( out, complement_base( ptr [ i - 1 ] ) );
+        }
+        out_buf_char( out, '\t' );
+    }
+    return rc;
+}
+
+
 static rc_t print_sliced_quality( const samdump_opts * const opts,
                                   const char * quality,
                                   uint32_t read_idx,
@@ -422,7 +464,102 @@ static rc_t print_sliced_quality( const samdump_opts * const opts,
 }
 
 
-static rc_t dump_the_other_read( const seq_table_ctx * const stx,
+static rc_t out_sliced_quality( const samdump_opts * const opts,
+                                out_buf * out,
+                                const char * quality,
+                                uint32_t read_idx,
+                                bool reverse,
+                                const INSDC_coord_zero * read_start,
+                                const INSDC_coord_len * read_len )
+{
+    const char * ptr = quality + read_start[ read_idx ];
+    return dump_quality_2_out_buf( opts, out, ptr, read_len[ read_idx ], reverse ); /* sam-dump-opts.c */
+}
+
+
+/* the field-writers for a sam-record in an out_buf: they reserve the space they need */
+
+static rc_t out_sam_str( out_buf * out, const char * str, size_t len )
+{
+    rc_t rc = reserve_out_buf( out, len );
+    if ( rc == 0 )
+        out_buf_mem( out, str, len );
+    return rc;
+}
+
+
+/* appends "value\t" */
+static rc_t out_sam_i64( out_buf * out, int64_t value )
+{
+    rc_t rc = reserve_out_buf( out, UNALIGNED_NUM_CHARS );
+    if ( rc == 0 )
+    {
+        out_buf_i64( out, value );
+        out_buf_char( out, '\t' );
+    }
+    return rc;
+}
+
+
+/* appends "ref_name\tpos\t" of the mate */
+static rc_t out_sam_mate( out_buf * out, const char * ref_name, size_t ref_name_len, int32_t pos )
+{
+    rc_t rc = reserve_out_buf( out, ref_name_len + UNALIGNED_NUM_CHARS );
+    if ( rc == 0 )
+    {
+        out_buf_mem( out, ref_name, ref_name_len );
+        out_buf_char( out, '\t' );
+        out_buf_i32( out, pos );
+        out_buf_char( out, '\t' );
+    }
+    return rc;
+}
+
+
+/* appends the optional fields XI and RG and the newline, then writes the record out */
+static rc_t out_sam_tail( const samdump_opts * const opts,
+                          out_buf * out,
+                          rc_t rc,
+                          int64_t row_id,
+                          const char * spot_group,
+                          uint32_t spot_group_len )
+{
+    /* OPT SAM-FIIELD:      SRA-column: ALIGN_ID */
+    if ( rc == 0 && opts->print_alignment_id_in_column_xi )
+    {
+        rc = reserve_out_buf( out, UNALIGNED_NUM_CHARS );
+        if ( rc == 0 )
+        {
+            out_buf_mem( out, "\tXI:i:", 6 );
+            out_buf_u32( out, ( uint32_t )row_id );
+        }
+    }
+
+    /* OPT SAM-FIIELD:      SRA-column: SPOT_GROUP */
+    if ( rc == 0 && spot_group != NULL && spot_group_len > 0 )
+    {
+        rc = reserve_out_buf( out, spot_group_len + 6 );
+        if ( rc == 0 )
+        {
+            out_buf_mem( out, "\tRG:Z:", 6 );
+            out_buf_mem( out, spot_group, spot_group_len );
+        }
+    }
+
+    if ( rc == 0 )
+        rc = out_sam_str( out, "\n", 1 );
+
+    /* hand the whole record over at once, on error the rest of it is dropped */
+    if ( rc == 0 )
+        rc = flush_out_buf( out ); /* out_buf.c */
+    else
+        out->used = 0;
+    return rc;
+}
+
+
+static rc_t dump_the_other_read( out_buf * out,
+                                 const seq_table_ctx * const stx,
                                  const prim_table_ctx * const ptx,
                                  const int64_t row_id,
                                  const uint32_t mate_idx )
@@ -448,7 +585,7 @@ static rc_t dump_the_other_read( const seq_table_ctx * const stx,
             int64_t a_row_id = prim_al_id_ptr[ mate_idx ];
             if ( a_row_id == 0 )
             {
-                rc = KOutMsg( "*\t0\t" );
+                rc = out_sam_str( out, "*\t0\t", 4 );
             }
             else
             {
@@ -467,7 +604,7 @@ static rc_t dump_the_other_read( const seq_table_ctx * const stx,
                         rc = read_INSDC_coord_zero_ptr( a_row_id, ptx->cursor, ptx->ref_pos_idx, &ref_pos, &row_len, "REF_POS" );
                         if ( rc == 0 )
                         {
-                            rc = KOutMsg( "%.*s\t%i\t", ref_name_len, ref_name, ref_pos[ 0 ] + 1 );
+                            rc = out_sam_mate( out, ref_name, ref_name_len, ref_pos[ 0 ] + 1 );
                         }
                     }
                 }
@@ -564,7 +701,7 @@ static bool calc_reverse_flag( const samdump_opts * const opts,
 
 
 static rc_t dump_seq_row_sam_filtered( const samdump_opts * const opts,
-                                       const seq_table_ctx * const stx,
+                                       seq_table_ctx * const stx,
                                        const prim_table_ctx * const ptx,
                                        const matecache * const mc,
                                        const input_database * const ids,
@@ -580,6 +717,7 @@ static rc_t dump_seq_row_sam_filtered( const samdump_opts * const opts,
     const INSDC_read_filter * read_filter = NULL;
     const INSDC_coord_zero * read_start = NULL;
     const INSDC_coord_len * read_len;
+    out_buf * out = &stx->rec;
 
     rc_t rc = read_int64_ptr( row_id, stx->cursor, stx->prim_al_id_idx, &prim_align_ids, &prim_align_ids_len, "PRIM_AL_ID" );
     if ( rc == 0 && nreads != prim_align_ids_len )
@@ -631,7 +769,7 @@ static rc_t dump_seq_row_sam_filtered( const samdump_opts * const opts,
 
                             /* SAM-FIELD: QNAME     SRA-column: SPOT_ID ( int64 ) */
                             if ( rc == 0 )
-                                rc = KOutMsg( "%ld\t", seq_spot_id );
+                                rc = out_sam_i64( out, seq_spot_id );
 
                             if ( rc == 0 && read_type == NULL )
                                 rc = read_read_type( stx, row_id, &read_type, nreads );
@@ -647,7 +785,7 @@ static rc_t dump_seq_row_sam_filtered( const samdump_opts * const opts,
                             {
                                 uint32_t sam_flags = calculate_unaligned_sam_flags_db( nreads, read_idx, mate_idx, 
                                                                                     align_id, read_type, reverse, read_filter );
-                                rc = KOutMsg( "%u\t", sam_flags );
+                                rc = out_sam_i64( out, sam_flags );
                             }
 
                             /* SAM-FIELD: RNAME     SRA-column: none, fix '*' */
@@ -655,16 +793,16 @@ static rc_t dump_seq_row_sam_filtered( const samdump_opts * const opts,
                             /* SAM-FIELD: MAPQ      SRA-column: none, fix '0' */
                             /* SAM-FIELD: CIGAR     SRA-column: none, fix '*' */
                             if ( rc == 0 )
-                                rc = KOutMsg( "*\t0\t0\t*\t" );
+                                rc = out_sam_str( out, "*\t0\t0\t*\t", 8 );
 
                             /* SAM-FIELD: RNEXT     SRA-column: found in cache */
                             /* SAM-FIELD: POS       SRA-column: found in cache */
                             if ( rc == 0 )
-                                rc = KOutMsg( "%s\t%li\t", mate_ref_name, mate_ref_pos + 1 );
+                                rc = out_sam_mate( out, mate_ref_name, string_size( mate_ref_name ), mate_ref_pos + 1 );
 
                             /* SAM-FIELD: TLEN      SRA-column: none, fix '0' */
                             if ( rc == 0 )
-                                rc = KOutMsg( "0\t" );
+                                rc = out_sam_str( out, "0\t", 2 );
 
                             if ( rc == 0 && read == NULL )
                                 rc = read_INSDC_dna_text_ptr( row_id, stx->cursor, stx->read_idx, &read, &rd_len, "READ" );
@@ -675,26 +813,17 @@ static rc_t dump_seq_row_sam_filtered( const samdump_opts * const opts,
 
                             /* SAM-FIELD: SEQ       SRA-column: READ, sliced by READ_START/READ_LEN */
                             if ( rc == 0 )
-                                rc = print_sliced_read( read, read_idx, reverse, read_start, read_len );
-                            if ( rc == 0 )
-                                rc = KOutMsg( "\t" );
+                                rc = out_sliced_read( out, read, read_idx, reverse, read_start, read_len );
 
                             /* SAM-FIELD: QUAL      SRA-column: QUALITY, sliced by READ_START/READ_LEN */
                             if ( rc == 0 )
-                                rc = print_sliced_quality( opts, quality, read_idx, reverse, read_start, read_len );
-
-                            /* OPT SAM-FIIELD:      SRA-column: ALIGN_ID */
-                            if ( rc == 0 && opts->print_alignment_id_in_column_xi )
-                                rc = KOutMsg( "\tXI:i:%u", row_id );
+                                rc = out_sliced_quality( opts, out, quality, read_idx, reverse, read_start, read_len );
 
-                            /* OPT SAM-FIIELD:      SRA-column: SPOT_GROUP */
                             if ( rc == 0 && spot_group == NULL )
                                 rc = read_char_ptr( row_id, stx->cursor, stx->spot_group_idx, &spot_group, &spot_group_len, "SPOT_GROUP" );
-                            if ( rc == 0 && spot_group_len > 0 )
-                                rc = KOutMsg( "\tRG:Z:%.*s", spot_group_len, spot_group );
 
-                            if ( rc == 0 )
-                                rc = KOutMsg( "\n" );
+                            /* OPT SAM-FIELDS: XI, RG and the end of the record */
+                            rc = out_sam_tail( opts, out, rc, row_id, spot_group, spot_group_len );
                         }
                     }
                 }
@@ -710,7 +839,7 @@ static rc_t dump_seq_row_sam_filtered( const samdump_opts * const opts,
 
 
 static rc_t dump_seq_prim_row_sam( const samdump_opts * const opts,
-                                   const seq_table_ctx * const stx,
+                                   seq_table_ctx * const stx,
                                    const prim_table_ctx * const ptx,
                                    const matecache * const mc,
                                    const input_database * const ids,
@@ -726,6 +855,7 @@ static rc_t dump_seq_prim_row_sam( const samdump_opts * const opts,
     const INSDC_read_filter * read_filter = NULL;
     const INSDC_coord_zero * read_start = NULL;
     const INSDC_coord_len * read_len;
+    out_buf * out = &stx->rec;
 
     rc_t rc = read_int64_ptr( row_id, stx->cursor, stx->prim_al_id_idx, &prim_align_ids, &prim_align_ids_len, "PRIM_AL_ID" );
     if ( rc == 0 && nreads != prim_align_ids_len )
@@ -764,7 +894,7 @@ static rc_t dump_seq_prim_row_sam( const samdump_opts * const opts,
 
             /* SAM-FIELD: QNAME     SRA-column: SPOT_ID ( int64 ) */
             if ( rc == 0 )
-                rc = KOutMsg( "%ld\t", row_id );
+                rc = out_sam_i64( out, row_id );
 
             /* SAM-FIELD: FLAG      SRA-column: calculated from READ_TYPE, READ_FILTER etc. */
             if ( rc == 0 )
@@ -784,7 +914,7 @@ static rc_t dump_seq_prim_row_sam( const samdump_opts * const opts,
                     else
                         sam_flags = 0x04;
                 }
-                rc = KOutMsg( "%u\t", sam_flags );
+                rc = out_sam_i64( out, sam_flags );
             }
 
             /* SAM-FIELD: RNAME     SRA-column: none, fix '*' */
@@ -792,7 +922,7 @@ static rc_t dump_seq_prim_row_sam( const samdump_opts * const opts,
             /* SAM-FIELD: MAPQ      SRA-column: none, fix '0' */
             /* SAM-FIELD: CIGAR     SRA-column: none, fix '*' */
             if ( rc == 0 )
-                rc = KOutMsg( "*\t0\t0\t*\t" );
+                rc = out_sam_str( out, "*\t0\t0\t*\t", 8 );
 
             /* SAM-FIELD: RNEXT     SRA-column: look up in cache, or none */
             /* SAM-FIELD: POS       SRA-column: look up in cache, or none */
@@ -800,7 +930,7 @@ static rc_t dump_seq_prim_row_sam( const samdump_opts * const opts,
             {
                 if ( ptx == NULL )
                 {
-                    rc = KOutMsg( "0\t0\t" );   /* no way to get that without PRIM_ALIGN-table */
+                    rc = out_sam_str( out, "0\t0\t", 4 );   /* no way to get that without PRIM_ALIGN-table */
                 }
                 else
                 {
@@ -812,12 +942,12 @@ static rc_t dump_seq_prim_row_sam( const samdump_opts * const opts,
 
                         rc = get_mate_info( ptx, mc, ids, row_id, mate_id, nreads, &mate_ref_name, &mate_ref_name_len, &mate_ref_pos );
                         if ( rc == 0 )
-                            rc = KOutMsg( "%.*s\t%li\t", mate_ref_name_len, mate_ref_name, mate_ref_pos );
+                            rc = out_sam_mate( out, mate_ref_name, mate_ref_name_len, mate_ref_pos );
                     }
                     else
                     {
                         /* print the mate info */
-                        rc = dump_the_other_read( stx, ptx, row_id, mate_idx );
+                        rc = dump_the_other_read( out, stx, ptx, row_id, mate_idx );
                     }
                 }
             }
@@ -825,7 +955,7 @@ static rc_t dump_seq_prim_row_sam( const samdump_opts * const opts,
 
             /* SAM-FIELD: TLEN      SRA-column: none, fix '0' */
             if ( rc == 0 )
-                rc = KOutMsg( "0\t" );
+                rc = out_sam_str( out, "0\t", 2 );
 
             if ( rc == 0 && read == NULL )
                 rc = read_INSDC_dna_text_ptr( row_id, stx->cursor, stx->read_idx, &read, &rd_len, "READ" );
@@ -834,29 +964,20 @@ static rc_t dump_seq_prim_row_sam( const samdump_opts * const opts,
 
             /* SAM-FIELD: SEQ       SRA-column: READ, sliced by READ_START/READ_LEN */
             if ( rc == 0 )
-                rc = print_sliced_read( read, read_idx, reverse, read_start, read_len );
-            if ( rc == 0 )
-                rc = KOutMsg( "\t" );
+                rc = out_sliced_read( out, read, read_idx, reverse, read_start, read_len );
 
             if ( rc == 0 && quality == NULL )
                 rc = read_quality( stx, row_id, &quality, rd_len );
 
             /* SAM-FIELD: QUAL      SRA-column: QUALITY, sliced by READ_START/READ_LEN */
             if ( rc == 0 )
-                rc = print_sliced_quality( opts, quality, read_idx, reverse, read_start, read_len );
+                rc = out_sliced_quality( opts, out, quality, read_idx, reverse, read_start, read_len );
 
-            /* OPT SAM-FIIELD:      SRA-column: ALIGN_ID */
-            if ( rc == 0 && opts->print_alignment_id_in_column_xi )
-                rc = KOutMsg( "\tXI:i:%u", row_id );
-
-            /* OPT SAM-FIIELD:      SRA-column: SPOT_GROUP */
             if ( rc == 0 && spot_group == NULL )
                 rc = read_char_ptr( row_id, stx->cursor, stx->spot_group_idx, &spot_group, &spot_group_len, "SPOT_GROUP" );
-            if ( rc == 0 && spot_group_len > 0 )
-                rc = KOutMsg( "\tRG:Z:%.*s", spot_group_len, spot_group );
 
-            if ( rc == 0 )
-                rc = KOutMsg( "\n" );
+            /* OPT SAM-FIELDS: XI, RG and the end of the record */
+            rc = out_sam_tail( opts, out, rc, row_id, spot_group, spot_group_len );
         }
     }
     return rc;
@@ -865,7 +986,7 @@ static rc_t dump_seq_prim_row_sam( const samdump_opts * const opts,
 
 /* called if we are dumping from a legacy table instead from a database */
 static rc_t dump_seq_row_sam( const samdump_opts * const opts,
-                              const seq_table_ctx * const stx,
+                              seq_table_ctx * const stx,
                               const int64_t row_id,
                               const uint32_t nreads )
 {
@@ -878,6 +999,7 @@ static rc_t dump_seq_row_sam( const samdump_opts * const opts,
     const INSDC_read_filter * read_filter = NULL;
     const INSDC_coord_zero * read_start = NULL;
     const INSDC_coord_len * read_len;
+    out_buf * out = &stx->rec;
 
     rc_t rc = read_read_len( stx, row_id, &read_len, nreads );
     if ( rc == 0 )
@@ -916,9 +1038,13 @@ static rc_t dump_seq_row_sam( const samdump_opts * const opts,
             if ( rc == 0 )
             {
                 if ( name != NULL && name_len > 0 )
-                    rc = KOutMsg( "%.*s\t", name_len, name );
+                {
+                    rc = out_sam_str( out, name, name_len );
+                    if ( rc == 0 )
+                        rc = out_sam_str( out, "\t", 1 );
+                }
                 else
-                    rc = KOutMsg( "%lu\t", row_id );
+                    rc = out_sam_i64( out, row_id );
             }
 
             /* SAM-FIELD: FLAG      SRA-column: calculated from READ_TYPE, READ_FILTER etc. */
@@ -926,7 +1052,7 @@ static rc_t dump_seq_row_sam( const samdump_opts * const opts,
             {
                 uint32_t sam_flags = calculate_unaligned_sam_flags_db( nreads, read_idx, mate_idx, 
                                             0, read_type, reverse, read_filter );
-                rc = KOutMsg( "%u\t", sam_flags );
+                rc = out_sam_i64( out, sam_flags );
             }
 
             /* SAM-FIELD: RNAME     SRA-column: none, fix '*' */
@@ -938,7 +1064,7 @@ static rc_t dump_seq_row_sam( const samdump_opts * const opts,
             /* SAM-FIELD: TLEN      SRA-column: none, fix '0' */
 
             if ( rc == 0 )
-                rc = KOutMsg( "*\t0\t0\t*\t*\t0\t0\t" );
+                rc = out_sam_str( out, "*\t0\t0\t*\t*\t0\t0\t", 14 );
 
             if ( rc == 0 && read == NULL )
                 rc = read_INSDC_dna_text_ptr( row_id, stx->cursor, stx->read_idx, &read, &rd_len, "READ" );
@@ -947,29 +1073,20 @@ static rc_t dump_seq_row_sam( const samdump_opts * const opts,
 
             /* SAM-FIELD: SEQ       SRA-column: READ, sliced by READ_START/READ_LEN */
             if ( rc == 0 )
-                rc = print_sliced_read( read, read_idx, reverse, read_start, read_len );
-            if ( rc == 0 )
-                rc = KOutMsg( "\t" );
+                rc = out_sliced_read( out, read, read_idx, reverse, read_start, read_len );
 
             if ( rc == 0 && quality == NULL )
                 rc = read_quality( stx, row_id, &quality, rd_len );
 
             /* SAM-FIELD: QUAL      SRA-column: QUALITY, sliced by READ_START/READ_LEN */
             if ( rc == 0 )
-                rc = print_sliced_quality( opts, quality, read_idx, reverse, read_start, read_len );
-
-            /* OPT SAM-FIIELD:      SRA-column: ALIGN_ID */
-            if ( rc == 0 && opts->print_alignment_id_in_column_xi )
-                rc = KOutMsg( "\tXI:i:%u", row_id );
+                rc = out_sliced_quality( opts, out, quality, read_idx, reverse, read_start, read_len );
 
-            /* OPT SAM-FIIELD:      SRA-column: SPOT_GROUP */
             if ( rc == 0 && spot_group == NULL )
                 rc = read_char_ptr( row_id, stx->cursor, stx->spot_group_idx, &spot_group, &spot_group_len, "SPOT_GROUP" );
-            if ( rc == 0 && ( spot_group != NULL ) && ( spot_group_len > 0 ) )
-                rc = KOutMsg( "\tRG:Z:%.*s", spot_group_len, spot_group );
 
-            if ( rc == 0 )
-                rc = KOutMsg( "\n" );
+            /* OPT SAM-FIELDS: XI, RG and the end of the record */
+            rc = out_sam_tail( opts, out, rc, row_id, spot_group, spot_group_len );
         }
     }
     return rc;
@@ -1027,7 +1144,7 @@ static rc_t dump_seq_row_fastx_filtered( const samdump_opts * const opts,
                         if ( opts->print_spot_group_in_name && spot_group == NULL )
                             rc = read_char_ptr( row_id, stx->cursor, stx->spot_group_idx, &spot_group, &spot_group_len, "SPOT_GROUP" );
                         if ( rc == 0 )
-                            rc = dump_name( opts, seq_spot_id, spot_group, spot_group_len ); /* sam-dump-opts.c */
+                            rc = dump_name( opts, NULL, seq_spot_id, spot_group, spot_group_len ); /* sam-dump-opts.c */
                         if ( rc == 0 )
                             rc = KOutMsg( "/%u unaligned\n", read_idx + 1 );
                     }
@@ -1107,7 +1224,7 @@ static rc_t dump_seq_row_fastx( const samdump_opts * const opts,
                 if ( opts->print_spot_group_in_name && spot_group == NULL )
                     rc = read_char_ptr( row_id, stx->cursor, stx->spot_group_idx, &spot_group, &spot_group_len, "SPOT_GROUP" );
                 if ( rc == 0 )
-                    rc = dump_name( opts, row_id, spot_group, spot_group_len ); /* sam-dump-opts.c */
+                    rc = dump_name( opts, NULL, row_id, spot_group, spot_group_len ); /* sam-dump-opts.c */
                 if ( rc == 0 )
                     rc = KOutMsg( "/%u unaligned\n", read_idx + 1 );
             }
@@ -1284,6 +1401,8 @@ static rc_t print_unaligned_database_filtered_2( const samdump_opts * const opts
                 VCursorRelease( ptx.cursor );
             }
         }
+        VCursorRelease( stx.cursor );
+        release_out_buf( &stx.rec );
     }
     return rc;
 }
@@ -1347,6 +1466,7 @@ static rc_t print_unaligned_database_filtered( const samdump_opts * const opts,
             }
         }
         VCursorRelease( stx.cursor );
+        release_out_buf( &stx.rec );
     }
     return rc;
 #endif
@@ -1409,6 +1529,7 @@ static rc_t print_unaligned_database_full( const samdump_opts * const opts,
             }
         }
         VCursorRelease( stx.cursor );
+        release_out_buf( &stx.rec );
     }
     return rc;
 }
@@ -1459,6 +1580,7 @@ static rc_t print_unaligned_table( const samdump_opts * const opts,
             }
         }
         VCursorRelease( stx.cursor );
+        release_out_buf( &stx.rec );
     }
     return rc;
 }
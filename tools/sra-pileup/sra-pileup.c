@@ -30,6 +30,8 @@
 #include "cmdline_cmn.h"
 #include "pileup_options.h"
 #include "dyn_string.h"
+#include "out_buf.h"
+#include "perf_log.h"
 #include "reref.h"
 #include "report_deletes.h"
 #include "ref_walker_0.h"
@@ -54,6 +56,10 @@
 #include <kfs/bzip.h>
 #include <kfs/gzip.h>
 
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+
 #include <insdc/sra.h>
 
 #include <kdb/manager.h>
@@ -98,6 +104,7 @@
 
 #define OPTION_MIN_M   "minmismatch"
 #define OPTION_MERGE   "merge-dist"
+#define OPTION_THREADS "threads"
 
 #define OPTION_FUNC    "function"
 #define ALIAS_FUNC     NULL
@@ -112,6 +119,10 @@
 #define FUNC_TEST       "test"
 #define FUNC_VARCOUNT   "varcount"
 #define FUNC_DELETES    "deletes"
+#define FUNC_DEPTH      "depth"
+
+#define PILEUP_DEFAULT_THREADS 6
+#define PILEUP_MAX_THREADS 64
 
 enum
 {
@@ -125,7 +136,8 @@ enum
     sra_pileup_index = 7,
     sra_pileup_test = 8,
     sra_pileup_varcount = 9,
-    sra_pileup_deletes = 10
+    sra_pileup_deletes = 10,
+    sra_pileup_depth = 11
 };
 
 static const char * minmapq_usage[]         = { "Minimum mapq-value, ", 
@@ -150,6 +162,9 @@ static const char * merge_usage[]           = { "If adjacent slices are closer t
                                                 "they are merged and a skiplist is created. ", 
                                                 "a value of zero disables the feature, default is 10000", NULL };
 
+static const char * threads_usage[]         = { "number of threads piling up parts of the references in parallel,",
+                                                "default is 6, not used for function stat and debug", NULL };
+
 static const char * no_qual_usage[]         = { "omit qualities", NULL };
 
 static const char * func_ref_usage[]        = { "list references", NULL };
@@ -166,6 +181,7 @@ static const char * func_varcount_usage[]   = { "variation counters: ",
                                                 "ins after A, ins after C, ins after G, ins after T", NULL };
 
 static const char * func_deletes_usage[]    = { "list deletions greater then 20", NULL };
+static const char * func_depth_usage[]      = { "coverage only: ref-name, ref-pos, depth", NULL };
 
 static const char * func_usage[]            = { "alternative functionality", NULL };
 
@@ -181,15 +197,40 @@ OptDef MyOptions[] =
     { OPTION_SEQNAME, ALIAS_SEQNAME, NULL, seqname_usage, 1,        false,       false },
     { OPTION_MIN_M,   NULL,          NULL, min_m_usage,   1,        true,        false },
     { OPTION_MERGE,   NULL,          NULL, merge_usage,   1,        true,        false },
+    { OPTION_THREADS, NULL,          NULL, threads_usage, 1,        true,        false },
     { OPTION_FUNC,    ALIAS_FUNC,    NULL, func_usage,    1,        true,        false }
 };
 
 /* =========================================================================================== */
 
+/* the qualities of the placement-records are not copied into a separately sized
+   tooldata-blob per record, they are appended to a shared slab instead. This keeps
+   the tooldata at a fixed size. A slab is recycled as soon as the reference-iterator
+   has destroyed the last record pointing into it. */
+
+#define QUAL_SLAB_SIZE ( 64 * 1024 )
+
+typedef struct qual_slab
+{
+    struct qual_slab * next;    /* link in the spare-list */
+    uint32_t size;
+    uint32_t used;
+    uint32_t refs;              /* number of records pointing into this slab */
+} qual_slab;
+
+
+typedef struct qual_pool
+{
+    qual_slab * current;        /* the slab new qualities are appended to */
+    qual_slab * spare;          /* unreferenced slabs ready to be reused */
+} qual_pool;
+
+
 typedef struct pileup_callback_data
 {
     const AlignMgr *almgr;
     pileup_options *options;
+    qual_pool quals;            /* every reference-iterator needs its own */
 } pileup_callback_data;
 
 
@@ -277,6 +318,13 @@ static rc_t get_pileup_options( Args * args, pileup_options *opts )
     if ( rc == 0 )
         rc = get_uint32_option( args, OPTION_MERGE, &opts->merge_dist, 10000 );
         
+    if ( rc == 0 )
+    {
+        rc = get_uint32_option( args, OPTION_THREADS, &opts->threads, PILEUP_DEFAULT_THREADS );
+        if ( opts->threads > PILEUP_MAX_THREADS )
+            opts->threads = PILEUP_MAX_THREADS;
+    }
+
     if ( rc == 0 )
         rc = get_bool_option( args, OPTION_DUPS, &opts->process_dups, false );
 
@@ -321,6 +369,8 @@ static rc_t get_pileup_options( Args * args, pileup_options *opts )
                 opts->function = sra_pileup_varcount;
             else if ( cmp_pchar( fkt, FUNC_DELETES ) == 0 )
                 opts->function = sra_pileup_deletes;
+            else if ( cmp_pchar( fkt, FUNC_DEPTH ) == 0 )
+                opts->function = sra_pileup_depth;
 
         }
     }
@@ -369,6 +419,7 @@ rc_t CC Usage ( const Args * args )
     HelpOptionLine ( ALIAS_SEQNAME, OPTION_SEQNAME, NULL, seqname_usage );
     HelpOptionLine ( NULL, OPTION_MIN_M, NULL, min_m_usage );
     HelpOptionLine ( NULL, OPTION_MERGE, NULL, merge_usage );
+    HelpOptionLine ( NULL, OPTION_THREADS, "count", threads_usage );
     HelpOptionLine ( ALIAS_NOQUAL, OPTION_NOQUAL, NULL, no_qual_usage );
 
     HelpOptionLine ( NULL, "function ref",      NULL, func_ref_usage );
@@ -379,6 +430,7 @@ rc_t CC Usage ( const Args * args )
     HelpOptionLine ( NULL, "function index",    NULL, func_index_usage );
     HelpOptionLine ( NULL, "function varcount", NULL, func_varcount_usage );
     HelpOptionLine ( NULL, "function deletes",  NULL, func_deletes_usage );
+    HelpOptionLine ( NULL, "function depth",    NULL, func_depth_usage );
 
     KOutMsg ( "\nGrouping of accessions into artificial spotgroups:\n" );
     KOutMsg ( "  sra-pileup SRRXXXXXX=a SRRYYYYYY=b SRRZZZZZZ=a\n\n" );
@@ -533,6 +585,89 @@ static rc_t read_base_and_len( struct VCursor const *curs,
 }
 
 
+static void qual_pool_init( qual_pool * self )
+{
+    self->current = NULL;
+    self->spare = NULL;
+}
+
+
+/* the reference-iterator has to be released before: no record points into a slab anymore */
+static void qual_pool_whack( qual_pool * self )
+{
+    qual_slab * slab = self->spare;
+    while ( slab != NULL )
+    {
+        qual_slab * next = slab->next;
+        free( slab );
+        slab = next;
+    }
+    if ( self->current != NULL )
+        free( self->current );
+    qual_pool_init( self );
+}
+
+
+static rc_t qual_pool_add( qual_pool * self, const uint8_t * quality, uint32_t len, tool_rec * rec )
+{
+    qual_slab * slab = self->current;
+    if ( slab != NULL && slab->used + len > slab->size )
+    {
+        if ( slab->refs == 0 && len <= slab->size )
+            slab->used = 0;     /* nobody points into it anymore, start over */
+        else
+        {
+            /* the last record released puts the slab back on the spare-list */
+            self->current = NULL;
+            if ( slab->refs == 0 )
+            {
+                slab->next = self->spare;
+                self->spare = slab;
+            }
+            slab = NULL;
+        }
+    }
+    if ( slab == NULL )
+    {
+        if ( self->spare != NULL && len <= self->spare->size )
+        {
+            slab = self->spare;
+            self->spare = slab->next;
+        }
+        else
+        {
+            uint32_t size = ( len > QUAL_SLAB_SIZE ) ? len : QUAL_SLAB_SIZE;
+            slab = malloc( ( sizeof *slab ) + size );
+            if ( slab == NULL )
+                return RC( rcApp, rcNoTarg, rcAllocating, rcMemory, rcExhausted );
+            slab->size = size;
+        }
+        slab->next = NULL;
+        slab->used = 0;
+        slab->refs = 0;
+        self->current = slab;
+    }
+
+    rec->quality = ( uint8_t * )slab;
+    rec->quality += ( sizeof *slab ) + slab->used;
+    memcpy( rec->quality, quality, len );
+    rec->slab = slab;
+    slab->used += len;
+    slab->refs++;
+    return 0;
+}
+
+
+static void qual_pool_release( qual_pool * self, qual_slab * slab )
+{
+    if ( --slab->refs == 0 && slab != self->current )
+    {
+        slab->next = self->spare;
+        self->spare = slab;
+    }
+}
+
+
 static rc_t CC populate_tooldata( void *obj, const PlacementRecord *placement,
         struct VCursor const *curs, INSDC_coord_zero ref_window_start, INSDC_coord_len ref_window_len,
         void *data, void * placement_ctx )
@@ -543,6 +678,8 @@ static rc_t CC populate_tooldata( void *obj, const PlacementRecord *placement,
     rc_t rc = 0;
 
     rec->quality = NULL;
+    rec->quality_len = 0;
+    rec->slab = NULL;
     if ( !cb_data->options->process_dups )
     {
         const uint8_t * read_filter;
@@ -568,21 +705,6 @@ static rc_t CC populate_tooldata( void *obj, const PlacementRecord *placement,
             rec->reverse = *orientation;
     }
 
-    if ( rc == 0 && !cb_data->options->omit_qualities )
-    {
-        const uint8_t * quality;
-        /*uint32_t quality_len;*/
-
-        rc = read_base_and_len( curs, col_ids->idx_quality, placement->id,
-                                (const void **)&quality, &rec->quality_len );
-        if ( rc == 0 )
-        {
-            rec->quality = ( uint8_t * )rec;
-            rec->quality += sizeof ( * rec );
-            memcpy( rec->quality, quality, rec->quality_len );
-        }
-    }
-
     if ( rc == 0 && cb_data->options->read_tlen )
     {
         const int32_t * tlen;
@@ -598,130 +720,224 @@ static rc_t CC populate_tooldata( void *obj, const PlacementRecord *placement,
     else
         rec->tlen = 0;
 
+    /* the last step: nothing can fail after the quality holds a reference to a slab */
+    if ( rc == 0 && !cb_data->options->omit_qualities )
+    {
+        const uint8_t * quality;
+        uint32_t quality_len;
+
+        rc = read_base_and_len( curs, col_ids->idx_quality, placement->id,
+                                (const void **)&quality, &quality_len );
+        if ( rc == 0 )
+        {
+            rc = qual_pool_add( &cb_data->quals, quality, quality_len, rec );
+            if ( rc == 0 )
+                rec->quality_len = quality_len;
+        }
+    }
+
     return rc;
 }
 
 
-static rc_t CC alloc_size( struct VCursor const *curs, int64_t row_id, size_t * size, void *data, void * placement_ctx )
+static void CC destroy_tooldata( void *obj, void *data )
+{
+    tool_rec * rec = ( tool_rec * ) obj;
+    pileup_callback_data * cb_data = ( pileup_callback_data * )data;
+    if ( rec->slab != NULL )
+    {
+        qual_pool_release( &cb_data->quals, rec->slab );
+        rec->slab = NULL;
+    }
+}
+
+
+/* the tooldata has a fixed size, the reference-iterator does not have to ask for it per record */
+static void make_tooldata_funcs( PlacementRecordExtendFuncs * cb_block, pileup_callback_data * cb_data )
+{
+    cb_block->data = cb_data;
+    cb_block->destroy = cb_data->options->omit_qualities ? NULL : destroy_tooldata;
+    cb_block->populate = populate_tooldata;
+    cb_block->alloc_size = NULL;
+    cb_block->fixed_size = sizeof( tool_rec );
+}
+
+
+/* state of the samtools-style output: lines are formatted directly into the output-buffer */
+
+#define PILEUP_OUT_BUF_SIZE ( 256 * 1024 )
+#define PILEUP_QUAL_SIZE 4096
+
+/* '^' + mapq + base, and '$' */
+#define PLACEMENT_CHARS 4
+/* "+4294967295" */
+#define INDEL_LEN_CHARS 11
+/* "(%,lu:%,d-%,d/%u)" */
+#define SHOW_ID_CHARS 96
+/* tabs, ref-pos, ref-base and depth after the ref-name */
+#define LINE_HEAD_CHARS 32
+
+typedef struct samtools_ctx
+{
+    out_buf out;                /* out_buf.h */
+    char * qual;                /* quality-chars of the current spotgroup */
+    uint32_t qual_size;
+    const char * refname;
+    size_t refname_len;
+    char base_tab[ 32 ];        /* 4na ( | 0x10 for reverse ) ---> ascii */
+    char qual_tab[ 256 ];       /* phred-value ---> ascii */
+} samtools_ctx;
+
+
+static rc_t init_samtools_ctx( samtools_ctx * ctx, pileup_options *options )
 {
     rc_t rc = 0;
-    tool_rec * rec;
-    pileup_callback_data *cb_data = ( pileup_callback_data * )data;
-    pileup_col_ids * col_ids = placement_ctx;
-    *size = ( sizeof *rec );
+    uint32_t i;
 
-    if ( !cb_data->options->omit_qualities )
+    for ( i = 0; i < 16; ++i )
     {
-        uint32_t q_len;
-        rc = read_base_and_len( curs, col_ids->idx_quality, row_id, NULL, &q_len );
-        if ( rc == 0 )
-            *size += q_len;
+        ctx->base_tab[ i ] = _4na_to_ascii( i, false );
+        ctx->base_tab[ i | 0x10 ] = _4na_to_ascii( i, true );
+    }
+    for ( i = 0; i < 256; ++i )
+        ctx->qual_tab[ i ] = ( char )( i + 33 );
+
+    ctx->refname = NULL;
+    ctx->refname_len = 0;
+    ctx->qual_size = PILEUP_QUAL_SIZE;
+    ctx->qual = malloc( ctx->qual_size );
+    if ( ctx->qual == NULL )
+        rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+    else
+    {
+        rc = init_out_buf( &ctx->out, PILEUP_OUT_BUF_SIZE, options->out ); /* out_buf.c */
+        if ( rc != 0 )
+        {
+            free( ctx->qual );
+            ctx->qual = NULL;
+        }
     }
     return rc;
 }
 
 
+static void release_samtools_ctx( samtools_ctx * ctx )
+{
+    release_out_buf( &ctx->out );
+    free( ctx->qual );
+}
+
+
 static rc_t walk_ref_position( ReferenceIterator *ref_iter,
                                const PlacementRecord *rec,
-                               struct dyn_string *line,
+                               samtools_ctx * ctx,
                                char * qual,
                                pileup_options *options )
 {
-    rc_t rc = 0;
+    out_buf * out = &ctx->out;
     INSDC_coord_zero seq_pos;
     int32_t state = ReferenceIteratorState ( ref_iter, &seq_pos );
     tool_rec *xrec = ( tool_rec * ) PlacementRecordCast ( rec, placementRecordExtension1 );
     bool reverse = xrec->reverse;
+    uint32_t rev = reverse ? 0x10 : 0;
+    rc_t rc;
 
     if ( !options->omit_qualities )
     {
         if ( seq_pos < xrec->quality_len )
-            *qual = xrec->quality[ seq_pos ];
+            *qual = ctx->qual_tab[ xrec->quality[ seq_pos ] ];
         else
-            *qual = 2;
+            *qual = ctx->qual_tab[ 2 ];
     }
 
+    rc = reserve_out_buf( out, PLACEMENT_CHARS );
+    if ( rc != 0 )
+        return rc;
+
     if ( ( state & align_iter_invalid ) == align_iter_invalid )
     {
-        return add_char_2_dyn_string( line, '?' );
+        out_buf_char( out, '?' );
+        return 0;
     }
 
     if ( ( state & align_iter_first ) == align_iter_first )
     {
-        char s[ 3 ];
         int32_t c = rec->mapq + 33;
         if ( c > '~' ) { c = '~'; }
         if ( c < 33 ) { c = 33; }
-        s[ 0 ] = '^';
-        s[ 1 ] = c;
-        s[ 2 ] = 0;
-        rc = add_string_2_dyn_string( line, s );
+        out_buf_char( out, '^' );
+        out_buf_char( out, ( char )c );
     }
 
-    if ( rc == 0 )
+    if ( ( state & align_iter_skip ) == align_iter_skip )
     {
-        if ( ( state & align_iter_skip ) == align_iter_skip )
-        {
-            if ( reverse )
-                rc = add_char_2_dyn_string( line, '<' );
-            else
-                rc = add_char_2_dyn_string( line, '>' );
-            if ( !options->omit_qualities )
-                *qual = xrec->quality[ seq_pos + 1 ];
-        }
-        else
-        {
-            if ( ( state & align_iter_match ) == align_iter_match )
-                rc = add_char_2_dyn_string( line, ( reverse ? ',' : '.' ) );
-            else
-                rc = add_char_2_dyn_string( line, _4na_to_ascii( state, reverse ) );
-        }
+        out_buf_char( out, reverse ? '<' : '>' );
+        if ( !options->omit_qualities )
+            *qual = ctx->qual_tab[ xrec->quality[ seq_pos + 1 ] ];
     }
+    else if ( ( state & align_iter_match ) == align_iter_match )
+        out_buf_char( out, reverse ? ',' : '.' );
+    else
+        out_buf_char( out, ctx->base_tab[ ( state & 0x0F ) | rev ] );
 
     if ( ( state & align_iter_insert ) == align_iter_insert )
     {
         const INSDC_4na_bin *bases;
-        uint32_t i;
         uint32_t n = ReferenceIteratorBasesInserted ( ref_iter, &bases );
-        
-        rc = print_2_dyn_string( line, "+%u", n );
-        for ( i = 0; i < n && rc == 0; ++i )
+        rc = reserve_out_buf( out, INDEL_LEN_CHARS + n + PLACEMENT_CHARS );
+        if ( rc == 0 )
         {
-            rc = add_char_2_dyn_string( line, _4na_to_ascii( bases[ i ], reverse ) );
+            uint32_t i;
+            out_buf_char( out, '+' );
+            out_buf_u32( out, n );
+            for ( i = 0; i < n; ++i )
+                out_buf_char( out, ctx->base_tab[ ( bases[ i ] & 0x0F ) | rev ] );
         }
     }
 
-    if ( ( state & align_iter_delete ) == align_iter_delete )
+    if ( rc == 0 && ( state & align_iter_delete ) == align_iter_delete )
     {
         const INSDC_4na_bin *bases;
         INSDC_coord_zero ref_pos;
         uint32_t n = ReferenceIteratorBasesDeleted ( ref_iter, &ref_pos, &bases );
         if ( bases != NULL )
         {
-            uint32_t i;
-            rc = print_2_dyn_string( line, "-%u", n );
-            for ( i = 0; i < n && rc == 0; ++i )
+            rc = reserve_out_buf( out, INDEL_LEN_CHARS + n + PLACEMENT_CHARS );
+            if ( rc == 0 )
             {
-                rc = add_char_2_dyn_string( line, _4na_to_ascii( bases[ i ], reverse ) );
+                uint32_t i;
+                out_buf_char( out, '-' );
+                out_buf_u32( out, n );
+                for ( i = 0; i < n; ++i )
+                    out_buf_char( out, ctx->base_tab[ ( bases[ i ] & 0x0F ) | rev ] );
             }
             free( (void *) bases );
         }
     }
 
-    if ( ( ( state & align_iter_last ) == align_iter_last )&& ( rc == 0 ) )
-        rc = add_char_2_dyn_string( line, '$' );
+    /* the reservations above always leave room for the '$' */
+    if ( rc == 0 && ( state & align_iter_last ) == align_iter_last )
+        out_buf_char( out, '$' );
 
-    if ( options->show_id )
-        rc = print_2_dyn_string( line, "(%,lu:%,d-%,d/%u)",
-                                 rec->id, rec->pos + 1, rec->pos + rec->len, seq_pos );
+    if ( rc == 0 && options->show_id )
+    {
+        rc = reserve_out_buf( out, SHOW_ID_CHARS );
+        if ( rc == 0 )
+        {
+            size_t num_writ;
+            rc = string_printf ( &out->data[ out->used ], out->size - out->used, &num_writ,
+                                 "(%,lu:%,d-%,d/%u)", rec->id, rec->pos + 1, rec->pos + rec->len, seq_pos );
+            if ( rc == 0 )
+                out->used += num_writ;
+        }
+    }
 
     return rc;
 }
 
 
 static rc_t walk_alignments( ReferenceIterator *ref_iter,
-                             struct dyn_string *line,
-                             struct dyn_string *qualities,
+                             samtools_ctx * ctx,
                              pileup_options *options )
 {
     uint32_t depth = 0;
@@ -731,30 +947,28 @@ static rc_t walk_alignments( ReferenceIterator *ref_iter,
         const PlacementRecord *rec;
         rc = ReferenceIteratorNextPlacement ( ref_iter, &rec );
         if ( rc == 0 )
-            rc = walk_ref_position( ref_iter, rec, line, dyn_string_char( qualities, depth++ ), options );
+            rc = walk_ref_position( ref_iter, rec, ctx, &ctx->qual[ depth++ ], options );
         if ( rc == 0 )
             rc = Quitting();
     } while ( rc == 0 );
+    if ( GetRCState( rc ) == rcDone ) { rc = 0; }
 
-    if ( !options->omit_qualities )
+    /* the quality-chars are already translated, append them in one piece */
+    if ( rc == 0 && !options->omit_qualities )
     {
-        uint32_t i;
-        add_char_2_dyn_string( line, '\t' );
-        for ( i = 0; i < depth; ++i )
+        rc = reserve_out_buf( &ctx->out, depth + 1 );
+        if ( rc == 0 )
         {
-            char * c = dyn_string_char( qualities, i );
-            add_char_2_dyn_string( line, *c + 33 );
+            out_buf_char( &ctx->out, '\t' );
+            out_buf_mem( &ctx->out, ctx->qual, depth );
         }
     }
-
-    if ( GetRCState( rc ) == rcDone ) { rc = 0; }
     return rc;
 }
 
 
 static rc_t walk_spot_groups( ReferenceIterator *ref_iter,
-                              struct dyn_string *line,
-                              struct dyn_string *qualities,
+                              samtools_ctx * ctx,
                               pileup_options *options )
 {
     rc_t rc;
@@ -762,9 +976,13 @@ static rc_t walk_spot_groups( ReferenceIterator *ref_iter,
     {
         rc = ReferenceIteratorNextSpotGroup ( ref_iter, NULL, NULL );
         if ( rc == 0 )
-            add_char_2_dyn_string( line, '\t' );
+        {
+            rc = reserve_out_buf( &ctx->out, 1 );
+            if ( rc == 0 )
+                out_buf_char( &ctx->out, '\t' );
+        }
         if ( rc == 0 )
-            rc = walk_alignments( ref_iter, line, qualities, options );
+            rc = walk_alignments( ref_iter, ctx, options );
     } while ( rc == 0 );
 
     if ( GetRCState( rc ) == rcDone ) { rc = 0; }
@@ -773,9 +991,7 @@ static rc_t walk_spot_groups( ReferenceIterator *ref_iter,
 
 
 static rc_t walk_position( ReferenceIterator *ref_iter,
-                           const char * refname,
-                           struct dyn_string *line,
-                           struct dyn_string *qualities,
+                           samtools_ctx * ctx,
                            pileup_options *options )
 {
     INSDC_coord_zero pos;
@@ -795,29 +1011,46 @@ static rc_t walk_position( ReferenceIterator *ref_iter,
         bool skip = skiplist_is_skip_position( options->skiplist, pos + 1 );
         if ( !skip )
         {
-            rc = expand_dyn_string( line, ( 5 * depth ) + 100 );
+            if ( depth > ctx->qual_size )
+            {
+                char * p = realloc( ctx->qual, depth + 100 );
+                if ( p == NULL )
+                    rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+                else
+                {
+                    ctx->qual = p;
+                    ctx->qual_size = depth + 100;
+                }
+            }
+            if ( rc == 0 )
+                rc = reserve_out_buf( &ctx->out, ctx->refname_len + LINE_HEAD_CHARS );
             if ( rc == 0 )
             {
-                rc = expand_dyn_string( qualities, depth + 100 );
+                out_buf * out = &ctx->out;
+
+                out_buf_mem( out, ctx->refname, ctx->refname_len );
+                out_buf_char( out, '\t' );
+                out_buf_u32( out, pos + 1 );
+                out_buf_char( out, '\t' );
+                out_buf_char( out, ctx->base_tab[ base & 0x0F ] );
+                out_buf_char( out, '\t' );
+                out_buf_u32( out, depth );
+
+                if ( depth > 0 )
+                    rc = walk_spot_groups( ref_iter, ctx, options );
+
                 if ( rc == 0 )
                 {
-                    char c = _4na_to_ascii( base, false );
-
-                    reset_dyn_string( line );
-                    rc = print_2_dyn_string( line, "%s\t%u\t%c\t%u", refname, pos + 1, c, depth );
+                    rc = reserve_out_buf( out, 1 );
                     if ( rc == 0 )
-                    {
-                        if ( depth > 0 )
-                            rc = walk_spot_groups( ref_iter, line, qualities, options );
+                        out_buf_char( out, '\n' );
+                }
 
-                        /* only one KOutMsg() per line... */
-                        if ( rc == 0 )
-                            rc = KOutMsg( "%s\n", dyn_string_char( line, 0 ) );
+                if ( rc == 0 && options->perf_log != NULL )
+                    perf_log_line( options->perf_log, pos + 1 );
 
-                        if ( GetRCState( rc ) == rcDone )
-                            rc = 0;
-                    }
-                }
+                if ( GetRCState( rc ) == rcDone )
+                    rc = 0;
             }
         }
     } 
@@ -826,9 +1059,7 @@ static rc_t walk_position( ReferenceIterator *ref_iter,
 
 
 static rc_t walk_reference_window( ReferenceIterator *ref_iter,
-                                   const char * refname,
-                                   struct dyn_string *line,
-                                   struct dyn_string *qualities,
+                                   samtools_ctx * ctx,
                                    pileup_options *options )
 {
     rc_t rc = 0;
@@ -844,7 +1075,7 @@ static rc_t walk_reference_window( ReferenceIterator *ref_iter,
         }
         else
         {
-            rc = walk_position( ref_iter, refname, line, qualities, options );
+            rc = walk_position( ref_iter, ctx, options );
         }
         if ( rc == 0 )
         {
@@ -857,39 +1088,28 @@ static rc_t walk_reference_window( ReferenceIterator *ref_iter,
 
 
 static rc_t walk_reference( ReferenceIterator *ref_iter,
-                            const char * refname,
+                            samtools_ctx * ctx,
                             pileup_options *options )
 {
-    struct dyn_string * line;
-    rc_t rc = allocated_dyn_string ( &line, 4096 );
-    if ( rc == 0 )
+    rc_t rc = 0;
+    while ( rc == 0 )
     {
-        struct dyn_string * qualities;
-        rc = allocated_dyn_string ( &qualities, 4096 );
+        rc = Quitting ();
         if ( rc == 0 )
         {
-            while ( rc == 0 )
+            INSDC_coord_zero first_pos;
+            INSDC_coord_len len;
+            rc = ReferenceIteratorNextWindow ( ref_iter, &first_pos, &len );
+            if ( rc != 0 )
             {
-                rc = Quitting ();
-                if ( rc == 0 )
+                if ( GetRCState( rc ) != rcDone )
                 {
-                    INSDC_coord_zero first_pos;
-                    INSDC_coord_len len;
-                    rc = ReferenceIteratorNextWindow ( ref_iter, &first_pos, &len );
-                    if ( rc != 0 )
-                    {
-                        if ( GetRCState( rc ) != rcDone )
-                        {
-                            LOGERR( klogInt, rc, "ReferenceIteratorNextWindow() failed" );
-                        }
-                    }
-                    else
-                        rc = walk_reference_window( ref_iter, refname, line, qualities, options );
+                    LOGERR( klogInt, rc, "ReferenceIteratorNextWindow() failed" );
                 }
             }
-            free_dyn_string ( qualities );
+            else
+                rc = walk_reference_window( ref_iter, ctx, options );
         }
-        free_dyn_string ( line );
     }
     if ( GetRCState( rc ) == rcDone ) rc = 0;
     return rc;
@@ -901,7 +1121,8 @@ static rc_t walk_reference( ReferenceIterator *ref_iter,
 
 static rc_t walk_ref_iter( ReferenceIterator *ref_iter, pileup_options *options )
 {
-    rc_t rc = 0;
+    samtools_ctx ctx;
+    rc_t rc = init_samtools_ctx( &ctx, options );
     while( rc == 0 )
     {
         /* this is the 1st level of walking the reference-iterator: 
@@ -923,7 +1144,15 @@ static rc_t walk_ref_iter( ReferenceIterator *ref_iter, pileup_options *options
                 {
                     if ( options->skiplist != NULL )
                         skiplist_enter_ref( options->skiplist, refname );
-                    rc = walk_reference( ref_iter, refname, options );
+                    if ( options->perf_log != NULL )
+                        perf_log_start_sub_section( options->perf_log, refname );
+
+                    ctx.refname = refname;
+                    ctx.refname_len = string_size( refname );
+                    rc = walk_reference( ref_iter, &ctx, options );
+
+                    if ( options->perf_log != NULL )
+                        perf_log_end_sub_section( options->perf_log );
                 }
                 else
                 {
@@ -948,6 +1177,14 @@ static rc_t walk_ref_iter( ReferenceIterator *ref_iter, pileup_options *options
     }
     if ( GetRCState( rc ) == rcDone ) { rc = 0; }
     if ( GetRCState( rc ) == rcCanceled ) { rc = 0; }
+    if ( ctx.qual != NULL )
+    {
+        /* what is already formatted is printed, even on cancel */
+        rc_t rc2 = flush_out_buf( &ctx.out );
+        if ( rc == 0 )
+            rc = rc2;
+        release_samtools_ctx( &ctx );
+    }
     return rc;
 }
 
@@ -1091,7 +1328,8 @@ static rc_t make_cursor_ids( Vector *cursor_id_vector, pileup_col_ids ** cursor_
 }
 
 
-static rc_t CC prepare_section_cb( prepare_ctx * ctx, const struct reference_range * range )
+static rc_t get_section_bounds( prepare_ctx * ctx, const struct reference_range * range,
+                                uint32_t * start, uint32_t * end )
 {
     rc_t rc = 0;
     INSDC_coord_len len;
@@ -1112,163 +1350,454 @@ static rc_t CC prepare_section_cb( prepare_ctx * ctx, const struct reference_ran
         }
         else
         {
-            uint32_t start, end;
-            rc_t rc1 = 0, rc2 = 0, rc3 = 0;
-
             if ( range == NULL )
             {
-                start = 1;
-                end = ( len - start ) + 1;
+                *start = 1;
+                *end = ( len - *start ) + 1;
             }
             else
             {
-                start = get_ref_range_start( range );
-                end   = get_ref_range_end( range );
+                *start = get_ref_range_start( range );
+                *end   = get_ref_range_end( range );
             }
 
-            if ( start == 0 ) start = 1;
-            if ( ( end == 0 )||( end > len + 1 ) )
+            if ( *start == 0 ) *start = 1;
+            if ( ( *end == 0 )||( *end > len + 1 ) )
             {
-                end = ( len - start ) + 1;
+                *end = ( len - *start ) + 1;
             }
-            
-            /* depending on ctx->select prepare primary, secondary or both... */
-            if ( ctx->use_primary_alignments )
-            {
-                if ( ctx->prim_cur == NULL )
-                {
-                    rc1 = make_cursor_ids( ctx->data, &ctx->prim_cur_ids );
-                    if ( rc1 != 0 )
-                    {
-                        LOGERR( klogInt, rc1, "cannot create cursor-ids for prim. alignment cursor" );
-                    }
-                    else
-                        rc1 = prepare_prim_cursor( ctx->db, &ctx->prim_cur, ctx->omit_qualities,
-                                                   ctx->read_tlen, ctx->prim_cur_ids );
-                }
+        }
+    }
+    return rc;
+}
 
-                if ( rc1 == 0 )
-                {
-                    /* show_placement_params( "primary", ctx->refobj, start, end ); */
-                    rc1 = ReferenceIteratorAddPlacements ( ctx->ref_iter,       /* the outer ref-iter */
-                                                          ctx->refobj,          /* the ref-obj for this chromosome */
-                                                          start - 1,            /* start ( zero-based ) */
-                                                          end - start + 1,      /* length */
-                                                          NULL,                 /* ref-cursor */
-                                                          ctx->prim_cur,        /* align-cursor */
-                                                          primary_align_ids,    /* which id's */
-                                                          ctx->spot_group,      /* what read-group */
-                                                          ctx->prim_cur_ids     /* placement-context */
-                                                         );
-                    if ( rc1 != 0 )
-                    {
-                        LOGERR( klogInt, rc1, "ReferenceIteratorAddPlacements(prim) failed" );
-                    }
-                }
-            }
 
-            if ( ctx->use_secondary_alignments )
+static rc_t prepare_section( prepare_ctx * ctx, uint32_t start, uint32_t end )
+{
+    rc_t rc = 0, rc1 = 0, rc2 = 0, rc3 = 0;
+
+    /* depending on ctx->select prepare primary, secondary or both... */
+    if ( ctx->use_primary_alignments )
+    {
+        if ( ctx->prim_cur == NULL )
+        {
+            rc1 = make_cursor_ids( ctx->data, &ctx->prim_cur_ids );
+            if ( rc1 != 0 )
             {
-                if ( ctx->sec_cur == NULL )
-                {
-                    rc2 = make_cursor_ids( ctx->data, &ctx->sec_cur_ids );
-                    if ( rc2 != 0 )
-                    {
-                        LOGERR( klogInt, rc2, "cannot create cursor-ids for sec. alignment cursor" );
-                    }
-                    else
-                        rc2 = prepare_sec_cursor( ctx->db, &ctx->sec_cur, ctx->omit_qualities,
-                                                  ctx->read_tlen, ctx->sec_cur_ids );
-                }
+                LOGERR( klogInt, rc1, "cannot create cursor-ids for prim. alignment cursor" );
+            }
+            else
+                rc1 = prepare_prim_cursor( ctx->db, &ctx->prim_cur, ctx->omit_qualities,
+                                           ctx->read_tlen, ctx->prim_cur_ids );
+        }
 
-                if ( rc2 == 0 )
-                {
-                    /* show_placement_params( "secondary", ctx->refobj, start, end ); */
-                    rc2 = ReferenceIteratorAddPlacements ( ctx->ref_iter,       /* the outer ref-iter */
-                                                          ctx->refobj,          /* the ref-obj for this chromosome */
-                                                          start - 1,            /* start ( zero-based ) */
-                                                          end - start + 1,      /* length */
-                                                          NULL,                 /* ref-cursor */
-                                                          ctx->sec_cur,         /* align-cursor */
-                                                          secondary_align_ids,  /* which id's */
-                                                          ctx->spot_group,      /* what read-group */
-                                                          ctx->sec_cur_ids      /* placement-context */
-                                                         );
-                    if ( rc2 != 0 )
-                    {
-                        LOGERR( klogInt, rc2, "ReferenceIteratorAddPlacements(sec) failed" );
-                    }
-                }
+        if ( rc1 == 0 )
+        {
+            /* show_placement_params( "primary", ctx->refobj, start, end ); */
+            rc1 = ReferenceIteratorAddPlacements ( ctx->ref_iter,       /* the outer ref-iter */
+                                                  ctx->refobj,          /* the ref-obj for this chromosome */
+                                                  start - 1,            /* start ( zero-based ) */
+                                                  end - start + 1,      /* length */
+                                                  NULL,                 /* ref-cursor */
+                                                  ctx->prim_cur,        /* align-cursor */
+                                                  primary_align_ids,    /* which id's */
+                                                  ctx->spot_group,      /* what read-group */
+                                                  ctx->prim_cur_ids     /* placement-context */
+                                                 );
+            if ( rc1 != 0 )
+            {
+                LOGERR( klogInt, rc1, "ReferenceIteratorAddPlacements(prim) failed" );
             }
+        }
+    }
 
-            if ( ctx->use_evidence_alignments )
+    if ( ctx->use_secondary_alignments )
+    {
+        if ( ctx->sec_cur == NULL )
+        {
+            rc2 = make_cursor_ids( ctx->data, &ctx->sec_cur_ids );
+            if ( rc2 != 0 )
             {
-                if ( ctx->ev_cur == NULL )
-                {
-                    rc3 = make_cursor_ids( ctx->data, &ctx->ev_cur_ids );
-                    if ( rc3 != 0 )
-                    {
-                        LOGERR( klogInt, rc3, "cannot create cursor-ids for ev. alignment cursor" );
-                    }
-                    else
-                        rc3 = prepare_evidence_cursor( ctx->db, &ctx->ev_cur, ctx->omit_qualities,
-                                                       ctx->read_tlen, ctx->ev_cur_ids );
-                }
+                LOGERR( klogInt, rc2, "cannot create cursor-ids for sec. alignment cursor" );
+            }
+            else
+                rc2 = prepare_sec_cursor( ctx->db, &ctx->sec_cur, ctx->omit_qualities,
+                                          ctx->read_tlen, ctx->sec_cur_ids );
+        }
 
-                if ( rc3 == 0 )
-                {
-                    /* show_placement_params( "evidende", ctx->refobj, start, end ); */
-                    rc3 = ReferenceIteratorAddPlacements ( ctx->ref_iter,       /* the outer ref-iter */
-                                                          ctx->refobj,          /* the ref-obj for this chromosome */
-                                                          start - 1,            /* start ( zero-based ) */
-                                                          end - start + 1,      /* length */
-                                                          NULL,                 /* ref-cursor */
-                                                          ctx->ev_cur,          /* align-cursor */
-                                                          evidence_align_ids,   /* which id's */
-                                                          ctx->spot_group,      /* what read-group */
-                                                          ctx->ev_cur_ids       /* placement-context */
-                                                         );
-                    if ( rc3 != 0 )
-                    {
-                        LOGERR( klogInt, rc3, "ReferenceIteratorAddPlacements(evidence) failed" );
-                    }
-                }
+        if ( rc2 == 0 )
+        {
+            /* show_placement_params( "secondary", ctx->refobj, start, end ); */
+            rc2 = ReferenceIteratorAddPlacements ( ctx->ref_iter,       /* the outer ref-iter */
+                                                  ctx->refobj,          /* the ref-obj for this chromosome */
+                                                  start - 1,            /* start ( zero-based ) */
+                                                  end - start + 1,      /* length */
+                                                  NULL,                 /* ref-cursor */
+                                                  ctx->sec_cur,         /* align-cursor */
+                                                  secondary_align_ids,  /* which id's */
+                                                  ctx->spot_group,      /* what read-group */
+                                                  ctx->sec_cur_ids      /* placement-context */
+                                                 );
+            if ( rc2 != 0 )
+            {
+                LOGERR( klogInt, rc2, "ReferenceIteratorAddPlacements(sec) failed" );
             }
+        }
+    }
 
-            if ( rc1 == SILENT_RC( rcAlign, rcType, rcAccessing, rcRow, rcNotFound ) )
-            { /* from allocate_populate_rec */
-                rc = rc1;
+    if ( ctx->use_evidence_alignments )
+    {
+        if ( ctx->ev_cur == NULL )
+        {
+            rc3 = make_cursor_ids( ctx->data, &ctx->ev_cur_ids );
+            if ( rc3 != 0 )
+            {
+                LOGERR( klogInt, rc3, "cannot create cursor-ids for ev. alignment cursor" );
             }
-            else if ( rc1 == 0 )
-                rc = 0;
-            else if ( rc2 == 0 )
-                rc = 0;
-            else if ( rc3 == 0 )
-                rc = 0;
             else
-                rc = rc1;
+                rc3 = prepare_evidence_cursor( ctx->db, &ctx->ev_cur, ctx->omit_qualities,
+                                               ctx->read_tlen, ctx->ev_cur_ids );
+        }
+
+        if ( rc3 == 0 )
+        {
+            /* show_placement_params( "evidende", ctx->refobj, start, end ); */
+            rc3 = ReferenceIteratorAddPlacements ( ctx->ref_iter,       /* the outer ref-iter */
+                                                  ctx->refobj,          /* the ref-obj for this chromosome */
+                                                  start - 1,            /* start ( zero-based ) */
+                                                  end - start + 1,      /* length */
+                                                  NULL,                 /* ref-cursor */
+                                                  ctx->ev_cur,          /* align-cursor */
+                                                  evidence_align_ids,   /* which id's */
+                                                  ctx->spot_group,      /* what read-group */
+                                                  ctx->ev_cur_ids       /* placement-context */
+                                                 );
+            if ( rc3 != 0 )
+            {
+                LOGERR( klogInt, rc3, "ReferenceIteratorAddPlacements(evidence) failed" );
+            }
         }
     }
+
+    if ( rc1 == SILENT_RC( rcAlign, rcType, rcAccessing, rcRow, rcNotFound ) )
+    { /* from allocate_populate_rec */
+        rc = rc1;
+    }
+    else if ( rc1 == 0 )
+        rc = 0;
+    else if ( rc2 == 0 )
+        rc = 0;
+    else if ( rc3 == 0 )
+        rc = 0;
+    else
+        rc = rc1;
     return rc;
 }
 
 
-typedef struct foreach_arg_ctx
+static rc_t CC prepare_section_cb( prepare_ctx * ctx, const struct reference_range * range )
 {
-    pileup_options *options;
-    const VDBManager *vdb_mgr;
-    VSchema *vdb_schema;
-    ReferenceIterator *ref_iter;
-    BSTree *ranges;
-    Vector *cursor_ids;
-} foreach_arg_ctx;
+    uint32_t start, end;
+    rc_t rc = get_section_bounds( ctx, range, &start, &end );
+    if ( rc == 0 )
+        rc = prepare_section( ctx, start, end );
+    return rc;
+}
 
 
-/* called for each source-file/accession */
-static rc_t CC on_argument( const char * path, const char * spot_group, void * data )
-{
-    rc_t rc = 0;
-    foreach_arg_ctx * ctx = ( foreach_arg_ctx * )data;
+/* =========================================================================================== */
+/* parallel pileup, part 1: the plan
+
+   Instead of loading one ReferenceIterator, the sections ( whole references or requested
+   regions ) of all inputs are recorded in the order the serial walk would visit them.
+   The same section found in different inputs is recorded once, with one part per input.
+   Every section is then cut into chunks, which are independent for all functions that
+   produce output per reference-position. */
+
+#define PILEUP_CHUNK_LEN ( 100 * 1024 )
+
+typedef struct pileup_input
+{
+    char * path;
+    char * spot_group;
+} pileup_input;
+
+
+typedef struct pileup_part
+{
+    uint32_t input;     /* index into plan->inputs */
+    uint32_t ref_idx;   /* index of the reference in the reference-list of this input */
+} pileup_part;
+
+
+typedef struct pileup_section
+{
+    BSTNode node;
+    char * name;        /* SEQ_ID of the reference */
+    uint32_t start;     /* 1-based, as calculated by get_section_bounds() */
+    uint32_t end;
+    uint32_t part_count;
+    pileup_part * parts;
+} pileup_section;
+
+
+typedef struct pileup_chunk
+{
+    const pileup_section * section;
+    uint32_t start;
+    uint32_t end;
+    struct dyn_string * out;    /* output of the chunk, written by a worker-thread */
+    rc_t rc;
+    bool done;
+} pileup_chunk;
+
+
+typedef struct pileup_plan
+{
+    Vector inputs;          /* pileup_input's */
+    Vector sections;        /* pileup_section's in the order of the serial walk */
+    BSTree section_tree;    /* the same sections, to find a section again for the next input */
+    pileup_chunk * chunks;
+    uint32_t chunk_count;
+} pileup_plan;
+
+
+static void init_plan( pileup_plan * plan )
+{
+    VectorInit ( &plan->inputs, 0, 10 );
+    VectorInit ( &plan->sections, 0, 100 );
+    BSTreeInit ( &plan->section_tree );
+    plan->chunks = NULL;
+    plan->chunk_count = 0;
+}
+
+
+static void CC plan_input_whack( void *item, void *data )
+{
+    pileup_input * input = item;
+    free( input->path );
+    if ( input->spot_group != NULL )
+        free( input->spot_group );
+    free( input );
+}
+
+
+static void CC plan_section_whack( void *item, void *data )
+{
+    pileup_section * section = item;
+    free( section->name );
+    if ( section->parts != NULL )
+        free( section->parts );
+    free( section );
+}
+
+
+static void release_plan( pileup_plan * plan )
+{
+    if ( plan->chunks != NULL )
+    {
+        uint32_t i;
+        for ( i = 0; i < plan->chunk_count; ++i )
+        {
+            if ( plan->chunks[ i ].out != NULL )
+                free_dyn_string( plan->chunks[ i ].out );
+        }
+        free( plan->chunks );
+    }
+    /* the tree only indexes the nodes owned by the vector */
+    VectorWhack ( &plan->sections, plan_section_whack, NULL );
+    VectorWhack ( &plan->inputs, plan_input_whack, NULL );
+}
+
+
+static rc_t plan_add_input( pileup_plan * plan, const char * path, const char * spot_group )
+{
+    rc_t rc = 0;
+    pileup_input * input = calloc( 1, sizeof *input );
+    if ( input == NULL )
+        rc = RC ( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+    else
+    {
+        input->path = string_dup_measure ( path, NULL );
+        if ( spot_group != NULL )
+            input->spot_group = string_dup_measure ( spot_group, NULL );
+        if ( input->path == NULL || ( spot_group != NULL && input->spot_group == NULL ) )
+            rc = RC ( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        else
+            rc = VectorAppend ( &plan->inputs, NULL, input );
+        if ( rc != 0 )
+            plan_input_whack( input, NULL );
+    }
+    return rc;
+}
+
+
+static int CC section_vs_section_cmp( const void * item, const BSTNode * n )
+{
+    const pileup_section * a = item;
+    const pileup_section * b = ( const pileup_section * )n;
+    int res = cmp_pchar( a->name, b->name );
+    if ( res == 0 )
+    {
+        if ( a->start != b->start )
+            res = ( a->start < b->start ) ? -1 : 1;
+        else if ( a->end != b->end )
+            res = ( a->end < b->end ) ? -1 : 1;
+    }
+    return res;
+}
+
+
+static int CC section_node_cmp( const BSTNode * item, const BSTNode * n )
+{
+    return section_vs_section_cmp( item, n );
+}
+
+
+static rc_t plan_add_part( pileup_plan * plan, const char * name,
+                           uint32_t start, uint32_t end, uint32_t ref_idx )
+{
+    rc_t rc = 0;
+    pileup_section key;
+    pileup_section * section;
+
+    key.name = ( char * )name;
+    key.start = start;
+    key.end = end;
+    section = ( pileup_section * )BSTreeFind ( &plan->section_tree, &key, section_vs_section_cmp );
+    if ( section == NULL )
+    {
+        section = calloc( 1, sizeof *section );
+        if ( section == NULL )
+            rc = RC ( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        else
+        {
+            section->name = string_dup_measure ( name, NULL );
+            section->start = start;
+            section->end = end;
+            if ( section->name == NULL )
+                rc = RC ( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+            else
+                rc = VectorAppend ( &plan->sections, NULL, section );
+            if ( rc != 0 )
+                plan_section_whack( section, NULL );
+            else
+                BSTreeInsert ( &plan->section_tree, &section->node, section_node_cmp );
+        }
+    }
+
+    if ( rc == 0 )
+    {
+        pileup_part * parts = realloc( section->parts, ( section->part_count + 1 ) * sizeof parts[ 0 ] );
+        if ( parts == NULL )
+            rc = RC ( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        else
+        {
+            parts[ section->part_count ].input = VectorLength( &plan->inputs ) - 1;
+            parts[ section->part_count ].ref_idx = ref_idx;
+            section->parts = parts;
+            section->part_count++;
+        }
+    }
+    return rc;
+}
+
+
+/* the on_section-callback used instead of prepare_section_cb() when building a plan */
+static rc_t CC plan_section_cb( prepare_ctx * ctx, const struct reference_range * range )
+{
+    uint32_t start, end;
+    rc_t rc = get_section_bounds( ctx, range, &start, &end );
+    if ( rc == 0 )
+    {
+        const char * name;
+        uint32_t ref_idx;
+
+        rc = ReferenceObj_SeqId( ctx->refobj, &name );
+        if ( rc != 0 )
+        {
+            LOGERR( klogInt, rc, "ReferenceObj_SeqId() failed" );
+        }
+        else
+        {
+            rc = ReferenceObj_Idx( ctx->refobj, &ref_idx );
+            if ( rc != 0 )
+            {
+                LOGERR( klogInt, rc, "ReferenceObj_Idx() failed" );
+            }
+            else
+                rc = plan_add_part( ctx->data, name, start, end, ref_idx );
+        }
+    }
+    return rc;
+}
+
+
+static uint32_t section_chunks( const pileup_section * section )
+{
+    if ( section->end < section->start )
+        return 1;
+    return ( ( section->end - section->start ) / PILEUP_CHUNK_LEN ) + 1;
+}
+
+
+static rc_t make_plan_chunks( pileup_plan * plan )
+{
+    rc_t rc = 0;
+    uint32_t i, n = VectorLength( &plan->sections );
+    uint32_t count = 0;
+
+    for ( i = 0; i < n; ++i )
+        count += section_chunks( VectorGet ( &plan->sections, i ) );
+
+    if ( count > 0 )
+    {
+        plan->chunks = calloc( count, sizeof plan->chunks[ 0 ] );
+        if ( plan->chunks == NULL )
+            rc = RC ( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        else
+        {
+            pileup_chunk * chunk = plan->chunks;
+            for ( i = 0; i < n; ++i )
+            {
+                const pileup_section * section = VectorGet ( &plan->sections, i );
+                uint32_t j, chunks = section_chunks( section );
+                uint32_t start = section->start;
+                for ( j = 0; j < chunks; ++j, ++chunk )
+                {
+                    chunk->section = section;
+                    chunk->start = start;
+                    if ( j + 1 < chunks )
+                        chunk->end = start + PILEUP_CHUNK_LEN - 1;
+                    else
+                        chunk->end = section->end;
+                    start += PILEUP_CHUNK_LEN;
+                }
+            }
+            plan->chunk_count = count;
+        }
+    }
+    return rc;
+}
+
+
+typedef struct foreach_arg_ctx
+{
+    pileup_options *options;
+    const VDBManager *vdb_mgr;
+    VSchema *vdb_schema;
+    ReferenceIterator *ref_iter;
+    BSTree *ranges;
+    Vector *cursor_ids;
+    pileup_plan *plan;      /* if not NULL: record sections into the plan instead of loading ref_iter */
+} foreach_arg_ctx;
+
+
+/* called for each source-file/accession */
+static rc_t CC on_argument( const char * path, const char * spot_group, void * data )
+{
+    rc_t rc = 0;
+    foreach_arg_ctx * ctx = ( foreach_arg_ctx * )data;
 
     int path_type = ( VDBManagerPathType ( ctx->vdb_mgr, "%s", path ) & ~ kptAlias );
     if ( path_type != kptDatabase )
@@ -1312,8 +1841,16 @@ static rc_t CC on_argument( const char * path, const char * spot_group, void * d
                 prep.prim_cur = NULL;
                 prep.sec_cur = NULL;
                 prep.ev_cur = NULL;
-                
-                rc = prepare_ref_iter( &prep, ctx->vdb_mgr, ctx->vdb_schema, path, ctx->ranges ); /* cmdline_cmn.c */
+
+                if ( ctx->plan != NULL )
+                {
+                    prep.on_section = plan_section_cb;
+                    prep.data = ctx->plan;
+                    rc = plan_add_input( ctx->plan, path, spot_group );
+                }
+
+                if ( rc == 0 )
+                    rc = prepare_ref_iter( &prep, ctx->vdb_mgr, ctx->vdb_schema, path, ctx->ranges ); /* cmdline_cmn.c */
                 if ( rc == 0 && prep.db == NULL )
                 {
                     rc = RC ( rcApp, rcNoTarg, rcOpening, rcSelf, rcInvalid );
@@ -1337,15 +1874,680 @@ static void CC cur_id_vector_entry_whack( void *item, void *data )
 }
 
 
+static rc_t walk_pileup( ReferenceIterator *ref_iter, pileup_options *options )
+{
+    rc_t rc;
+    switch( options->function )
+    {
+        case sra_pileup_stat        : rc = walk_stat( ref_iter, options ); break;
+        case sra_pileup_counters    : rc = walk_counters( ref_iter, options ); break;
+        case sra_pileup_debug       : rc = walk_debug( ref_iter, options ); break;
+        case sra_pileup_mismatch    : rc = walk_mismatches( ref_iter, options ); break;
+        case sra_pileup_index       : rc = walk_index( ref_iter, options ); break;
+        case sra_pileup_varcount    : rc = walk_varcount( ref_iter, options ); break;
+        default :  rc = walk_ref_iter( ref_iter, options ); break;
+    }
+    return rc;
+}
+
+
+/* =========================================================================================== */
+/* parallel pileup, part 2: the workers
+
+   Each worker takes the next chunk, piles it up on a ReferenceIterator of its own
+   into the output-buffer of the chunk. The main-thread prints the buffers in chunk-order,
+   workers do not run more than PILEUP_CHUNKS_AHEAD chunks per thread ahead of it. */
+
+#define PILEUP_CHUNKS_AHEAD 2
+#define PILEUP_CHUNK_OUT ( 64 * 1024 )
+
+typedef struct pileup_pool
+{
+    pileup_plan * plan;
+    pileup_options * options;
+    pileup_callback_data * cb_data;
+    const VDBManager * vdb_mgr;
+    VSchema * vdb_schema;
+    BSTree * regions;           /* each worker makes its own skiplist from it */
+    KLock * lock;
+    KCondition * cond;
+    uint32_t next;              /* next chunk to be taken by a worker */
+    uint32_t printed;           /* number of chunks printed by the main-thread */
+    uint32_t ahead;             /* how many chunks can be taken beyond the printed ones */
+    bool quit;
+} pileup_pool;
+
+
+typedef struct pileup_worker
+{
+    pileup_pool * pool;
+    KThread * thread;
+    pileup_options options;     /* copy of the tool-options with own skiplist and output */
+    pileup_callback_data cb_data;   /* copy with own quality-pool */
+    prepare_ctx * inputs;       /* one per plan-input, database opened on first use */
+    Vector cursor_ids;
+    int32_t * depth;            /* difference-array of the function depth */
+    uint32_t depth_len;
+} pileup_worker;
+
+
+/* the functions stat and debug carry state from one window/reference to the next */
+static bool use_parallel_pileup( const pileup_options * options )
+{
+    if ( options->cmn.no_mt || options->threads < 2 )
+        return false;
+    switch( options->function )
+    {
+        case sra_pileup_samtools    :
+        case sra_pileup_counters    :
+        case sra_pileup_mismatch    :
+        case sra_pileup_index       :
+        case sra_pileup_varcount    :
+        case sra_pileup_depth       : return true;
+    }
+    return false;
+}
+
+
+static void pileup_worker_whack( pileup_worker * w )
+{
+    if ( w->inputs != NULL )
+    {
+        uint32_t i, n = VectorLength( &w->pool->plan->inputs );
+        for ( i = 0; i < n; ++i )
+        {
+            prepare_ctx * ctx = &w->inputs[ i ];
+            if ( ctx->prim_cur != NULL ) VCursorRelease( ctx->prim_cur );
+            if ( ctx->sec_cur != NULL ) VCursorRelease( ctx->sec_cur );
+            if ( ctx->ev_cur != NULL ) VCursorRelease( ctx->ev_cur );
+            close_prepare_ctx( ctx ); /* cmdline_cmn.c */
+        }
+        free( w->inputs );
+        w->inputs = NULL;
+    }
+    VectorWhack ( &w->cursor_ids, cur_id_vector_entry_whack, NULL );
+    qual_pool_whack( &w->cb_data.quals );
+    if ( w->depth != NULL )
+    {
+        free( w->depth );
+        w->depth = NULL;
+    }
+    if ( w->options.skiplist != NULL )
+        skiplist_release( w->options.skiplist );
+}
+
+
+static rc_t pileup_worker_init( pileup_worker * w, pileup_pool * pool )
+{
+    rc_t rc = 0;
+    uint32_t n = VectorLength( &pool->plan->inputs );
+
+    w->pool = pool;
+    w->thread = NULL;
+    w->options = *pool->options;
+    w->options.skiplist = skiplist_make( pool->regions );
+    w->options.out = NULL;
+    w->options.perf_log = NULL;    /* only the printing main-thread counts lines */
+    w->cb_data = *pool->cb_data;
+    qual_pool_init( &w->cb_data.quals );
+    w->depth = NULL;
+    w->depth_len = 0;
+    VectorInit ( &w->cursor_ids, 0, 20 );
+    w->inputs = calloc( n, sizeof w->inputs[ 0 ] );
+    if ( w->inputs == NULL )
+        rc = RC ( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+    else
+    {
+        align_tab_select tab_select = pool->options->cmn.tab_select;
+        uint32_t i;
+        for ( i = 0; i < n; ++i )
+        {
+            const pileup_input * input = VectorGet ( &pool->plan->inputs, i );
+            prepare_ctx * ctx = &w->inputs[ i ];
+
+            ctx->omit_qualities = pool->options->omit_qualities;
+            ctx->read_tlen = pool->options->read_tlen;
+            ctx->use_primary_alignments = ( ( tab_select & primary_ats ) == primary_ats );
+            ctx->use_secondary_alignments = ( ( tab_select & secondary_ats ) == secondary_ats );
+            ctx->use_evidence_alignments = ( ( tab_select & evidence_ats ) == evidence_ats );
+            ctx->spot_group = input->spot_group;
+            ctx->path = input->path;
+            ctx->data = &w->cursor_ids;
+        }
+    }
+    return rc;
+}
+
+
+static rc_t pileup_chunk_prepare( pileup_worker * w, ReferenceIterator *ref_iter, const pileup_chunk * chunk )
+{
+    rc_t rc = 0;
+    const pileup_section * section = chunk->section;
+    uint32_t i;
+
+    for ( i = 0; i < section->part_count && rc == 0; ++i )
+    {
+        const pileup_part * part = &section->parts[ i ];
+        prepare_ctx * ctx = &w->inputs[ part->input ];
+
+        if ( ctx->db == NULL )
+            rc = open_prepare_ctx( ctx, w->pool->vdb_mgr, w->pool->vdb_schema, ctx->path ); /* cmdline_cmn.c */
+        if ( rc == 0 )
+        {
+            rc = ReferenceList_Get( ctx->reflist, &ctx->refobj, part->ref_idx );
+            if ( rc != 0 )
+            {
+                LOGERR( klogInt, rc, "ReferenceList_Get() failed" );
+            }
+            else
+            {
+                ctx->ref_iter = ref_iter;
+                rc = prepare_section( ctx, chunk->start, chunk->end );
+                ReferenceObj_Release( ctx->refobj );
+                ctx->refobj = NULL;
+                ctx->ref_iter = NULL;
+            }
+        }
+    }
+    return rc;
+}
+
+
+/* =========================================================================================== */
+/* depth only
+
+   The function depth needs nothing but the number of alignments covering each position.
+   It does not load a ReferenceIterator: the placements of each part of a chunk are read
+   with a bare PlacementIterator ( REF_POS, REF_LEN and the filter-columns, no tooldata ),
+   every placement adds +1 at its start and -1 behind its end to a difference-array of the
+   chunk, the running sum over it is the depth. Like in the other functions, positions inside
+   a deletion or a reference-skip are covered by the alignment.
+   counters, stat and samtools with --noqual stay on the ReferenceIterator: they print the
+   bases per position ( counters and stat also the indels, strands and template-lengths ),
+   which needs the read and cigar of every alignment, not only its extent. */
+
+static rc_t CC populate_depth_filter( void *obj, const PlacementRecord *placement,
+        struct VCursor const *curs, INSDC_coord_zero ref_window_start, INSDC_coord_len ref_window_len,
+        void *data, void * placement_ctx )
+{
+    pileup_col_ids * col_ids = placement_ctx;
+    const uint8_t * read_filter;
+    uint32_t read_filter_len;
+    rc_t rc = read_base_and_len( curs, col_ids->idx_read_filter, placement->id,
+                                 (const void **)&read_filter, &read_filter_len );
+    if ( rc == 0 && read_filter_len > 0 )
+    {
+        if ( ( *read_filter == SRA_READ_FILTER_REJECT )||
+             ( *read_filter == SRA_READ_FILTER_CRITERIA ) )
+        {
+            rc = RC( rcAlign, rcType, rcAccessing, rcId, rcIgnored );
+        }
+    }
+    return rc;
+}
+
+
+static rc_t depth_add_placements( pileup_worker * w, prepare_ctx * ctx, align_id_src ids,
+                                  const pileup_chunk * chunk, uint32_t len )
+{
+    rc_t rc = 0;
+    const VCursor ** cursor;
+    pileup_col_ids ** cursor_ids;
+    rc_t ( * prepare_cursor )( const VDatabase *, const VCursor **, bool, bool, pileup_col_ids * );
+
+    switch( ids )
+    {
+        case primary_align_ids   : cursor = &ctx->prim_cur;
+                                   cursor_ids = &ctx->prim_cur_ids;
+                                   prepare_cursor = prepare_prim_cursor;
+                                   break;
+
+        case secondary_align_ids : cursor = &ctx->sec_cur;
+                                   cursor_ids = &ctx->sec_cur_ids;
+                                   prepare_cursor = prepare_sec_cursor;
+                                   break;
+
+        default                  : cursor = &ctx->ev_cur;
+                                   cursor_ids = &ctx->ev_cur_ids;
+                                   prepare_cursor = prepare_evidence_cursor;
+                                   break;
+    }
+
+    /* the cursor carries no quality/tlen, the PlacementIterator adds what it needs */
+    if ( *cursor == NULL )
+    {
+        rc = make_cursor_ids( ctx->data, cursor_ids );
+        if ( rc != 0 )
+        {
+            LOGERR( klogInt, rc, "cannot create cursor-ids for alignment cursor" );
+        }
+        else
+            rc = prepare_cursor( ctx->db, cursor, true, false, *cursor_ids );
+    }
+
+    if ( rc == 0 )
+    {
+        PlacementRecordExtendFuncs ext_1;
+        PlacementIterator * pl_iter;
+        INSDC_coord_zero first = chunk->start - 1;
+
+        /* the only tooldata: dropping the duplicates */
+        memset( &ext_1, 0, sizeof ext_1 );
+        ext_1.populate = populate_depth_filter;
+        ext_1.fixed_size = sizeof( bool );
+
+        rc = ReferenceObj_MakePlacementIterator( ctx->refobj, &pl_iter, first, len,
+                    w->options.minmapq, NULL, *cursor, ids, NULL,
+                    w->options.process_dups ? NULL : &ext_1,
+                    ctx->spot_group, *cursor_ids );
+        if ( rc != 0 )
+        {
+            if ( GetRCState( rc ) == rcDone )
+                rc = 0;     /* no placements in this chunk */
+            else
+            {
+                LOGERR( klogInt, rc, "ReferenceObj_MakePlacementIterator() failed" );
+            }
+        }
+        else
+        {
+            int32_t * diff = w->depth;
+            INSDC_coord_zero pos;
+
+            for ( ; ; )
+            {
+                rc = PlacementIteratorNextAvailPos( pl_iter, &pos, NULL );
+                if ( rc != 0 )
+                    break;
+                do
+                {
+                    const PlacementRecord * rec;
+                    rc = PlacementIteratorNextRecordAt( pl_iter, pos, &rec );
+                    if ( rc == 0 )
+                    {
+                        /* the iterator returns placements sticking into the chunk from the left too */
+                        int64_t start = ( int64_t )rec->pos - first;
+                        int64_t end = start + rec->len;
+                        if ( start < 0 ) start = 0;
+                        if ( end > len ) end = len;
+                        if ( start < end )
+                        {
+                            diff[ start ]++;
+                            diff[ end ]--;
+                        }
+                        PlacementRecordWhack( rec );
+                    }
+                } while ( rc == 0 );
+                if ( GetRCState( rc ) != rcDone )
+                    break;
+            }
+            if ( GetRCState( rc ) == rcDone )
+                rc = 0;
+            else
+            {
+                LOGERR( klogInt, rc, "PlacementIteratorNextRecordAt() failed" );
+            }
+            PlacementIteratorRelease( pl_iter );
+        }
+    }
+    return rc;
+}
+
+
+static rc_t depth_print( pileup_worker * w, const pileup_chunk * chunk, const char * refname, uint32_t len )
+{
+    struct skiplist * skiplist = w->options.skiplist;
+    size_t refname_len = string_size( refname );
+    const int32_t * diff = w->depth;
+    int32_t depth = 0;
+    uint32_t i;
+    out_buf out;
+    rc_t rc = init_out_buf( &out, PILEUP_OUT_BUF_SIZE, chunk->out ); /* out_buf.c */
+
+    if ( skiplist != NULL )
+        skiplist_enter_ref( skiplist, refname );
+    for ( i = 0; i < len && rc == 0; ++i )
+    {
+        depth += diff[ i ];
+        if ( depth > 0 )
+        {
+            uint32_t pos = chunk->start + i;
+            if ( !skiplist_is_skip_position( skiplist, pos ) )
+            {
+                /* name, tab, pos, tab, depth, newline */
+                rc = reserve_out_buf( &out, refname_len + 23 );
+                if ( rc == 0 )
+                {
+                    out_buf_mem( &out, refname, refname_len );
+                    out_buf_char( &out, '\t' );
+                    out_buf_u32( &out, pos );
+                    out_buf_char( &out, '\t' );
+                    out_buf_u32( &out, ( uint32_t )depth );
+                    out_buf_char( &out, '\n' );
+                }
+            }
+        }
+    }
+    if ( rc == 0 )
+        rc = flush_out_buf( &out );
+    release_out_buf( &out );
+    return rc;
+}
+
+
+static rc_t depth_chunk_run( pileup_worker * w, pileup_chunk * chunk )
+{
+    const pileup_section * section = chunk->section;
+    const char * refname = NULL;
+    uint32_t i, len = 0;
+    rc_t rc = allocated_dyn_string ( &chunk->out, PILEUP_CHUNK_OUT );
+
+    if ( rc == 0 && chunk->end >= chunk->start )
+    {
+        len = chunk->end - chunk->start + 1;
+        if ( w->depth_len < len + 1 )
+        {
+            int32_t * depth = realloc( w->depth, ( len + 1 ) * sizeof depth[ 0 ] );
+            if ( depth == NULL )
+                rc = RC ( rcApp, rcNoTarg, rcAllocating, rcMemory, rcExhausted );
+            else
+            {
+                w->depth = depth;
+                w->depth_len = len + 1;
+            }
+        }
+        if ( rc == 0 )
+            memset( w->depth, 0, ( len + 1 ) * sizeof w->depth[ 0 ] );
+    }
+
+    for ( i = 0; i < section->part_count && rc == 0 && len > 0; ++i )
+    {
+        const pileup_part * part = &section->parts[ i ];
+        prepare_ctx * ctx = &w->inputs[ part->input ];
+
+        if ( ctx->db == NULL )
+            rc = open_prepare_ctx( ctx, w->pool->vdb_mgr, w->pool->vdb_schema, ctx->path ); /* cmdline_cmn.c */
+        if ( rc == 0 )
+        {
+            rc = ReferenceList_Get( ctx->reflist, &ctx->refobj, part->ref_idx );
+            if ( rc != 0 )
+            {
+                LOGERR( klogInt, rc, "ReferenceList_Get() failed" );
+            }
+            else
+            {
+                /* a table that is not selected counts as a missing one */
+                rc_t const not_used = RC( rcApp, rcNoTarg, rcOpening, rcTable, rcNotFound );
+                rc_t rc1 = not_used, rc2 = not_used, rc3 = not_used;
+
+                /* the reference-list keeps the reference-object and its name alive */
+                if ( refname == NULL )
+                {
+                    if ( w->options.use_seq_name )
+                        rc = ReferenceObj_Name( ctx->refobj, &refname );
+                    else
+                        rc = ReferenceObj_SeqId( ctx->refobj, &refname );
+                }
+
+                if ( rc == 0 )
+                {
+                    /* a selected table may be missing, as long as one of them is there,
+                       but any other failure leaves the depth of the chunk incomplete */
+                    if ( ctx->use_primary_alignments )
+                        rc1 = depth_add_placements( w, ctx, primary_align_ids, chunk, len );
+                    if ( ctx->use_secondary_alignments )
+                        rc2 = depth_add_placements( w, ctx, secondary_align_ids, chunk, len );
+                    if ( ctx->use_evidence_alignments )
+                        rc3 = depth_add_placements( w, ctx, evidence_align_ids, chunk, len );
+                    if ( rc1 != 0 && GetRCState( rc1 ) != rcNotFound )
+                        rc = rc1;
+                    else if ( rc2 != 0 && GetRCState( rc2 ) != rcNotFound )
+                        rc = rc2;
+                    else if ( rc3 != 0 && GetRCState( rc3 ) != rcNotFound )
+                        rc = rc3;
+                    else if ( rc1 != 0 && rc2 != 0 && rc3 != 0 )
+                        rc = rc1;
+                }
+                ReferenceObj_Release( ctx->refobj );
+                ctx->refobj = NULL;
+            }
+        }
+    }
+
+    if ( rc == 0 && refname != NULL )
+        rc = depth_print( w, chunk, refname, len );
+    return rc;
+}
+
+
+static rc_t pileup_chunk_run( pileup_worker * w, pileup_chunk * chunk )
+{
+    ReferenceIterator *ref_iter;
+    PlacementRecordExtendFuncs cb_block;
+    rc_t rc;
+
+    if ( w->options.function == sra_pileup_depth )
+        return depth_chunk_run( w, chunk );
+
+    make_tooldata_funcs( &cb_block, &w->cb_data );
+    rc = AlignMgrMakeReferenceIterator ( w->cb_data.almgr, &ref_iter, &cb_block, w->options.minmapq );
+    if ( rc != 0 )
+    {
+        LOGERR( klogInt, rc, "AlignMgrMakeReferenceIterator() failed" );
+    }
+    else
+    {
+        rc = pileup_chunk_prepare( w, ref_iter, chunk );
+        if ( rc == 0 )
+            rc = allocated_dyn_string ( &chunk->out, PILEUP_CHUNK_OUT );
+        if ( rc == 0 )
+        {
+            w->options.out = chunk->out;
+            rc = walk_pileup( ref_iter, &w->options );
+            w->options.out = NULL;
+        }
+        ReferenceIteratorRelease( ref_iter );
+    }
+    return rc;
+}
+
+
+static rc_t CC pileup_worker_thread( const KThread *self, void *data )
+{
+    pileup_worker * w = data;
+    pileup_pool * pool = w->pool;
+    rc_t rc = 0;
+
+    while ( rc == 0 )
+    {
+        pileup_chunk * chunk = NULL;
+
+        KLockAcquire( pool->lock );
+        while ( !pool->quit && pool->next < pool->plan->chunk_count &&
+                pool->next >= pool->printed + pool->ahead )
+        {
+            KConditionWait( pool->cond, pool->lock );
+        }
+        if ( !pool->quit && pool->next < pool->plan->chunk_count )
+            chunk = &pool->plan->chunks[ pool->next++ ];
+        KLockUnlock( pool->lock );
+
+        if ( chunk == NULL )
+            break;
+
+        rc = pileup_chunk_run( w, chunk );
+
+        KLockAcquire( pool->lock );
+        chunk->rc = rc;
+        chunk->done = true;
+        KConditionBroadcast( pool->cond );
+        KLockUnlock( pool->lock );
+    }
+    return rc;
+}
+
+
+static rc_t pileup_parallel( pileup_pool * pool )
+{
+    rc_t rc = 0;
+    pileup_plan * plan = pool->plan;
+    struct perf_log * pl = pool->options->perf_log;
+    const pileup_section * section = NULL;
+    uint32_t i, started = 0, threads = pool->options->threads;
+    pileup_worker * workers;
+    /* the function depth uses the plan without threads too: the main-thread runs the chunks */
+    bool serial = !use_parallel_pileup( pool->options );
+
+    if ( plan->chunk_count == 0 )
+        return 0;
+    if ( serial || threads > plan->chunk_count )
+        threads = serial ? 1 : plan->chunk_count;
+
+    pool->next = 0;
+    pool->printed = 0;
+    pool->ahead = threads * PILEUP_CHUNKS_AHEAD;
+    pool->quit = false;
+    pool->lock = NULL;
+    pool->cond = NULL;
+
+    workers = calloc( threads, sizeof workers[ 0 ] );
+    if ( workers == NULL )
+        rc = RC ( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+    if ( rc == 0 )
+    {
+        rc = KLockMake ( &pool->lock );
+        if ( rc != 0 )
+        {
+            LOGERR( klogInt, rc, "KLockMake() failed" );
+        }
+    }
+    if ( rc == 0 )
+    {
+        rc = KConditionMake ( &pool->cond );
+        if ( rc != 0 )
+        {
+            LOGERR( klogInt, rc, "KConditionMake() failed" );
+        }
+    }
+
+    while ( rc == 0 && started < threads )
+    {
+        pileup_worker * w = &workers[ started ];
+        rc = pileup_worker_init( w, pool );
+        if ( rc == 0 && !serial )
+        {
+            rc = KThreadMake ( &w->thread, pileup_worker_thread, w );
+            if ( rc != 0 )
+            {
+                LOGERR( klogInt, rc, "KThreadMake() failed" );
+            }
+        }
+        if ( rc == 0 )
+            started++;
+        else
+            pileup_worker_whack( w );
+    }
+
+    /* print the chunks in order as they are done */
+    for ( i = 0; i < plan->chunk_count && rc == 0; ++i )
+    {
+        pileup_chunk * chunk = &plan->chunks[ i ];
+
+        if ( serial )
+        {
+            chunk->rc = pileup_chunk_run( &workers[ 0 ], chunk );
+            chunk->done = true;
+        }
+
+        KLockAcquire( pool->lock );
+        while ( !chunk->done )
+            KConditionWait( pool->cond, pool->lock );
+        KLockUnlock( pool->lock );
+
+        rc = chunk->rc;
+        if ( rc == 0 )
+            rc = write_2_kout( dyn_string_char( chunk->out, 0 ), dyn_string_len( chunk->out ) ); /* out_buf.c */
+        if ( rc == 0 && pl != NULL )
+        {
+            /* the workers have no perf-log, count the lines of the chunk here */
+            const char * p = dyn_string_char( chunk->out, 0 );
+            size_t j, len = dyn_string_len( chunk->out );
+
+            if ( chunk->section != section )
+            {
+                if ( section != NULL )
+                    perf_log_end_sub_section( pl );
+                section = chunk->section;
+                perf_log_start_sub_section( pl, section->name );
+            }
+            for ( j = 0; j < len; ++j )
+            {
+                if ( p[ j ] == '\n' )
+                    perf_log_line( pl, chunk->end );
+            }
+        }
+        if ( chunk->out != NULL )
+        {
+            free_dyn_string( chunk->out );
+            chunk->out = NULL;
+        }
+        if ( rc == 0 )
+            rc = Quitting();
+
+        KLockAcquire( pool->lock );
+        pool->printed = i + 1;
+        KConditionBroadcast( pool->cond );
+        KLockUnlock( pool->lock );
+    }
+
+    if ( pl != NULL && section != NULL )
+        perf_log_end_sub_section( pl );
+
+    if ( pool->lock != NULL )
+    {
+        KLockAcquire( pool->lock );
+        pool->quit = true;
+        if ( pool->cond != NULL )
+            KConditionBroadcast( pool->cond );
+        KLockUnlock( pool->lock );
+    }
+
+    for ( i = 0; i < started; ++i )
+    {
+        if ( workers[ i ].thread != NULL )
+        {
+            rc_t status;
+            KThreadWait ( workers[ i ].thread, &status );
+            KThreadRelease ( workers[ i ].thread );
+        }
+        pileup_worker_whack( &workers[ i ] );
+    }
+
+    if ( pool->cond != NULL ) KConditionRelease( pool->cond );
+    if ( pool->lock != NULL ) KLockRelease( pool->lock );
+    if ( workers != NULL ) free( workers );
+
+    if ( GetRCState( rc ) == rcCanceled ) { rc = 0; }
+    return rc;
+}
+
+
 static rc_t pileup_main( Args * args, pileup_options *options )
 {
     foreach_arg_ctx arg_ctx;
     pileup_callback_data cb_data;
     KDirectory * dir = NULL;
     Vector cur_ids_vector;
+    pileup_plan plan;
+    rc_t rc;
+
+    if ( options->perf_log != NULL )
+        perf_log_start_section( options->perf_log, "pileup" );
+
+    qual_pool_init( &cb_data.quals );
 
     /* (1) make the align-manager ( necessary to make a ReferenceIterator... ) */
-    rc_t rc = AlignMgrMakeRead ( &cb_data.almgr );
+    rc = AlignMgrMakeRead ( &cb_data.almgr );
     if ( rc != 0 )
     {
         LOGERR( klogInt, rc, "AlignMgrMake() failed" );
@@ -1356,18 +2558,15 @@ static rc_t pileup_main( Args * args, pileup_options *options )
     arg_ctx.options = options;
     arg_ctx.vdb_schema = NULL;
     arg_ctx.cursor_ids = &cur_ids_vector;
+    arg_ctx.plan = NULL;
+    init_plan( &plan );
 
     /* (2) make the reference-iterator */
     if ( rc == 0 )
     {
         PlacementRecordExtendFuncs cb_block;
 
-        cb_block.data = &cb_data;
-        cb_block.destroy = NULL;
-        cb_block.populate = populate_tooldata;
-        cb_block.alloc_size = alloc_size;
-        cb_block.fixed_size = 0;
-
+        make_tooldata_funcs( &cb_block, &cb_data );
         rc = AlignMgrMakeReferenceIterator ( cb_data.almgr, &arg_ctx.ref_iter, &cb_block, options->minmapq );
         if ( rc != 0 )
         {
@@ -1457,6 +2656,10 @@ static rc_t pileup_main( Args * args, pileup_options *options )
             case sra_pileup_varcount   :  options->omit_qualities = true;
                                           options->read_tlen = false;
                                           break;
+
+            case sra_pileup_depth      :  options->omit_qualities = true;
+                                          options->read_tlen = false;
+                                          break;
         }
     }
 
@@ -1473,38 +2676,54 @@ static rc_t pileup_main( Args * args, pileup_options *options )
             options->skiplist = skiplist_make( &regions ); /* create skiplist for neighboring slices */
 
             arg_ctx.ranges = &regions;
+            if ( use_parallel_pileup( options ) || options->function == sra_pileup_depth )
+                arg_ctx.plan = &plan;
             rc = foreach_argument( args, dir, options->div_by_spotgrp, &empty, on_argument, &arg_ctx ); /* cmdline_cmn.c */
             if ( empty )
             {
                 Usage ( args );
             }
+
+            /* (6a) pile up chunks of the references on worker-threads */
+            if ( rc == 0 && arg_ctx.plan != NULL )
+            {
+                rc = make_plan_chunks( &plan );
+                if ( rc == 0 )
+                {
+                    pileup_pool pool;
+
+                    pool.plan = &plan;
+                    pool.options = options;
+                    pool.cb_data = &cb_data;
+                    pool.vdb_mgr = arg_ctx.vdb_mgr;
+                    pool.vdb_schema = arg_ctx.vdb_schema;
+                    pool.regions = &regions;
+                    rc = pileup_parallel( &pool );
+                }
+            }
             free_ref_regions( &regions );
         }
     }
 
-    /* (6) walk the "loaded" ref-iterator ===> perform the pileup */
-    if ( rc == 0 )
+    /* (6b) walk the "loaded" ref-iterator ===> perform the pileup */
+    if ( rc == 0 && arg_ctx.plan == NULL )
     {
         /* ============================================== */
-        switch( options->function )
-        {
-            case sra_pileup_stat        : rc = walk_stat( arg_ctx.ref_iter, options ); break;
-            case sra_pileup_counters    : rc = walk_counters( arg_ctx.ref_iter, options ); break;
-            case sra_pileup_debug       : rc = walk_debug( arg_ctx.ref_iter, options ); break;
-            case sra_pileup_mismatch    : rc = walk_mismatches( arg_ctx.ref_iter, options ); break;
-            case sra_pileup_index       : rc = walk_index( arg_ctx.ref_iter, options ); break;
-            case sra_pileup_varcount    : rc = walk_varcount( arg_ctx.ref_iter, options ); break;
-            default :  rc = walk_ref_iter( arg_ctx.ref_iter, options ); break;
-        }
+        rc = walk_pileup( arg_ctx.ref_iter, options );
         /* ============================================== */
     }
 
+    if ( options->perf_log != NULL )
+        perf_log_end_section( options->perf_log );
+
     if ( arg_ctx.vdb_mgr != NULL ) VDBManagerRelease( arg_ctx.vdb_mgr );
     if ( arg_ctx.vdb_schema != NULL ) VSchemaRelease( arg_ctx.vdb_schema );
     if ( dir != NULL ) KDirectoryRelease( dir );
     if ( arg_ctx.ref_iter != NULL ) ReferenceIteratorRelease( arg_ctx.ref_iter );
+    qual_pool_whack( &cb_data.quals );
     if ( cb_data.almgr != NULL ) AlignMgrRelease ( cb_data.almgr );
     VectorWhack ( &cur_ids_vector, cur_id_vector_entry_whack, NULL );
+    release_plan( &plan );
 
     return rc;
 }
@@ -1539,6 +2758,10 @@ rc_t CC KMain( int argc, char *argv [] )
                 if ( rc == 0 )
                 {
                     options.skiplist = NULL;
+                    options.out = NULL;
+                    options.perf_log = NULL;
+                    if ( options.cmn.timing_file != NULL )
+                        options.perf_log = make_perf_log( options.cmn.timing_file, "sra-pileup" ); /* perf_log.c */
                     if ( options.cmn.output_file != NULL )
                     {
                         rc = set_stdout_to( options.cmn.gzip_output,
@@ -1575,6 +2798,8 @@ rc_t CC KMain( int argc, char *argv [] )
 
                     if ( options.skiplist != NULL )
                         skiplist_release( options.skiplist );
+                    if ( options.perf_log != NULL )
+                        free_perf_log( options.perf_log );
                 }
             }
             ArgsWhack( args );
@@ -25,6 +25,7 @@
  */
 
 #include "idx-mapping.h"
+#include "radix-sort.h"
 #include "ctx.h"
 
 #include <klib/sort.h>
@@ -66,8 +67,11 @@ int CC IdxMappingCmpNew ( const void *a, const void *b, void *data )
 #define SWAP( a, b, off, size ) KSORT_TSWAP ( IdxMapping, a, b )
 
 
-void IdxMappingSortOld ( IdxMapping *self, const ctx_t *ctx, size_t count )
+static
+void IdxMappingKSortOld ( void *base, size_t count )
 {
+    IdxMapping *self = base;
+
 #define CMP( a, b ) \
     ( ( T ( a ) -> old_id < T ( b ) -> old_id ) ? -1 : ( T ( a ) -> old_id > T ( b ) -> old_id ) )
 
@@ -76,8 +80,11 @@ void IdxMappingSortOld ( IdxMapping *self, const ctx_t *ctx, size_t count )
 #undef CMP
 }
 
-void IdxMappingSortNew ( IdxMapping *self, const ctx_t *ctx, size_t count )
+static
+void IdxMappingKSortNew ( void *base, size_t count )
 {
+    IdxMapping *self = base;
+
 #define CMP( a, b ) \
     ( ( T ( a ) -> new_id < T ( b ) -> new_id ) ? -1 : ( T ( a ) -> new_id > T ( b ) -> new_id ) )
 
@@ -89,4 +96,18 @@ void IdxMappingSortNew ( IdxMapping *self, const ctx_t *ctx, size_t count )
 #undef T
 #undef SWAP
 
+
+/* the radix sort sees an IdxMapping as two words: old_id, new_id */
+void IdxMappingSortOld ( IdxMapping *self, const ctx_t *ctx, size_t count )
+{
+    static const RadixSortKey key = { RADIX_SORT_INT64_SIGN, 0, 0, -1 };
+    RadixSort16 ( self, ctx, count, & key, IdxMappingKSortOld );
+}
+
+void IdxMappingSortNew ( IdxMapping *self, const ctx_t *ctx, size_t count )
+{
+    static const RadixSortKey key = { RADIX_SORT_INT64_SIGN, 0, 1, -1 };
+    RadixSort16 ( self, ctx, count, & key, IdxMappingKSortNew );
+}
+
 #endif /* USE_OLD_KSORT */
@@ -35,6 +35,7 @@
 #include <kfs/directory.h>
 #include <kfs/file.h>
 #include <kfs/buffile.h>
+#include <kproc/thread.h>
 #include <klib/refcount.h>
 #include <klib/sort.h>
 #include <klib/rc.h>
@@ -58,12 +59,55 @@ struct MapFile
     uint64_t num_ids;
     uint64_t num_mapped_ids;
     int64_t max_new_id;
-    KFile *f_old, *f_new, *f_pos;
+    KFile *f_old, *f_new, *f_pos, *f_sel;
     size_t id_size;
+
+    /* old=>new pairs partitioned by windows of sel_window new ids,
+       in old-id order within each window. built on first selection,
+       dropped whenever old=>new is written again */
+    uint64_t *sel_count;
+    char *sel_buff;
+    uint64_t sel_windows;
+    size_t sel_window;
+    size_t sel_bsize;
+
+    /* needed to create f_sel on first partition, stored behind the struct */
+    const char *name;
+
     KRefcount refcount;
 };
 
 
+/* the smallest per-window write buffer that makes partitioning worthwhile */
+#define MIN_SEL_CHUNK ( 256 * 1024 )
+
+/* writing the pairs once and reading them back costs about
+   as much as 5 scans of old=>new, fewer windows just get scanned */
+#define MIN_SEL_WINDOWS 5
+
+
+/* DropSel
+ *  forget the partitioned pairs, selection goes back to scanning old=>new
+ */
+static
+void MapFileDropSel ( MapFile *self, const ctx_t *ctx )
+{
+    if ( self -> sel_count != NULL )
+    {
+        MemFree ( ctx, self -> sel_count, sizeof self -> sel_count [ 0 ] * self -> sel_windows );
+        self -> sel_count = NULL;
+    }
+    if ( self -> sel_buff != NULL )
+    {
+        MemFree ( ctx, self -> sel_buff, self -> sel_bsize );
+        self -> sel_buff = NULL;
+    }
+    self -> sel_windows = 0;
+    self -> sel_window = 0;
+    self -> sel_bsize = 0;
+}
+
+
 /* Whack
  */
 static
@@ -84,8 +128,13 @@ void MapFileWhack ( MapFile *self, const ctx_t *ctx )
             if ( rc != 0 )
                 ABORT ( rc, "KFileRelease failed on global poslen temp column" );
         }
-        
-        MemFree ( ctx, self, sizeof * self );
+
+        rc = KFileRelease ( self -> f_sel );
+        if ( rc != 0 )
+            ABORT ( rc, "KFileRelease failed on partitioned old=>new" );
+
+        MapFileDropSel ( self, ctx );
+        MemFree ( ctx, self, sizeof * self + strlen ( self -> name ) + 1 );
     }
 }
 
@@ -133,7 +182,8 @@ static
 MapFile *MapFileMakeInt ( const ctx_t *ctx, const char *name, bool random, bool for_poslen )
 {
     MapFile *mf;
-    TRY ( mf = MemAlloc ( ctx, sizeof * mf, true ) )
+    size_t name_size = strlen ( name ) + 1;
+    TRY ( mf = MemAlloc ( ctx, sizeof * mf + name_size, true ) )
     {
         /* create KDirectory */
         KDirectory *wd;
@@ -157,12 +207,17 @@ MapFile *MapFileMakeInt ( const ctx_t *ctx, const char *name, bool random, bool
 
                     if ( ! FAILED () )
                     {
+                        /* f_sel is only created if a partition is made */
+                        memmove ( mf + 1, name, name_size );
+                        mf -> name = ( const char* ) ( mf + 1 );
+
                         /* this is our guy */
                         KRefcountInit ( & mf -> refcount, 1, "MapFile", "make", name );
                         
                         return mf;
                     }
 
+                    KFileRelease ( mf -> f_pos );
                     KFileRelease ( mf -> f_new );
                 }
 
@@ -172,7 +227,7 @@ MapFile *MapFileMakeInt ( const ctx_t *ctx, const char *name, bool random, bool
             KDirectoryRelease ( wd );
         }
 
-        MemFree ( ctx, mf, sizeof * mf );
+        MemFree ( ctx, mf, sizeof * mf + name_size );
     }
 
     return NULL;
@@ -325,6 +380,11 @@ void MapFileSetOldToNew ( MapFile *self, const ctx_t *ctx, const IdxMapping *ids
     else
     {
         size_t i;
+
+        /* the partitioned pairs would be out of date */
+        if ( self -> sel_window != 0 )
+            MapFileDropSel ( self, ctx );
+
         for ( i = 0; i < count; ++ i )
         {
             size_t num_writ;
@@ -831,6 +891,389 @@ size_t MapFileReadNewToOld ( const MapFile *self, const ctx_t *ctx,
 }
 
 
+/* Read
+ *  a piece of a file read on a thread of its own,
+ *  or on the calling thread if it cannot get one
+ */
+typedef struct MapFileRead MapFileRead;
+struct MapFileRead
+{
+    const KFile *f;
+    KThread *thread;
+    char *buff;
+    uint64_t pos;
+    size_t to_read, num_read;
+    rc_t rc;
+};
+
+static
+rc_t CC MapFileReadRun ( const KThread *t, void *data )
+{
+    MapFileRead *self = data;
+    self -> rc = KFileReadAll ( self -> f, self -> pos, self -> buff, self -> to_read, & self -> num_read );
+    return 0;
+}
+
+static
+void MapFileReadStart ( MapFileRead *self, uint64_t pos, size_t to_read )
+{
+    self -> pos = pos;
+    self -> to_read = to_read;
+    self -> num_read = 0;
+    if ( KThreadMake ( & self -> thread, MapFileReadRun, self ) != 0 )
+    {
+        self -> thread = NULL;
+        MapFileReadRun ( NULL, self );
+    }
+}
+
+static
+void MapFileReadWait ( MapFileRead *self )
+{
+    if ( self -> thread != NULL )
+    {
+        rc_t status;
+        KThreadWait ( self -> thread, & status );
+        KThreadRelease ( self -> thread );
+        self -> thread = NULL;
+    }
+}
+
+
+/* Partition
+ *  one sequential pass over old=>new, distributing the pairs into
+ *  windows of "window" new ids. every window gets its own region in
+ *  f_sel, so that a selection becomes a single sequential read
+ *  instead of another scan of old=>new. the pass runs in old-id order,
+ *  so the pairs arrive sorted within their window.
+ *
+ *  half of map_file_bsize is used to read old=>new, double-buffered,
+ *  the other half is split into write buffers for the windows. if these would get
+ *  too small, no partition is made and selection keeps scanning.
+ *
+ *  f_sel is created here, on first use: it takes about as much temporary
+ *  space as old=>new itself once more. the partition is only a cache, if it
+ *  cannot be made ( out of space or memory ) selection keeps scanning as well.
+ */
+static
+void MapFileFlushSel ( MapFile *self, const ctx_t *ctx, uint64_t window_idx,
+    const char *buff, size_t bytes )
+{
+    FUNC_ENTRY ( ctx );
+
+    rc_t rc;
+    size_t num_writ;
+    size_t pair_size = self -> id_size * 2;
+    uint64_t pos = ( window_idx * self -> sel_window + self -> sel_count [ window_idx ] ) * pair_size;
+
+    rc = KFileWriteAll ( self -> f_sel, pos, buff, bytes, & num_writ );
+    if ( rc != 0 )
+        SYSTEM_ERROR ( rc, "failed to write partitioned old=>new map" );
+    else if ( num_writ != bytes )
+    {
+        rc = RC ( rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete );
+        SYSTEM_ERROR ( rc, "failed to write partitioned old=>new map" );
+    }
+    else
+    {
+        self -> sel_count [ window_idx ] += bytes / pair_size;
+    }
+}
+
+static
+void MapFilePartition ( MapFile *self, const ctx_t *ctx, size_t window )
+{
+    FUNC_ENTRY ( ctx );
+
+    size_t pair_size = self -> id_size * 2;
+    size_t bsize = ctx -> caps -> tool -> map_file_bsize;
+    uint64_t windows = ( self -> num_ids + window - 1 ) / window;
+    size_t rd_size = ( bsize / 2 ) / self -> id_size * self -> id_size;
+    size_t chunk = 0;
+
+    /* remember the attempt, successful or not */
+    self -> sel_window = window;
+
+    if ( windows < MIN_SEL_WINDOWS || rd_size == 0 )
+        return;
+
+    chunk = ( size_t ) ( ( bsize - rd_size ) / windows ) / pair_size * pair_size;
+    if ( chunk < MIN_SEL_CHUNK )
+        return;
+
+    if ( self -> f_sel == NULL )
+    {
+        KDirectory *wd;
+        rc_t rc = KDirectoryNativeDir ( & wd );
+        if ( rc != 0 )
+            SYSTEM_ERROR ( rc, "failed to create native directory" );
+        else
+        {
+            const Tool *tp = ctx -> caps -> tool;
+
+            /* written and read in large pieces of its own, needs no big buffer */
+            MapFileMakeFork ( & self -> f_sel, ctx, self -> name, wd, tp -> tmpdir, tp -> pid, 32 * 1024, "sel" );
+            KDirectoryRelease ( wd );
+        }
+    }
+
+    if ( ! FAILED () )
+    {
+        STATUS ( 3, "partitioning old=>new map into %,lu windows of %,zu ids", windows, window );
+        self -> sel_count = MemAlloc ( ctx, sizeof self -> sel_count [ 0 ] * windows, true );
+    }
+
+    if ( ! FAILED () )
+    {
+        size_t *fill;
+        self -> sel_windows = windows;
+
+        TRY ( fill = MemAlloc ( ctx, sizeof fill [ 0 ] * windows, true ) )
+        {
+            char *buckets;
+            TRY ( buckets = MemAlloc ( ctx, chunk * windows, false ) )
+            {
+                TRY ( self -> sel_buff = MemAlloc ( ctx, rd_size, false ) )
+                {
+                    rc_t rc;
+                    uint64_t k, pos, eof = self -> num_ids * self -> id_size;
+                    size_t num_read, half = ( rd_size / 2 ) / self -> id_size * self -> id_size;
+                    MapFileRead rd [ 2 ];
+                    uint32_t cur;
+
+                    self -> sel_bsize = rd_size;
+
+                    /* while one half is distributed, the next piece is read into the other */
+                    rd [ 0 ] . f = rd [ 1 ] . f = self -> f_old;
+                    rd [ 0 ] . buff = self -> sel_buff;
+                    rd [ 1 ] . buff = self -> sel_buff + half;
+                    rd [ 0 ] . thread = rd [ 1 ] . thread = NULL;
+                    MapFileReadStart ( & rd [ 0 ], 0, ( uint64_t ) half < eof ? half : ( size_t ) eof );
+
+                    for ( cur = 0, pos = 0; pos < eof && ! FAILED (); pos += num_read, cur ^= 1 )
+                    {
+                        size_t j;
+                        const char *piece = rd [ cur ] . buff;
+                        int64_t old_rel = pos / self -> id_size;
+
+                        MapFileReadWait ( & rd [ cur ] );
+                        rc = rd [ cur ] . rc;
+                        num_read = rd [ cur ] . num_read;
+                        if ( rc != 0 )
+                        {
+                            SYSTEM_ERROR ( rc, "failed to read old=>new map" );
+                            break;
+                        }
+                        if ( num_read < self -> id_size )
+                        {
+                            rc = RC ( rcExe, rcFile, rcReading, rcTransfer, rcIncomplete );
+                            SYSTEM_ERROR ( rc, "failed to read old=>new map - file incomplete" );
+                            break;
+                        }
+                        num_read -= num_read % self -> id_size;
+
+                        if ( pos + num_read < eof )
+                        {
+                            uint64_t next = pos + num_read;
+                            MapFileReadStart ( & rd [ cur ^ 1 ], next,
+                                next + half > eof ? ( size_t ) ( eof - next ) : half );
+                        }
+
+                        for ( j = 0; j < num_read; j += self -> id_size, ++ old_rel )
+                        {
+                            char *dst;
+                            int64_t unpacked = 0;
+                            memcpy ( & unpacked, & piece [ j ], self -> id_size );
+#if __BYTE_ORDER == __BIG_ENDIAN
+                            unpacked = bswap_64 ( unpacked );
+#endif
+                            /* NULL ids are never selected */
+                            if ( unpacked == 0 )
+                                continue;
+
+                            /* 0-based new id decides the window */
+                            k = ( uint64_t ) ( unpacked - 1 ) / window;
+
+                            /* a new id beyond the range has no window: give up on
+                               the partition, the scan copes with it */
+                            if ( k >= windows )
+                            {
+                                rc = RC ( rcExe, rcFile, rcReading, rcRange, rcExcessive );
+                                INTERNAL_ERROR ( rc, "new id %ld beyond the range of old=>new map", unpacked );
+                                break;
+                            }
+
+                            /* like the scan, never more than a window full */
+                            if ( self -> sel_count [ k ] + fill [ k ] / pair_size >= window )
+                                continue;
+
+                            /* the pair is stored with both 0-based ids packed like in old=>new */
+                            dst = & buckets [ k * chunk + fill [ k ] ];
+                            memcpy ( dst, & piece [ j ], self -> id_size );
+                            {
+                                int64_t packed = old_rel;
+#if __BYTE_ORDER == __BIG_ENDIAN
+                                packed = bswap_64 ( packed );
+#endif
+                                memcpy ( dst + self -> id_size, & packed, self -> id_size );
+                            }
+
+                            if ( ( fill [ k ] += pair_size ) == chunk )
+                            {
+                                ON_FAIL ( MapFileFlushSel ( self, ctx, k, & buckets [ k * chunk ], chunk ) )
+                                    break;
+                                fill [ k ] = 0;
+                            }
+                        }
+                    }
+
+                    /* a read may still be in flight after an error */
+                    MapFileReadWait ( & rd [ 0 ] );
+                    MapFileReadWait ( & rd [ 1 ] );
+
+                    for ( k = 0; k < windows && ! FAILED (); ++ k )
+                    {
+                        if ( fill [ k ] != 0 )
+                            MapFileFlushSel ( self, ctx, k, & buckets [ k * chunk ], fill [ k ] );
+                    }
+                }
+
+                MemFree ( ctx, buckets, chunk * windows );
+            }
+
+            MemFree ( ctx, fill, sizeof fill [ 0 ] * windows );
+        }
+    }
+
+    if ( FAILED () )
+    {
+        /* give back the space, and leave sel_window set
+           so that the partition is not attempted again */
+        MapFileDropSel ( self, ctx );
+        KFileRelease ( self -> f_sel );
+        self -> f_sel = NULL;
+        self -> sel_window = window;
+
+        WARN ( "failed to partition old=>new map '%s' - selecting by scan", self -> name );
+        CLEAR ();
+    }
+}
+
+
+/* UseSel
+ *  true if the selection of "window" new ids at start_id
+ *  can be read from the partitioned pairs
+ */
+static
+bool MapFileUseSel ( const MapFile *cself, const ctx_t *ctx, int64_t start_id, size_t window )
+{
+    FUNC_ENTRY ( ctx );
+
+    /* the partition is a cache, built behind a const reference */
+    MapFile *self = ( MapFile* ) cself;
+
+    if ( window == 0 || start_id < self -> first_id || ( uint64_t ) ( start_id - self -> first_id ) % window != 0 )
+        return false;
+
+    if ( self -> sel_window == 0 )
+    {
+        ON_FAIL ( MapFilePartition ( self, ctx, window ) )
+            return false;
+    }
+
+    return self -> sel_window == window && self -> sel_count != NULL &&
+        ( uint64_t ) ( start_id - self -> first_id ) / window < self -> sel_windows;
+}
+
+
+/* ReadSel
+ *  reads the pairs of one window, sequentially in pieces of sel_bsize
+ *  fills either "pairs" or "ids" + "opt_ord" like the two Select functions
+ */
+static
+size_t MapFileReadSel ( const MapFile *self, const ctx_t *ctx, int64_t start_id,
+    IdxMapping *pairs, int64_t *ids, uint32_t *opt_ord, size_t max_count )
+{
+    FUNC_ENTRY ( ctx );
+
+    size_t i = 0;
+    size_t pair_size = self -> id_size * 2;
+    uint64_t k = ( uint64_t ) ( start_id - self -> first_id ) / self -> sel_window;
+    uint64_t count = self -> sel_count [ k ];
+    uint64_t base = k * self -> sel_window * pair_size;
+    size_t per_read = self -> sel_bsize / pair_size;
+
+    if ( count > max_count )
+        count = max_count;
+
+    while ( i < count )
+    {
+        rc_t rc;
+        size_t j, off, num_read, n = per_read;
+        if ( n > count - i )
+            n = ( size_t ) ( count - i );
+
+        rc = KFileReadAll ( self -> f_sel, base + i * pair_size, self -> sel_buff, n * pair_size, & num_read );
+        if ( rc != 0 )
+        {
+            SYSTEM_ERROR ( rc, "failed to read partitioned old=>new map" );
+            break;
+        }
+        if ( ( num_read /= pair_size ) == 0 )
+        {
+            rc = RC ( rcExe, rcFile, rcReading, rcTransfer, rcIncomplete );
+            SYSTEM_ERROR ( rc, "failed to read partitioned old=>new map - file incomplete" );
+            break;
+        }
+
+        for ( off = j = 0; j < num_read; off += pair_size, ++ j, ++ i )
+        {
+            int64_t new_id = 0, old_id = 0;
+            memcpy ( & new_id, & self -> sel_buff [ off ], self -> id_size );
+            memcpy ( & old_id, & self -> sel_buff [ off + self -> id_size ], self -> id_size );
+#if __BYTE_ORDER == __BIG_ENDIAN
+            new_id = bswap_64 ( new_id );
+            old_id = bswap_64 ( old_id );
+#endif
+            /* new ids are stored 1-based like in old=>new, old ids 0-based */
+            new_id += self -> first_id - 1;
+            old_id += self -> first_id;
+
+            if ( pairs != NULL )
+            {
+                pairs [ i ] . old_id = old_id;
+                pairs [ i ] . new_id = new_id;
+            }
+            else
+            {
+                ids [ i ] = old_id;
+                assert ( i <= 0xFFFFFFFF );
+                if ( opt_ord != NULL )
+                    opt_ord [ new_id - start_id ] = ( uint32_t ) i;
+            }
+        }
+    }
+
+    return i;
+}
+
+
+/* ScanSize
+ *  selections that cannot use the partitioned pairs scan old=>new
+ *  in pieces of half map_file_bsize, but not more than the whole file
+ */
+static
+size_t MapFileScanSize ( const MapFile *self, const ctx_t *ctx )
+{
+    uint64_t eof = self -> num_ids * self -> id_size;
+    size_t scan_size = ctx -> caps -> tool -> map_file_bsize / 2;
+    if ( ( uint64_t ) scan_size > eof )
+        scan_size = ( size_t ) eof;
+    scan_size -= scan_size % self -> id_size;
+    return scan_size < 32 * 1024 ? 32 * 1024 : scan_size;
+}
+
+
 /* SelectOldToNewPairs
  *  specify the range of new ids to select from
  *  read them in old=>new order
@@ -843,26 +1286,40 @@ size_t MapFileSelectOldToNewPairs ( const MapFile *self, const ctx_t *ctx,
     uint64_t eof;
     int64_t end_excl;
     size_t i, j, total;
+    size_t scan_size;
+    char *buff;
+    bool use_sel;
+
+    /* windows of max_count new ids can come from the partitioned pairs */
+    ON_FAIL ( use_sel = MapFileUseSel ( self, ctx, start_id, max_count ) )
+        return 0;
 
     /* limit read to number of ids in index */
     if ( start_id + max_count > self -> first_id + self -> num_ids )
         max_count = ( size_t ) ( self -> first_id + self -> num_ids - start_id );
 
+    if ( use_sel )
+        return MapFileReadSel ( self, ctx, start_id, ids, NULL, NULL, max_count );
+
     /* range is start_id to end_excl */
     end_excl = start_id + max_count;
 
     /* eof for f_old */
     eof = self -> num_ids * self -> id_size;
 
+    /* scan in large sequential pieces */
+    scan_size = MapFileScanSize ( self, ctx );
+    ON_FAIL ( buff = MemAlloc ( ctx, scan_size, false ) )
+        return 0;
+
     for ( total = i = 0; i < max_count; total += j )
     {
         rc_t rc;
         size_t off, num_read;
-        char buff [ 32 * 1024 ];
 
         /* read some data from file */
         uint64_t pos = total * self -> id_size;
-        size_t to_read = sizeof buff;
+        size_t to_read = scan_size;
 	if ( pos == eof )
 	    break;
         if ( pos + to_read > eof )
@@ -909,6 +1366,8 @@ size_t MapFileSelectOldToNewPairs ( const MapFile *self, const ctx_t *ctx,
         }
     }
 
+    MemFree ( ctx, buff, scan_size );
+
     return i;
 }
 
@@ -925,26 +1384,40 @@ size_t MapFileSelectOldToNewSingle ( const MapFile *self, const ctx_t *ctx,
     uint64_t eof;
     int64_t end_excl;
     size_t i, j, total;
+    size_t scan_size;
+    char *buff;
+    bool use_sel;
+
+    /* windows of max_count new ids can come from the partitioned pairs */
+    ON_FAIL ( use_sel = MapFileUseSel ( self, ctx, start_id, max_count ) )
+        return 0;
 
     /* limit read to number of ids in index */
     if ( start_id + max_count > self -> first_id + self -> num_ids )
         max_count = ( size_t ) ( self -> first_id + self -> num_ids - start_id );
 
+    if ( use_sel )
+        return MapFileReadSel ( self, ctx, start_id, NULL, ids, opt_ord, max_count );
+
     /* range is start_id to end_excl */
     end_excl = start_id + max_count;
 
     /* eof for f_old */
     eof = self -> num_ids * self -> id_size;
 
+    /* scan in large sequential pieces */
+    scan_size = MapFileScanSize ( self, ctx );
+    ON_FAIL ( buff = MemAlloc ( ctx, scan_size, false ) )
+        return 0;
+
     for ( total = i = 0; i < max_count; total += j )
     {
         rc_t rc;
         size_t off, num_read;
-        char buff [ 32 * 1024 ];
 
         /* read some data from file */
         uint64_t pos = total * self -> id_size;
-        size_t to_read = sizeof buff;
+        size_t to_read = scan_size;
 	if ( pos == eof )
             break;
         if ( pos + to_read > eof )
@@ -993,6 +1466,8 @@ size_t MapFileSelectOldToNewSingle ( const MapFile *self, const ctx_t *ctx,
         }
     }
 
+    MemFree ( ctx, buff, scan_size );
+
     return i;
 }
 
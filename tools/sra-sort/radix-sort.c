@@ -0,0 +1,360 @@
+/*===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+#include "radix-sort.h"
+#include "ctx.h"
+#include "caps.h"
+#include "mem.h"
+#include "except.h"
+#include "status.h"
+#include "sra-sort.h"
+
+#include <kproc/thread.h>
+#include <klib/time.h>
+#include <klib/rc.h>
+
+#include <string.h>
+
+FILE_ENTRY ( radix-sort );
+
+
+/* below this the comparison sort is just as fast */
+#define RADIX_SORT_MIN_COUNT ( 64 * 1024 )
+
+#define RADIX_SORT_MAX_THREADS 64
+
+
+/*--------------------------------------------------------------------------
+ * RadixSort
+ *  one LSD pass per varying byte of the key, each pass in three phases
+ *  that run on all slices in parallel:
+ *    count  - histogram of the current byte within the slice
+ *    ( serial ) - turn the histograms into per-slice bucket offsets
+ *    scatter - move the records of the slice into their buckets
+ *  slices are contiguous and their offsets ascending within each bucket,
+ *  which keeps every pass stable.
+ */
+typedef struct RadixRec RadixRec;
+struct RadixRec
+{
+    uint64_t w [ 2 ];
+};
+
+typedef struct RadixSort RadixSort;
+typedef struct RadixSlice RadixSlice;
+
+typedef void ( * RadixPhase ) ( RadixSlice *slice );
+
+struct RadixSlice
+{
+    RadixSort *sort;
+    KThread *thread;
+    size_t start, end;
+
+    /* key bits seen in this slice */
+    uint64_t or_bits [ 2 ], and_bits [ 2 ];
+
+    /* histogram, turned into bucket offsets */
+    size_t offset [ 256 ];
+};
+
+struct RadixSort
+{
+    RadixRec *src, *dst;
+    RadixPhase phase;
+
+    /* the byte being ranked by the current pass */
+    uint64_t sign;
+    uint32_t word;
+    uint32_t shift;
+
+    uint32_t num_slices;
+    RadixSlice slice [ RADIX_SORT_MAX_THREADS ];
+};
+
+
+static
+void RadixSliceBits ( RadixSlice *self )
+{
+    const RadixRec *src = self -> sort -> src;
+    uint64_t or0 = 0, or1 = 0;
+    uint64_t and0 = ~ ( uint64_t ) 0, and1 = ~ ( uint64_t ) 0;
+    size_t i;
+
+    for ( i = self -> start; i < self -> end; ++ i )
+    {
+        or0 |= src [ i ] . w [ 0 ];
+        and0 &= src [ i ] . w [ 0 ];
+        or1 |= src [ i ] . w [ 1 ];
+        and1 &= src [ i ] . w [ 1 ];
+    }
+
+    self -> or_bits [ 0 ] = or0;
+    self -> and_bits [ 0 ] = and0;
+    self -> or_bits [ 1 ] = or1;
+    self -> and_bits [ 1 ] = and1;
+}
+
+static
+void RadixSliceCount ( RadixSlice *self )
+{
+    const RadixSort *sort = self -> sort;
+    const RadixRec *src = sort -> src;
+    uint64_t sign = sort -> sign;
+    uint32_t word = sort -> word;
+    uint32_t shift = sort -> shift;
+    size_t i, *count = self -> offset;
+
+    memset ( count, 0, sizeof self -> offset );
+    for ( i = self -> start; i < self -> end; ++ i )
+        ++ count [ ( ( src [ i ] . w [ word ] ^ sign ) >> shift ) & 0xFF ];
+}
+
+static
+void RadixSliceScatter ( RadixSlice *self )
+{
+    const RadixSort *sort = self -> sort;
+    const RadixRec *src = sort -> src;
+    RadixRec *dst = sort -> dst;
+    uint64_t sign = sort -> sign;
+    uint32_t word = sort -> word;
+    uint32_t shift = sort -> shift;
+    size_t i, *offset = self -> offset;
+
+    for ( i = self -> start; i < self -> end; ++ i )
+        dst [ offset [ ( ( src [ i ] . w [ word ] ^ sign ) >> shift ) & 0xFF ] ++ ] = src [ i ];
+}
+
+static
+void RadixSliceCopy ( RadixSlice *self )
+{
+    const RadixSort *sort = self -> sort;
+    memmove ( & sort -> dst [ self -> start ], & sort -> src [ self -> start ],
+        ( self -> end - self -> start ) * sizeof sort -> src [ 0 ] );
+}
+
+static
+rc_t CC RadixSliceRun ( const KThread *t, void *data )
+{
+    RadixSlice *self = data;
+    ( * self -> sort -> phase ) ( self );
+    return 0;
+}
+
+static
+void RadixSortRunPhase ( RadixSort *self, RadixPhase phase )
+{
+    uint32_t i;
+
+    self -> phase = phase;
+
+    /* slice 0 runs on the calling thread,
+       a slice that cannot get a thread as well */
+    for ( i = 1; i < self -> num_slices; ++ i )
+    {
+        RadixSlice *slice = & self -> slice [ i ];
+        if ( KThreadMake ( & slice -> thread, RadixSliceRun, slice ) != 0 )
+        {
+            slice -> thread = NULL;
+            ( * phase ) ( slice );
+        }
+    }
+
+    ( * phase ) ( & self -> slice [ 0 ] );
+
+    for ( i = 1; i < self -> num_slices; ++ i )
+    {
+        RadixSlice *slice = & self -> slice [ i ];
+        if ( slice -> thread != NULL )
+        {
+            rc_t status;
+            KThreadWait ( slice -> thread, & status );
+            KThreadRelease ( slice -> thread );
+            slice -> thread = NULL;
+        }
+    }
+}
+
+static
+void RadixSortPass ( RadixSort *self, uint32_t word, uint64_t sign, uint32_t shift )
+{
+    uint32_t i, b;
+    size_t total;
+    RadixRec *tmp;
+
+    self -> word = word;
+    self -> sign = sign;
+    self -> shift = shift;
+
+    RadixSortRunPhase ( self, RadixSliceCount );
+
+    /* bucket b of slice i follows bucket b of all previous slices */
+    for ( total = 0, b = 0; b < 256; ++ b )
+    {
+        for ( i = 0; i < self -> num_slices; ++ i )
+        {
+            size_t count = self -> slice [ i ] . offset [ b ];
+            self -> slice [ i ] . offset [ b ] = total;
+            total += count;
+        }
+    }
+
+    RadixSortRunPhase ( self, RadixSliceScatter );
+
+    tmp = self -> src;
+    self -> src = self -> dst;
+    self -> dst = tmp;
+}
+
+/* runs the passes for one key word, least significant byte first */
+static
+uint32_t RadixSortWord ( RadixSort *self, uint32_t word, uint64_t sign )
+{
+    uint32_t i, passes = 0;
+    uint64_t or_bits = 0, and_bits = ~ ( uint64_t ) 0, varying;
+
+    for ( i = 0; i < self -> num_slices; ++ i )
+    {
+        or_bits |= self -> slice [ i ] . or_bits [ word ];
+        and_bits &= self -> slice [ i ] . and_bits [ word ];
+    }
+
+    /* a byte that is the same in every key does not change the order */
+    varying = or_bits & ~ and_bits;
+    for ( i = 0; i < 64; i += 8 )
+    {
+        if ( ( ( varying >> i ) & 0xFF ) != 0 )
+        {
+            RadixSortPass ( self, word, sign, i );
+            ++ passes;
+        }
+    }
+
+    return passes;
+}
+
+static
+uint32_t RadixSortThreads ( const ctx_t *ctx, size_t count )
+{
+    const Tool *tp = ctx -> caps -> tool;
+    uint32_t threads = tp -> sort_threads;
+
+    if ( threads > RADIX_SORT_MAX_THREADS )
+        threads = RADIX_SORT_MAX_THREADS;
+    /* give every thread a sizable slice */
+    if ( threads > count / ( RADIX_SORT_MIN_COUNT / 4 ) )
+        threads = ( uint32_t ) ( count / ( RADIX_SORT_MIN_COUNT / 4 ) );
+    if ( threads == 0 )
+        threads = 1;
+
+    return threads;
+}
+
+void RadixSort16 ( void *base, const ctx_t *ctx, size_t count,
+    const RadixSortKey *key, void ( * fallback ) ( void *base, size_t count ) )
+{
+    FUNC_ENTRY ( ctx );
+
+    size_t bytes, quota, in_use;
+    uint32_t threads, passes;
+    KTimeMs_t start = KTimeMsStamp ();
+
+    assert ( sizeof ( RadixRec ) == 16 );
+    assert ( key != NULL );
+    assert ( fallback != NULL );
+
+    threads = ctx -> caps -> tool -> sort_threads;
+    bytes = count * sizeof ( RadixRec );
+    in_use = MemInUse ( ctx, & quota );
+
+    if ( count < RADIX_SORT_MIN_COUNT || threads < 2 || ( quota != 0 && in_use + bytes > quota ) )
+    {
+        ( * fallback ) ( base, count );
+        STATUS ( 4, "ksort of %,zu entries took %,lu ms", count, KTimeMsStamp () - start );
+        return;
+    }
+
+    {
+        RadixSort *self;
+
+        TRY ( self = MemAlloc ( ctx, sizeof * self, false ) )
+        {
+            TRY ( self -> dst = MemAlloc ( ctx, bytes, false ) )
+            {
+                uint32_t i;
+                size_t slice_size;
+                RadixRec *scratch = self -> dst;
+
+                self -> src = base;
+                self -> num_slices = threads = RadixSortThreads ( ctx, count );
+
+                slice_size = ( count + threads - 1 ) / threads;
+                for ( i = 0; i < threads; ++ i )
+                {
+                    RadixSlice *slice = & self -> slice [ i ];
+                    slice -> sort = self;
+                    slice -> thread = NULL;
+                    slice -> start = i * slice_size;
+                    slice -> end = slice -> start + slice_size;
+                    if ( slice -> start > count )
+                        slice -> start = count;
+                    if ( slice -> end > count )
+                        slice -> end = count;
+                }
+
+                RadixSortRunPhase ( self, RadixSliceBits );
+
+                /* LSD: the secondary key is ranked first */
+                passes = 0;
+                if ( key -> sub_word >= 0 )
+                    passes += RadixSortWord ( self, ( uint32_t ) key -> sub_word, key -> sub_sign );
+                passes += RadixSortWord ( self, key -> word, key -> sign );
+
+                /* an odd number of passes leaves the result in the scratch buffer */
+                if ( self -> src != base )
+                {
+                    self -> dst = base;
+                    RadixSortRunPhase ( self, RadixSliceCopy );
+                }
+
+                STATUS ( 4, "radix sort of %,zu entries ( %u passes on %u threads ) took %,lu ms",
+                         count, passes, threads, KTimeMsStamp () - start );
+
+                MemFree ( ctx, scratch, bytes );
+            }
+
+            MemFree ( ctx, self, sizeof * self );
+        }
+    }
+
+    if ( FAILED () )
+    {
+        /* could not get the scratch buffer after all */
+        CLEAR ();
+        ( * fallback ) ( base, count );
+        STATUS ( 4, "ksort of %,zu entries took %,lu ms", count, KTimeMsStamp () - start );
+    }
+}
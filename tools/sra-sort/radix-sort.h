@@ -0,0 +1,71 @@
+/*===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+#ifndef _h_sra_sort_radix_sort_
+#define _h_sra_sort_radix_sort_
+
+#ifndef _h_sra_sort_defs_
+#include "sort-defs.h"
+#endif
+
+
+/*--------------------------------------------------------------------------
+ * RadixSortKey
+ *  describes the sort key of a 16-byte record made of two 64-bit words,
+ *  e.g. IdxMapping or IdPosLen
+ *
+ *  "word" - index ( 0 or 1 ) of the word holding the primary key
+ *  "sub_word" - index of the word holding the secondary key, or -1
+ *  "sign", "sub_sign" - xored into the key words before ranking:
+ *   0x8000000000000000 for int64_t keys, 0 for uint64_t keys
+ */
+typedef struct RadixSortKey RadixSortKey;
+struct RadixSortKey
+{
+    uint64_t sign, sub_sign;
+    uint32_t word;
+    int32_t sub_word;
+};
+
+#define RADIX_SORT_INT64_SIGN ( ( uint64_t ) 1 << 63 )
+
+
+/* Sort16
+ *  sorts "count" 16-byte records at "base" on "key"
+ *
+ *  uses a stable, parallel LSD radix sort with Tool.sort_threads threads and
+ *  a scratch buffer of the same size as the input. passes on bytes that are
+ *  identical in all keys are skipped, so small ids cost only a few passes.
+ *
+ *  "fallback" [ IN ] - comparison sort for the same key ( ksort ), used for
+ *   small inputs, when only a single thread is configured or when the
+ *   scratch buffer would exceed the memory quota
+ */
+void RadixSort16 ( void *base, const ctx_t *ctx, size_t count,
+    const RadixSortKey *key, void ( * fallback ) ( void *base, size_t count ) );
+
+
+#endif /* _h_sra_sort_radix_sort_ */
@@ -37,6 +37,7 @@ struct AlignIdColReader;
 #include "status.h"
 #include "mem.h"
 #include "idx-mapping.h"
+#include "radix-sort.h"
 #include "map-file.h"
 #include "sra-sort.h"
 
@@ -90,8 +91,10 @@ int CC cmp_int64_t ( const void *a, const void *b, void *data )
 #else
 
 static
-void ksort_IdPosLen_pos ( IdPosLen *pbase, size_t total_elems )
+void ksort_IdPosLen_pos ( void *base, size_t total_elems )
 {
+    IdPosLen *pbase = base;
+
 #define SWAP( a, b, off, size )                               \
     do                                                        \
     {                                                         \
@@ -114,6 +117,14 @@ void ksort_IdPosLen_pos ( IdPosLen *pbase, size_t total_elems )
 #undef CMP
 
 }
+
+/* sort on poslen, then id */
+static
+void sort_IdPosLen_pos ( IdPosLen *pbase, const ctx_t *ctx, size_t total_elems )
+{
+    static const RadixSortKey key = { 0, RADIX_SORT_INT64_SIGN, 1, 0 };
+    RadixSort16 ( pbase, ctx, total_elems, & key, ksort_IdPosLen_pos );
+}
 #endif
 
 
@@ -482,7 +493,7 @@ const void *AlignIdColReaderRead ( AlignIdColReader *self, const ctx_t *ctx,
 #if USE_OLD_KSORT
         ksort ( self -> u . id_poslen, self -> num_elems, sizeof self -> u . id_poslen [ 0 ], IdPosLenCmpPos, ( void* ) ctx );
 #else
-        ksort_IdPosLen_pos ( self -> u . id_poslen, self -> num_elems );
+        sort_IdPosLen_pos ( self -> u . id_poslen, ctx, self -> num_elems );
 #endif
 
         /* write poslen to temp column */
@@ -84,6 +84,7 @@ rc_t CC UsageSummary ( const char *prog_name )
 #define OPT_TEMP_DIR "tempdir"
 #define OPT_MMAP_DIR "mmapdir"
 #define OPT_UNSORTED_OLD_NEW "unsorted-old-new"
+#define OPT_SORT_THREADS "sort-threads"
 
 #define OPT_COLUMN_MD5 "column-md5"
 #define OPT_NO_COLUMN_CHECKSUM "no-column-checksum"
@@ -106,6 +107,8 @@ static const char *hlp_max_large_idx_ids [] = { "sets number of rows to process
 static const char *hlp_temp_dir [] = { "sets a specific directory to use for temporary files", NULL };
 static const char *hlp_mmap_dir [] = { "sets a specific directory to use for memory-mapped buffers", NULL };
 static const char *hlp_unsorted_old_new [] = { "write old=>new index in unsorted order", NULL };
+static const char *hlp_sort_threads [] = { "sets number of threads for sorting id maps",
+                                           "0 or 1 for single-threaded sort", NULL };
 
 static const char *hlp_column_md5 [] = { "generate md5sum compatible checksum files for each column [default]", NULL };
 static const char *hlp_no_column_checksum [] = { "disable generation of column checksums", NULL };
@@ -139,6 +142,7 @@ static OptDef options [] =
   , { OPT_TEMP_DIR, NULL, NULL, hlp_temp_dir, 1, true, false }
   , { OPT_MMAP_DIR, NULL, NULL, hlp_mmap_dir, 1, true, false }
   , { OPT_UNSORTED_OLD_NEW, NULL, NULL, hlp_unsorted_old_new, 1, false, false }
+  , { OPT_SORT_THREADS, NULL, NULL, hlp_sort_threads, 1, true, false }
 
   , { OPT_COLUMN_MD5, NULL, NULL, hlp_column_md5, 1, false, false }
   , { OPT_NO_COLUMN_CHECKSUM, NULL, NULL, hlp_no_column_checksum, 1, false, false }
@@ -163,6 +167,7 @@ static const char *option_params [] =
   , "path-to-tmp"
   , "path-to-mmaps"
   , NULL
+  , "count"
   , NULL
   , NULL
   , NULL
@@ -347,6 +352,9 @@ void initialize_params ( const ctx_t *ctx, Caps *caps, Tool *tp, Selection *sel,
     tp -> min_idx_ids =  64 * 1024 * 1024;
     tp -> max_missing_ids = tp -> max_idx_ids;
 
+    /* threads for radix-sorting id maps */
+    tp -> sort_threads = 4;
+
 #if 0
     /* refpos cache size */
     tp -> refpos_cache_capacity = 100 * 1024 * 1024;
@@ -440,6 +448,11 @@ tp->write_new_to_old=true;
     if ( count != 0 )
         tp -> max_large_idx_ids = ( size_t ) val;
 
+    ON_FAIL ( val = ArgsGetOptU64 ( args, ctx, OPT_SORT_THREADS, & count ) )
+        return;
+    if ( count != 0 )
+        tp -> sort_threads = ( uint32_t ) val;
+
     ON_FAIL ( found = ArgsGetOptBool ( args, ctx, OPT_IGNORE_FAILURE, & count ) )
         return;
     if ( count != 0 )
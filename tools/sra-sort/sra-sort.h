@@ -95,6 +95,10 @@ struct Tool
     /* the number of missing SEQUENCE ids to gather at a time */
     size_t max_missing_ids;
 
+    /* the number of threads used to sort id maps
+       0 or 1 selects the single-threaded ksort */
+    uint32_t sort_threads;
+
     /* pid of tool */
     int pid;
 